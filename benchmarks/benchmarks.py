@@ -32,6 +32,8 @@ except TypeError:
     stdpopsim_available = False
 
 import msprime
+from msprime import _msprime
+from msprime import ancestry
 
 
 class LargeSimulationBenchmark:
@@ -201,3 +203,74 @@ class DTWF(LargeSimulationBenchmark):
 
     def peakmem_many_replicates(self):
         self._run_many_replicates()
+
+
+class HugePages(LargeSimulationBenchmark):
+    # The Hudson.time_large_sample_size simulation with the segment, AVL
+    # node and node mapping heaps and the mass indexes in huge pages.
+    params = [False, True]
+    param_names = ["huge_pages"]
+
+    def _run_large_sample_size(self, huge_pages):
+        sim = ancestry._parse_sim_ancestry(
+            5 * 10 ** 5,
+            ploidy=2,
+            sequence_length=1e7,
+            population_size=10 ** 4,
+            recombination_rate=1e-8,
+            discrete_genome=False,
+            random_seed=42,
+            huge_pages=huge_pages,
+        )
+        sim.run()
+
+    def time_large_sample_size(self, huge_pages):
+        self._run_large_sample_size(huge_pages)
+
+    def peakmem_large_sample_size(self, huge_pages):
+        self._run_large_sample_size(huge_pages)
+
+
+class VariateBuffer(LargeSimulationBenchmark):
+    # Compares drawing each random variate from GSL as it is needed
+    # (variate_buffer_size=0) with drawing them in blocks.
+    params = [0, 256, 4096]
+    param_names = ["variate_buffer_size"]
+
+    def setup(self, variate_buffer_size):
+        self.ts = msprime.sim_ancestry(
+            1000,
+            sequence_length=1e6,
+            population_size=10 ** 4,
+            recombination_rate=1e-8,
+            random_seed=42,
+        )
+
+    def _run_hudson(self, variate_buffer_size):
+        sim = ancestry._parse_sim_ancestry(
+            1000,
+            sequence_length=1e7,
+            population_size=10 ** 4,
+            recombination_rate=1e-8,
+            random_seed=42,
+            variate_buffer_size=variate_buffer_size,
+        )
+        sim.run()
+
+    def time_hudson(self, variate_buffer_size):
+        self._run_hudson(variate_buffer_size)
+
+    def _run_mutations(self, variate_buffer_size):
+        tables = _msprime.LightweightTableCollection()
+        tables.fromdict(self.ts.dump_tables().asdict())
+        rate_map = msprime.RateMap.uniform(self.ts.sequence_length, 1e-5)
+        _msprime.sim_mutations(
+            tables,
+            _msprime.RandomGenerator(42),
+            rate_map.asdict(),
+            model=msprime.BinaryMutationModel(),
+            variate_buffer_size=variate_buffer_size,
+        )
+
+    def time_mutations(self, variate_buffer_size):
+        self._run_mutations(variate_buffer_size)
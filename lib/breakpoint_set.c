@@ -0,0 +1,241 @@
+/*
+** Copyright (C) 2024 University of Oxford
+**
+** This file is part of msprime.
+**
+** msprime is free software: you can redistribute it and/or modify
+** it under the terms of the GNU General Public License as published by
+** the Free Software Foundation, either version 3 of the License, or
+** (at your option) any later version.
+**
+** msprime is distributed in the hope that it will be useful,
+** but WITHOUT ANY WARRANTY; without even the implied warranty of
+** MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+** GNU General Public License for more details.
+**
+** You should have received a copy of the GNU General Public License
+** along with msprime.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <math.h>
+
+#include "util.h"
+#include "breakpoint_set.h"
+
+/* Mixes the bits of the specified position, using the finaliser from
+ * MurmurHash3 so that nearby positions are spread over the table. */
+static inline size_t
+breakpoint_set_hash(breakpoint_set_t *self, double x)
+{
+    uint64_t h;
+
+    /* -0 and 0 compare equal, so they must hash to the same slot */
+    if (x == 0) {
+        x = 0;
+    }
+    memcpy(&h, &x, sizeof(h));
+    h ^= h >> 33;
+    h *= UINT64_C(0xff51afd7ed558ccd);
+    h ^= h >> 33;
+    h *= UINT64_C(0xc4ceb9fe1a85ec53);
+    h ^= h >> 33;
+    return (size_t) h & (self->size - 1);
+}
+
+static void
+breakpoint_set_fill_empty(double *slots, size_t size)
+{
+    size_t j;
+
+    for (j = 0; j < size; j++) {
+        slots[j] = NAN;
+    }
+}
+
+/* Returns the slot holding x, or the empty slot where x would go */
+static inline size_t
+breakpoint_set_find_slot(breakpoint_set_t *self, double x)
+{
+    size_t mask = self->size - 1;
+    size_t j = breakpoint_set_hash(self, x);
+
+    while (!isnan(self->slots[j]) && self->slots[j] != x) {
+        j = (j + 1) & mask;
+    }
+    return j;
+}
+
+int MSP_WARN_UNUSED
+breakpoint_set_init(breakpoint_set_t *self, size_t initial_size)
+{
+    int ret = 0;
+    size_t size = 2;
+
+    memset(self, 0, sizeof(*self));
+    if (initial_size > SIZE_MAX / 4) {
+        ret = MSP_ERR_BAD_PARAM_VALUE;
+        goto out;
+    }
+    while (size < 2 * initial_size) {
+        size *= 2;
+    }
+    self->slots = malloc(size * sizeof(*self->slots));
+    if (self->slots == NULL) {
+        ret = MSP_ERR_NO_MEMORY;
+        goto out;
+    }
+    self->size = size;
+    breakpoint_set_fill_empty(self->slots, self->size);
+out:
+    return ret;
+}
+
+int
+breakpoint_set_free(breakpoint_set_t *self)
+{
+    msp_safe_free(self->slots);
+    return 0;
+}
+
+void
+breakpoint_set_clear(breakpoint_set_t *self)
+{
+    breakpoint_set_fill_empty(self->slots, self->size);
+    self->num_items = 0;
+}
+
+static int MSP_WARN_UNUSED
+breakpoint_set_expand(breakpoint_set_t *self)
+{
+    int ret = 0;
+    double *old_slots = self->slots;
+    size_t old_size = self->size;
+    size_t j;
+
+    if (old_size > SIZE_MAX / (2 * sizeof(*self->slots))) {
+        ret = MSP_ERR_NO_MEMORY;
+        goto out;
+    }
+    self->slots = malloc(2 * old_size * sizeof(*self->slots));
+    if (self->slots == NULL) {
+        self->slots = old_slots;
+        ret = MSP_ERR_NO_MEMORY;
+        goto out;
+    }
+    self->size = 2 * old_size;
+    breakpoint_set_fill_empty(self->slots, self->size);
+    for (j = 0; j < old_size; j++) {
+        if (!isnan(old_slots[j])) {
+            self->slots[breakpoint_set_find_slot(self, old_slots[j])] = old_slots[j];
+        }
+    }
+    free(old_slots);
+out:
+    return ret;
+}
+
+bool
+breakpoint_set_contains(breakpoint_set_t *self, double x)
+{
+    return !isnan(self->slots[breakpoint_set_find_slot(self, x)]);
+}
+
+/* Inserts x into the set, if it is not already present. */
+int MSP_WARN_UNUSED
+breakpoint_set_insert(breakpoint_set_t *self, double x)
+{
+    int ret = 0;
+    size_t j;
+
+    tsk_bug_assert(!isnan(x));
+    j = breakpoint_set_find_slot(self, x);
+    if (isnan(self->slots[j])) {
+        if (2 * (self->num_items + 1) > self->size) {
+            ret = breakpoint_set_expand(self);
+            if (ret != 0) {
+                goto out;
+            }
+            j = breakpoint_set_find_slot(self, x);
+        }
+        self->slots[j] = x;
+        self->num_items++;
+    }
+out:
+    return ret;
+}
+
+size_t
+breakpoint_set_get_num_items(breakpoint_set_t *self)
+{
+    return self->num_items;
+}
+
+static int
+cmp_double(const void *a, const void *b)
+{
+    const double *ia = (const double *) a;
+    const double *ib = (const double *) b;
+    return (*ia > *ib) - (*ia < *ib);
+}
+
+/* Copies the items into the specified array, which must have space for
+ * breakpoint_set_get_num_items values, in increasing order. */
+void
+breakpoint_set_get_sorted(breakpoint_set_t *self, double *items)
+{
+    size_t j;
+    size_t k = 0;
+
+    for (j = 0; j < self->size; j++) {
+        if (!isnan(self->slots[j])) {
+            items[k] = self->slots[j];
+            k++;
+        }
+    }
+    tsk_bug_assert(k == self->num_items);
+    qsort(items, k, sizeof(*items), cmp_double);
+}
+
+size_t
+breakpoint_set_get_memory_usage(breakpoint_set_t *self)
+{
+    return self->size * sizeof(*self->slots);
+}
+
+void
+breakpoint_set_print_state(breakpoint_set_t *self, FILE *out)
+{
+    size_t j;
+
+    fprintf(out, "breakpoint set %p::\n", (void *) self);
+    fprintf(out, "\tsize = %d\n", (int) self->size);
+    fprintf(out, "\tnum_items = %d\n", (int) self->num_items);
+    for (j = 0; j < self->size; j++) {
+        if (!isnan(self->slots[j])) {
+            fprintf(out, "\t%d\t%.14g\n", (int) j, self->slots[j]);
+        }
+    }
+}
+
+/* Checks that the count of items is correct and that every item can be
+ * reached from its hash slot. */
+void
+breakpoint_set_verify(breakpoint_set_t *self)
+{
+    size_t j;
+    size_t num_items = 0;
+
+    tsk_bug_assert(self->size > 0 && (self->size & (self->size - 1)) == 0);
+    tsk_bug_assert(2 * self->num_items <= self->size);
+    for (j = 0; j < self->size; j++) {
+        if (!isnan(self->slots[j])) {
+            num_items++;
+            tsk_bug_assert(breakpoint_set_find_slot(self, self->slots[j]) == j);
+        }
+    }
+    tsk_bug_assert(num_items == self->num_items);
+}
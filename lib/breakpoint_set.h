@@ -0,0 +1,50 @@
+/*
+** Copyright (C) 2024 University of Oxford
+**
+** This file is part of msprime.
+**
+** msprime is free software: you can redistribute it and/or modify
+** it under the terms of the GNU General Public License as published by
+** the Free Software Foundation, either version 3 of the License, or
+** (at your option) any later version.
+**
+** msprime is distributed in the hope that it will be useful,
+** but WITHOUT ANY WARRANTY; without even the implied warranty of
+** MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+** GNU General Public License for more details.
+**
+** You should have received a copy of the GNU General Public License
+** along with msprime.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef __BREAKPOINT_SET_H__
+#define __BREAKPOINT_SET_H__
+
+#include <stdio.h>
+#include <stdbool.h>
+#include <stddef.h>
+
+/* An unordered set of genome positions, stored in an open addressing hash
+ * table with linear probing. Empty slots hold NaN, so NaN cannot be inserted.
+ * The table is kept at most half full, and is doubled in size when it
+ * fills. Items cannot be removed individually, but the whole set can be
+ * cleared. Use breakpoint_set_get_sorted to get the items in order. */
+typedef struct {
+    /* The number of slots, which is always a power of two */
+    size_t size;
+    size_t num_items;
+    double *slots;
+} breakpoint_set_t;
+
+int breakpoint_set_init(breakpoint_set_t *self, size_t initial_size);
+int breakpoint_set_free(breakpoint_set_t *self);
+void breakpoint_set_clear(breakpoint_set_t *self);
+bool breakpoint_set_contains(breakpoint_set_t *self, double x);
+int breakpoint_set_insert(breakpoint_set_t *self, double x);
+size_t breakpoint_set_get_num_items(breakpoint_set_t *self);
+void breakpoint_set_get_sorted(breakpoint_set_t *self, double *items);
+size_t breakpoint_set_get_memory_usage(breakpoint_set_t *self);
+void breakpoint_set_print_state(breakpoint_set_t *self, FILE *out);
+void breakpoint_set_verify(breakpoint_set_t *self);
+
+#endif /*__BREAKPOINT_SET_H__*/
@@ -609,6 +609,15 @@ read_recomb_map(rate_map_t *recomb_map, config_t *config)
     free(coordinates);
 }
 
+static void
+print_progress(double time, size_t num_ancestors, size_t num_nodes, size_t num_edges,
+    void *MSP_UNUSED(arg))
+{
+    fprintf(stderr, "progress: time=%g ancestors=%lu nodes=%lu edges=%lu\n", time,
+        (unsigned long) num_ancestors, (unsigned long) num_nodes,
+        (unsigned long) num_edges);
+}
+
 static void
 get_configuration(gsl_rng *rng, msp_t *msp, tsk_table_collection_t *tables,
     mutation_params_t *mutation_params, rate_map_t *recomb_map, const char *filename)
@@ -617,6 +626,7 @@ get_configuration(gsl_rng *rng, msp_t *msp, tsk_table_collection_t *tables,
     int err;
     int int_tmp;
     double start_time, gene_conversion_rate, gene_conversion_tract_length;
+    double progress_interval, memory_limit_mb, segment_compaction_threshold;
     const char *from_ts_path;
     config_t *config = malloc(sizeof(config_t));
     config_setting_t *t;
@@ -724,6 +734,41 @@ get_configuration(gsl_rng *rng, msp_t *msp, tsk_table_collection_t *tables,
     if (ret != 0) {
         fatal_error(msp_strerror(ret));
     }
+    if (config_lookup_int(config, "instrumentation", &int_tmp) == CONFIG_TRUE) {
+        ret = msp_set_instrumentation(msp, (bool) int_tmp);
+        if (ret != 0) {
+            fatal_msprime_error(ret, __LINE__);
+        }
+    }
+    if (config_lookup_float(config, "progress_interval", &progress_interval)
+            == CONFIG_TRUE
+        && progress_interval > 0) {
+        ret = msp_set_progress_callback(msp, print_progress, progress_interval, NULL);
+        if (ret != 0) {
+            fatal_msprime_error(ret, __LINE__);
+        }
+    }
+    if (config_lookup_float(config, "memory_limit_mb", &memory_limit_mb) == CONFIG_TRUE
+        && memory_limit_mb > 0) {
+        ret = msp_set_memory_limit(msp, (size_t) (memory_limit_mb * 1024 * 1024));
+        if (ret != 0) {
+            fatal_msprime_error(ret, __LINE__);
+        }
+    }
+    if (config_lookup_int(config, "huge_pages", &int_tmp) == CONFIG_TRUE) {
+        ret = msp_set_huge_pages(msp, (bool) int_tmp);
+        if (ret != 0) {
+            fatal_msprime_error(ret, __LINE__);
+        }
+    }
+    if (config_lookup_float(config, "segment_compaction_threshold",
+            &segment_compaction_threshold)
+        == CONFIG_TRUE) {
+        ret = msp_set_segment_compaction_threshold(msp, segment_compaction_threshold);
+        if (ret != 0) {
+            fatal_msprime_error(ret, __LINE__);
+        }
+    }
     t = config_lookup(config, "model");
     if (t == NULL) {
         fatal_error("model not specified");
@@ -757,6 +802,43 @@ record_provenance(tsk_provenance_table_t *provenance)
     }
 }
 
+static void
+print_timers(msp_t *msp)
+{
+    int j;
+    size_t calls[MSP_NUM_TIMERS];
+    double elapsed[MSP_NUM_TIMERS];
+
+    msp_get_timer_calls(msp, calls);
+    msp_get_timer_elapsed(msp, elapsed);
+    printf("%-16s %12s %12s\n", "handler", "calls", "seconds");
+    for (j = 0; j < MSP_NUM_TIMERS; j++) {
+        printf("%-16s %12lu %12.6f\n", msp_get_timer_name(j), (unsigned long) calls[j],
+            elapsed[j]);
+    }
+}
+
+static void
+print_memory_usage(msp_t *msp)
+{
+    int j;
+    size_t current[MSP_NUM_MEMORY_CATEGORIES];
+    size_t peak[MSP_NUM_MEMORY_CATEGORIES];
+    size_t total_current = 0;
+    size_t total_peak = 0;
+
+    msp_get_memory_usage(msp, current, peak);
+    printf("%-16s %12s %12s\n", "structure", "current", "peak");
+    for (j = 0; j < MSP_NUM_MEMORY_CATEGORIES; j++) {
+        printf("%-16s %12lu %12lu\n", msp_get_memory_category_name(j),
+            (unsigned long) current[j], (unsigned long) peak[j]);
+        total_current += current[j];
+        total_peak += peak[j];
+    }
+    printf("%-16s %12lu %12lu\n", "total", (unsigned long) total_current,
+        (unsigned long) total_peak);
+}
+
 static void
 run_simulate(
     const char *conf_file, const char *output_file, int verbose, int num_replicates)
@@ -817,8 +899,16 @@ run_simulate(
         if (ret < 0) {
             fatal_msprime_error(ret, __LINE__);
         }
+        if (ret == MSP_EXIT_MEMORY_LIMIT) {
+            fprintf(stderr, "Memory limit reached at time %g; output is partial\n",
+                msp_get_time(&msp));
+        }
         if (verbose >= 1) {
             msp_print_state(&msp, stdout);
+            print_memory_usage(&msp);
+        }
+        if (msp_get_instrumentation(&msp)) {
+            print_timers(&msp);
         }
         msp_verify(&msp, 0);
         ret = msp_finalise_tables(&msp);
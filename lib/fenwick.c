@@ -45,6 +45,54 @@ fenwick_compute_tree_value(fenwick_t *self, size_t index)
     return ret;
 }
 
+static uint64_t
+fenwick_compute_fixed_tree_value(fenwick_t *self, size_t index)
+{
+    uint64_t ret = fenwick_get_fixed_cumulative_sum(self, index);
+    if (index > 1) {
+        ret -= fenwick_get_fixed_cumulative_sum(self, index - 1);
+    }
+    return ret;
+}
+
+/* Returns the fixed-point representation of the specified value. Since the
+ * scale is a power of two the product is exact, and so the result does not
+ * depend on the platform. Nonzero values are never rounded down to zero, so
+ * that they can always be found. Values too large to represent are
+ * saturated; they can only occur once the total has overflowed. */
+static inline uint64_t
+fenwick_quantise(const fenwick_t *self, double value)
+{
+    double x = floor(value * self->fixed_scale + 0.5);
+
+    if (x >= 0x1p64) {
+        return UINT64_MAX;
+    }
+    if (x == 0 && value > 0) {
+        return 1;
+    }
+    return (uint64_t) x;
+}
+
+/* Adds the difference between the specified new and old quantised values to
+ * the fixed-point total, recording whether the true total overflows. All the
+ * nodes in the tree are partial sums of the total, so they cannot overflow
+ * unless it does. */
+static inline uint64_t
+fenwick_update_fixed_total(fenwick_t *self, uint64_t q_new, uint64_t q_old)
+{
+    uint64_t delta = q_new - q_old;
+
+    if (q_new > q_old && self->fixed_total > UINT64_MAX - delta) {
+        self->fixed_overflow = true;
+    }
+    if (q_new == UINT64_MAX) {
+        self->fixed_overflow = true;
+    }
+    self->fixed_total += delta;
+    return delta;
+}
+
 void
 fenwick_verify(fenwick_t *self, double eps)
 {
@@ -52,8 +100,18 @@ fenwick_verify(fenwick_t *self, double eps)
     double computed_value;
 
     for (j = 1; j <= self->size; j++) {
-        computed_value = fenwick_compute_tree_value(self, j);
-        tsk_bug_assert(gsl_fcmp(computed_value, self->values[j], eps) == 0);
+        if (fenwick_is_fixed_point(self)) {
+            tsk_bug_assert(fenwick_compute_fixed_tree_value(self, j)
+                           == fenwick_get_fixed_value(self, j));
+        } else {
+            computed_value = fenwick_compute_tree_value(self, j);
+            tsk_bug_assert(
+                gsl_fcmp(computed_value, fenwick_get_value(self, j), eps) == 0);
+        }
+    }
+    if (fenwick_is_fixed_point(self) && self->size > 0) {
+        tsk_bug_assert(
+            fenwick_get_fixed_cumulative_sum(self, self->size) == self->fixed_total);
     }
 }
 
@@ -63,11 +121,25 @@ fenwick_print_state(fenwick_t *self, FILE *out)
     size_t j;
 
     fprintf(out, "Fenwick tree @%p\n", (void *) self);
+    if (self->sibling != NULL) {
+        fprintf(out, "Interleaved channel %d with %p\n", (int) self->channel,
+            (void *) self->sibling);
+    }
+    if (fenwick_is_fixed_point(self)) {
+        fprintf(out, "Fixed point scale = %.17g\n", self->fixed_scale);
+        for (j = 1; j <= self->size; j++) {
+            fprintf(out, "%d\t%.16g\t%" PRIu64 "\t%" PRIu64 "\n", (int) j,
+                self->values[j * self->stride], self->fixed_tree[j * self->stride],
+                fenwick_compute_fixed_tree_value(self, j));
+        }
+        return;
+    }
     fprintf(out, "Numerical drift = %.17g\n", fenwick_get_numerical_drift(self));
 
     for (j = 1; j <= self->size; j++) {
-        fprintf(out, "%d\t%.16g\t%.16g\t%.16g\n", (int) j, self->values[j],
-            self->tree[j], fabs(self->values[j] - fenwick_compute_tree_value(self, j)));
+        fprintf(out, "%d\t%.16g\t%.16g\t%.16g\n", (int) j, fenwick_get_value(self, j),
+            self->tree[j * self->stride],
+            fabs(fenwick_get_value(self, j) - fenwick_compute_tree_value(self, j)));
     }
 }
 
@@ -88,6 +160,7 @@ fenwick_alloc(fenwick_t *self, size_t initial_size)
     int ret = 0;
 
     memset(self, 0, sizeof(*self));
+    self->stride = 1;
     self->size = initial_size;
     self->tree = calloc((1 + self->size), sizeof(*self->tree));
     self->values = calloc((1 + self->size), sizeof(*self->tree));
@@ -107,56 +180,357 @@ out:
     return ret;
 }
 
+/* Allocates a Fenwick tree in fixed-point mode. Values are represented to
+ * within max_value * 2^-FENWICK_FIXED_POINT_BITS, and the total of all the
+ * values must stay below 2^(64 - FENWICK_FIXED_POINT_BITS) * max_value; if it
+ * doesn't, fenwick_fixed_point_overflowed returns true. Sums are exact, and
+ * so the tree never needs to be rebuilt. */
 int MSP_WARN_UNUSED
-fenwick_expand(fenwick_t *self, size_t increment)
+fenwick_alloc_fixed_point(fenwick_t *self, size_t initial_size, double max_value)
 {
-    int ret = MSP_ERR_NO_MEMORY;
-    size_t j, n, k;
-    void *p;
+    int ret = 0;
+    int exponent;
 
-    p = realloc(self->tree, (1 + self->size + increment) * sizeof(*self->tree));
-    if (p == NULL) {
+    memset(self, 0, sizeof(*self));
+    self->stride = 1;
+    if (!(max_value > 0) || !isfinite(max_value)) {
+        ret = MSP_ERR_BAD_PARAM_VALUE;
         goto out;
     }
-    self->tree = p;
-    p = realloc(self->values, (1 + self->size + increment) * sizeof(*self->tree));
-    if (p == NULL) {
+    self->size = initial_size;
+    self->fixed_tree = calloc((1 + self->size), sizeof(*self->fixed_tree));
+    self->values = calloc((1 + self->size), sizeof(*self->values));
+    if (self->fixed_tree == NULL || self->values == NULL) {
+        ret = MSP_ERR_NO_MEMORY;
         goto out;
     }
-    self->values = p;
-
-    self->size += increment;
     fenwick_set_log_size(self);
-    for (j = self->size - increment + 1; j <= self->size; j++) {
-        self->values[j] = 0;
-        self->tree[j] = 0;
+    /* Use a power of two scale so that max_value * scale < 2^BITS */
+    frexp(max_value, &exponent);
+    self->fixed_scale = ldexp(1, FENWICK_FIXED_POINT_BITS - exponent);
+    self->fixed_total = 0;
+    self->fixed_overflow = false;
+out:
+    return ret;
+}
+
+/* Points the arrays of the specified channel into the interleaved storage
+ * owned by channel 0. */
+static void
+fenwick_set_interleaved_pointers(fenwick_t *self, fenwick_t *owner)
+{
+    if (owner->tree != NULL) {
+        self->tree = owner->tree + self->channel;
+    }
+    if (owner->fixed_tree != NULL) {
+        self->fixed_tree = owner->fixed_tree + self->channel;
+    }
+    self->values = owner->values + self->channel;
+}
+
+/* Stores the trees for two channels with the same size in a single
+ * allocation, with the nodes for each index adjacent in memory. Both trees
+ * can then be updated together with fenwick_set_value_pair, touching each
+ * cache line once rather than once per tree. After interleaving, expand
+ * and free must be called on self (channel 0), and affect both trees. */
+int MSP_WARN_UNUSED
+fenwick_interleave(fenwick_t *self, fenwick_t *sibling)
+{
+    int ret = 0;
+    const size_t n = 1 + self->size;
+    const bool huge_pages = self->huge_pages;
+    double *tree = NULL;
+    double *values = NULL;
+    uint64_t *fixed_tree = NULL;
+    size_t j;
+
+    if (self->size != sibling->size || self->sibling != NULL
+        || sibling->sibling != NULL
+        || fenwick_is_fixed_point(self) != fenwick_is_fixed_point(sibling)
+        || self->huge_pages != sibling->huge_pages) {
+        ret = MSP_ERR_BAD_PARAM_VALUE;
+        goto out;
+    }
+    values = msp_huge_alloc(2 * n * sizeof(*values), huge_pages);
+    if (fenwick_is_fixed_point(self)) {
+        fixed_tree = msp_huge_alloc(2 * n * sizeof(*fixed_tree), huge_pages);
+    } else {
+        tree = msp_huge_alloc(2 * n * sizeof(*tree), huge_pages);
+    }
+    if (values == NULL || (tree == NULL && fixed_tree == NULL)) {
+        ret = MSP_ERR_NO_MEMORY;
+        goto out;
+    }
+    for (j = 0; j < n; j++) {
+        values[2 * j] = self->values[j];
+        values[2 * j + 1] = sibling->values[j];
+        if (fixed_tree != NULL) {
+            fixed_tree[2 * j] = self->fixed_tree[j];
+            fixed_tree[2 * j + 1] = sibling->fixed_tree[j];
+        } else {
+            tree[2 * j] = self->tree[j];
+            tree[2 * j + 1] = sibling->tree[j];
+        }
+    }
+    fenwick_free(self);
+    fenwick_free(sibling);
+    self->tree = tree;
+    self->fixed_tree = fixed_tree;
+    self->values = values;
+    tree = NULL;
+    fixed_tree = NULL;
+    values = NULL;
+    self->stride = 2;
+    sibling->stride = 2;
+    self->channel = 0;
+    sibling->channel = 1;
+    self->sibling = sibling;
+    sibling->sibling = self;
+    fenwick_set_interleaved_pointers(sibling, self);
+out:
+    msp_huge_free(tree, 2 * n * sizeof(*tree), huge_pages);
+    msp_huge_free(fixed_tree, 2 * n * sizeof(*fixed_tree), huge_pages);
+    msp_huge_free(values, 2 * n * sizeof(*values), huge_pages);
+    return ret;
+}
+
+/* Initialises the nodes for the indexes after the specified old size */
+static void
+fenwick_init_expanded(fenwick_t *self, size_t old_size)
+{
+    size_t j, n, k;
+    const size_t stride = self->stride;
+
+    for (j = old_size + 1; j <= self->size; j++) {
+        self->values[j * stride] = 0;
+        if (fenwick_is_fixed_point(self)) {
+            self->fixed_tree[j * stride] = 0;
+        } else {
+            self->tree[j * stride] = 0;
+        }
         n = j;
         k = 1;
         while (n % 2 == 0) {
-            self->tree[j] += self->tree[j - k];
+            if (fenwick_is_fixed_point(self)) {
+                self->fixed_tree[j * stride] += self->fixed_tree[(j - k) * stride];
+            } else {
+                self->tree[j * stride] += self->tree[(j - k) * stride];
+            }
             k *= 2;
             n >>= 1;
         }
     }
+}
+
+int MSP_WARN_UNUSED
+fenwick_expand(fenwick_t *self, size_t increment)
+{
+    int ret = MSP_ERR_NO_MEMORY;
+    const size_t stride = self->stride;
+    const size_t n = stride * (1 + self->size + increment);
+    const size_t old_n = stride * (1 + self->size);
+    const size_t old_size = self->size;
+    void *p;
+
+    tsk_bug_assert(self->channel == 0);
+    if (fenwick_is_fixed_point(self)) {
+        p = msp_huge_realloc(self->fixed_tree, old_n * sizeof(*self->fixed_tree),
+            n * sizeof(*self->fixed_tree), self->huge_pages);
+        if (p == NULL) {
+            goto out;
+        }
+        self->fixed_tree = p;
+    } else {
+        p = msp_huge_realloc(self->tree, old_n * sizeof(*self->tree),
+            n * sizeof(*self->tree), self->huge_pages);
+        if (p == NULL) {
+            goto out;
+        }
+        self->tree = p;
+    }
+    p = msp_huge_realloc(self->values, old_n * sizeof(*self->values),
+        n * sizeof(*self->values), self->huge_pages);
+    if (p == NULL) {
+        goto out;
+    }
+    self->values = p;
+
+    self->size += increment;
+    fenwick_set_log_size(self);
+    fenwick_init_expanded(self, old_size);
+    if (self->sibling != NULL) {
+        self->sibling->size = self->size;
+        self->sibling->log_size = self->log_size;
+        fenwick_set_interleaved_pointers(self->sibling, self);
+        fenwick_init_expanded(self->sibling, old_size);
+    }
     ret = 0;
 out:
     return ret;
 }
 
+/* Reduces the size of the tree to new_size, moving the value at index
+ * old_index[j] to index j for 1 <= j <= new_size. An old_index of 0 gives
+ * a value of 0, and values at indexes that are not listed are discarded.
+ * The tree is rebuilt from the moved values. For interleaved trees both
+ * channels are moved, and this must be called on channel 0. If memory
+ * can't be allocated the tree is left unchanged. */
+int MSP_WARN_UNUSED
+fenwick_shrink(fenwick_t *self, size_t new_size, const uint32_t *old_index)
+{
+    int ret = 0;
+    const size_t stride = self->stride;
+    const size_t n = stride * (1 + new_size);
+    const bool huge_pages = self->huge_pages;
+    double *tree = NULL;
+    double *values = NULL;
+    uint64_t *fixed_tree = NULL;
+    size_t j, k, c;
+
+    tsk_bug_assert(self->channel == 0);
+    tsk_bug_assert(new_size <= self->size);
+    values = msp_huge_alloc(n * sizeof(*values), huge_pages);
+    if (fenwick_is_fixed_point(self)) {
+        fixed_tree = msp_huge_alloc(n * sizeof(*fixed_tree), huge_pages);
+    } else {
+        tree = msp_huge_alloc(n * sizeof(*tree), huge_pages);
+    }
+    if (values == NULL || (tree == NULL && fixed_tree == NULL)) {
+        ret = MSP_ERR_NO_MEMORY;
+        goto out;
+    }
+    for (j = 1; j <= new_size; j++) {
+        k = old_index[j];
+        tsk_bug_assert(k <= self->size);
+        if (k != 0) {
+            for (c = 0; c < stride; c++) {
+                values[j * stride + c] = self->values[k * stride + c];
+            }
+        }
+    }
+    fenwick_free(self);
+    self->tree = tree;
+    self->fixed_tree = fixed_tree;
+    self->values = values;
+    tree = NULL;
+    fixed_tree = NULL;
+    values = NULL;
+    self->size = new_size;
+    fenwick_set_log_size(self);
+    fenwick_rebuild(self);
+    if (self->sibling != NULL) {
+        self->sibling->size = self->size;
+        self->sibling->log_size = self->log_size;
+        fenwick_set_interleaved_pointers(self->sibling, self);
+        fenwick_rebuild(self->sibling);
+    }
+out:
+    msp_huge_free(tree, n * sizeof(*tree), huge_pages);
+    msp_huge_free(fixed_tree, n * sizeof(*fixed_tree), huge_pages);
+    msp_huge_free(values, n * sizeof(*values), huge_pages);
+    return ret;
+}
+
+/* Moves the arrays of a tree that has not been interleaved into memory
+ * allocated by msp_huge_alloc. Interleaving and expanding the tree then
+ * keep the arrays in huge pages. */
+int MSP_WARN_UNUSED
+fenwick_use_huge_pages(fenwick_t *self)
+{
+    int ret = 0;
+    const size_t n = 1 + self->size;
+    double *tree = NULL;
+    double *values = NULL;
+    uint64_t *fixed_tree = NULL;
+
+    if (self->sibling != NULL) {
+        ret = MSP_ERR_BAD_PARAM_VALUE;
+        goto out;
+    }
+    if (self->huge_pages) {
+        goto out;
+    }
+    values = msp_huge_alloc(n * sizeof(*values), true);
+    if (fenwick_is_fixed_point(self)) {
+        fixed_tree = msp_huge_alloc(n * sizeof(*fixed_tree), true);
+    } else {
+        tree = msp_huge_alloc(n * sizeof(*tree), true);
+    }
+    if (values == NULL || (tree == NULL && fixed_tree == NULL)) {
+        ret = MSP_ERR_NO_MEMORY;
+        goto out;
+    }
+    memcpy(values, self->values, n * sizeof(*values));
+    if (fixed_tree != NULL) {
+        memcpy(fixed_tree, self->fixed_tree, n * sizeof(*fixed_tree));
+    } else {
+        memcpy(tree, self->tree, n * sizeof(*tree));
+    }
+    fenwick_free(self);
+    self->tree = tree;
+    self->fixed_tree = fixed_tree;
+    self->values = values;
+    self->huge_pages = true;
+    tree = NULL;
+    fixed_tree = NULL;
+    values = NULL;
+out:
+    msp_huge_free(tree, n * sizeof(*tree), true);
+    msp_huge_free(fixed_tree, n * sizeof(*fixed_tree), true);
+    msp_huge_free(values, n * sizeof(*values), true);
+    return ret;
+}
+
 int
 fenwick_free(fenwick_t *self)
 {
-    msp_safe_free(self->tree);
-    msp_safe_free(self->values);
+    const size_t n = self->stride * (1 + self->size);
+
+    if (self->channel == 0) {
+        msp_huge_free(self->tree, n * sizeof(*self->tree), self->huge_pages);
+        msp_huge_free(self->values, n * sizeof(*self->values), self->huge_pages);
+        msp_huge_free(
+            self->fixed_tree, n * sizeof(*self->fixed_tree), self->huge_pages);
+        self->tree = NULL;
+        self->values = NULL;
+        self->fixed_tree = NULL;
+    } else {
+        /* The storage is owned by channel 0 */
+        self->tree = NULL;
+        self->values = NULL;
+        self->fixed_tree = NULL;
+    }
     return 0;
 }
 
+bool
+fenwick_is_fixed_point(fenwick_t *self)
+{
+    return self->fixed_scale > 0;
+}
+
 size_t
 fenwick_get_size(fenwick_t *self)
 {
     return self->size;
 }
 
+/* Returns the number of bytes allocated for the tree. Interleaved storage
+ * is counted once, by channel 0. */
+size_t
+fenwick_get_memory_usage(fenwick_t *self)
+{
+    const size_t n = self->stride * (1 + self->size);
+    const size_t tree_size = fenwick_is_fixed_point(self) ? sizeof(*self->fixed_tree)
+                                                          : sizeof(*self->tree);
+
+    if (self->channel != 0) {
+        return 0;
+    }
+    return msp_huge_get_allocated_size(n * sizeof(*self->values), self->huge_pages)
+           + msp_huge_get_allocated_size(n * tree_size, self->huge_pages);
+}
+
 /* Returns the difference between the total obtained by directly summing
  * the values and that we get from the Fenwick tree structure. The value
  * is expressed as |1 - stored_value / true_value| and is always positive.
@@ -166,7 +540,7 @@ double
 fenwick_get_numerical_drift(fenwick_t *self)
 {
     double ret = 0;
-    if (self->total_sum != 0.0) {
+    if (!fenwick_is_fixed_point(self) && self->total_sum != 0.0) {
         ret = fabs(1.0 - fenwick_get_cumulative_sum(self, self->size) / self->total_sum);
     }
     return ret;
@@ -182,13 +556,30 @@ fenwick_rebuild(fenwick_t *self)
     double value;
     size_t j;
     double current_drift;
-
+    const size_t stride = self->stride;
+
+    if (fenwick_is_fixed_point(self)) {
+        /* Sums are exact, but rebuilding is still well defined. */
+        self->fixed_total = 0;
+        self->fixed_overflow = false;
+        for (j = 0; j <= self->size; j++) {
+            self->fixed_tree[j * stride] = 0;
+        }
+        for (j = 1; j <= self->size; j++) {
+            value = self->values[j * stride];
+            self->values[j * stride] = 0;
+            fenwick_set_value(self, j, value);
+        }
+        return;
+    }
     self->total_sum = 0;
     self->total_c = 0;
-    memset(self->tree, 0, (1 + self->size) * sizeof(*self->tree));
+    for (j = 0; j <= self->size; j++) {
+        self->tree[j * stride] = 0;
+    }
     for (j = 1; j <= self->size; j++) {
-        value = self->values[j];
-        self->values[j] = 0;
+        value = self->values[j * stride];
+        self->values[j * stride] = 0;
         fenwick_increment(self, j, value);
     }
     current_drift = fenwick_get_numerical_drift(self);
@@ -207,15 +598,33 @@ fenwick_rebuild(fenwick_t *self)
 bool
 fenwick_rebuild_required(fenwick_t *self)
 {
-    return fenwick_get_numerical_drift(self) > self->rebuild_threshold;
+    return !fenwick_is_fixed_point(self)
+           && fenwick_get_numerical_drift(self) > self->rebuild_threshold;
 }
 
 double
 fenwick_get_total(fenwick_t *self)
 {
+    if (fenwick_is_fixed_point(self)) {
+        return (double) self->fixed_total / self->fixed_scale;
+    }
     return self->total_sum;
 }
 
+uint64_t
+fenwick_get_fixed_total(fenwick_t *self)
+{
+    return self->fixed_total;
+}
+
+/* Returns true if the total of a fixed-point tree has overflowed, and so
+ * its sums can't be used. */
+bool
+fenwick_fixed_point_overflowed(fenwick_t *self)
+{
+    return self->fixed_overflow;
+}
+
 static void
 fenwick_increment_total(fenwick_t *self, double value)
 {
@@ -231,13 +640,44 @@ fenwick_increment_total(fenwick_t *self, double value)
     self->total_sum = t;
 }
 
+/* Replaces the value at the specified index in a fixed-point tree. The
+ * integer updates are done modulo 2^64, which gives the exact result
+ * as long as the true total fits. If it doesn't, we record the overflow. */
+static void
+fenwick_set_fixed_value(fenwick_t *self, size_t index, double value)
+{
+    size_t j;
+    const size_t size = self->size;
+    const size_t stride = self->stride;
+    uint64_t *restrict tree = self->fixed_tree;
+    uint64_t delta;
+
+    tsk_bug_assert(0 < index && index <= size);
+    tsk_bug_assert(value >= 0);
+    delta = fenwick_update_fixed_total(self, fenwick_quantise(self, value),
+        fenwick_quantise(self, self->values[index * stride]));
+    self->values[index * stride] = value;
+    if (delta != 0) {
+        for (j = index; j <= size; j += (j & -j)) {
+            tree[j * stride] += delta;
+        }
+    }
+}
+
 void
 fenwick_increment(fenwick_t *self, size_t index, double value)
 {
     size_t j;
     const size_t size = self->size;
+    const size_t stride = self->stride;
     double *restrict tree = self->tree;
 
+    if (fenwick_is_fixed_point(self)) {
+        if (value != 0) {
+            fenwick_set_fixed_value(self, index, self->values[index * stride] + value);
+        }
+        return;
+    }
     /* Short-circuiting this saves us a bit of time in higher level
      * code where we don't have to reason about setting the segment
      * mass to the same value. */
@@ -245,9 +685,9 @@ fenwick_increment(fenwick_t *self, size_t index, double value)
         tsk_bug_assert(0 < index && index <= size);
         fenwick_increment_total(self, value);
 
-        self->values[index] += value;
+        self->values[index * stride] += value;
         for (j = index; j <= size; j += (j & -j)) {
-            tree[j] += value;
+            tree[j * stride] += value;
         }
     }
 }
@@ -255,8 +695,67 @@ fenwick_increment(fenwick_t *self, size_t index, double value)
 void
 fenwick_set_value(fenwick_t *self, size_t index, double value)
 {
-    double increment = value - self->values[index];
-    fenwick_increment(self, index, increment);
+    double increment;
+
+    if (fenwick_is_fixed_point(self)) {
+        fenwick_set_fixed_value(self, index, value);
+    } else {
+        increment = value - self->values[index * self->stride];
+        fenwick_increment(self, index, increment);
+    }
+}
+
+/* Sets the value at the specified index in an interleaved tree and in its
+ * sibling, walking the shared nodes once. */
+void
+fenwick_set_value_pair(fenwick_t *self, size_t index, double value, double sibling_value)
+{
+    fenwick_t *sibling = self->sibling;
+    const size_t size = self->size;
+    const size_t k = 2 * index;
+    size_t j;
+    double increment, sibling_increment;
+    uint64_t delta, sibling_delta;
+    double *restrict tree = self->tree;
+    uint64_t *restrict fixed_tree = self->fixed_tree;
+
+    tsk_bug_assert(sibling != NULL && self->channel == 0);
+    tsk_bug_assert(0 < index && index <= size);
+    if (fenwick_is_fixed_point(self)) {
+        tsk_bug_assert(value >= 0 && sibling_value >= 0);
+        delta = fenwick_update_fixed_total(self, fenwick_quantise(self, value),
+            fenwick_quantise(self, self->values[k]));
+        sibling_delta = fenwick_update_fixed_total(sibling,
+            fenwick_quantise(sibling, sibling_value),
+            fenwick_quantise(sibling, self->values[k + 1]));
+        self->values[k] = value;
+        self->values[k + 1] = sibling_value;
+        if (delta != 0 || sibling_delta != 0) {
+            for (j = index; j <= size; j += (j & -j)) {
+                fixed_tree[2 * j] += delta;
+                fixed_tree[2 * j + 1] += sibling_delta;
+            }
+        }
+    } else {
+        increment = value - self->values[k];
+        sibling_increment = sibling_value - self->values[k + 1];
+        /* As in fenwick_increment, we don't touch the totals for zero
+         * increments */
+        if (increment != 0) {
+            fenwick_increment_total(self, increment);
+        }
+        if (sibling_increment != 0) {
+            fenwick_increment_total(sibling, sibling_increment);
+        }
+        if (increment != 0 || sibling_increment != 0) {
+            self->values[k] += increment;
+            self->values[k + 1] += sibling_increment;
+            for (j = index; j <= size; j += (j & -j)) {
+                tree[2 * j] += increment;
+                tree[2 * j + 1] += sibling_increment;
+            }
+        }
+    }
 }
 
 double
@@ -264,32 +763,92 @@ fenwick_get_cumulative_sum(fenwick_t *self, size_t index)
 {
     double ret = 0;
     const double *restrict tree = self->tree;
+    const size_t stride = self->stride;
     size_t j;
 
+    if (fenwick_is_fixed_point(self)) {
+        return (double) fenwick_get_fixed_cumulative_sum(self, index)
+               / self->fixed_scale;
+    }
     tsk_bug_assert(0 < index && index <= self->size);
     for (j = index; j > 0; j -= (j & -j)) {
-        ret += tree[j];
+        ret += tree[j * stride];
     }
     return ret;
 }
 
+uint64_t
+fenwick_get_fixed_cumulative_sum(fenwick_t *self, size_t index)
+{
+    uint64_t ret = 0;
+    const uint64_t *restrict tree = self->fixed_tree;
+    const size_t stride = self->stride;
+    size_t j;
+
+    tsk_bug_assert(fenwick_is_fixed_point(self));
+    tsk_bug_assert(0 < index && index <= self->size);
+    for (j = index; j > 0; j -= (j & -j)) {
+        ret += tree[j * stride];
+    }
+    return ret;
+}
+
+/* Returns the quantised value at the specified index, as stored in the
+ * fixed-point tree. */
+uint64_t
+fenwick_get_fixed_value(fenwick_t *self, size_t index)
+{
+    tsk_bug_assert(fenwick_is_fixed_point(self));
+    tsk_bug_assert(0 < index && index <= self->size);
+    return fenwick_quantise(self, self->values[index * self->stride]);
+}
+
 double
 fenwick_get_value(fenwick_t *self, size_t index)
 {
     tsk_bug_assert(0 < index && index <= self->size);
-    return self->values[index];
+    return self->values[index * self->stride];
 }
 
+/* Returns the index whose interval of the cumulative sums contains the
+ * specified value, or 0 if all values are zero. The prefix sum of the values
+ * before that index and its value are returned in the same descent of the
+ * tree, so that callers who need them don't traverse it again. In
+ * fixed-point mode the prefix is the exact fixed-point prefix divided by
+ * the scale. */
 size_t
-fenwick_find(fenwick_t *self, double sum)
+fenwick_find_with_prefix(fenwick_t *self, double sum, double *prefix, double *value)
 {
     size_t j = 0;
     size_t k, index;
     double s = sum;
+    double p = 0;
+    uint64_t fixed_sum, fixed_prefix;
     const double *restrict tree = self->tree;
     const double *restrict values = self->values;
     const size_t size = self->size;
+    const size_t stride = self->stride;
     size_t half = self->log_size;
+    double target;
+
+    if (fenwick_is_fixed_point(self)) {
+        index = 0;
+        fixed_prefix = 0;
+        if (self->fixed_total > 0) {
+            target = ceil(sum * self->fixed_scale);
+            if (target < 1) {
+                fixed_sum = 1;
+            } else if (target >= (double) self->fixed_total) {
+                fixed_sum = self->fixed_total;
+            } else {
+                fixed_sum = (uint64_t) target;
+            }
+            index = fenwick_find_fixed_with_prefix(self, fixed_sum, &fixed_prefix);
+        }
+        *prefix = (double) fixed_prefix / self->fixed_scale;
+        *value = index == 0 ? 0 : values[index * stride];
+        return index;
+    }
 
     while (half > 0) {
         /* Skip non-existent entries */
@@ -297,9 +856,10 @@ fenwick_find(fenwick_t *self, double sum)
             half >>= 1;
         }
         k = j + half;
-        if (s > tree[k]) {
+        if (s > tree[k * stride]) {
             j = k;
-            s -= tree[j];
+            s -= tree[j * stride];
+            p += tree[j * stride];
         }
         half >>= 1;
     }
@@ -307,18 +867,74 @@ fenwick_find(fenwick_t *self, double sum)
     /* We can have situations due to numerical imprecision where
      * the sum points to an index that's actually mapped to zero,
      * so skip ahead until we find a non-zero value. */
-    while (index <= size && values[index] == 0) {
+    while (index <= size && values[index * stride] == 0) {
         index++;
     }
     /* But, it can ALSO happen that we just have trailing zeros.
-     * Skip back until we find a non-zero index. */
+     * Skip back until we find a non-zero index. The prefix we have is then
+     * for the wrong index, but this is rare enough to recompute it. */
     if (index > self->size) {
         tsk_bug_assert(index == self->size + 1);
-        tsk_bug_assert(values[self->size] == 0);
+        tsk_bug_assert(values[self->size * stride] == 0);
         index = self->size;
-        while (index > 0 && values[index] == 0) {
+        while (index > 0 && values[index * stride] == 0) {
             index--;
         }
+        p = 0;
+        if (index > 0) {
+            p = fenwick_get_cumulative_sum(self, index) - values[index * stride];
+        }
     }
+    *prefix = p;
+    *value = index == 0 ? 0 : values[index * stride];
     return index;
 }
+
+size_t
+fenwick_find(fenwick_t *self, double sum)
+{
+    double prefix, value;
+
+    return fenwick_find_with_prefix(self, sum, &prefix, &value);
+}
+
+/* Returns the smallest index whose cumulative sum is >= the specified value in
+ * a fixed-point tree, and the cumulative sum of the indexes before it. The
+ * value must be between 1 and the total, and the returned index therefore
+ * always has a nonzero value. */
+size_t
+fenwick_find_fixed_with_prefix(fenwick_t *self, uint64_t sum, uint64_t *prefix)
+{
+    size_t j = 0;
+    size_t k;
+    uint64_t s = sum;
+    const uint64_t *restrict tree = self->fixed_tree;
+    const size_t size = self->size;
+    const size_t stride = self->stride;
+    size_t half = self->log_size;
+
+    tsk_bug_assert(fenwick_is_fixed_point(self));
+    tsk_bug_assert(0 < sum && sum <= self->fixed_total);
+    while (half > 0) {
+        /* Skip non-existent entries */
+        while (half > 0 && j + half > size) {
+            half >>= 1;
+        }
+        k = j + half;
+        if (half > 0 && s > tree[k * stride]) {
+            j = k;
+            s -= tree[j * stride];
+        }
+        half >>= 1;
+    }
+    *prefix = sum - s;
+    return j + 1;
+}
+
+size_t
+fenwick_find_fixed(fenwick_t *self, uint64_t sum)
+{
+    uint64_t prefix;
+
+    return fenwick_find_fixed_with_prefix(self, sum, &prefix);
+}
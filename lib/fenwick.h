@@ -21,9 +21,15 @@
 #define __FENWICK_H__
 
 #include <stdlib.h>
+#include <stdbool.h>
 #include <inttypes.h>
 
-typedef struct {
+/* In fixed-point mode the largest value passed to fenwick_alloc_fixed_point
+ * is represented with this many bits, leaving the remaining bits of the
+ * 64 bit sums as headroom for the total. */
+#define FENWICK_FIXED_POINT_BITS 40
+
+typedef struct _fenwick_t {
     size_t size;
     size_t log_size;
     double rebuild_threshold;
@@ -32,12 +38,35 @@ typedef struct {
     double total_c;
     double *tree;
     double *values;
+    /* Fixed-point mode. Values are quantised to the nearest multiple of
+     * 1 / fixed_scale and the tree stores exact integer sums, so there is
+     * no numerical drift. The values array still holds the unquantised
+     * values. fixed_scale is 0 (and fixed_tree NULL) in the default floating
+     * point mode, and tree is NULL in fixed-point mode. */
+    double fixed_scale;
+    uint64_t fixed_total;
+    uint64_t *fixed_tree;
+    /* True if the fixed-point total has exceeded 2^64 since the tree was
+     * allocated or rebuilt, in which case the sums are meaningless. */
+    bool fixed_overflow;
+    /* Two trees of the same size can share their storage, with the nodes
+     * for each index interleaved. The arrays are then accessed with a stride
+     * of 2 and offset by the channel. The stride is 1 otherwise. */
+    size_t stride;
+    size_t channel;
+    struct _fenwick_t *sibling;
+    /* True if the arrays are allocated by msp_huge_alloc */
+    bool huge_pages;
 } fenwick_t;
 
 void fenwick_print_state(fenwick_t *self, FILE *out);
 void fenwick_verify(fenwick_t *self, double eps);
 int fenwick_alloc(fenwick_t *, size_t);
+int fenwick_alloc_fixed_point(fenwick_t *, size_t, double);
+int fenwick_use_huge_pages(fenwick_t *);
+int fenwick_interleave(fenwick_t *, fenwick_t *);
 int fenwick_expand(fenwick_t *, size_t);
+int fenwick_shrink(fenwick_t *, size_t, const uint32_t *);
 int fenwick_free(fenwick_t *);
 double fenwick_get_total(fenwick_t *);
 void fenwick_rebuild(fenwick_t *);
@@ -45,9 +74,19 @@ bool fenwick_rebuild_required(fenwick_t *);
 double fenwick_get_numerical_drift(fenwick_t *self);
 void fenwick_increment(fenwick_t *, size_t, double);
 void fenwick_set_value(fenwick_t *, size_t, double);
+void fenwick_set_value_pair(fenwick_t *, size_t, double, double);
 double fenwick_get_cumulative_sum(fenwick_t *, size_t);
 double fenwick_get_value(fenwick_t *, size_t);
 size_t fenwick_find(fenwick_t *, double);
+size_t fenwick_find_with_prefix(fenwick_t *, double, double *, double *);
 size_t fenwick_get_size(fenwick_t *);
+size_t fenwick_get_memory_usage(fenwick_t *);
+bool fenwick_is_fixed_point(fenwick_t *);
+uint64_t fenwick_get_fixed_total(fenwick_t *);
+bool fenwick_fixed_point_overflowed(fenwick_t *);
+uint64_t fenwick_get_fixed_value(fenwick_t *, size_t);
+uint64_t fenwick_get_fixed_cumulative_sum(fenwick_t *, size_t);
+size_t fenwick_find_fixed(fenwick_t *, uint64_t);
+size_t fenwick_find_fixed_with_prefix(fenwick_t *, uint64_t, uint64_t *);
 
 #endif /*__FENWICK_H__*/
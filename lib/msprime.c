@@ -36,6 +36,37 @@
 #define MSP_STATE_SIMULATING 2
 #define MSP_STATE_DEBUGGING 3
 
+/* The number of events between checks of the wall-clock time in msp_run */
+#define MSP_WALL_TIME_CHECK_INTERVAL 64
+
+/* The number of events between checks of the memory limit in msp_run */
+#define MSP_MEMORY_LIMIT_CHECK_INTERVAL 64
+
+/* When a memory limit is set, each of the node, edge and migration tables
+ * grows by at most this fraction of the limit at a time */
+#define MSP_MEMORY_LIMIT_TABLE_FRACTION 64
+
+/* The smallest number of rows that the tables grow by under a memory limit */
+#define MSP_MIN_TABLE_ROWS_INCREMENT 1024
+
+/* The initial size in bytes of the scratch buffer, which grows as needed */
+#define MSP_SCRATCH_BUFFER_SIZE 4096
+
+/* Event types stored for each population in the event rate index. The
+ * rate for event type k in population j is stored at index
+ * j * MSP_NUM_EVENT_RATE_TYPES + k + 1. */
+#define MSP_EVENT_RATE_CA 0
+#define MSP_EVENT_RATE_MIGRATION 1
+#define MSP_NUM_EVENT_RATE_TYPES 2
+
+/* Event channels for the next reaction scheduler. The global channels come
+ * first, followed by MSP_NUM_EVENT_RATE_TYPES channels per population laid
+ * out in the same order as the event rate index. */
+#define MSP_CHANNEL_RE 0
+#define MSP_CHANNEL_GC 1
+#define MSP_CHANNEL_GC_LEFT 2
+#define MSP_NUM_GLOBAL_CHANNELS 3
+
 /* Draw a random variable from a truncated Beta(a, b) distribution,
  * by rejecting draws above the truncation point x.
  */
@@ -99,36 +130,20 @@ get_population_size(population_t *pop, double t)
     return ret;
 }
 
-static int
-cmp_individual(const void *a, const void *b)
-{
-    const segment_t *ia = (const segment_t *) a;
-    const segment_t *ib = (const segment_t *) b;
-    return (ia->id > ib->id) - (ia->id < ib->id);
-}
-
 /* For the segment priority queue we want to sort on the left
  * coordinate and to break ties we arbitrarily use the ID */
 static int
 cmp_segment_queue(const void *a, const void *b)
 {
-    const segment_t *ia = (const segment_t *) a;
-    const segment_t *ib = (const segment_t *) b;
+    const segment_queue_node_t *ia = (const segment_queue_node_t *) a;
+    const segment_queue_node_t *ib = (const segment_queue_node_t *) b;
     int ret = (ia->left > ib->left) - (ia->left < ib->left);
     if (ret == 0) {
-        ret = (ia->id > ib->id) - (ia->id < ib->id);
+        ret = (ia->segment > ib->segment) - (ia->segment < ib->segment);
     }
     return ret;
 }
 
-static int
-cmp_node_mapping(const void *a, const void *b)
-{
-    const node_mapping_t *ia = (const node_mapping_t *) a;
-    const node_mapping_t *ib = (const node_mapping_t *) b;
-    return (ia->position > ib->position) - (ia->position < ib->position);
-}
-
 static int
 cmp_sampling_event(const void *a, const void *b)
 {
@@ -160,34 +175,22 @@ cmp_pedigree_individual_p(const void *a, const void *b)
     return ret;
 }
 
-static void
-segment_init(void **obj, size_t id)
-{
-    segment_t *seg = (segment_t *) obj;
-    seg->id = id + 1;
-}
-
 size_t
 msp_get_num_avl_node_blocks(msp_t *self)
 {
-    return self->avl_node_heap.num_blocks;
+    return object_heap_get_num_blocks(&self->avl_node_heap);
 }
 
 size_t
 msp_get_num_node_mapping_blocks(msp_t *self)
 {
-    return self->node_mapping_heap.num_blocks;
+    return object_heap_get_num_blocks(&self->node_mapping_heap);
 }
 
 size_t
 msp_get_num_segment_blocks(msp_t *self)
 {
-    uint32_t j;
-    size_t total = 0;
-    for (j = 0; j < self->num_labels; j++) {
-        total += self->segment_heap[j].num_blocks;
-    }
-    return total;
+    return segment_pool_get_size(&self->segments) / self->segment_block_size;
 }
 
 size_t
@@ -232,6 +235,62 @@ msp_get_sum_internal_gc_tract_lengths(msp_t *self)
     return self->sum_internal_gc_tract_lengths;
 }
 
+static const char *msp_timer_names[] = { "recombination", "gene_conversion",
+    "common_ancestor", "migration", "fixed_events", "flush_edges", "fenwick_rebuild" };
+
+static const char *msp_memory_category_names[] = { "segments", "avl_nodes",
+    "node_mappings", "fenwick", "rate_maps", "edge_buffer", "populations", "tables",
+    "breakpoints", "scratch" };
+
+static const char *msp_trace_event_names[]
+    = { "recombination", "gene_conversion", "common_ancestor", "migration",
+          "fixed_events" };
+
+/* Instrumentation of the event handlers. Timers measure monotonic wall
+ * time, so that they are unaffected by other threads running simulations
+ * in the same process. Timers are inclusive, so that (for example) the time
+ * spent flushing edges during a common ancestor event is counted by both
+ * timers. */
+static inline void
+msp_timer_start(msp_t *self, int timer)
+{
+    if (self->instrumentation) {
+        self->timer_start[timer] = msp_get_wall_time();
+    }
+}
+
+static inline void
+msp_timer_stop(msp_t *self, int timer)
+{
+    if (self->instrumentation) {
+        self->timer_elapsed[timer]
+            += msp_get_wall_time() - self->timer_start[timer];
+        self->timer_calls[timer]++;
+    }
+}
+
+/* Adds a record for an event that has just completed to the event trace.
+ * The num_segment_updates and num_stored_edges arguments are the values of
+ * the corresponding counters at the start of the event. */
+static void
+msp_trace_event(msp_t *self, int type, population_id_t population, label_id_t label,
+    size_t num_segment_updates, size_t num_stored_edges)
+{
+    event_trace_record_t *record;
+
+    if (self->event_trace_size > 0) {
+        record = &self->event_trace[self->num_traced_events % self->event_trace_size];
+        record->time = self->time;
+        record->type = type;
+        record->population = population;
+        record->label = label;
+        record->num_segments
+            = (uint32_t)(self->num_segment_updates - num_segment_updates);
+        record->num_edges = (uint32_t)(self->num_stored_edges - num_stored_edges);
+        self->num_traced_events++;
+    }
+}
+
 int
 msp_set_start_time(msp_t *self, double start_time)
 {
@@ -273,6 +332,401 @@ out:
     return ret;
 }
 
+int
+msp_set_scheduler(msp_t *self, int scheduler)
+{
+    int ret = 0;
+
+    if (scheduler != MSP_SCHEDULER_DIRECT && scheduler != MSP_SCHEDULER_NEXT_REACTION) {
+        ret = MSP_ERR_BAD_PARAM_VALUE;
+        goto out;
+    }
+    self->scheduler = scheduler;
+out:
+    return ret;
+}
+
+int
+msp_set_instrumentation(msp_t *self, bool instrumentation)
+{
+    self->instrumentation = instrumentation;
+    return 0;
+}
+
+/* Sets the number of events kept in the event trace. A size of zero
+ * disables the trace. Any existing records are discarded. */
+int
+msp_set_event_trace_size(msp_t *self, size_t size)
+{
+    int ret = 0;
+    event_trace_record_t *trace = NULL;
+
+    if (size > 0) {
+        trace = malloc(size * sizeof(*trace));
+        if (trace == NULL) {
+            ret = MSP_ERR_NO_MEMORY;
+            goto out;
+        }
+    }
+    msp_safe_free(self->event_trace);
+    self->event_trace = trace;
+    self->event_trace_size = size;
+    self->num_traced_events = 0;
+out:
+    return ret;
+}
+
+/* Sets the number of uniform and exponential variates drawn from the
+ * random generator in each block. A size of zero (the default) draws each
+ * variate from the generator as it is needed. Simulations are reproducible
+ * for a given seed and buffer size, but different buffer sizes give
+ * different results. */
+int
+msp_set_variate_buffer_size(msp_t *self, size_t size)
+{
+    int ret = 0;
+
+    variate_buffer_free(&self->variates);
+    ret = variate_buffer_alloc(&self->variates, self->rng, size);
+    if (ret != 0) {
+        /* Leave the buffer in a usable state */
+        variate_buffer_free(&self->variates);
+        variate_buffer_alloc(&self->variates, self->rng, 0);
+    }
+    return ret;
+}
+
+/* Sets whether the recombination and gene conversion mass indexes use
+ * fixed-point integer sums rather than floating point. Fixed-point sums
+ * are exact and independent of the order of updates, so the indexes never
+ * need to be rebuilt, but each segment's mass is rounded to a resolution of
+ * 2^-FENWICK_FIXED_POINT_BITS of the total mass of the rate map, and nonzero
+ * masses below this resolution are rounded up to it. The summed mass of all
+ * segments must stay below 2^(64 - FENWICK_FIXED_POINT_BITS) (about 16.7
+ * million) times the total mass of the map, which is exceeded by
+ * simulations with more lineages than this spanning the whole genome. Such
+ * simulations fail with MSP_ERR_MASS_INDEX_OVERFLOW and must use the
+ * floating point index. Must be set before msp_initialise. */
+int
+msp_set_exact_mass_index(msp_t *self, bool exact_mass_index)
+{
+    int ret = 0;
+
+    if (self->state != MSP_STATE_NEW) {
+        ret = MSP_ERR_BAD_STATE;
+        goto out;
+    }
+    self->exact_mass_index = exact_mass_index;
+out:
+    return ret;
+}
+
+/* Sets whether the blocks of the segment, AVL node and node mapping heaps
+ * and the arrays of the recombination and gene conversion mass indexes are
+ * allocated in huge pages (see msp_huge_alloc). This reduces the TLB misses
+ * from random accesses to these structures in large simulations. The
+ * heaps use the same block sizes in both modes, so the output for a given
+ * seed does not depend on this setting. Must be set before msp_initialise. */
+int
+msp_set_huge_pages(msp_t *self, bool huge_pages)
+{
+    int ret = 0;
+
+    if (self->state != MSP_STATE_NEW) {
+        ret = MSP_ERR_BAD_STATE;
+        goto out;
+    }
+    self->huge_pages = huge_pages;
+out:
+    return ret;
+}
+
+/* Sets the fraction of the segment IDs for a label that must be in use.
+ * When fewer are in use between events the segments are renumbered into a
+ * dense range and the mass index is shrunk to match, so that searches in
+ * the index don't pay for the peak number of segments for the rest of the
+ * simulation. The threshold must be at most 0.5, so that a compacted
+ * index is not compacted again straight away, and 0 disables compaction. */
+int
+msp_set_segment_compaction_threshold(msp_t *self, double threshold)
+{
+    int ret = 0;
+
+    if (!(threshold >= 0 && threshold <= 0.5)) {
+        ret = MSP_ERR_BAD_PARAM_VALUE;
+        goto out;
+    }
+    self->segment_compaction_threshold = threshold;
+out:
+    return ret;
+}
+
+/* Sets the maximum wall-clock time in seconds that each call to msp_run
+ * may take before returning MSP_EXIT_WALL_TIME. A limit of DBL_MAX (the
+ * default) means there is no limit. The sweep model can't stop part way
+ * through a sweep and pick up again, and so msp_run runs each sweep to the
+ * end regardless of this limit (and of the memory limit). */
+int
+msp_set_wall_time_limit(msp_t *self, double wall_time_limit)
+{
+    int ret = 0;
+
+    if (!(wall_time_limit > 0)) {
+        ret = MSP_ERR_BAD_PARAM_VALUE;
+        goto out;
+    }
+    self->wall_time_limit = wall_time_limit;
+out:
+    return ret;
+}
+
+static size_t
+msp_get_node_row_size(msp_t *self)
+{
+    const tsk_node_table_t *nodes = &self->tables->nodes;
+
+    return sizeof(*nodes->flags) + sizeof(*nodes->time) + sizeof(*nodes->population)
+           + sizeof(*nodes->individual) + sizeof(*nodes->metadata_offset);
+}
+
+static size_t
+msp_get_edge_row_size(msp_t *self)
+{
+    const tsk_edge_table_t *edges = &self->tables->edges;
+
+    return sizeof(*edges->left) + sizeof(*edges->right) + sizeof(*edges->parent)
+           + sizeof(*edges->child) + sizeof(*edges->metadata_offset);
+}
+
+static size_t
+msp_get_migration_row_size(msp_t *self)
+{
+    const tsk_migration_table_t *migrations = &self->tables->migrations;
+
+    return sizeof(*migrations->left) + sizeof(*migrations->right)
+           + sizeof(*migrations->node) + sizeof(*migrations->source)
+           + sizeof(*migrations->dest) + sizeof(*migrations->time)
+           + sizeof(*migrations->metadata_offset);
+}
+
+/* Returns the number of rows that a table with the specified row size
+ * should grow by under the specified memory limit. */
+static tsk_size_t
+msp_get_table_rows_increment(size_t memory_limit, size_t row_size)
+{
+    size_t increment;
+
+    increment = memory_limit / (MSP_MEMORY_LIMIT_TABLE_FRACTION * row_size);
+    increment = GSL_MAX(increment, MSP_MIN_TABLE_ROWS_INCREMENT);
+    increment = GSL_MIN(increment, (size_t) TSK_MAX_ID);
+    return (tsk_size_t) increment;
+}
+
+/* Sets the maximum number of bytes that the simulator may use, as
+ * given by the total of the categories reported by msp_get_memory_usage.
+ * The limit is checked at the start of each call to msp_run and then every
+ * MSP_MEMORY_LIMIT_CHECK_INTERVAL events. When it is exceeded msp_run
+ * returns MSP_EXIT_MEMORY_LIMIT leaving the simulation in a consistent state,
+ * so that msp_finalise_tables gives a valid partial result. The limit can
+ * therefore be overshot by what is allocated between two checks: blocks of
+ * the object heaps and mass indexes (which grow geometrically) and rows of
+ * the node, edge and migration tables. The sweep model is an exception:
+ * since it can't stop part way through a sweep and pick up again, msp_run
+ * runs each sweep to the end without checking the limit, and so a sweep can
+ * use any amount of memory. The limit applies again to the models after it.
+ *
+ * So that the tables don't double past the limit, while a limit is set they
+ * grow by a fixed number of rows using about 1/MSP_MEMORY_LIMIT_TABLE_FRACTION
+ * of the limit. The increments that the tables had when the limit was set
+ * are restored when it is cleared. A limit of 0 (the default) means there
+ * is no limit. */
+int
+msp_set_memory_limit(msp_t *self, size_t memory_limit)
+{
+    int ret = 0;
+    tsk_table_collection_t *tables = self->tables;
+    tsk_size_t increment[3];
+
+    if (memory_limit > 0 && self->memory_limit == 0) {
+        self->saved_rows_increment[0] = tables->nodes.max_rows_increment;
+        self->saved_rows_increment[1] = tables->edges.max_rows_increment;
+        self->saved_rows_increment[2] = tables->migrations.max_rows_increment;
+    }
+    if (memory_limit > 0) {
+        increment[0] = msp_get_table_rows_increment(
+            memory_limit, msp_get_node_row_size(self));
+        increment[1] = msp_get_table_rows_increment(
+            memory_limit, msp_get_edge_row_size(self));
+        increment[2] = msp_get_table_rows_increment(
+            memory_limit, msp_get_migration_row_size(self));
+    } else if (self->memory_limit > 0) {
+        memcpy(increment, self->saved_rows_increment, sizeof(increment));
+    } else {
+        /* There was no limit and still isn't, so leave the tables alone */
+        goto out;
+    }
+    ret = tsk_node_table_set_max_rows_increment(&tables->nodes, increment[0]);
+    if (ret != 0) {
+        ret = msp_set_tsk_error(ret);
+        goto out;
+    }
+    ret = tsk_edge_table_set_max_rows_increment(&tables->edges, increment[1]);
+    if (ret != 0) {
+        ret = msp_set_tsk_error(ret);
+        goto out;
+    }
+    ret = tsk_migration_table_set_max_rows_increment(
+        &tables->migrations, increment[2]);
+    if (ret != 0) {
+        ret = msp_set_tsk_error(ret);
+        goto out;
+    }
+    self->memory_limit = memory_limit;
+out:
+    return ret;
+}
+
+static size_t
+msp_get_table_memory_usage(msp_t *self)
+{
+    const tsk_node_table_t *nodes = &self->tables->nodes;
+    const tsk_edge_table_t *edges = &self->tables->edges;
+    const tsk_migration_table_t *migrations = &self->tables->migrations;
+    size_t ret = 0;
+
+    ret += nodes->max_rows * msp_get_node_row_size(self) + nodes->max_metadata_length;
+    ret += edges->max_rows * msp_get_edge_row_size(self) + edges->max_metadata_length;
+    ret += migrations->max_rows * msp_get_migration_row_size(self)
+           + migrations->max_metadata_length;
+    return ret;
+}
+
+static size_t
+msp_get_population_memory_usage(msp_t *self)
+{
+    size_t N = self->num_populations;
+    size_t num_channels = self->event_queue.size;
+    size_t ret = 0;
+    size_t j, k;
+
+    ret += 2 * N * sizeof(population_t);
+    ret += N * self->num_labels * sizeof(ancestor_set_t);
+    for (j = 0; j < N; j++) {
+        if (self->populations[j].ancestors != NULL) {
+            for (k = 0; k < self->num_labels; k++) {
+                ret += self->populations[j].ancestors[k].max_lineages
+                       * sizeof(segment_id_t);
+            }
+        }
+    }
+    ret += N * N
+           * (sizeof(*self->populations->potential_destinations)
+               + sizeof(*self->populations->migration_alias_probability)
+               + sizeof(*self->populations->migration_alias));
+    ret += N * N
+           * (sizeof(*self->initial_migration_matrix) + sizeof(*self->migration_matrix)
+               + sizeof(*self->num_migration_events));
+    ret += N
+           * (sizeof(*self->dirty_populations) + sizeof(*self->changed_migration_rows)
+               + sizeof(*self->migration_alias_work));
+    ret += num_channels
+           * (sizeof(*self->event_queue.time) + sizeof(*self->event_queue.heap)
+               + sizeof(*self->event_queue.position) + sizeof(*self->channel_rate));
+    return ret;
+}
+
+/* Fills the specified array with the number of bytes allocated for each of
+ * the MSP_NUM_MEMORY_CATEGORIES groups of structures, and raises the peak
+ * usage of each to match. Usage is computed from the allocated capacities
+ * rather than by counting calls to malloc, so it reflects the memory
+ * reserved for the structures and not what is currently in use. */
+static void
+msp_update_memory_usage(msp_t *self, size_t *usage)
+{
+    size_t j;
+    label_id_t label;
+
+    memset(usage, 0, MSP_NUM_MEMORY_CATEGORIES * sizeof(*usage));
+    usage[MSP_MEMORY_SEGMENTS] = segment_pool_get_memory_usage(&self->segments);
+    if (self->ancestor_index != NULL) {
+        usage[MSP_MEMORY_SEGMENTS]
+            += (segment_pool_get_size(&self->segments) + 1)
+               * sizeof(*self->ancestor_index);
+    }
+    for (label = 0; label < (label_id_t) self->num_labels; label++) {
+        if (self->recomb_mass_index != NULL) {
+            usage[MSP_MEMORY_FENWICK]
+                += fenwick_get_memory_usage(&self->recomb_mass_index[label]);
+        }
+        if (self->gc_mass_index != NULL) {
+            usage[MSP_MEMORY_FENWICK]
+                += fenwick_get_memory_usage(&self->gc_mass_index[label]);
+        }
+    }
+    usage[MSP_MEMORY_AVL_NODES] = object_heap_get_memory_usage(&self->avl_node_heap);
+    usage[MSP_MEMORY_NODE_MAPPINGS]
+        = object_heap_get_memory_usage(&self->node_mapping_heap)
+          + overlap_map_get_memory_usage(&self->overlap_counts);
+    usage[MSP_MEMORY_FENWICK] += fenwick_get_memory_usage(&self->event_rate_index);
+    usage[MSP_MEMORY_RATE_MAPS] = rate_map_get_memory_usage(&self->recomb_map)
+                                  + rate_map_get_memory_usage(&self->gc_map);
+    usage[MSP_MEMORY_EDGE_BUFFER]
+        = self->max_buffered_edges * sizeof(*self->buffered_edges);
+    usage[MSP_MEMORY_POPULATIONS] = msp_get_population_memory_usage(self);
+    usage[MSP_MEMORY_TABLES] = msp_get_table_memory_usage(self);
+    usage[MSP_MEMORY_BREAKPOINTS] = breakpoint_set_get_memory_usage(&self->breakpoints);
+    usage[MSP_MEMORY_SCRATCH] = scratch_buffer_get_memory_usage(&self->scratch);
+
+    for (j = 0; j < MSP_NUM_MEMORY_CATEGORIES; j++) {
+        self->memory_peak[j] = GSL_MAX(self->memory_peak[j], usage[j]);
+    }
+}
+
+/* Raises the peak memory usage of each category to match the current usage.
+ * This is called whenever the simulator grows one of its own structures,
+ * and before it releases any memory in the middle of a simulation. */
+static void
+msp_record_memory_peak(msp_t *self)
+{
+    size_t usage[MSP_NUM_MEMORY_CATEGORIES];
+
+    msp_update_memory_usage(self, usage);
+}
+
+static size_t
+msp_get_total_memory_usage(msp_t *self)
+{
+    size_t usage[MSP_NUM_MEMORY_CATEGORIES];
+    size_t j;
+    size_t ret = 0;
+
+    msp_update_memory_usage(self, usage);
+    for (j = 0; j < MSP_NUM_MEMORY_CATEGORIES; j++) {
+        ret += usage[j];
+    }
+    return ret;
+}
+
+/* Sets a function to be called from msp_run at most once in each interval
+ * of the specified number of seconds of wall-clock time. A NULL callback
+ * disables progress reporting. */
+int
+msp_set_progress_callback(
+    msp_t *self, msp_progress_callback_t callback, double interval, void *arg)
+{
+    int ret = 0;
+
+    if (!(interval >= 0)) {
+        ret = MSP_ERR_BAD_PARAM_VALUE;
+        goto out;
+    }
+    self->progress_callback = callback;
+    self->progress_interval = interval;
+    self->progress_callback_arg = arg;
+out:
+    return ret;
+}
+
 int
 msp_set_discrete_genome(msp_t *self, bool is_discrete)
 {
@@ -351,19 +805,20 @@ msp_set_gene_conversion_rate(msp_t *self, double rate)
 }
 
 static inline double
-msp_get_recomb_left_bound(msp_t *self, segment_t *seg)
+msp_get_recomb_left_bound(msp_t *self, segment_id_t seg)
 {
+    segment_pool_t *pool = &self->segments;
     double left_bound;
-    if (seg->prev == NULL) {
-        left_bound = self->discrete_genome ? seg->left + 1 : seg->left;
+    if (pool->prev[seg] == MSP_NULL_SEGMENT) {
+        left_bound = self->discrete_genome ? pool->left[seg] + 1 : pool->left[seg];
     } else {
-        left_bound = seg->prev->right;
+        left_bound = pool->right[pool->prev[seg]];
     }
     return left_bound;
 }
 
 static inline double
-msp_get_gc_left_bound(msp_t *self, segment_t *seg)
+msp_get_gc_left_bound(msp_t *self, segment_id_t seg)
 {
     return msp_get_recomb_left_bound(self, seg);
 }
@@ -371,41 +826,63 @@ msp_get_gc_left_bound(msp_t *self, segment_t *seg)
 /* Set the mass of the specified segment to that between the segment's right endpoint
  * and the right endpoint of the left tail segment.
  */
+/* Sets the recombination and gene conversion masses of a segment in
+ * whichever of the mass indexes exist. When both exist they are interleaved,
+ * and are updated together. */
+static inline void
+msp_set_mass_index_values(
+    msp_t *self, label_id_t label, size_t id, double recomb_mass, double gc_mass)
+{
+    if (self->recomb_mass_index != NULL && self->gc_mass_index != NULL) {
+        fenwick_set_value_pair(
+            &self->recomb_mass_index[label], id, recomb_mass, gc_mass);
+    } else if (self->recomb_mass_index != NULL) {
+        fenwick_set_value(&self->recomb_mass_index[label], id, recomb_mass);
+    } else if (self->gc_mass_index != NULL) {
+        fenwick_set_value(&self->gc_mass_index[label], id, gc_mass);
+    }
+}
+
 static void
-msp_set_segment_mass(msp_t *self, segment_t *seg)
+msp_set_segment_mass(msp_t *self, segment_id_t seg)
 {
-    double left_bound, mass;
+    segment_pool_t *pool = &self->segments;
+    double left_bound;
+    double recomb_mass = 0;
+    double gc_mass = 0;
 
+    self->num_segment_updates++;
     if (self->recomb_mass_index != NULL) {
         left_bound = msp_get_recomb_left_bound(self, seg);
-        mass = rate_map_mass_between(&self->recomb_map, left_bound, seg->right);
-        fenwick_set_value(&self->recomb_mass_index[seg->label], seg->id, mass);
+        recomb_mass
+            = rate_map_mass_between(&self->recomb_map, left_bound, pool->right[seg]);
     }
     if (self->gc_mass_index != NULL) {
         /* NOTE: it looks like the gc_left_bound doesn't actually give us the
          * right distribution of gc events, so we'll probably get rid of this
          * and use the same left bound for both. */
         left_bound = msp_get_gc_left_bound(self, seg);
-        mass = rate_map_mass_between(&self->gc_map, left_bound, seg->right);
-        fenwick_set_value(&self->gc_mass_index[seg->label], seg->id, mass);
+        gc_mass = rate_map_mass_between(&self->gc_map, left_bound, pool->right[seg]);
     }
+    msp_set_mass_index_values(self, pool->label[seg], seg, recomb_mass, gc_mass);
 }
 
 /* Add all extant segments into the indexes. */
 static void
 msp_reindex_segments(msp_t *self)
 {
-    avl_node_t *node;
-    avl_tree_t *population_ancestors;
-    segment_t *seg;
-    size_t j;
+    segment_pool_t *pool = &self->segments;
+    ancestor_set_t *population_ancestors;
+    segment_id_t seg;
+    size_t j, k;
     label_id_t label;
 
     for (j = 0; j < self->num_populations; j++) {
         for (label = 0; label < (label_id_t) self->num_labels; label++) {
             population_ancestors = &self->populations[j].ancestors[label];
-            for (node = population_ancestors->head; node != NULL; node = node->next) {
-                for (seg = (segment_t *) node->item; seg != NULL; seg = seg->next) {
+            for (k = 0; k < population_ancestors->num_lineages; k++) {
+                for (seg = population_ancestors->lineages[k]; seg != MSP_NULL_SEGMENT;
+                     seg = pool->next[seg]) {
                     msp_set_segment_mass(self, seg);
                 }
             }
@@ -413,6 +890,23 @@ msp_reindex_segments(msp_t *self)
     }
 }
 
+static int MSP_WARN_UNUSED
+msp_alloc_mass_index(msp_t *self, fenwick_t *index, size_t size, rate_map_t *rate_map)
+{
+    int ret;
+
+    if (self->exact_mass_index) {
+        /* No segment can have more mass than the whole map */
+        ret = fenwick_alloc_fixed_point(index, size, rate_map_get_total_mass(rate_map));
+    } else {
+        ret = fenwick_alloc(index, size);
+    }
+    if (ret == 0 && self->huge_pages) {
+        ret = fenwick_use_huge_pages(index);
+    }
+    return ret;
+}
+
 /* Setup the mass indexes either after a simulation model change
  * or during msp_initialise */
 static int
@@ -425,6 +919,7 @@ msp_setup_mass_indexes(msp_t *self)
 
     /* For simplicity, we always drop the mass indexes even though
      * sometimes we'll be dropping it just to rebuild */
+    msp_record_memory_peak(self);
     if (self->recomb_mass_index != NULL) {
         for (label = 0; label < (label_id_t) self->num_labels; label++) {
             fenwick_free(&self->recomb_mass_index[label]);
@@ -451,7 +946,6 @@ msp_setup_mass_indexes(msp_t *self)
         build_gc_mass_index = rate_map_get_total_mass(&self->gc_map) > 0;
     }
 
-    num_segments = self->segment_heap->size;
     if (build_recomb_mass_index) {
         self->recomb_mass_index
             = calloc(self->num_labels, sizeof(*self->recomb_mass_index));
@@ -460,7 +954,9 @@ msp_setup_mass_indexes(msp_t *self)
             goto out;
         }
         for (label = 0; label < (label_id_t) self->num_labels; label++) {
-            ret = fenwick_alloc(&self->recomb_mass_index[label], num_segments);
+            num_segments = segment_pool_get_size(&self->segments);
+            ret = msp_alloc_mass_index(
+                self, &self->recomb_mass_index[label], num_segments, &self->recomb_map);
             if (ret != 0) {
                 goto out;
             }
@@ -473,7 +969,19 @@ msp_setup_mass_indexes(msp_t *self)
             goto out;
         }
         for (label = 0; label < (label_id_t) self->num_labels; label++) {
-            ret = fenwick_alloc(&self->gc_mass_index[label], num_segments);
+            num_segments = segment_pool_get_size(&self->segments);
+            ret = msp_alloc_mass_index(
+                self, &self->gc_mass_index[label], num_segments, &self->gc_map);
+            if (ret != 0) {
+                goto out;
+            }
+        }
+    }
+
+    if (build_recomb_mass_index && build_gc_mass_index) {
+        for (label = 0; label < (label_id_t) self->num_labels; label++) {
+            ret = fenwick_interleave(
+                &self->recomb_mass_index[label], &self->gc_mass_index[label]);
             if (ret != 0) {
                 goto out;
             }
@@ -485,31 +993,147 @@ out:
     return ret;
 }
 
-static int
-msp_alloc_populations(msp_t *self)
+/* Indexed binary heap of channel firing times. Each channel is always
+ * present in the heap; channels that can never fire have time DBL_MAX. */
+
+static int MSP_WARN_UNUSED
+event_queue_alloc(event_queue_t *self, size_t size)
 {
     int ret = 0;
     size_t j;
-    size_t N = self->num_populations * self->num_populations;
 
-    self->initial_migration_matrix = calloc(N, sizeof(*self->initial_migration_matrix));
-    self->migration_matrix = calloc(N, sizeof(*self->migration_matrix));
-    self->num_migration_events = calloc(N, sizeof(*self->num_migration_events));
-    self->initial_populations
-        = calloc(self->num_populations, sizeof(*self->initial_populations));
-    self->populations = calloc(self->num_populations, sizeof(*self->populations));
+    memset(self, 0, sizeof(*self));
+    self->size = size;
+    self->time = malloc(size * sizeof(*self->time));
+    self->heap = malloc(size * sizeof(*self->heap));
+    self->position = malloc(size * sizeof(*self->position));
+    if (self->time == NULL || self->heap == NULL || self->position == NULL) {
+        ret = MSP_ERR_NO_MEMORY;
+        goto out;
+    }
+    for (j = 0; j < size; j++) {
+        self->time[j] = DBL_MAX;
+        self->heap[j] = j;
+        self->position[j] = j;
+    }
+out:
+    return ret;
+}
+
+static void
+event_queue_free(event_queue_t *self)
+{
+    msp_safe_free(self->time);
+    msp_safe_free(self->heap);
+    msp_safe_free(self->position);
+}
+
+static void
+event_queue_swap(event_queue_t *self, size_t j, size_t k)
+{
+    size_t tmp = self->heap[j];
+
+    self->heap[j] = self->heap[k];
+    self->heap[k] = tmp;
+    self->position[self->heap[j]] = j;
+    self->position[self->heap[k]] = k;
+}
+
+/* Sets the firing time for the specified channel and restores the
+ * heap property. */
+static void
+event_queue_update(event_queue_t *self, size_t channel, double time)
+{
+    const double *restrict t = self->time;
+    size_t j = self->position[channel];
+    size_t parent, child;
+
+    self->time[channel] = time;
+    while (j > 0) {
+        parent = (j - 1) / 2;
+        if (t[self->heap[parent]] <= t[self->heap[j]]) {
+            break;
+        }
+        event_queue_swap(self, j, parent);
+        j = parent;
+    }
+    while (true) {
+        child = 2 * j + 1;
+        if (child >= self->size) {
+            break;
+        }
+        if (child + 1 < self->size && t[self->heap[child + 1]] < t[self->heap[child]]) {
+            child++;
+        }
+        if (t[self->heap[j]] <= t[self->heap[child]]) {
+            break;
+        }
+        event_queue_swap(self, j, child);
+        j = child;
+    }
+}
+
+static inline size_t
+event_queue_get_min(event_queue_t *self)
+{
+    return self->heap[0];
+}
+
+static int
+msp_alloc_populations(msp_t *self)
+{
+    int ret = 0;
+    size_t j, num_channels;
+    population_t *pop;
+    size_t N = self->num_populations * self->num_populations;
+
+    self->initial_migration_matrix = calloc(N, sizeof(*self->initial_migration_matrix));
+    self->migration_matrix = calloc(N, sizeof(*self->migration_matrix));
+    self->num_migration_events = calloc(N, sizeof(*self->num_migration_events));
+    self->initial_populations
+        = calloc(self->num_populations, sizeof(*self->initial_populations));
+    self->populations = calloc(self->num_populations, sizeof(*self->populations));
+    self->dirty_populations
+        = malloc(self->num_populations * sizeof(*self->dirty_populations));
+    self->changed_migration_rows
+        = malloc(self->num_populations * sizeof(*self->changed_migration_rows));
+    self->migration_alias_work
+        = malloc(self->num_populations * sizeof(*self->migration_alias_work));
 
     if (self->migration_matrix == NULL || self->initial_migration_matrix == NULL
         || self->num_migration_events == NULL || self->initial_populations == NULL
-        || self->populations == NULL) {
+        || self->populations == NULL || self->dirty_populations == NULL
+        || self->changed_migration_rows == NULL || self->migration_alias_work == NULL) {
+        ret = MSP_ERR_NO_MEMORY;
+        goto out;
+    }
+    ret = fenwick_alloc(
+        &self->event_rate_index, MSP_NUM_EVENT_RATE_TYPES * self->num_populations);
+    if (ret != 0) {
+        goto out;
+    }
+    num_channels
+        = MSP_NUM_GLOBAL_CHANNELS + MSP_NUM_EVENT_RATE_TYPES * self->num_populations;
+    ret = event_queue_alloc(&self->event_queue, num_channels);
+    if (ret != 0) {
+        goto out;
+    }
+    self->channel_rate = calloc(num_channels, sizeof(*self->channel_rate));
+    if (self->channel_rate == NULL) {
         ret = MSP_ERR_NO_MEMORY;
         goto out;
     }
     for (j = 0; j < self->num_populations; j++) {
-        self->populations[j].potential_destinations
-            = malloc(self->num_populations
-                     * sizeof(*self->populations[j].potential_destinations));
-        if (self->populations[j].potential_destinations == NULL) {
+        pop = &self->populations[j];
+        pop->potential_destinations
+            = malloc(self->num_populations * sizeof(*pop->potential_destinations));
+        pop->migration_alias_probability = malloc(
+            self->num_populations * sizeof(*pop->migration_alias_probability));
+        pop->migration_alias
+            = malloc(self->num_populations * sizeof(*pop->migration_alias));
+        if (pop->potential_destinations == NULL
+            || pop->migration_alias_probability == NULL
+            || pop->migration_alias == NULL) {
             ret = MSP_ERR_NO_MEMORY;
             goto out;
         }
@@ -523,11 +1147,26 @@ out:
     return ret;
 }
 
+static void
+msp_free_ancestor_sets(msp_t *self)
+{
+    size_t j, k;
+
+    for (j = 0; j < self->num_populations; j++) {
+        if (self->populations[j].ancestors != NULL) {
+            for (k = 0; k < self->num_labels; k++) {
+                msp_safe_free(self->populations[j].ancestors[k].lineages);
+            }
+        }
+        msp_safe_free(self->populations[j].ancestors);
+    }
+}
+
 int
 msp_set_num_labels(msp_t *self, size_t num_labels)
 {
     int ret = 0;
-    size_t j, k;
+    size_t j;
 
     if (num_labels < 1 || num_labels > UINT32_MAX) {
         ret = MSP_ERR_BAD_PARAM_VALUE;
@@ -535,28 +1174,16 @@ msp_set_num_labels(msp_t *self, size_t num_labels)
     }
 
     /* Free any memory, if it has been allocated */
-    for (j = 0; j < self->num_populations; j++) {
-        msp_safe_free(self->populations[j].ancestors);
-    }
-    msp_safe_free(self->segment_heap);
+    msp_free_ancestor_sets(self);
 
     self->num_labels = (uint32_t) num_labels;
-    self->segment_heap = calloc(self->num_labels, sizeof(*self->segment_heap));
-    if (self->segment_heap == NULL) {
-        ret = MSP_ERR_NO_MEMORY;
-        goto out;
-    }
-
     for (j = 0; j < self->num_populations; j++) {
         self->populations[j].ancestors
-            = malloc(self->num_labels * sizeof(*self->populations[j].ancestors));
+            = calloc(self->num_labels, sizeof(*self->populations[j].ancestors));
         if (self->populations[j].ancestors == NULL) {
             ret = MSP_ERR_NO_MEMORY;
             goto out;
         }
-        for (k = 0; k < num_labels; k++) {
-            avl_init_tree(&self->populations[j].ancestors[k], cmp_individual, NULL);
-        }
     }
 out:
     return ret;
@@ -659,56 +1286,94 @@ out:
     return ret;
 }
 
-static segment_t *MSP_WARN_UNUSED
-msp_alloc_segment(msp_t *self, double left, double right, tsk_id_t value,
-    population_id_t population, label_id_t label, segment_t *prev, segment_t *next)
+/* Adds segment_block_size segments to the pool. The arrays and mass indexes
+ * that are indexed by segment are expanded to match before the pool itself,
+ * so that if any allocation fails the pool is unchanged and the expansion
+ * can be retried later. */
+static int MSP_WARN_UNUSED
+msp_expand_segments(msp_t *self)
 {
-    segment_t *seg = NULL;
+    int ret = 0;
+    const size_t size
+        = segment_pool_get_size(&self->segments) + self->segment_block_size;
+    label_id_t label;
+    fenwick_t *index;
+    void *p;
 
-    if (object_heap_empty(&self->segment_heap[label])) {
-        if (object_heap_expand(&self->segment_heap[label]) != 0) {
-            goto out;
-        }
+    if (size >= UINT32_MAX) {
+        ret = MSP_ERR_NO_MEMORY;
+        goto out;
+    }
+    p = realloc(self->ancestor_index, (size + 1) * sizeof(*self->ancestor_index));
+    if (p == NULL) {
+        ret = MSP_ERR_NO_MEMORY;
+        goto out;
+    }
+    self->ancestor_index = p;
+    for (label = 0; label < (label_id_t) self->num_labels; label++) {
+        index = NULL;
         if (self->recomb_mass_index != NULL) {
-            if (fenwick_expand(&self->recomb_mass_index[label], self->segment_block_size)
-                != 0) {
-                goto out;
-            }
+            index = &self->recomb_mass_index[label];
+        } else if (self->gc_mass_index != NULL) {
+            /* An interleaved gc index is expanded along with the recomb index */
+            index = &self->gc_mass_index[label];
         }
-        if (self->gc_mass_index != NULL) {
-            if (fenwick_expand(&self->gc_mass_index[label], self->segment_block_size)
-                != 0) {
+        if (index != NULL && fenwick_get_size(index) < size) {
+            ret = fenwick_expand(index, size - fenwick_get_size(index));
+            if (ret != 0) {
                 goto out;
             }
         }
     }
-    seg = (segment_t *) object_heap_alloc_object(&self->segment_heap[label]);
-    if (seg == NULL) {
+    ret = segment_pool_expand(&self->segments, self->segment_block_size);
+    if (ret != 0) {
         goto out;
     }
+    msp_record_memory_peak(self);
+out:
+    return ret;
+}
+
+static segment_id_t MSP_WARN_UNUSED
+msp_alloc_segment(msp_t *self, double left, double right, tsk_id_t value,
+    population_id_t population, label_id_t label, segment_id_t prev, segment_id_t next)
+{
+    segment_pool_t *pool = &self->segments;
+    segment_id_t seg;
+
+    seg = segment_pool_alloc(pool);
+    if (seg == MSP_NULL_SEGMENT) {
+        if (msp_expand_segments(self) != 0) {
+            goto out;
+        }
+        seg = segment_pool_alloc(pool);
+        tsk_bug_assert(seg != MSP_NULL_SEGMENT);
+    }
     tsk_bug_assert(left < right);
     if (self->recomb_mass_index != NULL) {
-        tsk_bug_assert(fenwick_get_value(&self->recomb_mass_index[label], seg->id) == 0);
+        tsk_bug_assert(fenwick_get_value(&self->recomb_mass_index[label], seg) == 0);
     }
     if (self->gc_mass_index != NULL) {
-        tsk_bug_assert(fenwick_get_value(&self->gc_mass_index[label], seg->id) == 0);
-    }
-    seg->prev = prev;
-    seg->next = next;
-    seg->left = left;
-    seg->right = right;
-    seg->value = value;
-    seg->population = population;
-    seg->label = label;
+        tsk_bug_assert(fenwick_get_value(&self->gc_mass_index[label], seg) == 0);
+    }
+    pool->prev[seg] = prev;
+    pool->next[seg] = next;
+    pool->left[seg] = left;
+    pool->right[seg] = right;
+    pool->value[seg] = value;
+    pool->population[seg] = population;
+    pool->label[seg] = label;
 out:
     return seg;
 }
 
-static segment_t *MSP_WARN_UNUSED
-msp_copy_segment(msp_t *self, const segment_t *seg)
+static segment_id_t MSP_WARN_UNUSED
+msp_copy_segment(msp_t *self, segment_id_t seg)
 {
-    return msp_alloc_segment(self, seg->left, seg->right, seg->value, seg->population,
-        seg->label, seg->prev, seg->next);
+    segment_pool_t *pool = &self->segments;
+
+    return msp_alloc_segment(self, pool->left[seg], pool->right[seg], pool->value[seg],
+        pool->population[seg], pool->label[seg], pool->prev[seg], pool->next[seg]);
 }
 
 /* Top level allocators and initialisation */
@@ -729,6 +1394,11 @@ msp_alloc(msp_t *self, tsk_table_collection_t *tables, gsl_rng *rng)
     ret = msp_set_simulation_model_hudson(self);
     tsk_bug_assert(ret == 0);
     self->rng = rng;
+    /* Variates are drawn directly from the generator by default */
+    ret = variate_buffer_alloc(&self->variates, rng, 0);
+    if (ret != 0) {
+        goto out;
+    }
     self->discrete_genome = true;
 
     self->tables = tables;
@@ -767,9 +1437,8 @@ msp_alloc(msp_t *self, tsk_table_collection_t *tables, gsl_rng *rng)
     self->avl_node_block_size = 1024;
     self->node_mapping_block_size = 1024;
     self->segment_block_size = 1024;
+    self->segment_compaction_threshold = 0.25;
     /* set up the AVL trees */
-    avl_init_tree(&self->breakpoints, cmp_node_mapping, NULL);
-    avl_init_tree(&self->overlap_counts, cmp_node_mapping, NULL);
     avl_init_tree(&self->non_empty_populations, cmp_pointer, NULL);
     /* Set up the demographic events */
     self->demographic_events_head = NULL;
@@ -778,6 +1447,7 @@ msp_alloc(msp_t *self, tsk_table_collection_t *tables, gsl_rng *rng)
     self->state = MSP_STATE_NEW;
     /* Set default to diploid */
     self->ploidy = 2;
+    self->wall_time_limit = DBL_MAX;
 out:
     return ret;
 }
@@ -786,26 +1456,40 @@ static int
 msp_alloc_memory_blocks(msp_t *self)
 {
     int ret = 0;
-    uint32_t j;
 
     /* Allocate the memory heaps */
-    ret = object_heap_init(
-        &self->avl_node_heap, sizeof(avl_node_t), self->avl_node_block_size, NULL);
+    ret = object_heap_init(&self->avl_node_heap, sizeof(segment_queue_node_t),
+        self->avl_node_block_size, NULL, self->huge_pages);
     if (ret != 0) {
         goto out;
     }
     ret = object_heap_init(&self->node_mapping_heap, sizeof(node_mapping_t),
-        self->node_mapping_block_size, NULL);
+        self->node_mapping_block_size, NULL, self->huge_pages);
+    if (ret != 0) {
+        goto out;
+    }
+    ret = breakpoint_set_init(&self->breakpoints, self->node_mapping_block_size);
+    if (ret != 0) {
+        goto out;
+    }
+    ret = overlap_map_init(&self->overlap_counts);
+    if (ret != 0) {
+        goto out;
+    }
+    ret = scratch_buffer_alloc(&self->scratch, MSP_SCRATCH_BUFFER_SIZE);
     if (ret != 0) {
         goto out;
     }
     /* allocate the segments */
-    for (j = 0; j < self->num_labels; j++) {
-        ret = object_heap_init(&self->segment_heap[j], sizeof(segment_t),
-            self->segment_block_size, segment_init);
-        if (ret != 0) {
-            goto out;
-        }
+    ret = segment_pool_init(&self->segments, self->segment_block_size, self->huge_pages);
+    if (ret != 0) {
+        goto out;
+    }
+    self->ancestor_index = malloc(
+        (self->segment_block_size + 1) * sizeof(*self->ancestor_index));
+    if (self->ancestor_index == NULL) {
+        ret = MSP_ERR_NO_MEMORY;
+        goto out;
     }
     /* Allocate the edge records */
     self->num_buffered_edges = 0;
@@ -852,17 +1536,27 @@ msp_free(msp_t *self)
         if (self->gc_mass_index != NULL) {
             fenwick_free(&self->gc_mass_index[j]);
         }
-        if (self->segment_heap != NULL) {
-            object_heap_free(&self->segment_heap[j]);
-        }
     }
+    msp_free_ancestor_sets(self);
+    breakpoint_set_free(&self->breakpoints);
+    overlap_map_free(&self->overlap_counts);
+    scratch_buffer_free(&self->scratch);
     for (j = 0; j < self->num_populations; j++) {
-        msp_safe_free(self->populations[j].ancestors);
         msp_safe_free(self->populations[j].potential_destinations);
+        msp_safe_free(self->populations[j].migration_alias_probability);
+        msp_safe_free(self->populations[j].migration_alias);
     }
     msp_safe_free(self->recomb_mass_index);
     msp_safe_free(self->gc_mass_index);
-    msp_safe_free(self->segment_heap);
+    fenwick_free(&self->event_rate_index);
+    event_queue_free(&self->event_queue);
+    msp_safe_free(self->channel_rate);
+    msp_safe_free(self->dirty_populations);
+    msp_safe_free(self->changed_migration_rows);
+    msp_safe_free(self->event_trace);
+    variate_buffer_free(&self->variates);
+    msp_safe_free(self->migration_alias_work);
+    msp_safe_free(self->ancestor_index);
     msp_safe_free(self->initial_migration_matrix);
     msp_safe_free(self->migration_matrix);
     msp_safe_free(self->num_migration_events);
@@ -875,6 +1569,7 @@ msp_free(msp_t *self)
     msp_safe_free(self->pedigree.individuals);
     msp_safe_free(self->pedigree.visit_order);
     /* free the object heaps */
+    segment_pool_free(&self->segments);
     object_heap_free(&self->avl_node_heap);
     object_heap_free(&self->node_mapping_heap);
     rate_map_free(&self->recomb_map);
@@ -895,6 +1590,7 @@ msp_alloc_avl_node(msp_t *self)
         if (object_heap_expand(&self->avl_node_heap) != 0) {
             goto out;
         }
+        msp_record_memory_peak(self);
     }
     ret = (avl_node_t *) object_heap_alloc_object(&self->avl_node_heap);
 out:
@@ -907,88 +1603,169 @@ msp_free_avl_node(msp_t *self, avl_node_t *node)
     object_heap_free_object(&self->avl_node_heap, node);
 }
 
-static inline node_mapping_t *
-msp_alloc_node_mapping(msp_t *self)
+/* Initialises the specified AVL node to hold the specified segment in a
+ * tree ordered by cmp_segment_queue. The segment's left coordinate is
+ * copied into the node, so must not change while the node is in a tree. */
+static inline void
+msp_init_segment_queue_node(msp_t *self, avl_node_t *node, segment_id_t u)
 {
-    node_mapping_t *ret = NULL;
+    segment_queue_node_t *queue_node = (segment_queue_node_t *) node;
 
-    if (object_heap_empty(&self->node_mapping_heap)) {
-        if (object_heap_expand(&self->node_mapping_heap) != 0) {
-            goto out;
-        }
-    }
-    ret = (node_mapping_t *) object_heap_alloc_object(&self->node_mapping_heap);
-out:
-    return ret;
+    queue_node->left = self->segments.left[u];
+    queue_node->segment = u;
+    avl_init_node(node, queue_node);
 }
 
-static void
-msp_free_node_mapping(msp_t *self, node_mapping_t *nm)
+static inline segment_id_t
+msp_get_queue_segment(avl_node_t *node)
 {
-    object_heap_free_object(&self->node_mapping_heap, nm);
+    return ((segment_queue_node_t *) node->item)->segment;
 }
 
 /*
- * Returns the segment with the specified id.
+ * Returns the segment at the specified index of the mass index for the
+ * specified label.
  */
-static segment_t *
-msp_get_segment(msp_t *self, size_t id, label_id_t label)
+static segment_id_t
+msp_get_indexed_segment(msp_t *self, size_t index, label_id_t label)
 {
-    segment_t *u = object_heap_get_object(&self->segment_heap[label], id - 1);
+    segment_id_t u = (segment_id_t) index;
 
-    tsk_bug_assert(u != NULL);
-    tsk_bug_assert(u->id == id);
+    tsk_bug_assert(u != MSP_NULL_SEGMENT && u <= segment_pool_get_size(&self->segments));
+    tsk_bug_assert(self->segments.label[u] == label);
     return u;
 }
 
 static void
-msp_free_segment(msp_t *self, segment_t *seg)
+msp_free_segment(msp_t *self, segment_id_t seg)
 {
-    object_heap_free_object(&self->segment_heap[seg->label], seg);
-    if (self->recomb_mass_index != NULL) {
-        fenwick_set_value(&self->recomb_mass_index[seg->label], seg->id, 0);
+    self->num_segment_updates++;
+    msp_set_mass_index_values(self, self->segments.label[seg], seg, 0, 0);
+    segment_pool_free_segment(&self->segments, seg);
+}
+
+static inline ancestor_set_t *
+msp_get_segment_population(msp_t *self, segment_id_t u)
+{
+    segment_pool_t *pool = &self->segments;
+
+    return &self->populations[pool->population[u]].ancestors[pool->label[u]];
+}
+
+/* Records that the number of ancestors in the specified population has
+ * changed, so that its entries in the event rate index must be updated. */
+static inline void
+msp_mark_population_dirty(msp_t *self, population_id_t population_id)
+{
+    population_t *pop = &self->populations[population_id];
+
+    if (!pop->event_rates_dirty) {
+        pop->event_rates_dirty = true;
+        self->dirty_populations[self->num_dirty_populations] = population_id;
+        self->num_dirty_populations++;
     }
-    if (self->gc_mass_index != NULL) {
-        fenwick_set_value(&self->gc_mass_index[seg->label], seg->id, 0);
+}
+
+/* Records that a row of the migration matrix has been changed by a
+ * demographic event, so that the destinations for the source population
+ * must be recomputed. */
+static void
+msp_mark_migration_row_changed(msp_t *self, population_id_t population_id)
+{
+    population_t *pop = &self->populations[population_id];
+
+    if (!pop->migration_row_changed) {
+        pop->migration_row_changed = true;
+        self->changed_migration_rows[self->num_changed_migration_rows] = population_id;
+        self->num_changed_migration_rows++;
     }
 }
 
-static inline avl_tree_t *
-msp_get_segment_population(msp_t *self, segment_t *u)
+/* Returns true if the waiting time until the next common ancestor event
+ * in the specified population is exponentially distributed with a rate that
+ * only changes when the number of lineages does. For these populations we
+ * store the rates in the event rate index; otherwise (under population growth
+ * or the multiple merger models) the waiting times are sampled per population.
+ */
+static bool
+msp_ca_rate_indexable(msp_t *self, population_t *pop)
+{
+    return (self->model.type == MSP_MODEL_HUDSON || self->model.type == MSP_MODEL_SMC
+               || self->model.type == MSP_MODEL_SMC_PRIME)
+           && pop->state == MSP_POP_STATE_ACTIVE && pop->growth_rate == 0.0
+           && pop->initial_size > 0.0;
+}
+
+/* Recomputes the constants for the current epoch of the specified population. */
+static void
+msp_update_population_epoch(msp_t *self, population_id_t population_id)
+{
+    population_t *pop = &self->populations[population_id];
+
+    pop->ploidy_size = self->ploidy * pop->initial_size;
+    pop->growth_scale = self->ploidy * pop->growth_rate * pop->initial_size;
+    pop->ca_rate_indexed = msp_ca_rate_indexable(self, pop);
+}
+
+/* Records that the size, growth rate or state of the specified population
+ * has been changed by a demographic event. */
+static void
+msp_mark_population_parameters_changed(msp_t *self, population_id_t population_id)
 {
-    return &self->populations[u->population].ancestors[u->label];
+    self->population_parameters_changed = true;
+    msp_update_population_epoch(self, population_id);
+    msp_mark_population_dirty(self, population_id);
 }
 
 static inline int MSP_WARN_UNUSED
-msp_insert_individual(msp_t *self, segment_t *u)
+msp_insert_individual(msp_t *self, segment_id_t u)
 {
+    segment_pool_t *pool = &self->segments;
     int ret = 0;
-    avl_node_t *node;
-
-    tsk_bug_assert(u != NULL);
-    node = msp_alloc_avl_node(self);
-    if (node == NULL) {
-        ret = MSP_ERR_NO_MEMORY;
-        goto out;
+    ancestor_set_t *pop;
+    segment_id_t *p;
+    size_t max_lineages;
+
+    tsk_bug_assert(u != MSP_NULL_SEGMENT);
+    pop = msp_get_segment_population(self, u);
+    if (pop->num_lineages == pop->max_lineages) {
+        max_lineages = GSL_MAX(2 * pop->max_lineages, 64);
+        p = realloc(pop->lineages, max_lineages * sizeof(*pop->lineages));
+        if (p == NULL) {
+            ret = MSP_ERR_NO_MEMORY;
+            goto out;
+        }
+        pop->lineages = p;
+        pop->max_lineages = max_lineages;
+        msp_record_memory_peak(self);
     }
-    avl_init_node(node, u);
-    node = avl_insert_node(msp_get_segment_population(self, u), node);
-    tsk_bug_assert(node != NULL);
+    pop->lineages[pop->num_lineages] = u;
+    self->ancestor_index[u] = (uint32_t) pop->num_lineages;
+    pop->num_lineages++;
+    msp_mark_population_dirty(self, pool->population[u]);
 out:
     return ret;
 }
 
+/* Removes the lineage with the specified head segment from its population,
+ * moving the last lineage in the population into its place. */
 static inline void
-msp_remove_individual(msp_t *self, segment_t *u)
+msp_remove_individual(msp_t *self, segment_id_t u)
 {
-    avl_node_t *node;
-    avl_tree_t *pop = msp_get_segment_population(self, u);
+    segment_pool_t *pool = &self->segments;
+    ancestor_set_t *pop;
+    segment_id_t last;
+    uint32_t j;
 
-    tsk_bug_assert(u != NULL);
-    node = avl_search(pop, u);
-    tsk_bug_assert(node != NULL);
-    avl_unlink_node(pop, node);
-    msp_free_avl_node(self, node);
+    tsk_bug_assert(u != MSP_NULL_SEGMENT);
+    pop = msp_get_segment_population(self, u);
+    j = self->ancestor_index[u];
+    tsk_bug_assert(j < pop->num_lineages && pop->lineages[j] == u);
+    pop->num_lineages--;
+    last = pop->lineages[pop->num_lineages];
+    pop->lineages[j] = last;
+    self->ancestor_index[last] = j;
+    msp_mark_population_dirty(self, pool->population[u]);
 }
 
 static void
@@ -996,52 +1773,37 @@ msp_remove_individuals_from_population(msp_t *self, avl_tree_t *Q)
 {
     avl_node_t *node;
     for (node = Q->head; node != NULL; node = node->next) {
-        msp_remove_individual(self, (segment_t *) node->item);
+        msp_remove_individual(self, msp_get_queue_segment(node));
     }
 }
 
 /* Returns true if the specified breakpoint exists */
-static bool
+static inline bool
 msp_has_breakpoint(msp_t *self, double x)
 {
-    node_mapping_t search;
-    search.position = x;
-
-    return avl_search(&self->breakpoints, &search) != NULL;
+    return breakpoint_set_contains(&self->breakpoints, x);
 }
 
 /*
  * Inserts a new breakpoint at the specified locus left.
  */
-static int MSP_WARN_UNUSED
+static inline int MSP_WARN_UNUSED
 msp_insert_breakpoint(msp_t *self, double left)
 {
-    int ret = 0;
-    avl_node_t *node = msp_alloc_avl_node(self);
-    node_mapping_t *m = msp_alloc_node_mapping(self);
-
-    if (node == NULL || m == NULL) {
-        ret = MSP_ERR_NO_MEMORY;
-        goto out;
-    }
-    m->position = left;
-    m->value = 0;
-    avl_init_node(node, m);
-    node = avl_insert_node(&self->breakpoints, node);
-    tsk_bug_assert(node != NULL);
-out:
-    return ret;
+    return breakpoint_set_insert(&self->breakpoints, left);
 }
 
 static void
-msp_print_segment_chain(msp_t *MSP_UNUSED(self), segment_t *head, FILE *out)
+msp_print_segment_chain(msp_t *self, segment_id_t head, FILE *out)
 {
-    segment_t *s = head;
+    segment_pool_t *pool = &self->segments;
+    segment_id_t s = head;
 
-    fprintf(out, "[pop=%d,label=%d]", s->population, s->label);
-    while (s != NULL) {
-        fprintf(out, "[(%.14g,%.14g) %d] ", s->left, s->right, (int) s->value);
-        s = s->next;
+    fprintf(out, "[pop=%d,label=%d]", pool->population[s], pool->label[s]);
+    while (s != MSP_NULL_SEGMENT) {
+        fprintf(out, "[(%.14g,%.14g) %d] ", pool->left[s], pool->right[s],
+            (int) pool->value[s]);
+        s = pool->next[s];
     }
     fprintf(out, "\n");
 }
@@ -1051,40 +1813,48 @@ static void
 msp_verify_segment_index(
     msp_t *self, fenwick_t *mass_index_array, rate_map_t *rate_map, bool left_at_zero)
 {
-
+    segment_pool_t *pool = &self->segments;
     double left, right, left_bound;
     double s, ss, total_mass, alt_total_mass;
-    size_t j, k;
+    uint64_t fixed_total_mass;
+    size_t j, k, l;
     const double epsilon = 1e-10;
-    avl_node_t *node;
-    segment_t *u;
+    ancestor_set_t *ancestors;
+    segment_id_t u;
 
     for (k = 0; k < self->num_labels; k++) {
         total_mass = 0;
         alt_total_mass = 0;
+        fixed_total_mass = 0;
         for (j = 0; j < self->num_populations; j++) {
-            node = (&self->populations[j].ancestors[k])->head;
-            while (node != NULL) {
-                u = (segment_t *) node->item;
-                left = u->left;
-                while (u != NULL) {
-                    if (u->prev != NULL) {
-                        s = rate_map_mass_between(rate_map, u->prev->right, u->right);
+            ancestors = &self->populations[j].ancestors[k];
+            for (l = 0; l < ancestors->num_lineages; l++) {
+                u = ancestors->lineages[l];
+                left = pool->left[u];
+                while (u != MSP_NULL_SEGMENT) {
+                    if (pool->prev[u] != MSP_NULL_SEGMENT) {
+                        s = rate_map_mass_between(
+                            rate_map, pool->right[pool->prev[u]], pool->right[u]);
                     } else {
                         if (left_at_zero) {
                             left_bound = self->discrete_genome ? 1 : 0;
                         } else {
-                            left_bound = self->discrete_genome ? u->left + 1 : u->left;
+                            left_bound = self->discrete_genome ? pool->left[u] + 1
+                                                               : pool->left[u];
                         }
-                        tsk_bug_assert(left_bound <= u->right);
-                        s = rate_map_mass_between(rate_map, left_bound, u->right);
+                        tsk_bug_assert(left_bound <= pool->right[u]);
+                        s = rate_map_mass_between(rate_map, left_bound, pool->right[u]);
                     }
                     tsk_bug_assert(s >= 0);
-                    ss = fenwick_get_value(&mass_index_array[k], u->id);
+                    ss = fenwick_get_value(&mass_index_array[k], u);
                     tsk_bug_assert(doubles_almost_equal(s, ss, epsilon));
                     total_mass += ss;
-                    right = u->right;
-                    u = u->next;
+                    if (fenwick_is_fixed_point(&mass_index_array[k])) {
+                        fixed_total_mass
+                            += fenwick_get_fixed_value(&mass_index_array[k], u);
+                    }
+                    right = pool->right[u];
+                    u = pool->next[u];
                 }
                 if (left_at_zero) {
                     left_bound = self->discrete_genome ? 1 : 0;
@@ -1093,9 +1863,12 @@ msp_verify_segment_index(
                 }
                 s = rate_map_mass_between(rate_map, left_bound, right);
                 alt_total_mass += s;
-                node = node->next;
             }
         }
+        if (fenwick_is_fixed_point(&mass_index_array[k])) {
+            tsk_bug_assert(
+                fixed_total_mass == fenwick_get_fixed_total(&mass_index_array[k]));
+        }
         tsk_bug_assert(doubles_almost_equal(
             total_mass, fenwick_get_total(&mass_index_array[k]), epsilon));
         tsk_bug_assert(doubles_almost_equal(total_mass, alt_total_mass, epsilon));
@@ -1105,57 +1878,57 @@ msp_verify_segment_index(
 static void
 msp_verify_segments(msp_t *self, bool verify_breakpoints)
 {
+    segment_pool_t *pool = &self->segments;
     size_t j, k;
-    size_t label_segments = 0;
+    size_t num_segments;
     size_t total_avl_nodes = 0;
     size_t num_root_segments = 0;
     size_t pedigree_avl_nodes = 0;
-    avl_node_t *node;
-    segment_t *u;
+    size_t l;
+    ancestor_set_t *ancestors;
+    segment_id_t u;
     individual_t *ind;
 
     for (j = 0; j < self->input_position.nodes; j++) {
-        for (u = self->root_segments[j]; u != NULL; u = u->next) {
+        for (u = self->root_segments[j]; u != MSP_NULL_SEGMENT; u = pool->next[u]) {
             num_root_segments++;
         }
     }
 
+    num_segments = num_root_segments;
     for (k = 0; k < self->num_labels; k++) {
-        label_segments = 0;
-        if (k == 0) {
-            label_segments += num_root_segments;
-        }
         for (j = 0; j < self->num_populations; j++) {
-            node = (&self->populations[j].ancestors[k])->head;
-            while (node != NULL) {
-                u = (segment_t *) node->item;
-                tsk_bug_assert(u->prev == NULL);
-                while (u != NULL) {
-                    label_segments++;
-                    tsk_bug_assert(u->population == (population_id_t) j);
-                    tsk_bug_assert(u->label == (label_id_t) k);
-                    tsk_bug_assert(u->left < u->right);
-                    tsk_bug_assert(u->right <= self->sequence_length);
-                    if (u->prev != NULL) {
-                        tsk_bug_assert(u->prev->next == u);
+            ancestors = &self->populations[j].ancestors[k];
+            tsk_bug_assert(ancestors->num_lineages <= ancestors->max_lineages);
+            for (l = 0; l < ancestors->num_lineages; l++) {
+                u = ancestors->lineages[l];
+                tsk_bug_assert(pool->prev[u] == MSP_NULL_SEGMENT);
+                tsk_bug_assert(self->ancestor_index[u] == l);
+                while (u != MSP_NULL_SEGMENT) {
+                    num_segments++;
+                    tsk_bug_assert(pool->population[u] == (population_id_t) j);
+                    tsk_bug_assert(pool->label[u] == (label_id_t) k);
+                    tsk_bug_assert(pool->left[u] < pool->right[u]);
+                    tsk_bug_assert(pool->right[u] <= self->sequence_length);
+                    if (pool->prev[u] != MSP_NULL_SEGMENT) {
+                        tsk_bug_assert(pool->next[pool->prev[u]] == u);
                     }
-                    if (verify_breakpoints && u->left != 0) {
-                        tsk_bug_assert(msp_has_breakpoint(self, u->left));
+                    if (verify_breakpoints && pool->left[u] != 0) {
+                        tsk_bug_assert(msp_has_breakpoint(self, pool->left[u]));
                     }
                     if (self->discrete_genome) {
-                        tsk_bug_assert(floor(u->left) == u->left);
+                        tsk_bug_assert(floor(pool->left[u]) == pool->left[u]);
                     }
-                    u = u->next;
+                    u = pool->next[u];
                 }
-                node = node->next;
             }
         }
-        tsk_bug_assert(
-            label_segments == object_heap_get_num_allocated(&self->segment_heap[k]));
     }
-    total_avl_nodes = msp_get_num_ancestors(self) + avl_count(&self->breakpoints)
-                      + avl_count(&self->overlap_counts)
-                      + avl_count(&self->non_empty_populations);
+    tsk_bug_assert(num_segments == segment_pool_get_num_allocated(pool));
+    segment_pool_verify(pool);
+    breakpoint_set_verify(&self->breakpoints);
+    overlap_map_verify(&self->overlap_counts);
+    total_avl_nodes = avl_count(&self->non_empty_populations);
     for (j = 0; j < self->pedigree.num_individuals; j++) {
         ind = &self->pedigree.individuals[j];
         for (k = 0; k < self->ploidy; k++) {
@@ -1164,9 +1937,7 @@ msp_verify_segments(msp_t *self, bool verify_breakpoints)
     }
     tsk_bug_assert(total_avl_nodes + pedigree_avl_nodes
                    == object_heap_get_num_allocated(&self->avl_node_heap));
-    tsk_bug_assert(total_avl_nodes - msp_get_num_ancestors(self)
-                       - avl_count(&self->non_empty_populations)
-                   == object_heap_get_num_allocated(&self->node_mapping_heap));
+    tsk_bug_assert(object_heap_get_num_allocated(&self->node_mapping_heap) == 0);
     if (self->recomb_mass_index != NULL) {
         msp_verify_segment_index(
             self, self->recomb_mass_index, &self->recomb_map, false);
@@ -1186,9 +1957,19 @@ msp_verify_segments(msp_t *self, bool verify_breakpoints)
     }
 }
 
+/* An interval of the genome in an overlap_counter_t, with the number of
+ * segments that overlap it. */
+typedef struct _overlap_interval_t {
+    double left;
+    double right;
+    int value;
+    struct _overlap_interval_t *prev;
+    struct _overlap_interval_t *next;
+} overlap_interval_t;
+
 typedef struct {
     double seq_length;
-    segment_t *overlaps;
+    overlap_interval_t *overlaps;
 } overlap_counter_t;
 
 static int
@@ -1197,7 +1978,7 @@ overlap_counter_alloc(overlap_counter_t *self, double seq_length, int initial_co
     int ret = 0;
     memset(self, 0, sizeof(overlap_counter_t));
 
-    segment_t *overlaps = malloc(sizeof(segment_t));
+    overlap_interval_t *overlaps = malloc(sizeof(overlap_interval_t));
     if (overlaps == NULL) {
         ret = MSP_ERR_NO_MEMORY;
         goto out;
@@ -1208,8 +1989,6 @@ overlap_counter_alloc(overlap_counter_t *self, double seq_length, int initial_co
     overlaps->left = 0;
     overlaps->right = seq_length;
     overlaps->value = initial_count;
-    overlaps->population = 0;
-    overlaps->label = 0;
 
     self->seq_length = seq_length;
     self->overlaps = overlaps;
@@ -1221,7 +2000,7 @@ out:
 static void
 overlap_counter_free(overlap_counter_t *self)
 {
-    segment_t *curr_overlap, *next_overlap;
+    overlap_interval_t *curr_overlap, *next_overlap;
 
     tsk_bug_assert(self->overlaps->prev == NULL);
     curr_overlap = self->overlaps;
@@ -1237,7 +2016,7 @@ static uint32_t
 overlap_counter_overlaps_at(overlap_counter_t *self, double pos)
 {
     tsk_bug_assert(pos >= 0 && pos < self->seq_length);
-    segment_t *curr_overlap = self->overlaps;
+    overlap_interval_t *curr_overlap = self->overlaps;
     while (curr_overlap->next != NULL) {
         if (curr_overlap->left <= pos && pos < curr_overlap->right) {
             break;
@@ -1253,16 +2032,14 @@ overlap_counter_overlaps_at(overlap_counter_t *self, double pos)
  * right endpoint to breakpoint.
  */
 static void
-overlap_counter_split_segment(segment_t *seg, double breakpoint)
+overlap_counter_split_segment(overlap_interval_t *seg, double breakpoint)
 {
-    segment_t *right_seg = malloc(sizeof(segment_t));
+    overlap_interval_t *right_seg = malloc(sizeof(overlap_interval_t));
     right_seg->prev = NULL;
     right_seg->next = NULL;
     right_seg->left = breakpoint;
     right_seg->right = seg->right;
     right_seg->value = seg->value;
-    right_seg->population = 0;
-    right_seg->label = 0;
 
     if (seg->next != NULL) {
         right_seg->next = seg->next;
@@ -1279,7 +2056,7 @@ overlap_counter_split_segment(segment_t *seg, double breakpoint)
 static void
 overlap_counter_increment_interval(overlap_counter_t *self, double left, double right)
 {
-    segment_t *curr_interval = self->overlaps;
+    overlap_interval_t *curr_interval = self->overlaps;
     while (left < right) {
         if (curr_interval->left == left) {
             if (curr_interval->right <= right) {
@@ -1305,13 +2082,15 @@ overlap_counter_increment_interval(overlap_counter_t *self, double left, double
 static void
 msp_verify_overlaps(msp_t *self)
 {
-    avl_node_t *node;
-    node_mapping_t *nm;
+    segment_pool_t *pool = &self->segments;
+    overlap_map_cursor_t cursor;
     sampling_event_t se;
-    segment_t *u;
-    size_t j;
+    segment_id_t u;
+    size_t j, k;
     uint32_t label, count;
+    ancestor_set_t *ancestors;
     overlap_counter_t counter;
+    bool more;
 
     int ok = overlap_counter_alloc(&counter, self->sequence_length, 0);
     tsk_bug_assert(ok == 0);
@@ -1319,25 +2098,34 @@ msp_verify_overlaps(msp_t *self)
     /* add in the overlaps for ancient samples */
     for (j = self->next_sampling_event; j < self->num_sampling_events; j++) {
         se = self->sampling_events[j];
-        for (u = self->root_segments[se.sample]; u != NULL; u = u->next) {
-            overlap_counter_increment_interval(&counter, u->left, u->right);
+        for (u = self->root_segments[se.sample]; u != MSP_NULL_SEGMENT;
+             u = pool->next[u]) {
+            overlap_counter_increment_interval(&counter, pool->left[u], pool->right[u]);
         }
     }
 
     for (label = 0; label < self->num_labels; label++) {
         for (j = 0; j < self->num_populations; j++) {
-            for (node = (&self->populations[j].ancestors[label])->head; node != NULL;
-                 node = node->next) {
-                for (u = (segment_t *) node->item; u != NULL; u = u->next) {
-                    overlap_counter_increment_interval(&counter, u->left, u->right);
+            ancestors = &self->populations[j].ancestors[label];
+            for (k = 0; k < ancestors->num_lineages; k++) {
+                for (u = ancestors->lineages[k]; u != MSP_NULL_SEGMENT;
+                     u = pool->next[u]) {
+                    overlap_counter_increment_interval(
+                        &counter, pool->left[u], pool->right[u]);
                 }
             }
         }
     }
-    for (node = self->overlap_counts.head; node->next != NULL; node = node->next) {
-        nm = (node_mapping_t *) node->item;
-        count = overlap_counter_overlaps_at(&counter, nm->position);
-        tsk_bug_assert(nm->value == count);
+    /* The last item is at the end of the sequence, where there are no
+     * segments. */
+    more = overlap_map_first(&self->overlap_counts, &cursor);
+    tsk_bug_assert(more);
+    for (j = 1; j < overlap_map_get_num_items(&self->overlap_counts); j++) {
+        count = overlap_counter_overlaps_at(
+            &counter, overlap_map_get_position(&self->overlap_counts, &cursor));
+        tsk_bug_assert(overlap_map_get_count(&self->overlap_counts, &cursor) == count);
+        more = overlap_map_next(&self->overlap_counts, &cursor);
+        tsk_bug_assert(more);
     }
 
     overlap_counter_free(&counter);
@@ -1373,9 +2161,12 @@ msp_verify_migration_destinations(msp_t *self)
     tsk_id_t j, k, i;
     tsk_id_t N = (tsk_id_t) self->num_populations;
     double *M = self->migration_matrix;
+    double *weights = malloc(self->num_populations * sizeof(*weights));
+    double D, p, total;
     population_t *pop;
     bool found;
 
+    tsk_bug_assert(weights != NULL);
     for (j = 0; j < N; j++) {
         pop = &self->populations[j];
         for (k = 0; k < (tsk_id_t) pop->num_potential_destinations; k++) {
@@ -1395,15 +2186,94 @@ msp_verify_migration_destinations(msp_t *self)
             tsk_bug_assert(found == (M[j * N + k] != 0));
         }
     }
+    /* Check that the alias tables reproduce the migration rates */
+    for (j = 0; j < N; j++) {
+        pop = &self->populations[j];
+        D = (double) pop->num_potential_destinations;
+        total = 0;
+        for (k = 0; k < N; k++) {
+            total += M[j * N + k];
+            weights[k] = 0;
+        }
+        tsk_bug_assert(gsl_fcmp(total, pop->total_migration_rate, 1e-9) == 0
+                       || total == pop->total_migration_rate);
+        for (i = 0; i < (tsk_id_t) pop->num_potential_destinations; i++) {
+            p = pop->migration_alias_probability[i];
+            tsk_bug_assert(p >= 0 && p <= 1.0);
+            weights[pop->potential_destinations[i]] += p / D;
+            k = pop->migration_alias[i];
+            weights[pop->potential_destinations[k]] += (1 - p) / D;
+        }
+        for (k = 0; k < N; k++) {
+            tsk_bug_assert(fabs(weights[k] - M[j * N + k] / total) < 1e-9
+                           || M[j * N + k] == 0);
+        }
+    }
+    free(weights);
+}
+
+/* Returns true if the common ancestor rates for all populations that can
+ * contain lineages are stored in the event rate index. */
+static bool
+msp_ca_rates_indexable(msp_t *self)
+{
+    bool ret = true;
+    size_t j;
+
+    for (j = 0; j < self->num_populations && ret; j++) {
+        /* Lineages can only be present in active populations */
+        if (self->populations[j].state == MSP_POP_STATE_ACTIVE
+            && !self->populations[j].ca_rate_indexed) {
+            ret = false;
+        }
+    }
+    return ret;
+}
+
+/* Checks that the event rate index agrees with the current state for all
+ * populations that have not been marked as changed. */
+static void
+msp_verify_event_rates(msp_t *self)
+{
+    tsk_id_t j;
+    population_t *pop;
+    fenwick_t *index = &self->event_rate_index;
+    size_t k;
+    double n, ca_rate, migration_rate;
+
+    if (!self->population_parameters_changed) {
+        tsk_bug_assert(self->ca_rates_indexed == msp_ca_rates_indexable(self));
+    }
+    for (j = 0; j < (tsk_id_t) self->num_populations; j++) {
+        pop = &self->populations[j];
+        tsk_bug_assert(pop->ca_rate_indexed == msp_ca_rate_indexable(self, pop));
+        tsk_bug_assert(pop->ploidy_size == self->ploidy * pop->initial_size);
+        tsk_bug_assert(
+            pop->growth_scale == self->ploidy * pop->growth_rate * pop->initial_size);
+        if (pop->event_rates_dirty || pop->migration_row_changed) {
+            continue;
+        }
+        n = (double) pop->ancestors[0].num_lineages;
+        ca_rate = 0;
+        if (pop->ca_rate_indexed && n > 1) {
+            ca_rate = n * (n - 1.0) / 2.0 / pop->ploidy_size;
+        }
+        migration_rate = n * pop->total_migration_rate;
+        k = ((size_t) j) * MSP_NUM_EVENT_RATE_TYPES + 1;
+        tsk_bug_assert(fenwick_get_value(index, k + MSP_EVENT_RATE_CA) == ca_rate);
+        tsk_bug_assert(
+            fenwick_get_value(index, k + MSP_EVENT_RATE_MIGRATION) == migration_rate);
+    }
 }
 
 static void
 msp_verify_initial_state(msp_t *self)
 {
+    segment_pool_t *pool = &self->segments;
     overlap_count_t *overlap;
     double last_overlap_left = -1;
     tsk_size_t j;
-    segment_t *head, *seg, *prev;
+    segment_id_t head, seg, prev;
 
     for (overlap = self->initial_overlaps; overlap->left < self->sequence_length;
          overlap++) {
@@ -1420,16 +2290,16 @@ msp_verify_initial_state(msp_t *self)
     /* Check the root segments */
     for (j = 0; j < self->input_position.nodes; j++) {
         head = self->root_segments[j];
-        if (head != NULL) {
-            prev = NULL;
-            for (seg = head; seg != NULL; seg = seg->next) {
-                if (prev != NULL) {
-                    tsk_bug_assert(prev->next == seg);
-                    tsk_bug_assert(seg->prev == prev);
-                    tsk_bug_assert(prev->right <= seg->left);
+        if (head != MSP_NULL_SEGMENT) {
+            prev = MSP_NULL_SEGMENT;
+            for (seg = head; seg != MSP_NULL_SEGMENT; seg = pool->next[seg]) {
+                if (prev != MSP_NULL_SEGMENT) {
+                    tsk_bug_assert(pool->next[prev] == seg);
+                    tsk_bug_assert(pool->prev[seg] == prev);
+                    tsk_bug_assert(pool->right[prev] <= pool->left[seg]);
                 }
-                tsk_bug_assert(seg->left < seg->right);
-                tsk_bug_assert(seg->value == (tsk_id_t) j);
+                tsk_bug_assert(pool->left[seg] < pool->right[seg]);
+                tsk_bug_assert(pool->value[seg] == (tsk_id_t) j);
                 prev = seg;
             }
         }
@@ -1459,6 +2329,7 @@ msp_verify(msp_t *self, int options)
     if (self->model.type == MSP_MODEL_HUDSON && self->state == MSP_STATE_SIMULATING) {
         msp_verify_non_empty_populations(self);
         msp_verify_migration_destinations(self);
+        msp_verify_event_rates(self);
     }
     if (self->model.type == MSP_MODEL_WF_PED) {
         msp_verify_pedigree(self);
@@ -1507,16 +2378,17 @@ msp_pedigree_print_state(msp_t *self, FILE *out)
 static void
 msp_print_root_segments(msp_t *self, FILE *out)
 {
-    segment_t *seg, *head;
+    segment_pool_t *pool = &self->segments;
+    segment_id_t seg, head;
     tsk_size_t j;
 
     fprintf(out, "Root segments\n");
     for (j = 0; j < self->input_position.nodes; j++) {
         head = self->root_segments[j];
-        if (head != NULL) {
+        if (head != MSP_NULL_SEGMENT) {
             fprintf(out, "\t%d", (int) j);
-            for (seg = head; seg != NULL; seg = seg->next) {
-                fprintf(out, "(%f, %f)", seg->left, seg->right);
+            for (seg = head; seg != MSP_NULL_SEGMENT; seg = pool->next[seg]) {
+                fprintf(out, "(%f, %f)", pool->left[seg], pool->right[seg]);
             }
             fprintf(out, "\n");
         }
@@ -1538,19 +2410,36 @@ msp_print_initial_overlaps(msp_t *self, FILE *out)
     fprintf(out, "\t%f -> %d\n", overlap->left, (int) overlap->count);
 }
 
+static void
+msp_print_event_trace(msp_t *self, FILE *out)
+{
+    size_t j, num_records = msp_get_num_event_trace_records(self);
+    size_t start = self->num_traced_events - num_records;
+    event_trace_record_t *record;
+
+    fprintf(out, "event trace: size = %d, num_events = %d\n",
+        (int) self->event_trace_size, (int) self->num_traced_events);
+    for (j = 0; j < num_records; j++) {
+        record = &self->event_trace[(start + j) % self->event_trace_size];
+        fprintf(out, "\t%.14g\t%s\tpopulation=%d\tlabel=%d\tsegments=%d\tedges=%d\n",
+            record->time, msp_trace_event_names[record->type], (int) record->population,
+            (int) record->label, (int) record->num_segments, (int) record->num_edges);
+    }
+}
+
 int
 msp_print_state(msp_t *self, FILE *out)
 {
+    segment_pool_t *pool = &self->segments;
     int ret = 0;
     avl_node_t *a;
-    node_mapping_t *nm;
-    segment_t *u;
+    segment_id_t u;
     tsk_edge_t *edge;
     demographic_event_t *de;
     sampling_event_t *se;
     double v;
     uint32_t j, k;
-    segment_t **ancestors = malloc(msp_get_num_ancestors(self) * sizeof(segment_t *));
+    segment_id_t *ancestors = malloc(msp_get_num_ancestors(self) * sizeof(segment_id_t));
 
     if (ancestors == NULL && msp_get_num_ancestors(self) != 0) {
         ret = MSP_ERR_NO_MEMORY;
@@ -1576,6 +2465,24 @@ msp_print_state(msp_t *self, FILE *out)
     fprintf(out, "L = %.14g\n", self->sequence_length);
     fprintf(out, "discrete_genome = %d\n", self->discrete_genome);
     fprintf(out, "start_time = %f\n", self->start_time);
+    fprintf(out, "instrumentation = %d\n", self->instrumentation);
+    fprintf(out, "wall_time_limit = %.14g\n", self->wall_time_limit);
+    fprintf(out, "memory_limit = %lu\n", (unsigned long) self->memory_limit);
+    for (j = 0; j < MSP_NUM_MEMORY_CATEGORIES; j++) {
+        fprintf(out, "\tpeak %s memory = %lu\n", msp_memory_category_names[j],
+            (unsigned long) self->memory_peak[j]);
+    }
+    fprintf(out, "variate_buffer_size = %d\n", (int) self->variates.size);
+    fprintf(out, "exact_mass_index = %d\n", self->exact_mass_index);
+    fprintf(out, "huge_pages = %d\n", self->huge_pages);
+    fprintf(out, "progress_interval = %.14g\n", self->progress_interval);
+    if (self->instrumentation) {
+        for (j = 0; j < MSP_NUM_TIMERS; j++) {
+            fprintf(out, "\t%s: calls = %d, elapsed = %f\n", msp_timer_names[j],
+                (int) self->timer_calls[j], self->timer_elapsed[j]);
+        }
+    }
+    msp_print_event_trace(self, out);
     fprintf(out, "recombination map:\n");
     rate_map_print_state(&self->recomb_map, out);
     fprintf(out, "gene_conversion_tract_length = %f\n", self->gc_tract_length);
@@ -1625,7 +2532,7 @@ msp_print_state(msp_t *self, FILE *out)
                                         : fenwick_get_total(&self->gc_mass_index[j]));
         for (k = 0; k < self->num_populations; k++) {
             fprintf(out, "\tpop_size[%d] = %d\n", k,
-                avl_count(&self->populations[k].ancestors[j]));
+                (int) self->populations[k].ancestors[j].num_lineages);
         }
     }
     fprintf(out, "non_empty_populations = [");
@@ -1647,7 +2554,20 @@ msp_print_state(msp_t *self, FILE *out)
             fprintf(out, "%d,", self->populations[j].potential_destinations[k]);
         }
         fprintf(out, "]\n");
-    }
+        fprintf(out, "\tevent_rates  = [ca=%.14g, migration=%.14g] dirty=%d\n",
+            fenwick_get_value(
+                &self->event_rate_index, j * MSP_NUM_EVENT_RATE_TYPES + 1),
+            fenwick_get_value(
+                &self->event_rate_index, j * MSP_NUM_EVENT_RATE_TYPES + 2),
+            self->populations[j].event_rates_dirty);
+        fprintf(out, "\tepoch        = [ploidy_size=%.14g, growth_scale=%.14g] "
+                     "ca_rate_indexed=%d\n",
+            self->populations[j].ploidy_size, self->populations[j].growth_scale,
+            self->populations[j].ca_rate_indexed);
+    }
+    fprintf(out, "Event rate index: total = %.14g nonzero = %d ca_rates_indexed = %d\n",
+        fenwick_get_total(&self->event_rate_index), (int) self->num_nonzero_event_rates,
+        self->ca_rates_indexed);
     fprintf(out, "Time = %f\n", self->time);
     for (j = 0; j < msp_get_num_ancestors(self); j++) {
         fprintf(out, "\t");
@@ -1663,12 +2583,12 @@ msp_print_state(msp_t *self, FILE *out)
                 fenwick_get_numerical_drift(&self->recomb_mass_index[k]));
             for (j = 1; j <= (uint32_t) fenwick_get_size(&self->recomb_mass_index[k]);
                  j++) {
-                u = msp_get_segment(self, j, (label_id_t) k);
                 v = fenwick_get_value(&self->recomb_mass_index[k], j);
                 if (v != 0) {
-                    fprintf(out, "\t%.14f\ti=%d l=%.14g r=%.14g v=%d prev=%p next=%p\n",
-                        v, (int) u->id, u->left, u->right, (int) u->value,
-                        (void *) u->prev, (void *) u->next);
+                    u = msp_get_indexed_segment(self, j, (label_id_t) k);
+                    fprintf(out, "\t%.14f\ti=%d l=%.14g r=%.14g v=%d prev=%d next=%d\n",
+                        v, (int) u, pool->left[u], pool->right[u], (int) pool->value[u],
+                        (int) pool->prev[u], (int) pool->next[u]);
                 }
             }
         }
@@ -1677,26 +2597,21 @@ msp_print_state(msp_t *self, FILE *out)
             fprintf(out, "numerical drift = %.17g\n",
                 fenwick_get_numerical_drift(&self->gc_mass_index[k]));
             for (j = 1; j <= (uint32_t) fenwick_get_size(&self->gc_mass_index[k]); j++) {
-                u = msp_get_segment(self, j, (label_id_t) k);
                 v = fenwick_get_value(&self->gc_mass_index[k], j);
                 if (v != 0) {
-                    fprintf(out, "\t%.14f\ti=%d l=%.14g r=%.14g v=%d prev=%p next=%p\n",
-                        v, (int) u->id, u->left, u->right, (int) u->value,
-                        (void *) u->prev, (void *) u->next);
+                    u = msp_get_indexed_segment(self, j, (label_id_t) k);
+                    fprintf(out, "\t%.14f\ti=%d l=%.14g r=%.14g v=%d prev=%d next=%d\n",
+                        v, (int) u, pool->left[u], pool->right[u], (int) pool->value[u],
+                        (int) pool->prev[u], (int) pool->next[u]);
                 }
             }
         }
     }
-    fprintf(out, "Breakpoints = %d\n", avl_count(&self->breakpoints));
-    for (a = self->breakpoints.head; a != NULL; a = a->next) {
-        nm = (node_mapping_t *) a->item;
-        fprintf(out, "\t%.14g -> %d\n", nm->position, (int) nm->value);
-    }
-    fprintf(out, "Overlap count = %d\n", avl_count(&self->overlap_counts));
-    for (a = self->overlap_counts.head; a != NULL; a = a->next) {
-        nm = (node_mapping_t *) a->item;
-        fprintf(out, "\t%.14g -> %d\n", nm->position, (int) nm->value);
-    }
+    fprintf(out, "Breakpoints = %d\n", (int) msp_get_num_breakpoints(self));
+    breakpoint_set_print_state(&self->breakpoints, out);
+    fprintf(out, "Overlap count = %d\n",
+        (int) overlap_map_get_num_items(&self->overlap_counts));
+    overlap_map_print_state(&self->overlap_counts, out);
     fprintf(out, "Tables = \n");
     tsk_table_collection_print_state(self->tables, out);
 
@@ -1707,10 +2622,7 @@ msp_print_state(msp_t *self, FILE *out)
             edge->child);
     }
     fprintf(out, "Memory heaps\n");
-    for (j = 0; j < self->num_labels; j++) {
-        fprintf(out, "segment_heap[%d]:", j);
-        object_heap_print_state(&self->segment_heap[j], out);
-    }
+    segment_pool_print_state(pool, out);
     fprintf(out, "avl_node_heap:");
     object_heap_print_state(&self->avl_node_heap, out);
     fprintf(out, "node_mapping_heap:");
@@ -1748,6 +2660,8 @@ msp_flush_edges(msp_t *self)
     tsk_size_t j, num_edges;
     tsk_edge_t edge;
 
+    msp_timer_start(self, MSP_TIMER_FLUSH_EDGES);
+
     if (self->num_buffered_edges > 0) {
         ret = tsk_squash_edges(
             self->buffered_edges, self->num_buffered_edges, &num_edges);
@@ -1768,6 +2682,7 @@ msp_flush_edges(msp_t *self)
     }
     ret = 0;
 out:
+    msp_timer_stop(self, MSP_TIMER_FLUSH_EDGES);
     return ret;
 }
 
@@ -1808,6 +2723,7 @@ msp_store_edge(msp_t *self, double left, double right, tsk_id_t parent, tsk_id_t
             goto out;
         }
         self->buffered_edges = edge;
+        msp_record_memory_peak(self);
     }
     if (node_time[child] >= node_time[parent]) {
         ret = MSP_ERR_TIME_TRAVEL;
@@ -1821,63 +2737,63 @@ msp_store_edge(msp_t *self, double left, double right, tsk_id_t parent, tsk_id_t
     edge->metadata = NULL;
     edge->metadata_length = 0;
     self->num_buffered_edges++;
+    self->num_stored_edges++;
 out:
     return ret;
 }
 
 static int MSP_WARN_UNUSED
-msp_store_arg_edges(msp_t *self, segment_t *z)
+msp_store_arg_edges(msp_t *self, segment_id_t z)
 {
+    segment_pool_t *pool = &self->segments;
     int ret = 0;
     tsk_id_t u = (tsk_id_t) msp_get_num_nodes(self) - 1;
-    segment_t *x;
+    segment_id_t x;
 
     /* Store edges to the left */
     x = z;
-    while (x != NULL) {
-        if (x->value != u) {
-            ret = msp_store_edge(self, x->left, x->right, u, x->value);
+    while (x != MSP_NULL_SEGMENT) {
+        if (pool->value[x] != u) {
+            ret = msp_store_edge(self, pool->left[x], pool->right[x], u, pool->value[x]);
             if (ret != 0) {
                 goto out;
             }
-            x->value = u;
+            pool->value[x] = u;
         }
-        x = x->prev;
+        x = pool->prev[x];
     }
 
     /* Store edges to the right */
     x = z;
-    while (x != NULL) {
-        if (x->value != u) {
-            ret = msp_store_edge(self, x->left, x->right, u, x->value);
+    while (x != MSP_NULL_SEGMENT) {
+        if (pool->value[x] != u) {
+            ret = msp_store_edge(self, pool->left[x], pool->right[x], u, pool->value[x]);
             if (ret != 0) {
                 goto out;
             }
-            x->value = u;
+            pool->value[x] = u;
         }
-        x = x->next;
+        x = pool->next[x];
     }
 out:
     return ret;
 }
 
+/* Moves the lineage with the specified head segment, which has already been
+ * removed from its ancestor set, into the specified population and label. */
 static int MSP_WARN_UNUSED
-msp_move_individual(msp_t *self, avl_node_t *node, avl_tree_t *source,
-    population_id_t dest_pop, label_id_t dest_label)
+msp_move_removed_individual(
+    msp_t *self, segment_id_t ind, population_id_t dest_pop, label_id_t dest_label)
 {
+    segment_pool_t *pool = &self->segments;
     int ret = 0;
-    segment_t *ind, *x, *y, *new_ind;
+    segment_id_t x;
     double recomb_mass, gc_mass;
 
     if (self->populations[dest_pop].state != MSP_POP_STATE_ACTIVE) {
         ret = MSP_ERR_POPULATION_INACTIVE_MOVE;
         goto out;
     }
-
-    ind = (segment_t *) node->item;
-    avl_unlink_node(source, node);
-    msp_free_avl_node(self, node);
-
     if (self->store_full_arg) {
         ret = msp_store_node(
             self, MSP_NODE_IS_MIG_EVENT, self->time, dest_pop, TSK_NULL);
@@ -1889,46 +2805,55 @@ msp_move_individual(msp_t *self, avl_node_t *node, avl_tree_t *source,
             goto out;
         }
     }
-    if (ind->label == dest_label) {
+    if (pool->label[ind] == dest_label) {
         /* Need to set the population and label for each segment. */
-        new_ind = ind;
-        for (x = ind; x != NULL; x = x->next) {
+        for (x = ind; x != MSP_NULL_SEGMENT; x = pool->next[x]) {
             if (self->store_migrations) {
-                ret = msp_record_migration(
-                    self, x->left, x->right, x->value, x->population, dest_pop);
+                ret = msp_record_migration(self, pool->left[x], pool->right[x],
+                    pool->value[x], pool->population[x], dest_pop);
                 if (ret != 0) {
                     goto out;
                 }
             }
-            x->population = dest_pop;
+            pool->population[x] = dest_pop;
+            self->num_segment_updates++;
         }
     } else {
-        /* Because we are changing to a different Fenwick tree we must allocate
-         * new segments each time. */
-        new_ind = NULL;
-        y = NULL;
-        for (x = ind; x != NULL; x = x->next) {
-            y = msp_alloc_segment(
-                self, x->left, x->right, x->value, x->population, dest_label, y, NULL);
-            if (new_ind == NULL) {
-                new_ind = y;
-            } else {
-                y->prev->next = y;
-            }
+        /* The segments keep their indexes when the label changes, so we
+         * only need to move their masses to the indexes for the new label. */
+        for (x = ind; x != MSP_NULL_SEGMENT; x = pool->next[x]) {
+            recomb_mass = 0;
+            gc_mass = 0;
             if (self->recomb_mass_index != NULL) {
                 recomb_mass
-                    = fenwick_get_value(&self->recomb_mass_index[x->label], x->id);
-                fenwick_set_value(
-                    &self->recomb_mass_index[y->label], y->id, recomb_mass);
+                    = fenwick_get_value(&self->recomb_mass_index[pool->label[x]], x);
             }
             if (self->gc_mass_index != NULL) {
-                gc_mass = fenwick_get_value(&self->gc_mass_index[x->label], x->id);
-                fenwick_set_value(&self->gc_mass_index[y->label], y->id, gc_mass);
+                gc_mass = fenwick_get_value(&self->gc_mass_index[pool->label[x]], x);
             }
-            msp_free_segment(self, x);
+            msp_set_mass_index_values(self, pool->label[x], x, 0, 0);
+            msp_set_mass_index_values(self, dest_label, x, recomb_mass, gc_mass);
+            pool->label[x] = dest_label;
+            self->num_segment_updates++;
         }
     }
-    ret = msp_insert_individual(self, new_ind);
+    ret = msp_insert_individual(self, ind);
+out:
+    return ret;
+}
+
+static int MSP_WARN_UNUSED
+msp_move_individual(
+    msp_t *self, segment_id_t ind, population_id_t dest_pop, label_id_t dest_label)
+{
+    int ret = 0;
+
+    if (self->populations[dest_pop].state != MSP_POP_STATE_ACTIVE) {
+        ret = MSP_ERR_POPULATION_INACTIVE_MOVE;
+        goto out;
+    }
+    msp_remove_individual(self, ind);
+    ret = msp_move_removed_individual(self, ind, dest_pop, dest_label);
 out:
     return ret;
 }
@@ -1979,75 +2904,14 @@ msp_remove_non_empty_population(msp_t *self, tsk_id_t population)
 static int MSP_WARN_UNUSED
 msp_insert_overlap_count(msp_t *self, double left, uint32_t count)
 {
-    int ret = 0;
-    avl_node_t *node = msp_alloc_avl_node(self);
-    node_mapping_t *m = msp_alloc_node_mapping(self);
-
-    if (node == NULL || m == NULL) {
-        ret = MSP_ERR_NO_MEMORY;
-        goto out;
-    }
-    m->position = left;
-    m->value = count;
-    avl_init_node(node, m);
-    node = avl_insert_node(&self->overlap_counts, node);
-    tsk_bug_assert(node != NULL);
-out:
-    return ret;
-}
-
-/*
- * Inserts a new overlap_count at the specified locus, and copies its
- * node mapping from the containing overlap_count.
- */
-static int MSP_WARN_UNUSED
-msp_copy_overlap_count(msp_t *self, double k)
-{
-    int ret;
-    node_mapping_t search, *nm;
-    avl_node_t *node;
-
-    search.position = k;
-    avl_search_closest(&self->overlap_counts, &search, &node);
-    tsk_bug_assert(node != NULL);
-    nm = (node_mapping_t *) node->item;
-    if (nm->position > k) {
-        node = node->prev;
-        tsk_bug_assert(node != NULL);
-        nm = (node_mapping_t *) node->item;
-    }
-    ret = msp_insert_overlap_count(self, k, nm->value);
-    return ret;
+    return overlap_map_insert(&self->overlap_counts, left, count);
 }
 
 static int
 msp_compress_overlap_counts(msp_t *self, double l, double r)
 {
-    int ret = 0;
-    avl_node_t *node1, *node2;
-    node_mapping_t search, *nm1, *nm2;
-
-    search.position = l;
-    node1 = avl_search(&self->overlap_counts, &search);
-    tsk_bug_assert(node1 != NULL);
-    if (node1->prev != NULL) {
-        node1 = node1->prev;
-    }
-    node2 = node1->next;
-    do {
-        nm1 = (node_mapping_t *) node1->item;
-        nm2 = (node_mapping_t *) node2->item;
-        if (nm1->value == nm2->value) {
-            avl_unlink_node(&self->overlap_counts, node2);
-            msp_free_avl_node(self, node2);
-            msp_free_node_mapping(self, nm2);
-            node2 = node1->next;
-        } else {
-            node1 = node2;
-            node2 = node2->next;
-        }
-    } while (node2 != NULL && nm2->position <= r);
-    return ret;
+    overlap_map_compress(&self->overlap_counts, l, r);
+    return 0;
 }
 
 static int MSP_WARN_UNUSED
@@ -2074,18 +2938,19 @@ out:
 /* Defragment the segment chain ending in z by squashing any redundant
  * segments together */
 static int MSP_WARN_UNUSED
-msp_defrag_segment_chain(msp_t *self, segment_t *z)
+msp_defrag_segment_chain(msp_t *self, segment_id_t z)
 {
-    segment_t *y, *x;
+    segment_pool_t *pool = &self->segments;
+    segment_id_t y, x;
 
     y = z;
-    while (y->prev != NULL) {
-        x = y->prev;
-        if (x->right == y->left && x->value == y->value) {
-            x->right = y->right;
-            x->next = y->next;
-            if (y->next != NULL) {
-                y->next->prev = x;
+    while (pool->prev[y] != MSP_NULL_SEGMENT) {
+        x = pool->prev[y];
+        if (pool->right[x] == pool->left[y] && pool->value[x] == pool->value[y]) {
+            pool->right[x] = pool->right[y];
+            pool->next[x] = pool->next[y];
+            if (pool->next[y] != MSP_NULL_SEGMENT) {
+                pool->prev[pool->next[y]] = x;
             }
             /* msp_add_segment_mass(self, x, y); */
             msp_set_segment_mass(self, x);
@@ -2103,7 +2968,7 @@ msp_dtwf_generate_breakpoint(msp_t *self, double start)
 
     left_bound = self->discrete_genome ? start + 1 : start;
     do {
-        mass_to_next_recomb = gsl_ran_exponential(self->rng, 1.0);
+        mass_to_next_recomb = variate_buffer_exponential(&self->variates, 1.0);
     } while (mass_to_next_recomb == 0.0);
 
     breakpoint
@@ -2137,7 +3002,7 @@ msp_reset_pedigree(msp_t *self)
 
 static int MSP_WARN_UNUSED
 msp_pedigree_add_individual_common_ancestor(
-    msp_t *self, tsk_id_t individual_id, segment_t *ancestor, tsk_size_t ploid)
+    msp_t *self, tsk_id_t individual_id, segment_id_t ancestor, tsk_size_t ploid)
 {
     int ret;
     individual_t *ind = &self->pedigree.individuals[individual_id];
@@ -2151,7 +3016,7 @@ msp_pedigree_add_individual_common_ancestor(
     tsk_bug_assert(ind->common_ancestors != NULL);
     tsk_bug_assert(ploid < self->ploidy);
 
-    avl_init_node(node, ancestor);
+    msp_init_segment_queue_node(self, node, ancestor);
     node = avl_insert_node(&ind->common_ancestors[ploid], node);
     tsk_bug_assert(node != NULL);
 
@@ -2161,11 +3026,12 @@ out:
 }
 
 static int MSP_WARN_UNUSED
-msp_pedigree_add_sample_ancestry(msp_t *self, segment_t *segment)
+msp_pedigree_add_sample_ancestry(msp_t *self, segment_id_t segment)
 {
+    segment_pool_t *pool = &self->segments;
     int ret = 0;
     tsk_size_t ploid;
-    tsk_id_t node_id = segment->value;
+    tsk_id_t node_id = pool->value[segment];
     tsk_id_t individual_id;
     individual_t *ind;
 
@@ -2201,10 +3067,9 @@ msp_pedigree_initialise(msp_t *self)
 {
     int ret = 0;
     population_t *pop;
-    segment_t *segment;
-    avl_node_t *a;
+    segment_id_t segment;
     label_id_t label = 0;
-    tsk_size_t j;
+    tsk_size_t j, k;
 
     if (self->next_demographic_event != NULL || self->store_full_arg) {
         ret = MSP_ERR_UNSUPPORTED_OPERATION;
@@ -2228,8 +3093,8 @@ msp_pedigree_initialise(msp_t *self)
 
     for (j = 0; j < self->num_populations; j++) {
         pop = &self->populations[j];
-        for (a = pop->ancestors[label].head; a != NULL; a = a->next) {
-            segment = (segment_t *) a->item;
+        for (k = 0; k < pop->ancestors[label].num_lineages; k++) {
+            segment = pop->ancestors[label].lineages[k];
             ret = msp_pedigree_add_sample_ancestry(self, segment);
             if (ret != 0) {
                 goto out;
@@ -2242,72 +3107,73 @@ out:
 }
 
 static int MSP_WARN_UNUSED
-msp_dtwf_recombine(msp_t *self, segment_t *x, segment_t **u, segment_t **v)
+msp_dtwf_recombine(msp_t *self, segment_id_t x, segment_id_t *u, segment_id_t *v)
 {
+    segment_pool_t *pool = &self->segments;
     int ret = 0;
     int ix;
     double k;
-    segment_t *y, *z, *tail;
-    segment_t s1, s2;
-    segment_t *seg_tails[] = { &s1, &s2 };
-
-    k = msp_dtwf_generate_breakpoint(self, x->left);
-    s1.next = NULL;
-    s2.next = NULL;
-    ix = (int) gsl_rng_uniform_int(self->rng, 2);
-    seg_tails[ix]->next = x;
-    tsk_bug_assert(x->prev == NULL);
-
-    while (x != NULL) {
+    segment_id_t y, z, tail;
+    /* The heads and tails of the two chains, which are null until the
+     * first segment is added to a chain */
+    segment_id_t seg_heads[] = { MSP_NULL_SEGMENT, MSP_NULL_SEGMENT };
+    segment_id_t seg_tails[] = { MSP_NULL_SEGMENT, MSP_NULL_SEGMENT };
+
+    k = msp_dtwf_generate_breakpoint(self, pool->left[x]);
+    ix = (int) variate_buffer_uniform_int(&self->variates, 2);
+    seg_heads[ix] = x;
+    tsk_bug_assert(pool->prev[x] == MSP_NULL_SEGMENT);
+
+    while (x != MSP_NULL_SEGMENT) {
         seg_tails[ix] = x;
-        y = x->next;
+        y = pool->next[x];
 
-        if (x->right > k) {
+        if (pool->right[x] > k) {
             // Make new segment
-            tsk_bug_assert(x->left < k);
+            tsk_bug_assert(pool->left[x] < k);
             self->num_re_events++;
             ix = (ix + 1) % 2;
 
-            if (seg_tails[ix] == &s1 || seg_tails[ix] == &s2) {
-                tail = NULL;
-            } else {
-                tail = seg_tails[ix];
-            }
-            z = msp_alloc_segment(
-                self, k, x->right, x->value, x->population, x->label, tail, x->next);
-            if (z == NULL) {
+            tail = seg_tails[ix];
+            z = msp_alloc_segment(self, k, pool->right[x], pool->value[x],
+                pool->population[x], pool->label[x], tail, pool->next[x]);
+            if (z == MSP_NULL_SEGMENT) {
                 ret = MSP_ERR_NO_MEMORY;
                 goto out;
             }
             msp_set_segment_mass(self, z);
-            tsk_bug_assert(z->left < z->right);
-            if (x->next != NULL) {
-                x->next->prev = z;
+            tsk_bug_assert(pool->left[z] < pool->right[z]);
+            if (pool->next[x] != MSP_NULL_SEGMENT) {
+                pool->prev[pool->next[x]] = z;
+            }
+            if (tail == MSP_NULL_SEGMENT) {
+                seg_heads[ix] = z;
+            } else {
+                pool->next[tail] = z;
             }
-            seg_tails[ix]->next = z;
             seg_tails[ix] = z;
-            x->next = NULL;
-            x->right = k;
+            pool->next[x] = MSP_NULL_SEGMENT;
+            pool->right[x] = k;
             msp_set_segment_mass(self, x);
-            tsk_bug_assert(x->left < x->right);
+            tsk_bug_assert(pool->left[x] < pool->right[x]);
             x = z;
             k = msp_dtwf_generate_breakpoint(self, k);
-        } else if (x->right <= k && y != NULL && y->left >= k) {
+        } else if (pool->right[x] <= k && y != MSP_NULL_SEGMENT && pool->left[y] >= k) {
             // Recombine in gap between segment and the next
-            x->next = NULL;
-            y->prev = NULL;
-            while (y->left >= k) {
+            pool->next[x] = MSP_NULL_SEGMENT;
+            pool->prev[y] = MSP_NULL_SEGMENT;
+            while (pool->left[y] >= k) {
                 self->num_re_events++;
                 ix = (ix + 1) % 2;
                 k = msp_dtwf_generate_breakpoint(self, k);
             }
-            seg_tails[ix]->next = y;
-            if (seg_tails[ix] == &s1 || seg_tails[ix] == &s2) {
-                tail = NULL;
+            tail = seg_tails[ix];
+            if (tail == MSP_NULL_SEGMENT) {
+                seg_heads[ix] = y;
             } else {
-                tail = seg_tails[ix];
+                pool->next[tail] = y;
             }
-            y->prev = tail;
+            pool->prev[y] = tail;
             msp_set_segment_mass(self, y);
             seg_tails[ix] = y;
             x = y;
@@ -2316,21 +3182,21 @@ msp_dtwf_recombine(msp_t *self, segment_t *x, segment_t **u, segment_t **v)
             x = y;
         }
     }
-    // Remove sentinal segments
-    *u = s1.next;
-    *v = s2.next;
+    *u = seg_heads[0];
+    *v = seg_heads[1];
 out:
     return ret;
 }
 
 static int MSP_WARN_UNUSED
-msp_store_arg_recombination(msp_t *self, segment_t *lhs_tail, segment_t *rhs)
+msp_store_arg_recombination(msp_t *self, segment_id_t lhs_tail, segment_id_t rhs)
 {
+    segment_pool_t *pool = &self->segments;
     int ret = 0;
 
     /* Store the edges for the LHS */
     ret = msp_store_node(
-        self, MSP_NODE_IS_RE_EVENT, self->time, lhs_tail->population, TSK_NULL);
+        self, MSP_NODE_IS_RE_EVENT, self->time, pool->population[lhs_tail], TSK_NULL);
     if (ret < 0) {
         goto out;
     }
@@ -2340,7 +3206,7 @@ msp_store_arg_recombination(msp_t *self, segment_t *lhs_tail, segment_t *rhs)
     }
     /* Store the edges for the RHS */
     ret = msp_store_node(
-        self, MSP_NODE_IS_RE_EVENT, self->time, rhs->population, TSK_NULL);
+        self, MSP_NODE_IS_RE_EVENT, self->time, pool->population[rhs], TSK_NULL);
     if (ret < 0) {
         goto out;
     }
@@ -2354,17 +3220,18 @@ out:
 
 static int MSP_WARN_UNUSED
 msp_store_arg_gene_conversion(
-    msp_t *self, segment_t *tail, segment_t *alpha, segment_t *head)
+    msp_t *self, segment_id_t tail, segment_id_t alpha, segment_id_t head)
 {
+    segment_pool_t *pool = &self->segments;
     int ret = 0;
 
     /* If head and tail both null then all material moves in the gene conversion so no
      * split to record */
-    if (tail != NULL || head != NULL) {
-        tsk_bug_assert(alpha != NULL);
+    if (tail != MSP_NULL_SEGMENT || head != MSP_NULL_SEGMENT) {
+        tsk_bug_assert(alpha != MSP_NULL_SEGMENT);
         /* Store the edges for tail & head */
         ret = msp_store_node(
-            self, MSP_NODE_IS_GC_EVENT, self->time, alpha->population, TSK_NULL);
+            self, MSP_NODE_IS_GC_EVENT, self->time, pool->population[alpha], TSK_NULL);
         if (ret < 0) {
             goto out;
         }
@@ -2378,7 +3245,7 @@ msp_store_arg_gene_conversion(
         }
         /* Store the edges for the alpha section */
         ret = msp_store_node(
-            self, MSP_NODE_IS_GC_EVENT, self->time, alpha->population, TSK_NULL);
+            self, MSP_NODE_IS_GC_EVENT, self->time, pool->population[alpha], TSK_NULL);
         if (ret < 0) {
             goto out;
         }
@@ -2394,28 +3261,52 @@ out:
 static int MSP_WARN_UNUSED
 msp_choose_uniform_breakpoint(msp_t *self, int label, rate_map_t *rate_map,
     fenwick_t *mass_index_array, bool left_at_zero, double *ret_breakpoint,
-    segment_t **ret_seg)
+    segment_id_t *ret_seg)
 {
-
+    segment_pool_t *pool = &self->segments;
     int ret = 0;
-    double breakpoint, breakpoint_mass, random_mass, y_cumulative_mass, y_right_mass,
-        left_bound;
-    segment_t *x, *y;
+    double breakpoint, breakpoint_mass, random_mass, y_prefix_mass, y_mass, y_right_mass,
+        left_bound, fraction_right;
+    uint64_t fixed_total, fixed_mass, fixed_prefix, fixed_value;
+    segment_id_t x, y;
     fenwick_t *tree = &mass_index_array[label];
     int num_breakpoint_resamplings = 0;
     size_t segment_id;
 
     do {
-        /* Choose a recombination mass uniformly from the total and find the
-         * segment y that is associated with this *cumulative* value. */
-        random_mass = gsl_ran_flat(self->rng, 0, fenwick_get_total(tree));
-        segment_id = fenwick_find(tree, random_mass);
-        y = msp_get_segment(self, segment_id, label);
-        tsk_bug_assert(fenwick_get_value(tree, y->id) > 0);
-        x = y->prev;
-        y_cumulative_mass = fenwick_get_cumulative_sum(tree, y->id);
-        y_right_mass = rate_map_position_to_mass(rate_map, y->right);
-        breakpoint_mass = y_right_mass - (y_cumulative_mass - random_mass);
+        if (fenwick_is_fixed_point(tree)) {
+            /* Choose an integer mass r uniformly and find the segment whose
+             * fixed-point interval contains it. The fractional part of the
+             * variate then gives the position within the segment, in
+             * proportion to its unrounded mass. */
+            fixed_total = fenwick_get_fixed_total(tree);
+            random_mass = variate_buffer_flat(&self->variates, 0, (double) fixed_total);
+            fixed_mass = GSL_MIN((uint64_t) random_mass, fixed_total - 1);
+            segment_id
+                = fenwick_find_fixed_with_prefix(tree, fixed_mass + 1, &fixed_prefix);
+            y = msp_get_indexed_segment(self, segment_id, label);
+            fixed_value = fenwick_get_fixed_value(tree, y);
+            tsk_bug_assert(fixed_value > 0);
+            fraction_right = ((double) (fixed_prefix + fixed_value - fixed_mass)
+                                 - (random_mass - (double) fixed_mass))
+                             / (double) fixed_value;
+            x = pool->prev[y];
+            y_right_mass = rate_map_position_to_mass(rate_map, pool->right[y]);
+            breakpoint_mass
+                = y_right_mass - fraction_right * fenwick_get_value(tree, y);
+        } else {
+            /* Choose a recombination mass uniformly from the total and find the
+             * segment y that is associated with this *cumulative* value. */
+            random_mass
+                = variate_buffer_flat(&self->variates, 0, fenwick_get_total(tree));
+            segment_id
+                = fenwick_find_with_prefix(tree, random_mass, &y_prefix_mass, &y_mass);
+            y = msp_get_indexed_segment(self, segment_id, label);
+            tsk_bug_assert(y_mass > 0);
+            x = pool->prev[y];
+            y_right_mass = rate_map_position_to_mass(rate_map, pool->right[y]);
+            breakpoint_mass = y_right_mass - (y_prefix_mass + y_mass - random_mass);
+        }
         breakpoint = rate_map_mass_to_position(rate_map, breakpoint_mass);
         if (self->discrete_genome) {
             breakpoint = floor(breakpoint);
@@ -2426,16 +3317,16 @@ msp_choose_uniform_breakpoint(msp_t *self, int label, rate_map_t *rate_map,
          * and physical positions. We try to make this robust by making
          * resampling the default case and only break out of the loop
          * when the conditions we need are explicitly met. */
-        if (x == NULL) {
-            left_bound = left_at_zero ? 0 : y->left;
+        if (x == MSP_NULL_SEGMENT) {
+            left_bound = left_at_zero ? 0 : pool->left[y];
             /* if there is no previous segment we cannot have breakpoint
-             * <= y->left (or zero, if the left limit is zero) */
-            if (left_bound < breakpoint && breakpoint < y->right) {
+             * <= the left of y (or zero, if the left limit is zero) */
+            if (left_bound < breakpoint && breakpoint < pool->right[y]) {
                 break;
             }
         } else {
-            tsk_bug_assert(x->right <= y->left);
-            if (x->right <= breakpoint && breakpoint < y->right) {
+            tsk_bug_assert(pool->right[x] <= pool->left[y]);
+            if (pool->right[x] <= breakpoint && breakpoint < pool->right[y]) {
                 break;
             }
         }
@@ -2455,11 +3346,18 @@ out:
 }
 
 static int MSP_WARN_UNUSED
-msp_recombination_event(msp_t *self, label_id_t label, segment_t **lhs, segment_t **rhs)
+msp_recombination_event(
+    msp_t *self, label_id_t label, segment_id_t *lhs, segment_id_t *rhs)
 {
+    segment_pool_t *pool = &self->segments;
     int ret = 0;
     double breakpoint;
-    segment_t *x, *y, *alpha, *lhs_tail;
+    segment_id_t x, y, alpha, lhs_tail;
+    population_id_t population = TSK_NULL;
+    size_t num_segment_updates = self->num_segment_updates;
+    size_t num_stored_edges = self->num_stored_edges;
+
+    msp_timer_start(self, MSP_TIMER_RECOMBINATION);
 
     self->num_re_events++;
     tsk_bug_assert(self->recomb_mass_index != NULL);
@@ -2469,21 +3367,22 @@ msp_recombination_event(msp_t *self, label_id_t label, segment_t **lhs, segment_
     if (ret != 0) {
         goto out;
     }
-    x = y->prev;
+    population = pool->population[y];
+    x = pool->prev[y];
 
-    if (y->left < breakpoint) {
-        tsk_bug_assert(breakpoint < y->right);
-        alpha = msp_alloc_segment(self, breakpoint, y->right, y->value, y->population,
-            y->label, NULL, y->next);
-        if (alpha == NULL) {
+    if (pool->left[y] < breakpoint) {
+        tsk_bug_assert(breakpoint < pool->right[y]);
+        alpha = msp_alloc_segment(self, breakpoint, pool->right[y], pool->value[y],
+            pool->population[y], pool->label[y], MSP_NULL_SEGMENT, pool->next[y]);
+        if (alpha == MSP_NULL_SEGMENT) {
             ret = MSP_ERR_NO_MEMORY;
             goto out;
         }
-        if (y->next != NULL) {
-            y->next->prev = alpha;
+        if (pool->next[y] != MSP_NULL_SEGMENT) {
+            pool->prev[pool->next[y]] = alpha;
         }
-        y->next = NULL;
-        y->right = breakpoint;
+        pool->next[y] = MSP_NULL_SEGMENT;
+        pool->right[y] = breakpoint;
         msp_set_segment_mass(self, y);
         if (msp_has_breakpoint(self, breakpoint)) {
             self->num_multiple_re_events++;
@@ -2494,16 +3393,16 @@ msp_recombination_event(msp_t *self, label_id_t label, segment_t **lhs, segment_
             }
         }
         lhs_tail = y;
-        tsk_bug_assert(y->left < y->right);
+        tsk_bug_assert(pool->left[y] < pool->right[y]);
     } else {
-        tsk_bug_assert(x != NULL);
-        x->next = NULL;
-        y->prev = NULL;
+        tsk_bug_assert(x != MSP_NULL_SEGMENT);
+        pool->next[x] = MSP_NULL_SEGMENT;
+        pool->prev[y] = MSP_NULL_SEGMENT;
         alpha = y;
         self->num_trapped_re_events++;
         lhs_tail = x;
     }
-    tsk_bug_assert(alpha->left < alpha->right);
+    tsk_bug_assert(pool->left[alpha] < pool->right[alpha]);
     msp_set_segment_mass(self, alpha);
     ret = msp_insert_individual(self, alpha);
     if (ret != 0) {
@@ -2518,13 +3417,18 @@ msp_recombination_event(msp_t *self, label_id_t label, segment_t **lhs, segment_
     if (lhs != NULL) {
         x = lhs_tail;
         /* Seek back to the head of the x chain */
-        while (x->prev != NULL) {
-            x = x->prev;
+        while (pool->prev[x] != MSP_NULL_SEGMENT) {
+            x = pool->prev[x];
         }
         *lhs = x;
         *rhs = alpha;
     }
 out:
+    if (ret == 0) {
+        msp_trace_event(self, MSP_TRACE_RECOMBINATION, population, label,
+            num_segment_updates, num_stored_edges);
+    }
+    msp_timer_stop(self, MSP_TIMER_RECOMBINATION);
     return ret;
 }
 
@@ -2543,7 +3447,7 @@ msp_generate_gc_tract_length(msp_t *self)
                 tl = -1;
                 goto out;
             }
-            tl = gsl_ran_exponential(self->rng, self->gc_tract_length);
+            tl = variate_buffer_exponential(&self->variates, self->gc_tract_length);
             num_resamplings++;
         } while (tl <= 0);
     }
@@ -2554,10 +3458,16 @@ out:
 static int MSP_WARN_UNUSED
 msp_gene_conversion_event(msp_t *self, label_id_t label)
 {
+    segment_pool_t *pool = &self->segments;
     int ret = 0;
-    segment_t *x, *y, *alpha, *head, *tail, *z, *new_individual_head;
+    segment_id_t x, y, alpha, head, tail, z, new_individual_head;
     double left_breakpoint, right_breakpoint, tl;
     bool insert_alpha;
+    population_id_t population = TSK_NULL;
+    size_t num_segment_updates = self->num_segment_updates;
+    size_t num_stored_edges = self->num_stored_edges;
+
+    msp_timer_start(self, MSP_TIMER_GENE_CONVERSION);
 
     tsk_bug_assert(self->gc_mass_index != NULL);
     self->num_gc_events++;
@@ -2567,8 +3477,9 @@ msp_gene_conversion_event(msp_t *self, label_id_t label)
     if (ret != 0) {
         goto out;
     }
+    population = pool->population[y];
 
-    x = y->prev;
+    x = pool->prev[y];
 
     /* generate tract length */
     tl = msp_generate_gc_tract_length(self);
@@ -2580,17 +3491,17 @@ msp_gene_conversion_event(msp_t *self, label_id_t label)
     self->sum_internal_gc_tract_lengths += tl;
     right_breakpoint = left_breakpoint + tl;
 
-    if (y->left >= right_breakpoint) {
+    if (pool->left[y] >= right_breakpoint) {
         //                  y
         // ...  |   |   ========== ...
         //     lbp rbp
         self->num_noneffective_gc_events++;
-        return 0;
+        goto out;
     }
 
     /* Process left break */
     insert_alpha = true;
-    if (left_breakpoint <= y->left) {
+    if (left_breakpoint <= pool->left[y]) {
         //  x             y
         // =====  |  ==========
         //       lbp
@@ -2599,14 +3510,14 @@ msp_gene_conversion_event(msp_t *self, label_id_t label)
         //  x
         // =====         α
         //           ==========
-        if (x == NULL) {
+        if (x == MSP_NULL_SEGMENT) {
             // In this case we *don't* insert alpha because it is already
             // the head of a segment chain
             insert_alpha = false;
         } else {
-            x->next = NULL;
+            pool->next[x] = MSP_NULL_SEGMENT;
         }
-        y->prev = NULL;
+        pool->prev[y] = MSP_NULL_SEGMENT;
         alpha = y;
         tail = x;
     } else {
@@ -2620,17 +3531,17 @@ msp_gene_conversion_event(msp_t *self, label_id_t label)
         //               ======
         /* alpha = self->copy_segment(y) */
         alpha = msp_copy_segment(self, y);
-        if (alpha == NULL) {
+        if (alpha == MSP_NULL_SEGMENT) {
             ret = MSP_ERR_NO_MEMORY;
             goto out;
         }
-        alpha->left = left_breakpoint;
-        alpha->prev = NULL;
-        if (y->next != NULL) {
-            y->next->prev = alpha;
+        pool->left[alpha] = left_breakpoint;
+        pool->prev[alpha] = MSP_NULL_SEGMENT;
+        if (pool->next[y] != MSP_NULL_SEGMENT) {
+            pool->prev[pool->next[y]] = alpha;
         }
-        y->next = NULL;
-        y->right = left_breakpoint;
+        pool->next[y] = MSP_NULL_SEGMENT;
+        pool->right[y] = left_breakpoint;
         msp_set_segment_mass(self, y);
         tail = y;
 
@@ -2645,14 +3556,14 @@ msp_gene_conversion_event(msp_t *self, label_id_t label)
 
     // Find the segment z that the right breakpoint falls in
     z = alpha;
-    while (z != NULL && right_breakpoint >= z->right) {
-        z = z->next;
+    while (z != MSP_NULL_SEGMENT && right_breakpoint >= pool->right[z]) {
+        z = pool->next[z];
     }
 
-    head = NULL;
+    head = MSP_NULL_SEGMENT;
     // Process the right break
-    if (z != NULL) {
-        if (z->left < right_breakpoint) {
+    if (z != MSP_NULL_SEGMENT) {
+        if (pool->left[z] < right_breakpoint) {
             //   tail             z
             // ======
             //       ...  ===|==========
@@ -2664,16 +3575,16 @@ msp_gene_conversion_event(msp_t *self, label_id_t label)
             //      ...   ===
             //             z
             head = msp_copy_segment(self, z);
-            if (head == NULL) {
+            if (head == MSP_NULL_SEGMENT) {
                 ret = MSP_ERR_NO_MEMORY;
                 goto out;
             }
-            head->left = right_breakpoint;
-            if (z->next != NULL) {
-                z->next->prev = head;
+            pool->left[head] = right_breakpoint;
+            if (pool->next[z] != MSP_NULL_SEGMENT) {
+                pool->prev[pool->next[z]] = head;
             }
-            z->right = right_breakpoint;
-            z->next = NULL;
+            pool->right[z] = right_breakpoint;
+            pool->next[z] = MSP_NULL_SEGMENT;
             msp_set_segment_mass(self, z);
 
             if (!msp_has_breakpoint(self, right_breakpoint)) {
@@ -2692,15 +3603,15 @@ msp_gene_conversion_event(msp_t *self, label_id_t label)
             //  tail             z
             // ======      =============
             //  ...
-            if (z->prev != NULL) {
-                z->prev->next = NULL;
+            if (pool->prev[z] != MSP_NULL_SEGMENT) {
+                pool->next[pool->prev[z]] = MSP_NULL_SEGMENT;
             }
             head = z;
         }
-        if (tail != NULL) {
-            tail->next = head;
+        if (tail != MSP_NULL_SEGMENT) {
+            pool->next[tail] = head;
         }
-        head->prev = tail;
+        pool->prev[head] = tail;
         msp_set_segment_mass(self, head);
     }
 
@@ -2709,13 +3620,13 @@ msp_gene_conversion_event(msp_t *self, label_id_t label)
     // lbp                     rbp
     // When y and z are the head and tail of the segment chains, then
     // this GC event does nothing. This logic takes care of this situation.
-    new_individual_head = NULL;
+    new_individual_head = MSP_NULL_SEGMENT;
     if (insert_alpha) {
         new_individual_head = alpha;
-    } else if (head != NULL) {
+    } else if (head != MSP_NULL_SEGMENT) {
         new_individual_head = head;
     }
-    if (new_individual_head != NULL) {
+    if (new_individual_head != MSP_NULL_SEGMENT) {
         ret = msp_insert_individual(self, new_individual_head);
     } else {
         self->num_noneffective_gc_events++;
@@ -2727,6 +3638,11 @@ msp_gene_conversion_event(msp_t *self, label_id_t label)
         }
     }
 out:
+    if (ret == 0) {
+        msp_trace_event(self, MSP_TRACE_GENE_CONVERSION, population, label,
+            num_segment_updates, num_stored_edges);
+    }
+    msp_timer_stop(self, MSP_TIMER_GENE_CONVERSION);
     return ret;
 }
 
@@ -2734,24 +3650,25 @@ out:
  * there aren't any overlapping segments.
  */
 static int MSP_WARN_UNUSED
-msp_reject_ca_event(msp_t *self, segment_t *a, segment_t *b)
+msp_reject_ca_event(msp_t *self, segment_id_t a, segment_id_t b)
 {
+    segment_pool_t *pool = &self->segments;
     int ret = 0;
-    segment_t *x = a;
-    segment_t *y = b;
-    segment_t *beta;
+    segment_id_t x = a;
+    segment_id_t y = b;
+    segment_id_t beta;
     double overlap;
     int model = self->model.type;
 
     if (model == MSP_MODEL_SMC || model == MSP_MODEL_SMC_PRIME) {
         ret = 1;
-        while (x != NULL && y != NULL) {
-            if (y->left < x->left) {
+        while (x != MSP_NULL_SEGMENT && y != MSP_NULL_SEGMENT) {
+            if (pool->left[y] < pool->left[x]) {
                 beta = x;
                 x = y;
                 y = beta;
             }
-            overlap = x->right - y->left;
+            overlap = pool->right[x] - pool->left[y];
             /* For the SMC' overlap must be >= 0, but SMC it must
              * be strictly greater than zero, as it doesn't allow
              * directly adjacent segments to coalesce */
@@ -2760,7 +3677,7 @@ msp_reject_ca_event(msp_t *self, segment_t *a, segment_t *b)
                 ret = 0;
                 break;
             }
-            x = x->next;
+            x = pool->next[x];
         }
     }
     return ret;
@@ -2768,58 +3685,64 @@ msp_reject_ca_event(msp_t *self, segment_t *a, segment_t *b)
 
 static int MSP_WARN_UNUSED
 msp_merge_two_ancestors(msp_t *self, population_id_t population_id, label_id_t label,
-    segment_t *a, segment_t *b, tsk_id_t new_node_id, segment_t **ret_merged_head)
+    segment_id_t a, segment_id_t b, tsk_id_t new_node_id, segment_id_t *ret_merged_head)
 {
+    segment_pool_t *pool = &self->segments;
     int ret = 0;
     bool coalescence = false;
     bool defrag_required = false;
     tsk_id_t v;
     double l, r, l_min, r_max;
-    avl_node_t *node;
-    node_mapping_t *nm, search;
-    segment_t *x, *y, *z, *alpha, *beta, *merged_head;
+    overlap_map_cursor_t cursor;
+    bool found;
+    segment_id_t x, y, z, alpha, beta, merged_head;
 
     x = a;
     y = b;
-    merged_head = NULL;
+    merged_head = MSP_NULL_SEGMENT;
     /* Keep GCC happy */
     l_min = 0;
     r_max = 0;
+    /* The coalescing intervals are visited from left to right, so each
+     * search of the overlap counts starts from where the last one ended. */
+    found = overlap_map_first(&self->overlap_counts, &cursor);
+    tsk_bug_assert(found);
 
     /* update recomb mass and get ready for loop */
-    z = NULL;
-    while (x != NULL || y != NULL) {
-        alpha = NULL;
-        if (x == NULL || y == NULL) {
-            if (x != NULL) {
+    z = MSP_NULL_SEGMENT;
+    while (x != MSP_NULL_SEGMENT || y != MSP_NULL_SEGMENT) {
+        alpha = MSP_NULL_SEGMENT;
+        if (x == MSP_NULL_SEGMENT || y == MSP_NULL_SEGMENT) {
+            if (x != MSP_NULL_SEGMENT) {
                 alpha = x;
-                x = NULL;
+                x = MSP_NULL_SEGMENT;
             }
-            if (y != NULL) {
+            if (y != MSP_NULL_SEGMENT) {
                 alpha = y;
-                y = NULL;
+                y = MSP_NULL_SEGMENT;
             }
         } else {
-            if (y->left < x->left) {
+            if (pool->left[y] < pool->left[x]) {
                 beta = x;
                 x = y;
                 y = beta;
             }
-            if (x->right <= y->left) {
+            if (pool->right[x] <= pool->left[y]) {
                 alpha = x;
-                x = x->next;
-                alpha->next = NULL;
-            } else if (x->left != y->left) {
-                alpha = msp_alloc_segment(self, x->left, y->left, x->value,
-                    x->population, x->label, NULL, NULL);
-                if (alpha == NULL) {
+                x = pool->next[x];
+                pool->next[alpha] = MSP_NULL_SEGMENT;
+            } else if (pool->left[x] != pool->left[y]) {
+                alpha = msp_alloc_segment(self, pool->left[x], pool->left[y],
+                    pool->value[x], pool->population[x], pool->label[x],
+                    MSP_NULL_SEGMENT, MSP_NULL_SEGMENT);
+                if (alpha == MSP_NULL_SEGMENT) {
                     ret = MSP_ERR_NO_MEMORY;
                     goto out;
                 }
-                x->left = y->left;
+                pool->left[x] = pool->left[y];
             } else {
-                l = x->left;
-                r_max = GSL_MIN(x->right, y->right);
+                l = pool->left[x];
+                r_max = GSL_MIN(pool->right[x], pool->right[y]);
                 if (!coalescence) {
                     coalescence = true;
                     l_min = l;
@@ -2833,78 +3756,63 @@ msp_merge_two_ancestors(msp_t *self, population_id_t population_id, label_id_t l
                     }
                 }
                 v = new_node_id;
-                /* Insert overlap counts for bounds, if necessary */
-                search.position = l;
-                node = avl_search(&self->overlap_counts, &search);
-                if (node == NULL) {
-                    ret = msp_copy_overlap_count(self, l);
-                    if (ret < 0) {
-                        goto out;
-                    }
-                }
-                search.position = r_max;
-                node = avl_search(&self->overlap_counts, &search);
-                if (node == NULL) {
-                    ret = msp_copy_overlap_count(self, r_max);
-                    if (ret < 0) {
-                        goto out;
-                    }
+                /* Insert overlap counts for bounds, if necessary, and get
+                 * the overlap count at the left */
+                ret = overlap_map_split_interval(
+                    &self->overlap_counts, l, r_max, &cursor);
+                if (ret < 0) {
+                    goto out;
                 }
-                /* Now get overlap count at the left */
-                search.position = l;
-                node = avl_search(&self->overlap_counts, &search);
-                tsk_bug_assert(node != NULL);
-                nm = (node_mapping_t *) node->item;
-                if (nm->value == 2) {
-                    nm->value = 0;
-                    node = node->next;
-                    tsk_bug_assert(node != NULL);
-                    nm = (node_mapping_t *) node->item;
-                    r = nm->position;
+                if (overlap_map_get_count(&self->overlap_counts, &cursor) == 2) {
+                    overlap_map_set_count(&self->overlap_counts, &cursor, 0);
+                    found = overlap_map_next(&self->overlap_counts, &cursor);
+                    tsk_bug_assert(found);
+                    r = overlap_map_get_position(&self->overlap_counts, &cursor);
                 } else {
                     r = l;
-                    while (nm->value != 2 && r < r_max) {
-                        nm->value--;
-                        node = node->next;
-                        tsk_bug_assert(node != NULL);
-                        nm = (node_mapping_t *) node->item;
-                        r = nm->position;
+                    while (overlap_map_get_count(&self->overlap_counts, &cursor) != 2
+                           && r < r_max) {
+                        overlap_map_set_count(&self->overlap_counts, &cursor,
+                            overlap_map_get_count(&self->overlap_counts, &cursor) - 1);
+                        found = overlap_map_next(&self->overlap_counts, &cursor);
+                        tsk_bug_assert(found);
+                        r = overlap_map_get_position(&self->overlap_counts, &cursor);
                     }
-                    alpha = msp_alloc_segment(
-                        self, l, r, v, population_id, label, NULL, NULL);
-                    if (alpha == NULL) {
+                    alpha = msp_alloc_segment(self, l, r, v, population_id, label,
+                        MSP_NULL_SEGMENT, MSP_NULL_SEGMENT);
+                    if (alpha == MSP_NULL_SEGMENT) {
                         ret = MSP_ERR_NO_MEMORY;
                         goto out;
                     }
                 }
-                tsk_bug_assert(v != x->value);
-                ret = msp_store_edge(self, l, r, v, x->value);
+                tsk_bug_assert(v != pool->value[x]);
+                ret = msp_store_edge(self, l, r, v, pool->value[x]);
                 if (ret != 0) {
                     goto out;
                 }
-                ret = msp_store_edge(self, l, r, v, y->value);
+                ret = msp_store_edge(self, l, r, v, pool->value[y]);
                 if (ret != 0) {
                     goto out;
                 }
                 /* Trim the ends of x and y, and prepare for next iteration. */
-                if (x->right == r) {
+                if (pool->right[x] == r) {
                     beta = x;
-                    x = x->next;
+                    x = pool->next[x];
                     msp_free_segment(self, beta);
                 } else {
-                    x->left = r;
+                    pool->left[x] = r;
                 }
-                if (y->right == r) {
+                if (pool->right[y] == r) {
                     beta = y;
-                    y = y->next;
+                    y = pool->next[y];
                     msp_free_segment(self, beta);
                 } else {
-                    y->left = r;
+                    pool->left[y] = r;
                 }
             }
         }
-        if (alpha != NULL) {
-            if (z == NULL) {
+        if (alpha != MSP_NULL_SEGMENT) {
+            if (z == MSP_NULL_SEGMENT) {
                 ret = msp_insert_individual(self, alpha);
                 if (ret != 0) {
                     goto out;
@@ -2913,15 +3821,16 @@ msp_merge_two_ancestors(msp_t *self, population_id_t population_id, label_id_t l
             } else {
                 if (self->store_full_arg) {
                     // we pre-empt the fact that values will be set equal later
-                    defrag_required |= z->right == alpha->left;
+                    defrag_required |= pool->right[z] == pool->left[alpha];
                 } else {
                     defrag_required
-                        |= z->right == alpha->left && z->value == alpha->value;
+                        |= pool->right[z] == pool->left[alpha]
+                           && pool->value[z] == pool->value[alpha];
                 }
-                tsk_bug_assert(z->right <= alpha->left);
-                z->next = alpha;
+                tsk_bug_assert(pool->right[z] <= pool->left[alpha]);
+                pool->next[z] = alpha;
             }
-            alpha->prev = z;
+            pool->prev[alpha] = z;
             msp_set_segment_mass(self, alpha);
             z = alpha;
         }
@@ -2959,29 +3868,29 @@ out:
 }
 
 static int MSP_WARN_UNUSED
-msp_priority_queue_insert(msp_t *self, avl_tree_t *Q, segment_t *u)
+msp_priority_queue_insert(msp_t *self, avl_tree_t *Q, segment_id_t u)
 {
     int ret = 0;
     avl_node_t *node;
 
-    tsk_bug_assert(u != NULL);
+    tsk_bug_assert(u != MSP_NULL_SEGMENT);
     node = msp_alloc_avl_node(self);
     if (node == NULL) {
         ret = MSP_ERR_NO_MEMORY;
         goto out;
     }
-    avl_init_node(node, u);
+    msp_init_segment_queue_node(self, node, u);
     node = avl_insert_node(Q, node);
     tsk_bug_assert(node != NULL);
 out:
     return ret;
 }
 
-static segment_t *
+static segment_id_t
 msp_priority_queue_pop(msp_t *self, avl_tree_t *Q)
 {
     avl_node_t *node = Q->head;
-    segment_t *seg = (segment_t *) node->item;
+    segment_id_t seg = msp_get_queue_segment(node);
     msp_free_avl_node(self, node);
     avl_unlink_node(Q, node);
 
@@ -2995,38 +3904,45 @@ msp_priority_queue_pop(msp_t *self, avl_tree_t *Q)
  */
 static int MSP_WARN_UNUSED
 msp_merge_ancestors(msp_t *self, avl_tree_t *Q, population_id_t population_id,
-    label_id_t label, tsk_id_t new_node_id, segment_t **ret_merged_head)
+    label_id_t label, tsk_id_t new_node_id, segment_id_t *ret_merged_head)
 
 {
+    segment_pool_t *pool = &self->segments;
     int ret = MSP_ERR_GENERIC;
     bool coalescence = false;
     bool defrag_required = false;
     uint32_t j, h;
     double l, r, r_max, next_l, l_min;
     avl_node_t *node;
-    node_mapping_t *nm, search;
-    segment_t *x, *z, *alpha;
-    segment_t **H = NULL;
-    segment_t *merged_head = NULL;
+    overlap_map_cursor_t cursor;
+    bool found;
+    uint32_t count;
+    segment_id_t x, y, z, alpha;
+    segment_id_t *H = NULL;
+    segment_id_t merged_head = MSP_NULL_SEGMENT;
     tsk_id_t individual = TSK_NULL;
 
-    H = malloc(avl_count(Q) * sizeof(segment_t *));
+    H = scratch_buffer_get(&self->scratch, avl_count(Q) * sizeof(segment_id_t));
     if (H == NULL) {
         ret = MSP_ERR_NO_MEMORY;
         goto out;
     }
     r_max = 0; /* keep compiler happy */
     l_min = 0;
-    z = NULL;
-    merged_head = NULL;
+    z = MSP_NULL_SEGMENT;
+    merged_head = MSP_NULL_SEGMENT;
+    /* Q is ordered by left coordinate, so the overlap counts are searched
+     * from left to right, each search starting from where the last ended. */
+    found = overlap_map_first(&self->overlap_counts, &cursor);
+    tsk_bug_assert(found);
     while (avl_count(Q) > 0) {
         h = 0;
         node = Q->head;
-        l = ((segment_t *) node->item)->left;
+        l = pool->left[msp_get_queue_segment(node)];
         r_max = self->sequence_length;
-        while (node != NULL && ((segment_t *) node->item)->left == l) {
-            H[h] = (segment_t *) node->item;
-            r_max = GSL_MIN(r_max, H[h]->right);
+        while (node != NULL && pool->left[msp_get_queue_segment(node)] == l) {
+            H[h] = msp_get_queue_segment(node);
+            r_max = GSL_MIN(r_max, pool->right[H[h]]);
             h++;
             msp_free_avl_node(self, node);
             avl_unlink_node(Q, node);
@@ -3034,26 +3950,27 @@ msp_merge_ancestors(msp_t *self, avl_tree_t *Q, population_id_t population_id,
         }
         next_l = 0;
         if (node != NULL) {
-            next_l = ((segment_t *) node->item)->left;
+            next_l = pool->left[msp_get_queue_segment(node)];
             r_max = GSL_MIN(r_max, next_l);
         }
-        alpha = NULL;
+        alpha = MSP_NULL_SEGMENT;
         if (h == 1) {
             x = H[0];
-            if (node != NULL && next_l < x->right) {
-                alpha = msp_alloc_segment(self, x->left, next_l, x->value, x->population,
-                    x->label, NULL, NULL);
-                if (alpha == NULL) {
+            if (node != NULL && next_l < pool->right[x]) {
+                alpha = msp_alloc_segment(self, pool->left[x], next_l, pool->value[x],
+                    pool->population[x], pool->label[x], MSP_NULL_SEGMENT,
+                    MSP_NULL_SEGMENT);
+                if (alpha == MSP_NULL_SEGMENT) {
                     ret = MSP_ERR_NO_MEMORY;
                     goto out;
                 }
-                x->left = next_l;
+                pool->left[x] = next_l;
             } else {
                 alpha = x;
-                x = x->next;
-                alpha->next = NULL;
+                x = pool->next[x];
+                pool->next[alpha] = MSP_NULL_SEGMENT;
             }
-            if (x != NULL) {
+            if (x != MSP_NULL_SEGMENT) {
                 ret = msp_priority_queue_insert(self, Q, x);
                 if (ret != 0) {
                     goto out;
@@ -3071,46 +3988,31 @@ msp_merge_ancestors(msp_t *self, avl_tree_t *Q, population_id_t population_id,
                 }
             }
             /* Insert overlap counts for bounds, if necessary */
-            search.position = l;
-            node = avl_search(&self->overlap_counts, &search);
-            if (node == NULL) {
-                ret = msp_copy_overlap_count(self, l);
-                if (ret < 0) {
-                    goto out;
-                }
-            }
-            search.position = r_max;
-            node = avl_search(&self->overlap_counts, &search);
-            if (node == NULL) {
-                ret = msp_copy_overlap_count(self, r_max);
-                if (ret < 0) {
-                    goto out;
-                }
+            ret = overlap_map_split_interval(&self->overlap_counts, l, r_max, &cursor);
+            if (ret < 0) {
+                goto out;
             }
             /* Update the extant segments and allocate alpha if the interval
              * has not coalesced. */
-            search.position = l;
-            node = avl_search(&self->overlap_counts, &search);
-            tsk_bug_assert(node != NULL);
-            nm = (node_mapping_t *) node->item;
-            if (nm->value == h) {
-                nm->value = 0;
-                node = node->next;
-                tsk_bug_assert(node != NULL);
-                nm = (node_mapping_t *) node->item;
-                r = nm->position;
+            count = overlap_map_get_count(&self->overlap_counts, &cursor);
+            if (count == h) {
+                overlap_map_set_count(&self->overlap_counts, &cursor, 0);
+                found = overlap_map_next(&self->overlap_counts, &cursor);
+                tsk_bug_assert(found);
+                r = overlap_map_get_position(&self->overlap_counts, &cursor);
             } else {
                 r = l;
-                while (nm->value != h && r < r_max) {
-                    nm->value -= h - 1;
-                    node = node->next;
-                    tsk_bug_assert(node != NULL);
-                    nm = (node_mapping_t *) node->item;
-                    r = nm->position;
+                while (count != h && r < r_max) {
+                    overlap_map_set_count(
+                        &self->overlap_counts, &cursor, count - (h - 1));
+                    found = overlap_map_next(&self->overlap_counts, &cursor);
+                    tsk_bug_assert(found);
+                    r = overlap_map_get_position(&self->overlap_counts, &cursor);
+                    count = overlap_map_get_count(&self->overlap_counts, &cursor);
                 }
-                alpha = msp_alloc_segment(
-                    self, l, r, new_node_id, population_id, label, NULL, NULL);
-                if (alpha == NULL) {
+                alpha = msp_alloc_segment(self, l, r, new_node_id, population_id, label,
+                    MSP_NULL_SEGMENT, MSP_NULL_SEGMENT);
+                if (alpha == MSP_NULL_SEGMENT) {
                     ret = MSP_ERR_NO_MEMORY;
                     goto out;
                 }
@@ -3118,18 +4020,19 @@ msp_merge_ancestors(msp_t *self, avl_tree_t *Q, population_id_t population_id,
             /* Store the edges and update the priority queue */
             for (j = 0; j < h; j++) {
                 x = H[j];
-                tsk_bug_assert(new_node_id != x->value);
-                ret = msp_store_edge(self, l, r, new_node_id, x->value);
+                tsk_bug_assert(new_node_id != pool->value[x]);
+                ret = msp_store_edge(self, l, r, new_node_id, pool->value[x]);
                 if (ret != 0) {
                     goto out;
                 }
-                if (x->right == r) {
-                    msp_free_segment(self, x);
-                    x = x->next;
-                } else if (x->right > r) {
-                    x->left = r;
+                if (pool->right[x] == r) {
+                    y = x;
+                    x = pool->next[x];
+                    msp_free_segment(self, y);
+                } else if (pool->right[x] > r) {
+                    pool->left[x] = r;
                 }
-                if (x != NULL) {
+                if (x != MSP_NULL_SEGMENT) {
                     ret = msp_priority_queue_insert(self, Q, x);
                     if (ret != 0) {
                         goto out;
@@ -3138,8 +4041,8 @@ msp_merge_ancestors(msp_t *self, avl_tree_t *Q, population_id_t population_id,
             }
         }
         /* Loop tail; integrate alpha into the global state */
-        if (alpha != NULL) {
-            if (z == NULL) {
+        if (alpha != MSP_NULL_SEGMENT) {
+            if (z == MSP_NULL_SEGMENT) {
                 merged_head = alpha;
                 ret = msp_insert_individual(self, alpha);
                 if (ret != 0) {
@@ -3148,14 +4051,15 @@ msp_merge_ancestors(msp_t *self, avl_tree_t *Q, population_id_t population_id,
             } else {
                 if (self->store_full_arg) {
                     // we pre-empt the fact that values will be set equal later
-                    defrag_required |= z->right == alpha->left;
+                    defrag_required |= pool->right[z] == pool->left[alpha];
                 } else {
                     defrag_required
-                        |= z->right == alpha->left && z->value == alpha->value;
+                        |= pool->right[z] == pool->left[alpha]
+                           && pool->value[z] == pool->value[alpha];
                 }
-                z->next = alpha;
+                pool->next[z] = alpha;
             }
-            alpha->prev = z;
+            pool->prev[alpha] = z;
             msp_set_segment_mass(self, alpha);
             z = alpha;
         }
@@ -3190,9 +4094,6 @@ msp_merge_ancestors(msp_t *self, avl_tree_t *Q, population_id_t population_id,
     }
     ret = 0;
 out:
-    if (H != NULL) {
-        free(H);
-    }
     return ret;
 }
 
@@ -3201,24 +4102,21 @@ out:
  * where necessary. */
 static int MSP_WARN_UNUSED
 msp_merge_n_ancestors(msp_t *self, avl_tree_t *Q, population_id_t population_id,
-    label_id_t label, tsk_id_t new_node_id, segment_t **ret_merged_head)
+    label_id_t label, tsk_id_t new_node_id, segment_id_t *ret_merged_head)
 {
+    segment_pool_t *pool = &self->segments;
     int ret = 0;
     const size_t num_common_ancestors = avl_count(Q);
-    population_t *current_pop;
-    avl_node_t *a, *avl_node;
-    segment_t *merged_head = NULL;
-    segment_t *u, *v;
+    avl_node_t *a;
+    segment_id_t merged_head = MSP_NULL_SEGMENT;
+    segment_id_t u, v;
 
     /* Migrate any of the child segments to this population, if necessary */
     for (a = Q->head; a != NULL; a = a->next) {
-        u = (segment_t *) a->item;
-        if (u->population != population_id) {
-            current_pop = &self->populations[u->population];
-            avl_node = avl_search(&current_pop->ancestors[label], u);
-            tsk_bug_assert(avl_node != NULL);
-            ret = msp_move_individual(
-                self, avl_node, &current_pop->ancestors[label], population_id, label);
+        u = msp_get_queue_segment(a);
+        if (pool->population[u] != population_id) {
+            tsk_bug_assert(pool->label[u] == label);
+            ret = msp_move_individual(self, u, population_id, label);
             if (ret != 0) {
                 goto out;
             }
@@ -3242,8 +4140,8 @@ msp_merge_n_ancestors(msp_t *self, avl_tree_t *Q, population_id_t population_id,
     if (ret_merged_head != NULL) {
         *ret_merged_head = merged_head;
     }
-    if (merged_head != NULL) {
-        tsk_bug_assert(merged_head->population == population_id);
+    if (merged_head != MSP_NULL_SEGMENT) {
+        tsk_bug_assert(pool->population[merged_head] == population_id);
     }
 out:
     return ret;
@@ -3253,75 +4151,70 @@ static int MSP_WARN_UNUSED
 msp_migration_event(msp_t *self, population_id_t source_pop, population_id_t dest_pop)
 {
     int ret = 0;
-    uint32_t j;
-    avl_node_t *node;
+    size_t j;
     label_id_t label = 0; /* For now only support label 0 */
-    avl_tree_t *source = &self->populations[source_pop].ancestors[label];
+    ancestor_set_t *source = &self->populations[source_pop].ancestors[label];
     size_t index = ((size_t) source_pop) * self->num_populations + (size_t) dest_pop;
+    size_t num_segment_updates = self->num_segment_updates;
+    size_t num_stored_edges = self->num_stored_edges;
 
+    msp_timer_start(self, MSP_TIMER_MIGRATION);
     self->num_migration_events[index]++;
-    j = (uint32_t) gsl_rng_uniform_int(self->rng, avl_count(source));
-    node = avl_at(source, j);
-    tsk_bug_assert(node != NULL);
-    ret = msp_move_individual(self, node, source, dest_pop, label);
+    j = (size_t) variate_buffer_uniform_int(&self->variates, source->num_lineages);
+    ret = msp_move_individual(self, source->lineages[j], dest_pop, label);
+    if (ret == 0) {
+        msp_trace_event(self, MSP_TRACE_MIGRATION, source_pop, label,
+            num_segment_updates, num_stored_edges);
+    }
+    msp_timer_stop(self, MSP_TIMER_MIGRATION);
     return ret;
 }
 
 static int MSP_WARN_UNUSED
 msp_reset_memory_state(msp_t *self)
 {
+    segment_pool_t *pool = &self->segments;
     int ret = 0;
-    avl_node_t *node;
-    node_mapping_t *nm;
     population_t *pop;
-    segment_t *u, *v;
+    segment_id_t u, v;
     label_id_t label;
-    size_t j;
+    size_t j, k;
 
     for (j = 0; j < self->num_populations; j++) {
         pop = &self->populations[j];
         for (label = 0; label < (label_id_t) self->num_labels; label++) {
-            for (node = pop->ancestors[label].head; node != NULL; node = node->next) {
-                u = (segment_t *) node->item;
-                while (u != NULL) {
-                    v = u->next;
+            for (k = 0; k < pop->ancestors[label].num_lineages; k++) {
+                u = pop->ancestors[label].lineages[k];
+                while (u != MSP_NULL_SEGMENT) {
+                    v = pool->next[u];
                     msp_free_segment(self, u);
                     u = v;
                 }
-                avl_unlink_node(&pop->ancestors[label], node);
-                msp_free_avl_node(self, node);
             }
+            pop->ancestors[label].num_lineages = 0;
         }
     }
-    for (node = self->breakpoints.head; node != NULL; node = node->next) {
-        nm = (node_mapping_t *) node->item;
-        avl_unlink_node(&self->breakpoints, node);
-        msp_free_avl_node(self, node);
-        msp_free_node_mapping(self, nm);
-    }
-    for (node = self->overlap_counts.head; node != NULL; node = node->next) {
-        nm = (node_mapping_t *) node->item;
-        avl_unlink_node(&self->overlap_counts, node);
-        msp_free_avl_node(self, node);
-        msp_free_node_mapping(self, nm);
-    }
+    breakpoint_set_clear(&self->breakpoints);
+    overlap_map_clear(&self->overlap_counts);
+    scratch_buffer_reset(&self->scratch);
     return ret;
 }
 
 static int
-msp_insert_root_segments(msp_t *self, const segment_t *head, segment_t **new_head)
+msp_insert_root_segments(msp_t *self, segment_id_t head, segment_id_t *new_head)
 {
+    segment_pool_t *pool = &self->segments;
     int ret = 0;
-    segment_t *copy, *prev;
-    const segment_t *seg;
+    segment_id_t copy, prev;
+    segment_id_t seg;
     double breakpoints[2];
     int j;
 
-    prev = NULL;
-    for (seg = head; seg != NULL; seg = seg->next) {
+    prev = MSP_NULL_SEGMENT;
+    for (seg = head; seg != MSP_NULL_SEGMENT; seg = pool->next[seg]) {
         /* Insert breakpoints, if we need to */
-        breakpoints[0] = seg->left;
-        breakpoints[1] = seg->right;
+        breakpoints[0] = pool->left[seg];
+        breakpoints[1] = pool->right[seg];
         for (j = 0; j < 2; j++) {
             if (breakpoints[j] != 0 && breakpoints[j] != self->sequence_length
                 && !msp_has_breakpoint(self, breakpoints[j])) {
@@ -3333,22 +4226,22 @@ msp_insert_root_segments(msp_t *self, const segment_t *head, segment_t **new_hea
         }
         /* Copy the segment and insert into the global state */
         copy = msp_copy_segment(self, seg);
-        if (copy == NULL) {
+        if (copy == MSP_NULL_SEGMENT) {
             ret = MSP_ERR_NO_MEMORY;
             goto out;
         }
         if (seg == head && new_head != NULL) {
             *new_head = copy;
         }
-        copy->prev = prev;
-        if (prev == NULL) {
+        pool->prev[copy] = prev;
+        if (prev == MSP_NULL_SEGMENT) {
             ret = msp_insert_individual(self, copy);
             if (ret != 0) {
                 goto out;
             }
 
         } else {
-            prev->next = copy;
+            pool->next[prev] = copy;
         }
         msp_set_segment_mass(self, copy);
         prev = copy;
@@ -3360,12 +4253,13 @@ out:
 static int MSP_WARN_UNUSED
 msp_insert_sample(msp_t *self, tsk_id_t node)
 {
+    segment_pool_t *pool = &self->segments;
     int ret = 0;
-    segment_t *root_seg;
+    segment_id_t root_seg;
     population_t pop;
 
     root_seg = self->root_segments[node];
-    pop = self->populations[root_seg->population];
+    pop = self->populations[pool->population[root_seg]];
     if (pop.state != MSP_POP_STATE_ACTIVE) {
         ret = MSP_ERR_POPULATION_INACTIVE_SAMPLE;
         goto out;
@@ -3381,11 +4275,12 @@ out:
 
 static inline int
 msp_allocate_root_segments(msp_t *self, tsk_tree_t *tree, double left, double right,
-    segment_t *restrict *root_segments_head, segment_t *restrict *root_segments_tail)
+    segment_id_t *restrict root_segments_head, segment_id_t *restrict root_segments_tail)
 {
+    segment_pool_t *pool = &self->segments;
     int ret = 0;
     tsk_id_t root;
-    segment_t *seg, *tail;
+    segment_id_t seg, tail;
     population_id_t population;
     const population_id_t *restrict node_population = self->tables->nodes.population;
     label_id_t label = 0; /* For now only support label 0 */
@@ -3399,10 +4294,10 @@ msp_allocate_root_segments(msp_t *self, tsk_tree_t *tree, double left, double ri
             ret = MSP_ERR_POPULATION_OUT_OF_BOUNDS;
             goto out;
         }
-        if (root_segments_head[root] == NULL) {
-            seg = msp_alloc_segment(
-                self, left, right, root, population, label, NULL, NULL);
-            if (seg == NULL) {
+        if (root_segments_head[root] == MSP_NULL_SEGMENT) {
+            seg = msp_alloc_segment(self, left, right, root, population, label,
+                MSP_NULL_SEGMENT, MSP_NULL_SEGMENT);
+            if (seg == MSP_NULL_SEGMENT) {
                 ret = MSP_ERR_NO_MEMORY;
                 goto out;
             }
@@ -3410,16 +4305,16 @@ msp_allocate_root_segments(msp_t *self, tsk_tree_t *tree, double left, double ri
             root_segments_tail[root] = seg;
         } else {
             tail = root_segments_tail[root];
-            if (tail->right == left) {
-                tail->right = right;
+            if (pool->right[tail] == left) {
+                pool->right[tail] = right;
             } else {
                 seg = msp_alloc_segment(
-                    self, left, right, root, population, label, tail, NULL);
-                if (seg == NULL) {
+                    self, left, right, root, population, label, tail, MSP_NULL_SEGMENT);
+                if (seg == MSP_NULL_SEGMENT) {
                     ret = MSP_ERR_NO_MEMORY;
                     goto out;
                 }
-                tail->next = seg;
+                pool->next[tail] = seg;
                 root_segments_tail[root] = seg;
             }
         }
@@ -3439,7 +4334,7 @@ msp_process_input_trees(msp_t *self)
     tsk_size_t num_trees, num_roots;
     const size_t num_nodes = self->tables->nodes.num_rows;
     overlap_count_t *overlap;
-    segment_t **root_segments_tail = NULL;
+    segment_id_t *root_segments_tail = NULL;
 
     /* Initialise the memory for the tree and tree sequence so we can
      * safely free them in all cases */
@@ -3578,7 +4473,7 @@ msp_pedigree_insert_ancient_samples(msp_t *self)
 {
     int ret = 0;
     sampling_event_t *se;
-    segment_t *root_seg, *new_head;
+    segment_id_t root_seg, new_head;
 
     while (self->next_sampling_event < self->num_sampling_events
            && self->sampling_events[self->next_sampling_event].time <= self->time) {
@@ -3617,6 +4512,10 @@ static int MSP_WARN_UNUSED
 msp_apply_fixed_events(msp_t *self, double time)
 {
     int ret = 0;
+    size_t num_segment_updates = self->num_segment_updates;
+    size_t num_stored_edges = self->num_stored_edges;
+
+    msp_timer_start(self, MSP_TIMER_FIXED_EVENTS);
 
     ret = msp_apply_demographic_events(self, time);
     if (ret != 0) {
@@ -3627,6 +4526,11 @@ msp_apply_fixed_events(msp_t *self, double time)
         goto out;
     }
 out:
+    if (ret == 0) {
+        msp_trace_event(self, MSP_TRACE_FIXED_EVENTS, TSK_NULL, TSK_NULL,
+            num_segment_updates, num_stored_edges);
+    }
+    msp_timer_stop(self, MSP_TIMER_FIXED_EVENTS);
     return ret;
 }
 
@@ -3657,6 +4561,7 @@ msp_reset(msp_t *self)
         pop->initial_size = initial_pop->initial_size;
         pop->start_time = 0;
         pop->state = initial_pop->state;
+        msp_update_population_epoch(self, population_id);
     }
     /* Reset the tables to their correct position for replication */
     ret = tsk_table_collection_truncate(self->tables, &self->input_position);
@@ -3685,6 +4590,14 @@ msp_reset(msp_t *self)
     self->num_trapped_re_events = 0;
     self->num_multiple_re_events = 0;
     memset(self->num_migration_events, 0, N * N * sizeof(size_t));
+    memset(self->timer_elapsed, 0, sizeof(self->timer_elapsed));
+    memset(self->timer_calls, 0, sizeof(self->timer_calls));
+    self->num_traced_events = 0;
+    /* Discard buffered variates so that reseeding the generator between
+     * replicates gives the same results as a fresh simulator. */
+    variate_buffer_clear(&self->variates);
+    self->population_indexes_valid = false;
+    self->event_queue_valid = false;
 
     if (self->start_time < DBL_MAX) {
         while ((event_time = msp_get_next_fixed_event_time(self)) <= self->start_time) {
@@ -3703,11 +4616,12 @@ out:
 static int MSP_WARN_UNUSED
 msp_initialise_simulation_state(msp_t *self)
 {
+    segment_pool_t *pool = &self->segments;
     int ret = 0;
     tsk_size_t num_samples;
     size_t j;
     double min_root_time;
-    segment_t *head;
+    segment_id_t head;
     tsk_id_t root;
     const double *restrict node_time = self->tables->nodes.time;
     const tsk_id_t *restrict node_population = self->tables->nodes.population;
@@ -3727,8 +4641,8 @@ msp_initialise_simulation_state(msp_t *self)
     min_root_time = DBL_MAX;
     for (j = 0; j < self->input_position.nodes; j++) {
         head = self->root_segments[j];
-        if (head != NULL) {
-            root = head->value;
+        if (head != MSP_NULL_SEGMENT) {
+            root = pool->value[head];
             min_root_time = GSL_MIN(node_time[root], min_root_time);
         }
     }
@@ -3744,8 +4658,8 @@ msp_initialise_simulation_state(msp_t *self)
     num_samples = 0;
     for (j = 0; j < self->input_position.nodes; j++) {
         head = self->root_segments[j];
-        if (head != NULL) {
-            root = head->value;
+        if (head != MSP_NULL_SEGMENT) {
+            root = pool->value[head];
             samples[num_samples] = root;
             num_samples++;
         }
@@ -3843,12 +4757,12 @@ msp_get_common_ancestor_waiting_time_from_rate(
     double u, dt, z;
 
     if (lambda > 0.0) {
-        u = gsl_ran_exponential(self->rng, 1.0 / lambda);
+        u = variate_buffer_exponential(&self->variates, 1.0 / lambda);
         if (alpha == 0.0) {
-            ret = self->ploidy * pop->initial_size * u;
+            ret = pop->ploidy_size * u;
         } else {
             dt = t - pop->start_time;
-            z = 1 + self->ploidy * alpha * pop->initial_size * exp(-alpha * dt) * u;
+            z = 1 + pop->growth_scale * exp(-alpha * dt) * u;
             /* if z is <= 0 no coancestry can occur */
             if (z > 0) {
                 ret = log(z) / alpha;
@@ -3861,6 +4775,199 @@ msp_get_common_ancestor_waiting_time_from_rate(
     return ret;
 }
 
+static void
+msp_set_event_rate(msp_t *self, population_id_t population_id, int type, double rate)
+{
+    fenwick_t *index = &self->event_rate_index;
+    size_t j = ((size_t) population_id) * MSP_NUM_EVENT_RATE_TYPES + (size_t) type + 1;
+    double current = fenwick_get_value(index, j);
+
+    if (current == 0 && rate != 0) {
+        self->num_nonzero_event_rates++;
+    } else if (current != 0 && rate == 0) {
+        self->num_nonzero_event_rates--;
+    }
+    fenwick_set_value(index, j, rate);
+}
+
+/* Writes the rates of the common ancestor and migration events for the
+ * specified population into the event rate index. */
+static void
+msp_update_event_rates(msp_t *self, population_id_t population_id)
+{
+    population_t *pop = &self->populations[population_id];
+    /* Only support a single label for now. */
+    double n = (double) pop->ancestors[0].num_lineages;
+    double ca_rate = 0;
+
+    if (pop->ca_rate_indexed && n > 1) {
+        ca_rate = n * (n - 1.0) / 2.0 / pop->ploidy_size;
+    }
+    msp_set_event_rate(self, population_id, MSP_EVENT_RATE_CA, ca_rate);
+    msp_set_event_rate(
+        self, population_id, MSP_EVENT_RATE_MIGRATION, n * pop->total_migration_rate);
+    pop->event_rates_dirty = false;
+}
+
+static void
+msp_update_dirty_event_rates(msp_t *self)
+{
+    uint32_t j;
+
+    for (j = 0; j < self->num_dirty_populations; j++) {
+        msp_update_event_rates(self, self->dirty_populations[j]);
+    }
+    self->num_dirty_populations = 0;
+}
+
+static void
+msp_compute_event_rates(msp_t *self)
+{
+    population_id_t j;
+
+    for (j = 0; j < (population_id_t) self->num_populations; j++) {
+        msp_update_population_epoch(self, j);
+        msp_update_event_rates(self, j);
+    }
+    self->ca_rates_indexed = msp_ca_rates_indexable(self);
+    self->num_dirty_populations = 0;
+    fenwick_rebuild(&self->event_rate_index);
+}
+
+/* Returns the waiting time until the next event tracked in the event
+ * rate index. */
+static int MSP_WARN_UNUSED
+msp_sample_event_rate_waiting_time(msp_t *self, double *ret_t_wait)
+{
+    int ret = 0;
+    fenwick_t *index = &self->event_rate_index;
+    double lambda;
+
+    msp_update_dirty_event_rates(self);
+    *ret_t_wait = DBL_MAX;
+    if (self->num_nonzero_event_rates > 0) {
+        if (fenwick_rebuild_required(index)) {
+            msp_timer_start(self, MSP_TIMER_FENWICK_REBUILD);
+            fenwick_rebuild(index);
+            msp_timer_stop(self, MSP_TIMER_FENWICK_REBUILD);
+            self->num_fenwick_rebuilds++;
+        }
+        lambda = fenwick_get_total(index);
+        if (!isfinite(lambda)) {
+            ret = MSP_ERR_BREAKPOINT_MASS_NON_FINITE;
+            goto out;
+        }
+        *ret_t_wait = variate_buffer_exponential(&self->variates, 1.0 / lambda);
+        if (*ret_t_wait == 0) {
+            *ret_t_wait = handle_zero_waiting_time(self->time);
+        }
+    }
+out:
+    return ret;
+}
+
+/* Chooses an event from the event rate index with probability proportional
+ * to its rate, returning the event type and the population. */
+static int
+msp_choose_event(msp_t *self, population_id_t *population_id)
+{
+    fenwick_t *index = &self->event_rate_index;
+    double u = variate_buffer_flat(&self->variates, 0, fenwick_get_total(index));
+    size_t j = fenwick_find(index, u);
+
+    tsk_bug_assert(j > 0 && fenwick_get_value(index, j) > 0);
+    *population_id = (population_id_t)((j - 1) / MSP_NUM_EVENT_RATE_TYPES);
+    return (int) ((j - 1) % MSP_NUM_EVENT_RATE_TYPES);
+}
+
+/* Chooses the destination for a lineage migrating out of the specified
+ * population with probability proportional to the migration rate, using
+ * the alias table built in msp_compute_migration_destinations. */
+static population_id_t
+msp_choose_migration_destination(msp_t *self, population_id_t source)
+{
+    population_t *pop = &self->populations[source];
+    const double D = (double) pop->num_potential_destinations;
+    double u = variate_buffer_uniform(&self->variates) * D;
+    tsk_size_t k = (tsk_size_t) u;
+
+    tsk_bug_assert(pop->num_potential_destinations > 0);
+    if (k == pop->num_potential_destinations) {
+        k--;
+    }
+    if (u - (double) k >= pop->migration_alias_probability[k]) {
+        k = (tsk_size_t) pop->migration_alias[k];
+    }
+    return pop->potential_destinations[k];
+}
+
+/* Sets up the potential destinations, the total rate of migration and
+ * the alias table (using Vose's method) for the specified source
+ * population from the current migration matrix. */
+static void
+msp_compute_migration_destinations(msp_t *self, population_id_t source)
+{
+    const tsk_id_t N = (tsk_id_t) self->num_populations;
+    const double *M = self->migration_matrix + source * N;
+    population_t *pop = &self->populations[source];
+    double *prob = pop->migration_alias_probability;
+    tsk_id_t *alias = pop->migration_alias;
+    tsk_id_t *work = self->migration_alias_work;
+    tsk_id_t k, s, l, num_small, num_large, D;
+    double total = 0;
+
+    pop->num_potential_destinations = 0;
+    for (k = 0; k < N; k++) {
+        if (M[k] > 0) {
+            pop->potential_destinations[pop->num_potential_destinations] = k;
+            pop->num_potential_destinations++;
+            total += M[k];
+        }
+    }
+    pop->total_migration_rate = total;
+
+    /* The small entries are stacked from the start of the work array and
+     * the large entries from the end. */
+    D = (tsk_id_t) pop->num_potential_destinations;
+    num_small = 0;
+    num_large = 0;
+    for (k = 0; k < D; k++) {
+        prob[k] = M[pop->potential_destinations[k]] * D / total;
+        alias[k] = k;
+        if (prob[k] < 1.0) {
+            work[num_small] = k;
+            num_small++;
+        } else {
+            num_large++;
+            work[D - num_large] = k;
+        }
+    }
+    while (num_small > 0 && num_large > 0) {
+        num_small--;
+        s = work[num_small];
+        l = work[D - num_large];
+        num_large--;
+        alias[s] = l;
+        prob[l] = (prob[l] + prob[s]) - 1.0;
+        if (prob[l] < 1.0) {
+            work[num_small] = l;
+            num_small++;
+        } else {
+            num_large++;
+            work[D - num_large] = l;
+        }
+    }
+    /* Anything left over is within rounding error of 1 */
+    while (num_small > 0) {
+        num_small--;
+        prob[work[num_small]] = 1.0;
+    }
+    while (num_large > 0) {
+        prob[work[D - num_large]] = 1.0;
+        num_large--;
+    }
+}
+
 /* Computes the set of non empty populations and the set
  * of populations reachable from each population. */
 static int MSP_WARN_UNUSED
@@ -3868,23 +4975,16 @@ msp_compute_population_indexes(msp_t *self)
 {
     int ret = 0;
     const tsk_id_t N = (tsk_id_t) self->num_populations;
-    tsk_id_t j, k;
-    double migration_rate;
-    population_t *pop;
+    tsk_id_t j;
     avl_node_t *avl_node;
 
     /* Set up the possible destinations for each population */
     for (j = 0; j < N; j++) {
-        pop = &self->populations[j];
-        pop->num_potential_destinations = 0;
-        for (k = 0; k < N; k++) {
-            migration_rate = self->migration_matrix[j * N + k];
-            if (migration_rate > 0) {
-                pop->potential_destinations[pop->num_potential_destinations] = k;
-                pop->num_potential_destinations++;
-            }
-        }
+        msp_compute_migration_destinations(self, j);
+        self->populations[j].migration_row_changed = false;
     }
+    self->num_changed_migration_rows = 0;
+    self->population_parameters_changed = false;
 
     /* Set up the non_empty_populations */
     /* First clear out any existing structures */
@@ -3902,6 +5002,58 @@ msp_compute_population_indexes(msp_t *self)
             }
         }
     }
+    msp_compute_event_rates(self);
+out:
+    return ret;
+}
+
+/* Patches the population indexes to reflect the changes reported by the
+ * demographic and sampling events that have just been applied. Only the
+ * migration rows that were changed are recomputed, and only populations
+ * whose number of ancestors or parameters changed are updated. */
+static int MSP_WARN_UNUSED
+msp_update_population_indexes(msp_t *self)
+{
+    int ret = 0;
+    uint32_t j;
+    population_id_t pop_id;
+    avl_node_t *avl_node;
+
+    for (j = 0; j < self->num_changed_migration_rows; j++) {
+        pop_id = self->changed_migration_rows[j];
+        msp_compute_migration_destinations(self, pop_id);
+        self->populations[pop_id].migration_row_changed = false;
+        /* The total migration rate out of the population may have changed */
+        msp_mark_population_dirty(self, pop_id);
+    }
+    self->num_changed_migration_rows = 0;
+
+    for (j = 0; j < self->num_dirty_populations; j++) {
+        pop_id = self->dirty_populations[j];
+        if (msp_get_num_population_ancestors(self, pop_id) > 0) {
+            ret = msp_insert_non_empty_population(self, pop_id);
+            if (ret != 0) {
+                goto out;
+            }
+        } else {
+            avl_node = avl_search(
+                &self->non_empty_populations, (void *) (intptr_t) pop_id);
+            if (avl_node != NULL) {
+                avl_unlink_node(&self->non_empty_populations, avl_node);
+                msp_free_avl_node(self, avl_node);
+            }
+        }
+    }
+
+    if (self->population_parameters_changed) {
+        /* The rates for the changed populations are updated along with the
+         * other dirty populations, but we may need to start or stop
+         * sampling CA waiting times for non-indexed populations. */
+        self->population_parameters_changed = false;
+        self->ca_rates_indexed = msp_ca_rates_indexable(self);
+    }
+    /* Any remaining dirty populations are updated in the event rate index
+     * before the next waiting time is sampled. */
 out:
     return ret;
 }
@@ -3928,7 +5080,9 @@ msp_sample_waiting_time(
          * now and again. */
 
         if (fenwick_rebuild_required(mass_index)) {
+            msp_timer_start(self, MSP_TIMER_FENWICK_REBUILD);
             fenwick_rebuild(mass_index);
+            msp_timer_stop(self, MSP_TIMER_FENWICK_REBUILD);
             self->num_fenwick_rebuilds++;
         }
 
@@ -3937,10 +5091,14 @@ msp_sample_waiting_time(
             ret = MSP_ERR_BREAKPOINT_MASS_NON_FINITE;
             goto out;
         }
+        if (fenwick_fixed_point_overflowed(mass_index)) {
+            ret = MSP_ERR_MASS_INDEX_OVERFLOW;
+            goto out;
+        }
         lambda = total_mass;
         t_wait = DBL_MAX;
         if (lambda > 0.0) {
-            t_wait = gsl_ran_exponential(self->rng, 1.0 / lambda);
+            t_wait = variate_buffer_exponential(&self->variates, 1.0 / lambda);
         }
 
         *ret_t_wait = t_wait;
@@ -3960,13 +5118,11 @@ msp_get_total_gc_left(msp_t *self)
     return total;
 }
 
-static segment_t *
+static segment_id_t
 msp_find_gc_left_individual(msp_t *self, label_id_t label, double value)
 {
     size_t j, num_ancestors, individual_index;
-    avl_tree_t *ancestors;
-    avl_node_t *node;
-    segment_t *ind;
+    ancestor_set_t *ancestors;
 
     double mean_gc_rate = rate_map_get_total_mass(&self->gc_map) / self->sequence_length;
     individual_index = (size_t) floor(value / (mean_gc_rate * self->gc_tract_length));
@@ -3975,15 +5131,13 @@ msp_find_gc_left_individual(msp_t *self, label_id_t label, double value)
         if (individual_index < num_ancestors) {
             ancestors = &self->populations[j].ancestors[label];
             /* Choose the correct individual */
-            node = avl_at(ancestors, (unsigned int) individual_index);
-            assert(node != NULL);
-            ind = (segment_t *) node->item;
-            return ind;
+            tsk_bug_assert(individual_index < ancestors->num_lineages);
+            return ancestors->lineages[individual_index];
         } else {
             individual_index -= num_ancestors;
         }
     }
-    return NULL;
+    return MSP_NULL_SEGMENT;
 }
 
 static double
@@ -4008,7 +5162,7 @@ msp_sample_gc_left_waiting_time(msp_t *self, double *ret_t_wait)
     double t_wait = DBL_MAX;
 
     if (lambda > 0.0) {
-        t_wait = gsl_ran_exponential(self->rng, 1.0 / lambda);
+        t_wait = variate_buffer_exponential(&self->variates, 1.0 / lambda);
     }
     *ret_t_wait = t_wait;
     return ret;
@@ -4017,14 +5171,21 @@ msp_sample_gc_left_waiting_time(msp_t *self, double *ret_t_wait)
 static int MSP_WARN_UNUSED
 msp_gene_conversion_left_event(msp_t *self, label_id_t label)
 {
+    segment_pool_t *pool = &self->segments;
     int ret = 0;
     const double gc_left_total = msp_get_total_gc_left(self);
-    double h = gsl_rng_uniform(self->rng) * gc_left_total;
+    double h = variate_buffer_uniform(&self->variates) * gc_left_total;
     double tl, bp;
-    segment_t *y, *x, *alpha;
+    segment_id_t y, x, alpha;
+    population_id_t population;
+    size_t num_segment_updates = self->num_segment_updates;
+    size_t num_stored_edges = self->num_stored_edges;
+
+    msp_timer_start(self, MSP_TIMER_GENE_CONVERSION);
 
     y = msp_find_gc_left_individual(self, label, h);
-    assert(y != NULL);
+    assert(y != MSP_NULL_SEGMENT);
+    population = pool->population[y];
 
     /* generate tract length */
     tl = msp_generate_gc_tract_length(self);
@@ -4036,24 +5197,24 @@ msp_gene_conversion_left_event(msp_t *self, label_id_t label)
     self->num_internal_gc_events++;
     self->sum_internal_gc_tract_lengths += tl;
 
-    bp = y->left + tl;
+    bp = pool->left[y] + tl;
 
-    while (y != NULL && y->right <= bp) {
-        y = y->next;
+    while (y != MSP_NULL_SEGMENT && pool->right[y] <= bp) {
+        y = pool->next[y];
     }
 
-    if (y == NULL) {
+    if (y == MSP_NULL_SEGMENT) {
         //   last segment
         // ... ==========   |
         //                  bp
         self->num_noneffective_gc_events++;
-        return 0;
+        goto out;
     }
-    tsk_bug_assert(y != NULL);
+    tsk_bug_assert(y != MSP_NULL_SEGMENT);
     self->num_gc_events++;
-    x = y->prev;
+    x = pool->prev[y];
 
-    if (y->left < bp) {
+    if (pool->left[y] < bp) {
         //  x          y
         // =====   =====|====
         //              bp
@@ -4063,17 +5224,17 @@ msp_gene_conversion_left_event(msp_t *self, label_id_t label)
         //              =====
         //                α
         alpha = msp_copy_segment(self, y);
-        if (alpha == NULL) {
+        if (alpha == MSP_NULL_SEGMENT) {
             ret = MSP_ERR_NO_MEMORY;
             goto out;
         }
-        alpha->left = bp;
-        alpha->prev = NULL;
-        if (alpha->next != NULL) {
-            alpha->next->prev = alpha;
+        pool->left[alpha] = bp;
+        pool->prev[alpha] = MSP_NULL_SEGMENT;
+        if (pool->next[alpha] != MSP_NULL_SEGMENT) {
+            pool->prev[pool->next[alpha]] = alpha;
         }
-        y->next = NULL;
-        y->right = bp;
+        pool->next[y] = MSP_NULL_SEGMENT;
+        pool->right[y] = bp;
         msp_set_segment_mass(self, y);
         if (!msp_has_breakpoint(self, bp)) {
             ret = msp_insert_breakpoint(self, bp);
@@ -4090,21 +5251,275 @@ msp_gene_conversion_left_event(msp_t *self, label_id_t label)
         // =====
         //          =========
         //              α
-        x->next = NULL;
-        y->prev = NULL;
+        pool->next[x] = MSP_NULL_SEGMENT;
+        pool->prev[y] = MSP_NULL_SEGMENT;
         alpha = y;
         // Ensure y points to the last segment left of the break for full ARG recording
         y = x;
     }
     msp_set_segment_mass(self, alpha);
-    tsk_bug_assert(alpha->prev == NULL);
+    tsk_bug_assert(pool->prev[alpha] == MSP_NULL_SEGMENT);
     ret = msp_insert_individual(self, alpha);
     if (self->store_full_arg) {
-        ret = msp_store_arg_gene_conversion(self, NULL, y, alpha);
+        ret = msp_store_arg_gene_conversion(self, MSP_NULL_SEGMENT, y, alpha);
         if (ret != 0) {
             goto out;
         }
     }
+out:
+    if (ret == 0) {
+        msp_trace_event(self, MSP_TRACE_GENE_CONVERSION, population, label,
+            num_segment_updates, num_stored_edges);
+    }
+    msp_timer_stop(self, MSP_TIMER_GENE_CONVERSION);
+    return ret;
+}
+
+/* Calls the model's common ancestor event function, recording the time
+ * taken and the event trace. Returns 1 if the model rejected the event. */
+static int MSP_WARN_UNUSED
+msp_common_ancestor_event(msp_t *self, population_id_t pop_id, label_id_t label)
+{
+    int ret;
+    size_t num_segment_updates = self->num_segment_updates;
+    size_t num_stored_edges = self->num_stored_edges;
+
+    msp_timer_start(self, MSP_TIMER_COMMON_ANCESTOR);
+    ret = self->common_ancestor_event(self, pop_id, label);
+    if (ret == 0) {
+        msp_trace_event(self, MSP_TRACE_COMMON_ANCESTOR, pop_id, label,
+            num_segment_updates, num_stored_edges);
+    }
+    msp_timer_stop(self, MSP_TIMER_COMMON_ANCESTOR);
+    return ret;
+}
+
+/* Runs a common ancestor event in the specified population and updates
+ * the set of non-empty populations. Returns 1 if the model rejected
+ * the event. */
+static int MSP_WARN_UNUSED
+msp_apply_common_ancestor_event(msp_t *self, population_id_t pop_id, label_id_t label)
+{
+    int ret, err;
+
+    ret = msp_common_ancestor_event(self, pop_id, label);
+    if (ret < 0) {
+        goto out;
+    }
+    msp_mark_population_dirty(self, pop_id);
+    if (msp_get_num_population_ancestors(self, pop_id) == 0) {
+        err = msp_remove_non_empty_population(self, pop_id);
+        if (err != 0) {
+            ret = err;
+        }
+    }
+out:
+    return ret;
+}
+
+/* Migrates a lineage out of the specified source population, choosing the
+ * destination in proportion to the migration rates. */
+static int MSP_WARN_UNUSED
+msp_apply_migration_event(msp_t *self, population_id_t source)
+{
+    int ret = 0;
+    /* m[j, k] is the rate at which migrants move from
+     * population k to j forwards in time. Backwards
+     * in time, we move the individual from from
+     * population j into population k.
+     */
+    population_id_t dest = msp_choose_migration_destination(self, source);
+
+    ret = msp_migration_event(self, source, dest);
+    if (ret != 0) {
+        goto out;
+    }
+    msp_mark_population_dirty(self, source);
+    msp_mark_population_dirty(self, dest);
+    if (msp_get_num_population_ancestors(self, source) == 0) {
+        ret = msp_remove_non_empty_population(self, source);
+        if (ret != 0) {
+            goto out;
+        }
+    }
+    ret = msp_insert_non_empty_population(self, dest);
+out:
+    return ret;
+}
+
+/* Moves the segments into a new pool in which they are numbered 1 to n in
+ * the order of their chains, where n is the number of segments, and which
+ * is the smallest multiple of the block size with room for num_spare more
+ * segments. The mass indexes and ancestor_index are shrunk to match. Every
+ * segment must be in a population or be a root segment. */
+static int MSP_WARN_UNUSED
+msp_compact_segments(msp_t *self, size_t num_spare)
+{
+    segment_pool_t *pool = &self->segments;
+    int ret = 0;
+    const size_t block_size = self->segment_block_size;
+    const size_t num_segments = segment_pool_get_num_allocated(pool);
+    size_t size, j, l, n;
+    label_id_t label;
+    ancestor_set_t *ancestors;
+    segment_id_t u;
+    segment_pool_t new_pool;
+    uint32_t *old_id = NULL;
+    uint32_t *ancestor_index = NULL;
+
+    /* Zero the new pool so that it can be freed on all paths */
+    memset(&new_pool, 0, sizeof(new_pool));
+    size = (num_segments + num_spare + block_size - 1) / block_size;
+    size = GSL_MAX(1, size) * block_size;
+    if (size >= segment_pool_get_size(pool)) {
+        goto out;
+    }
+    /* Make sure the peak usage is recorded before we release anything */
+    msp_record_memory_peak(self);
+    old_id = calloc(size + 1, sizeof(*old_id));
+    ancestor_index = malloc((size + 1) * sizeof(*ancestor_index));
+    if (old_id == NULL || ancestor_index == NULL) {
+        ret = MSP_ERR_NO_MEMORY;
+        goto out;
+    }
+    ret = segment_pool_init(&new_pool, size, pool->huge_pages);
+    if (ret != 0) {
+        goto out;
+    }
+    n = 0;
+    for (label = 0; label < (label_id_t) self->num_labels; label++) {
+        for (j = 0; j < self->num_populations; j++) {
+            ancestors = &self->populations[j].ancestors[label];
+            for (l = 0; l < ancestors->num_lineages; l++) {
+                ancestor_index[n + 1] = (uint32_t) l;
+                for (u = ancestors->lineages[l]; u != MSP_NULL_SEGMENT;
+                     u = pool->next[u]) {
+                    n++;
+                    old_id[n] = u;
+                }
+            }
+        }
+    }
+    if (self->root_segments != NULL) {
+        for (j = 0; j < self->input_position.nodes; j++) {
+            for (u = self->root_segments[j]; u != MSP_NULL_SEGMENT; u = pool->next[u]) {
+                n++;
+                old_id[n] = u;
+            }
+        }
+    }
+    tsk_bug_assert(n == num_segments);
+
+    /* A mass index is left unchanged if it can't be shrunk, so we make no
+     * other changes until they all have been. If this fails after the
+     * index of an earlier label has been shrunk the simulator can only
+     * be freed. */
+    for (label = 0; label < (label_id_t) self->num_labels; label++) {
+        if (self->recomb_mass_index != NULL) {
+            ret = fenwick_shrink(&self->recomb_mass_index[label], size, old_id);
+        } else if (self->gc_mass_index != NULL) {
+            ret = fenwick_shrink(&self->gc_mass_index[label], size, old_id);
+        }
+        if (ret != 0) {
+            goto out;
+        }
+    }
+    /* Each head is numbered one more than the segments before it */
+    n = 0;
+    for (label = 0; label < (label_id_t) self->num_labels; label++) {
+        for (j = 0; j < self->num_populations; j++) {
+            ancestors = &self->populations[j].ancestors[label];
+            for (l = 0; l < ancestors->num_lineages; l++) {
+                u = ancestors->lineages[l];
+                ancestors->lineages[l] = (segment_id_t)(n + 1);
+                for (; u != MSP_NULL_SEGMENT; u = pool->next[u]) {
+                    n++;
+                }
+            }
+        }
+    }
+    if (self->root_segments != NULL) {
+        for (j = 0; j < self->input_position.nodes; j++) {
+            u = self->root_segments[j];
+            if (u != MSP_NULL_SEGMENT) {
+                self->root_segments[j] = (segment_id_t)(n + 1);
+                for (; u != MSP_NULL_SEGMENT; u = pool->next[u]) {
+                    n++;
+                }
+            }
+        }
+    }
+    segment_pool_move_segments(&new_pool, pool, n, old_id);
+    segment_pool_free(pool);
+    *pool = new_pool;
+    memset(&new_pool, 0, sizeof(new_pool));
+    free(self->ancestor_index);
+    self->ancestor_index = ancestor_index;
+    ancestor_index = NULL;
+out:
+    segment_pool_free(&new_pool);
+    msp_safe_free(old_id);
+    msp_safe_free(ancestor_index);
+    return ret;
+}
+
+/* Compacts the segments if fewer than the compaction threshold of them
+ * are in use. This must be called between events. Only the mass indexes
+ * search over the segment indexes, and so we don't compact without them;
+ * in the pedigree model segments can also be held by individuals, where
+ * we wouldn't find them. */
+static int MSP_WARN_UNUSED
+msp_update_segment_ids(msp_t *self)
+{
+    int ret = 0;
+    const size_t size = segment_pool_get_size(&self->segments);
+    const size_t num_segments = segment_pool_get_num_allocated(&self->segments);
+
+    if (self->recomb_mass_index == NULL && self->gc_mass_index == NULL) {
+        goto out;
+    }
+    if (size > self->segment_block_size
+        && (double) num_segments < self->segment_compaction_threshold * (double) size) {
+        /* Leave room for as many segments again, so that we don't compact
+         * repeatedly while the number of segments is growing */
+        ret = msp_compact_segments(self, num_segments);
+    }
+out:
+    return ret;
+}
+
+/* Checks the limits on the resources used by msp_run between events.
+ * Returns MSP_EXIT_MEMORY_LIMIT if the memory limit has been exceeded,
+ * which is checked every MSP_MEMORY_LIMIT_CHECK_INTERVAL events (including
+ * before the first) since it means walking all of the structures. Otherwise,
+ * reads the wall clock every MSP_WALL_TIME_CHECK_INTERVAL events,
+ * calling the progress callback if it is due, and returns MSP_EXIT_WALL_TIME
+ * if the wall-clock limit for the current call to msp_run has been reached. */
+static int
+msp_check_run_limits(msp_t *self, unsigned long events)
+{
+    int ret = 0;
+    double now;
+
+    if (self->memory_limit > 0 && events % MSP_MEMORY_LIMIT_CHECK_INTERVAL == 0
+        && msp_get_total_memory_usage(self) > self->memory_limit) {
+        ret = MSP_EXIT_MEMORY_LIMIT;
+        goto out;
+    }
+    if ((self->wall_time_limit < DBL_MAX || self->progress_callback != NULL)
+        && events > 0 && events % MSP_WALL_TIME_CHECK_INTERVAL == 0) {
+        now = msp_get_wall_time();
+        if (self->progress_callback != NULL
+            && now - self->last_progress_wall_time >= self->progress_interval) {
+            self->progress_callback(self->time, msp_get_num_ancestors(self),
+                msp_get_num_nodes(self), msp_get_num_edges(self),
+                self->progress_callback_arg);
+            self->last_progress_wall_time = now;
+        }
+        if (now - self->run_start_wall_time >= self->wall_time_limit) {
+            ret = MSP_EXIT_WALL_TIME;
+        }
+    }
 out:
     return ret;
 }
@@ -4122,26 +5537,350 @@ out:
  *    of events was reached.
  * MSP_EXIT_MAX_TIME if the simulation stopped because the maximum time would
  *    have been exceeded by an event.
+ * MSP_EXIT_WALL_TIME if the simulation stopped because the wall-clock limit
+ *    was reached.
+ * MSP_EXIT_MEMORY_LIMIT if the simulation stopped because the memory limit
+ *    was exceeded.
  * A negative value if an error occured.
  */
 static int MSP_WARN_UNUSED
-msp_run_coalescent(msp_t *self, double max_time, unsigned long max_events)
+msp_run_coalescent(msp_t *self, double max_time, unsigned long max_events)
+{
+    int ret = 0;
+    double t_temp, t_wait, ca_t_wait, re_t_wait, gc_t_wait, gc_left_t_wait,
+        indexed_t_wait, random_event_time, fixed_event_time;
+    tsk_id_t pop_id, ca_pop_id;
+    unsigned long events = 0;
+    avl_node_t *avl_node;
+    int event_type;
+    /* Only support a single label for now. */
+    label_id_t label = 0;
+
+    /* The direct method doesn't maintain the event queue */
+    self->event_queue_valid = false;
+    if (!self->population_indexes_valid) {
+        ret = msp_compute_population_indexes(self);
+        if (ret != 0) {
+            goto out;
+        }
+        self->population_indexes_valid = true;
+    }
+
+    while (msp_get_num_ancestors(self) > 0) {
+        if (events == max_events) {
+            ret = MSP_EXIT_MAX_EVENTS;
+            break;
+        }
+        ret = msp_check_run_limits(self, events);
+        if (ret != 0) {
+            break;
+        }
+        events++;
+        scratch_buffer_reset(&self->scratch);
+        ret = msp_update_segment_ids(self);
+        if (ret != 0) {
+            goto out;
+        }
+
+        /* Recombination */
+        ret = msp_sample_waiting_time(self, self->recomb_mass_index, label, &re_t_wait);
+        if (ret != 0) {
+            goto out;
+        }
+
+        /* Gene conversion */
+        gc_t_wait = DBL_MAX;
+        ret = msp_sample_waiting_time(self, self->gc_mass_index, label, &gc_t_wait);
+        if (ret != 0) {
+            goto out;
+        }
+        gc_left_t_wait = DBL_MAX;
+        ret = msp_sample_gc_left_waiting_time(self, &gc_left_t_wait);
+        if (ret != 0) {
+            goto out;
+        }
+
+        /* Common ancestor and migration events with constant rates are
+         * chosen from the event rate index */
+        ret = msp_sample_event_rate_waiting_time(self, &indexed_t_wait);
+        if (ret != 0) {
+            goto out;
+        }
+
+        /* Common ancestors in populations where the rate is not constant */
+        ca_t_wait = DBL_MAX;
+        ca_pop_id = 0;
+        if (!self->ca_rates_indexed) {
+            for (avl_node = self->non_empty_populations.head; avl_node != NULL;
+                 avl_node = avl_node->next) {
+                pop_id = (tsk_id_t)(intptr_t) avl_node->item;
+                if (self->populations[pop_id].ca_rate_indexed) {
+                    continue;
+                }
+                t_temp = self->get_common_ancestor_waiting_time(self, pop_id, label);
+                if (t_temp < ca_t_wait) {
+                    ca_t_wait = t_temp;
+                    ca_pop_id = pop_id;
+                }
+            }
+        }
+
+        fixed_event_time = msp_get_next_fixed_event_time(self);
+        t_wait = GSL_MIN(indexed_t_wait,
+            GSL_MIN(gc_t_wait, GSL_MIN(gc_left_t_wait, GSL_MIN(re_t_wait, ca_t_wait))));
+
+        if (fixed_event_time == DBL_MAX && t_wait == DBL_MAX) {
+            ret = MSP_ERR_INFINITE_WAITING_TIME;
+            goto out;
+        }
+        random_event_time = self->time + t_wait;
+
+        /* The simulation state is can only changed from this point on. If
+         * any of the events would cause the time to be >= max_time, we exit
+         */
+        if (fixed_event_time < random_event_time) {
+            if (fixed_event_time > max_time) {
+                ret = MSP_EXIT_MAX_TIME;
+                break;
+            }
+            ret = msp_apply_fixed_events(self, fixed_event_time);
+            if (ret != 0) {
+                goto out;
+            }
+            ret = msp_update_population_indexes(self);
+            if (ret != 0) {
+                goto out;
+            }
+        } else {
+            if (random_event_time > max_time) {
+                ret = MSP_EXIT_MAX_TIME;
+                break;
+            }
+            self->time = random_event_time;
+            if (re_t_wait == t_wait) {
+                ret = msp_recombination_event(self, label, NULL, NULL);
+            } else if (gc_t_wait == t_wait) {
+                ret = msp_gene_conversion_event(self, label);
+            } else if (gc_left_t_wait == t_wait) {
+                ret = msp_gene_conversion_left_event(self, label);
+            } else {
+                event_type = MSP_EVENT_RATE_CA;
+                if (ca_t_wait != t_wait) {
+                    event_type = msp_choose_event(self, &pop_id);
+                    ca_pop_id = pop_id;
+                }
+                if (event_type == MSP_EVENT_RATE_CA) {
+                    ret = msp_apply_common_ancestor_event(self, ca_pop_id, label);
+                    if (ret == 1) {
+                        /* The CA event has signalled that this event should be
+                         * rejected */
+                        self->time -= t_wait;
+                        ret = 0;
+                    }
+                } else {
+                    ret = msp_apply_migration_event(self, pop_id);
+                }
+            }
+            if (ret != 0) {
+                goto out;
+            }
+        }
+    }
+out:
+    return ret;
+}
+
+/* Next reaction method (Gibson & Bruck 2000).
+ *
+ * Every event channel (recombination, gene conversion, and the common
+ * ancestor and migration events in each population) holds the absolute time
+ * at which it will next fire in an indexed priority queue. After an event
+ * we only update the channels that depend on it: the global channels after
+ * anything but a migration, and the channels of the populations whose
+ * number of lineages changed. Channels with a constant rate reuse their
+ * existing firing time, rescaled to the new rate, so that only the channel
+ * that fired needs a fresh random draw. */
+
+static int MSP_WARN_UNUSED
+msp_get_global_channel_rate(msp_t *self, size_t channel, double *rate)
+{
+    int ret = 0;
+    fenwick_t *mass_index = NULL;
+
+    *rate = 0;
+    if (channel == MSP_CHANNEL_GC_LEFT) {
+        *rate = msp_get_total_gc_left_rate(self);
+    } else {
+        /* Only support a single label for now. */
+        if (channel == MSP_CHANNEL_RE && self->recomb_mass_index != NULL) {
+            mass_index = &self->recomb_mass_index[0];
+        } else if (channel == MSP_CHANNEL_GC && self->gc_mass_index != NULL) {
+            mass_index = &self->gc_mass_index[0];
+        }
+        if (mass_index != NULL) {
+            if (fenwick_rebuild_required(mass_index)) {
+                msp_timer_start(self, MSP_TIMER_FENWICK_REBUILD);
+                fenwick_rebuild(mass_index);
+                msp_timer_stop(self, MSP_TIMER_FENWICK_REBUILD);
+                self->num_fenwick_rebuilds++;
+            }
+            *rate = fenwick_get_total(mass_index);
+            if (!isfinite(*rate)) {
+                ret = MSP_ERR_BREAKPOINT_MASS_NON_FINITE;
+            } else if (fenwick_fixed_point_overflowed(mass_index)) {
+                ret = MSP_ERR_MASS_INDEX_OVERFLOW;
+            }
+        }
+    }
+    return ret;
+}
+
+/* Sets the next firing time for the specified channel given its new rate. If
+ * the channel has just fired, or was previously not able to fire, we draw a
+ * new waiting time; otherwise we rescale the time remaining on the
+ * existing draw. */
+static void
+msp_schedule_channel(msp_t *self, size_t channel, double rate, bool fired)
+{
+    event_queue_t *queue = &self->event_queue;
+    const double t = self->time;
+    double old_rate = self->channel_rate[channel];
+    double old_time = queue->time[channel];
+    double new_time = DBL_MAX;
+    double u;
+
+    if (rate > 0) {
+        if (fired || old_rate <= 0 || old_time == DBL_MAX) {
+            u = variate_buffer_exponential(&self->variates, 1.0 / rate);
+            if (u == 0) {
+                u = handle_zero_waiting_time(t);
+            }
+            new_time = t + u;
+        } else if (rate == old_rate) {
+            new_time = old_time;
+        } else {
+            new_time = t + (old_rate / rate) * (old_time - t);
+        }
+    }
+    self->channel_rate[channel] = rate;
+    event_queue_update(queue, channel, new_time);
+}
+
+/* Updates the channels for the specified population, which is assumed to
+ * have changed its number of lineages. */
+static void
+msp_schedule_population_channels(
+    msp_t *self, population_id_t pop_id, size_t fired_channel)
+{
+    fenwick_t *index = &self->event_rate_index;
+    size_t k = ((size_t) pop_id) * MSP_NUM_EVENT_RATE_TYPES;
+    size_t ca_channel = MSP_NUM_GLOBAL_CHANNELS + k + MSP_EVENT_RATE_CA;
+    size_t mig_channel = MSP_NUM_GLOBAL_CHANNELS + k + MSP_EVENT_RATE_MIGRATION;
+    double t_wait;
+
+    msp_update_event_rates(self, pop_id);
+    if (self->populations[pop_id].ca_rate_indexed) {
+        msp_schedule_channel(self, ca_channel,
+            fenwick_get_value(index, k + MSP_EVENT_RATE_CA + 1),
+            ca_channel == fired_channel);
+    } else {
+        /* The waiting time depends on the time as well as the number of
+         * lineages, so we always resample from the current time. */
+        t_wait = DBL_MAX;
+        if (self->populations[pop_id].ancestors[0].num_lineages > 0) {
+            t_wait = self->get_common_ancestor_waiting_time(self, pop_id, 0);
+        }
+        self->channel_rate[ca_channel] = -1;
+        event_queue_update(&self->event_queue, ca_channel,
+            t_wait == DBL_MAX ? DBL_MAX : self->time + t_wait);
+    }
+    msp_schedule_channel(self, mig_channel,
+        fenwick_get_value(index, k + MSP_EVENT_RATE_MIGRATION + 1),
+        mig_channel == fired_channel);
+}
+
+static int MSP_WARN_UNUSED
+msp_schedule_global_channels(msp_t *self, size_t fired_channel)
+{
+    int ret = 0;
+    double rate;
+    size_t j;
+
+    for (j = 0; j < MSP_NUM_GLOBAL_CHANNELS; j++) {
+        ret = msp_get_global_channel_rate(self, j, &rate);
+        if (ret != 0) {
+            goto out;
+        }
+        msp_schedule_channel(self, j, rate, j == fired_channel);
+    }
+out:
+    return ret;
+}
+
+static void
+msp_schedule_dirty_population_channels(msp_t *self, size_t fired_channel)
+{
+    uint32_t j;
+
+    for (j = 0; j < self->num_dirty_populations; j++) {
+        msp_schedule_population_channels(
+            self, self->dirty_populations[j], fired_channel);
+    }
+    self->num_dirty_populations = 0;
+}
+
+/* Discards all existing firing times and samples new ones for all channels. */
+static int MSP_WARN_UNUSED
+msp_reset_event_queue(msp_t *self)
+{
+    int ret = 0;
+    size_t j;
+    population_id_t pop_id;
+
+    for (j = 0; j < self->event_queue.size; j++) {
+        self->channel_rate[j] = 0;
+        event_queue_update(&self->event_queue, j, DBL_MAX);
+    }
+    ret = msp_schedule_global_channels(self, SIZE_MAX);
+    if (ret != 0) {
+        goto out;
+    }
+    for (pop_id = 0; pop_id < (population_id_t) self->num_populations; pop_id++) {
+        msp_schedule_population_channels(self, pop_id, SIZE_MAX);
+    }
+    self->num_dirty_populations = 0;
+out:
+    return ret;
+}
+
+/* Equivalent to msp_run_coalescent, but chooses events using the next
+ * reaction method. */
+static int MSP_WARN_UNUSED
+msp_run_coalescent_next_reaction(msp_t *self, double max_time, unsigned long max_events)
 {
     int ret = 0;
-    double lambda, t_temp, t_wait, ca_t_wait, re_t_wait, gc_t_wait, gc_left_t_wait,
-        mig_t_wait, random_event_time, fixed_event_time;
-    uint32_t n;
-    tsk_id_t i, pop_id, pop_id_j, pop_id_k, ca_pop_id, mig_source_pop, mig_dest_pop;
-    const tsk_id_t N = (tsk_id_t) self->num_populations;
-    population_t *pop;
+    double t_wait, random_event_time, fixed_event_time;
     unsigned long events = 0;
-    avl_node_t *avl_node;
+    size_t channel, k;
+    population_id_t pop_id;
+    int event_type;
     /* Only support a single label for now. */
     label_id_t label = 0;
 
-    ret = msp_compute_population_indexes(self);
-    if (ret != 0) {
-        goto out;
+    if (!self->population_indexes_valid) {
+        ret = msp_compute_population_indexes(self);
+        if (ret != 0) {
+            goto out;
+        }
+        self->population_indexes_valid = true;
+        self->event_queue_valid = false;
+    }
+    if (!self->event_queue_valid) {
+        ret = msp_reset_event_queue(self);
+        if (ret != 0) {
+            goto out;
+        }
+        self->event_queue_valid = true;
     }
 
     while (msp_get_num_ancestors(self) > 0) {
@@ -4149,80 +5888,25 @@ msp_run_coalescent(msp_t *self, double max_time, unsigned long max_events)
             ret = MSP_EXIT_MAX_EVENTS;
             break;
         }
-        events++;
-
-        /* Recombination */
-        ret = msp_sample_waiting_time(self, self->recomb_mass_index, label, &re_t_wait);
-        if (ret != 0) {
-            goto out;
-        }
-
-        /* Gene conversion */
-        gc_t_wait = DBL_MAX;
-        ret = msp_sample_waiting_time(self, self->gc_mass_index, label, &gc_t_wait);
+        ret = msp_check_run_limits(self, events);
         if (ret != 0) {
-            goto out;
+            break;
         }
-        gc_left_t_wait = DBL_MAX;
-        ret = msp_sample_gc_left_waiting_time(self, &gc_left_t_wait);
+        events++;
+        scratch_buffer_reset(&self->scratch);
+        ret = msp_update_segment_ids(self);
         if (ret != 0) {
             goto out;
         }
 
-        /* Common ancestors */
-        ca_t_wait = DBL_MAX;
-        ca_pop_id = 0;
-        for (avl_node = self->non_empty_populations.head; avl_node != NULL;
-             avl_node = avl_node->next) {
-            pop_id = (tsk_id_t)(intptr_t) avl_node->item;
-            t_temp = self->get_common_ancestor_waiting_time(self, pop_id, label);
-            if (t_temp < ca_t_wait) {
-                ca_t_wait = t_temp;
-                ca_pop_id = pop_id;
-            }
-        }
-
-        /* Migration */
-        mig_t_wait = DBL_MAX;
-        mig_source_pop = 0;
-        mig_dest_pop = 0;
-        for (avl_node = self->non_empty_populations.head; avl_node != NULL;
-             avl_node = avl_node->next) {
-            pop_id_j = (tsk_id_t)(intptr_t) avl_node->item;
-            pop = &self->populations[pop_id_j];
-            n = avl_count(&pop->ancestors[label]);
-            tsk_bug_assert(n > 0);
-            for (i = 0; i < (tsk_id_t) pop->num_potential_destinations; i++) {
-                pop_id_k = pop->potential_destinations[i];
-                lambda = n * self->migration_matrix[pop_id_j * N + pop_id_k];
-                tsk_bug_assert(lambda > 0);
-                t_temp = gsl_ran_exponential(self->rng, 1.0 / lambda);
-                if (t_temp < mig_t_wait) {
-                    mig_t_wait = t_temp;
-                    /* m[j, k] is the rate at which migrants move from
-                     * population k to j forwards in time. Backwards
-                     * in time, we move the individual from from
-                     * population j into population k.
-                     */
-                    mig_source_pop = pop_id_j;
-                    mig_dest_pop = pop_id_k;
-                }
-            }
-        }
-
+        channel = event_queue_get_min(&self->event_queue);
+        random_event_time = self->event_queue.time[channel];
         fixed_event_time = msp_get_next_fixed_event_time(self);
-        t_wait = GSL_MIN(mig_t_wait,
-            GSL_MIN(gc_t_wait, GSL_MIN(gc_left_t_wait, GSL_MIN(re_t_wait, ca_t_wait))));
-
-        if (fixed_event_time == DBL_MAX && t_wait == DBL_MAX) {
+        if (fixed_event_time == DBL_MAX && random_event_time == DBL_MAX) {
             ret = MSP_ERR_INFINITE_WAITING_TIME;
             goto out;
         }
-        random_event_time = self->time + t_wait;
 
-        /* The simulation state is can only changed from this point on. If
-         * any of the events would cause the time to be >= max_time, we exit
-         */
         if (fixed_event_time < random_event_time) {
             if (fixed_event_time > max_time) {
                 ret = MSP_EXIT_MAX_TIME;
@@ -4232,52 +5916,59 @@ msp_run_coalescent(msp_t *self, double max_time, unsigned long max_events)
             if (ret != 0) {
                 goto out;
             }
-            /* Rather than try to reason about the changes that have occured
-             * during any demographic events, just recompute the indexes
-             * used to track nonempty populations and migration destinations
-             */
-            ret = msp_compute_population_indexes(self);
+            ret = msp_update_population_indexes(self);
+            if (ret != 0) {
+                goto out;
+            }
+            /* Populations whose parameters changed are marked dirty, and so
+             * their CA channels are rescheduled along with the others. */
+            ret = msp_schedule_global_channels(self, SIZE_MAX);
             if (ret != 0) {
                 goto out;
             }
+            msp_schedule_dirty_population_channels(self, SIZE_MAX);
         } else {
             if (random_event_time > max_time) {
                 ret = MSP_EXIT_MAX_TIME;
                 break;
             }
+            t_wait = random_event_time - self->time;
             self->time = random_event_time;
-            if (re_t_wait == t_wait) {
+            event_type = -1;
+            if (channel == MSP_CHANNEL_RE) {
                 ret = msp_recombination_event(self, label, NULL, NULL);
-            } else if (gc_t_wait == t_wait) {
+            } else if (channel == MSP_CHANNEL_GC) {
                 ret = msp_gene_conversion_event(self, label);
-            } else if (gc_left_t_wait == t_wait) {
+            } else if (channel == MSP_CHANNEL_GC_LEFT) {
                 ret = msp_gene_conversion_left_event(self, label);
-            } else if (ca_t_wait == t_wait) {
-                ret = self->common_ancestor_event(self, ca_pop_id, label);
-                if (ret == 1) {
-                    /* The CA event has signalled that this event should be rejected */
-                    self->time -= t_wait;
-                    ret = 0;
-                }
-                if (ret != 0) {
-                    goto out;
-                }
-                if (msp_get_num_population_ancestors(self, ca_pop_id) == 0) {
-                    ret = msp_remove_non_empty_population(self, ca_pop_id);
-                }
             } else {
-                ret = msp_migration_event(self, mig_source_pop, mig_dest_pop);
-                if (ret != 0) {
-                    goto out;
-                }
-                if (msp_get_num_population_ancestors(self, mig_source_pop) == 0) {
-                    ret = msp_remove_non_empty_population(self, mig_source_pop);
+                k = channel - MSP_NUM_GLOBAL_CHANNELS;
+                pop_id = (population_id_t)(k / MSP_NUM_EVENT_RATE_TYPES);
+                event_type = (int) (k % MSP_NUM_EVENT_RATE_TYPES);
+                if (event_type == MSP_EVENT_RATE_CA) {
+                    ret = msp_apply_common_ancestor_event(self, pop_id, label);
+                    if (ret == 1) {
+                        /* The CA event has signalled that this event should be
+                         * rejected */
+                        self->time -= t_wait;
+                        ret = 0;
+                    }
+                } else {
+                    ret = msp_apply_migration_event(self, pop_id);
                 }
-                ret = msp_insert_non_empty_population(self, mig_dest_pop);
             }
             if (ret != 0) {
                 goto out;
             }
+            /* Migration events do not change the segments, so the
+             * recombination and gene conversion rates are unaffected. */
+            if (event_type != MSP_EVENT_RATE_MIGRATION) {
+                ret = msp_schedule_global_channels(self, channel);
+                if (ret != 0) {
+                    goto out;
+                }
+            }
+            msp_schedule_dirty_population_channels(self, channel);
         }
     }
 out:
@@ -4287,11 +5978,12 @@ out:
 static int
 msp_pedigree_process_common_ancestors(msp_t *self, individual_t *ind, tsk_size_t ploid)
 {
+    segment_pool_t *pool = &self->segments;
     int ret = 0;
     tsk_id_t node = ind->nodes[ploid];
     tsk_id_t parent = ind->parents[ploid];
     avl_tree_t *common_ancestors = &ind->common_ancestors[ploid];
-    segment_t *genome, *parent_ancestry[MSP_MAX_PED_PLOIDY], *seg;
+    segment_id_t genome, parent_ancestry[MSP_MAX_PED_PLOIDY], seg;
     const tsk_size_t ploidy = self->ploidy;
     tsk_size_t j;
 
@@ -4301,8 +5993,8 @@ msp_pedigree_process_common_ancestors(msp_t *self, individual_t *ind, tsk_size_t
     if (ret != 0) {
         goto out;
     }
-    if (genome != NULL) {
-        tsk_bug_assert(genome->prev == NULL);
+    if (genome != MSP_NULL_SEGMENT) {
+        tsk_bug_assert(pool->prev[genome] == MSP_NULL_SEGMENT);
 
         if (parent == TSK_NULL) {
             /* If parent is NULL, we are at a pedigree founder and create
@@ -4317,9 +6009,10 @@ msp_pedigree_process_common_ancestors(msp_t *self, individual_t *ind, tsk_size_t
              * for the pedigree simulation to avoid adding the unary edges
              * up to the final simulation time.
              */
-            for (seg = genome; seg != NULL; seg = seg->next) {
-                if (seg->value != node) {
-                    ret = msp_store_edge(self, seg->left, seg->right, node, seg->value);
+            for (seg = genome; seg != MSP_NULL_SEGMENT; seg = pool->next[seg]) {
+                if (pool->value[seg] != node) {
+                    ret = msp_store_edge(
+                        self, pool->left[seg], pool->right[seg], node, pool->value[seg]);
                     if (ret != 0) {
                         goto out;
                     }
@@ -4333,15 +6026,15 @@ msp_pedigree_process_common_ancestors(msp_t *self, individual_t *ind, tsk_size_t
                     goto out;
                 }
             } else {
-                parent_ancestry[0] = NULL;
-                parent_ancestry[1] = NULL;
-                j = (tsk_size_t) gsl_rng_uniform_int(self->rng, 2);
+                parent_ancestry[0] = MSP_NULL_SEGMENT;
+                parent_ancestry[1] = MSP_NULL_SEGMENT;
+                j = (tsk_size_t) variate_buffer_uniform_int(&self->variates, 2);
                 parent_ancestry[j] = genome;
             }
             for (j = 0; j < ploidy; j++) {
                 seg = parent_ancestry[j];
-                if (seg != NULL) {
-                    tsk_bug_assert(seg->prev == NULL);
+                if (seg != MSP_NULL_SEGMENT) {
+                    tsk_bug_assert(pool->prev[seg] == MSP_NULL_SEGMENT);
                     ret = msp_pedigree_add_individual_common_ancestor(
                         self, parent, seg, j);
                     if (ret != 0) {
@@ -4373,6 +6066,10 @@ out:
  *    of events was reached.
  * MSP_EXIT_MAX_TIME if the simulation stopped because the maximum time would
  *    have been exceeded by an event.
+ * MSP_EXIT_WALL_TIME if the simulation stopped because the wall-clock limit
+ *    was reached.
+ * MSP_EXIT_MEMORY_LIMIT if the simulation stopped because the memory limit
+ *    was exceeded.
  * A negative value if an error occured.
  */
 static int
@@ -4406,6 +6103,11 @@ msp_run_pedigree(msp_t *self, double max_time, unsigned long max_events)
             ret = MSP_EXIT_MAX_EVENTS;
             break;
         }
+        ret = msp_check_run_limits(self, num_events);
+        if (ret != 0) {
+            break;
+        }
+        scratch_buffer_reset(&self->scratch);
         tsk_bug_assert(ind->time >= self->time);
         self->time = ind->time;
         ret = msp_pedigree_insert_ancient_samples(self);
@@ -4426,7 +6128,8 @@ msp_run_pedigree(msp_t *self, double max_time, unsigned long max_events)
     } else if (pedigree->next_individual == num_individuals) {
         ret = MSP_EXIT_MODEL_COMPLETE;
     } else {
-        tsk_bug_assert(ret == MSP_EXIT_MAX_TIME || ret == MSP_EXIT_MAX_EVENTS);
+        tsk_bug_assert(ret == MSP_EXIT_MAX_TIME || ret == MSP_EXIT_MAX_EVENTS
+                       || ret == MSP_EXIT_WALL_TIME || ret == MSP_EXIT_MEMORY_LIMIT);
     }
 out:
     return ret;
@@ -4434,7 +6137,7 @@ out:
 
 /* List structure for collecting segments by parent */
 typedef struct _segment_list_t {
-    avl_node_t *node;
+    segment_id_t head;
     struct _segment_list_t *next;
 } segment_list_t;
 
@@ -4445,13 +6148,12 @@ msp_dtwf_generation(msp_t *self)
     int ret = 0;
     int ix;
     uint32_t N, i, j, k, p;
-    size_t segment_mem_offset;
+    size_t a, segment_mem_offset;
     population_t *pop;
-    segment_t *x, *u[2];
+    segment_id_t x, u[2];
     segment_list_t **parents = NULL;
     segment_list_t *segment_mem = NULL;
     segment_list_t *s;
-    avl_node_t *a, *node;
     avl_tree_t Q[2];
     /* Only support single structured coalescent label for now. */
     label_id_t label = 0;
@@ -4463,7 +6165,7 @@ msp_dtwf_generation(msp_t *self)
     for (j = 0; j < self->num_populations; j++) {
 
         pop = &self->populations[j];
-        if (avl_count(&pop->ancestors[label]) == 0) {
+        if (pop->ancestors[label].num_lineages == 0) {
             continue;
         }
         /* For the DTWF, N for each population is the reference population size
@@ -4478,31 +6180,32 @@ msp_dtwf_generation(msp_t *self)
         }
 
         // Allocate memory for linked list of offspring per parent
-        parents = calloc(N, sizeof(segment_list_t *));
-        segment_mem = malloc(msp_get_num_ancestors(self) * sizeof(segment_list_t));
+        parents = scratch_buffer_get(&self->scratch, N * sizeof(segment_list_t *));
+        segment_mem = scratch_buffer_get(
+            &self->scratch, msp_get_num_ancestors(self) * sizeof(segment_list_t));
         if (parents == NULL || segment_mem == NULL) {
             ret = MSP_ERR_NO_MEMORY;
             goto out;
         }
+        memset(parents, 0, N * sizeof(segment_list_t *));
         // Iterate through ancestors and draw parents
         segment_mem_offset = 0;
-        for (a = pop->ancestors[label].head; a != NULL; a = a->next) {
+        for (a = 0; a < pop->ancestors[label].num_lineages; a++) {
             s = segment_mem + segment_mem_offset;
             segment_mem_offset++;
-            p = (uint32_t) gsl_rng_uniform_int(self->rng, N);
+            p = (uint32_t) variate_buffer_uniform_int(&self->variates, N);
             if (parents[p] != NULL) {
                 self->num_ca_events++;
             }
             s->next = parents[p];
-            s->node = a;
+            s->head = pop->ancestors[label].lineages[a];
             parents[p] = s;
         }
 
         // Iterate through offspring of parent k, adding to avl_tree
         for (k = 0; k < N; k++) {
             for (s = parents[k]; s != NULL; s = s->next) {
-                node = s->node;
-                x = (segment_t *) node->item;
+                x = s->head;
                 // Recombine ancestor
                 // TODO Should this be the recombination rate going foward from x.left?
                 if (rate_map_get_total_mass(&self->recomb_map) > 0) {
@@ -4511,7 +6214,7 @@ msp_dtwf_generation(msp_t *self)
                         goto out;
                     }
                     for (i = 0; i < 2; i++) {
-                        if (u[i] != NULL && u[i] != x) {
+                        if (u[i] != MSP_NULL_SEGMENT && u[i] != x) {
                             ret = msp_insert_individual(self, u[i]);
                             if (ret != 0) {
                                 goto out;
@@ -4519,14 +6222,14 @@ msp_dtwf_generation(msp_t *self)
                         }
                     }
                 } else {
-                    ix = (int) gsl_rng_uniform_int(self->rng, 2);
-                    u[0] = NULL;
-                    u[1] = NULL;
+                    ix = (int) variate_buffer_uniform_int(&self->variates, 2);
+                    u[0] = MSP_NULL_SEGMENT;
+                    u[1] = MSP_NULL_SEGMENT;
                     u[ix] = x;
                 }
                 // Add to AVLTree for each parental chromosome
                 for (i = 0; i < 2; i++) {
-                    if (u[i] != NULL) {
+                    if (u[i] != MSP_NULL_SEGMENT) {
                         ret = msp_priority_queue_insert(self, &Q[i], u[i]);
                         if (ret != 0) {
                             goto out;
@@ -4543,57 +6246,42 @@ msp_dtwf_generation(msp_t *self)
                 }
             }
         }
-        free(parents);
-        free(segment_mem);
-        segment_mem = NULL;
-        parents = NULL;
     }
 out:
-    msp_safe_free(parents);
-    msp_safe_free(segment_mem);
     return ret;
 }
 
-static int MSP_WARN_UNUSED
+/* Removes a lineage chosen uniformly from the specified population, so that
+ * it cannot be chosen again before it is moved by
+ * msp_simultaneous_migration_event. */
+static segment_id_t
 msp_store_simultaneous_migration_events(
-    msp_t *self, avl_tree_t *nodes, population_id_t source_pop, label_id_t label)
+    msp_t *self, population_id_t source_pop, label_id_t label)
 {
-    int ret = 0;
-    uint32_t j;
-    avl_node_t *node;
-    avl_tree_t *source;
-
-    source = &self->populations[source_pop].ancestors[label];
+    size_t j;
+    segment_id_t u;
+    ancestor_set_t *source = &self->populations[source_pop].ancestors[label];
 
     // Choose node to migrate
-    j = (uint32_t) gsl_rng_uniform_int(self->rng, avl_count(source));
-    node = avl_at(source, j);
-    tsk_bug_assert(node != NULL);
-
-    avl_unlink_node(source, node);
-    node = avl_insert_node(nodes, node);
-    tsk_bug_assert(node != NULL);
-
-    return ret;
+    j = (size_t) variate_buffer_uniform_int(&self->variates, source->num_lineages);
+    u = source->lineages[j];
+    msp_remove_individual(self, u);
+    return u;
 }
 
 static int MSP_WARN_UNUSED
-msp_simultaneous_migration_event(
-    msp_t *self, avl_tree_t *nodes, population_id_t source_pop, population_id_t dest_pop)
+msp_simultaneous_migration_event(msp_t *self, segment_id_t *migrants,
+    size_t num_migrants, population_id_t source_pop, population_id_t dest_pop)
 {
     int ret = 0;
-    avl_node_t *node;
-    size_t index;
+    size_t j, index;
     label_id_t label = 0; /* For now only support label 0 */
 
     index = ((size_t) source_pop) * self->num_populations + (size_t) dest_pop;
     self->num_migration_events[index]++;
 
-    // Iterate through nodes in tree and move to new pop
-    // -- removed from "nodes" in msp_move_individual()
-    while (avl_count(nodes) > 0) {
-        node = nodes->head;
-        ret = msp_move_individual(self, node, nodes, dest_pop, label);
+    for (j = 0; j < num_migrants; j++) {
+        ret = msp_move_removed_individual(self, migrants[j], dest_pop, label);
         if (ret != 0) {
             goto out;
         }
@@ -4610,6 +6298,10 @@ out:
  *    of events was reached.
  * MSP_EXIT_MAX_TIME if the simulation stopped because the maximum time would
  *    have been exceeded by an event.
+ * MSP_EXIT_WALL_TIME if the simulation stopped because the wall-clock limit
+ *    was reached.
+ * MSP_EXIT_MEMORY_LIMIT if the simulation stopped because the memory limit
+ *    was exceeded.
  * A negative value if an error occured.
  */
 static int MSP_WARN_UNUSED
@@ -4623,8 +6315,9 @@ msp_run_dtwf(msp_t *self, double max_time, unsigned long max_events)
     unsigned int *n = NULL;
     double *mig_tmp = NULL;
     double sum, cur_time;
-    avl_tree_t *node_trees = NULL;
-    avl_tree_t *nodes;
+    segment_id_t *migrants = NULL;
+    size_t *num_pair_migrants = NULL;
+    size_t num_migrants;
     /* Only support a single structured coalescent label at the moment */
     label_id_t label = 0;
 
@@ -4652,7 +6345,16 @@ msp_run_dtwf(msp_t *self, double max_time, unsigned long max_events)
             ret = MSP_EXIT_MAX_EVENTS;
             break;
         }
+        ret = msp_check_run_limits(self, events);
+        if (ret != 0) {
+            break;
+        }
         events++;
+        scratch_buffer_reset(&self->scratch);
+        ret = msp_update_segment_ids(self);
+        if (ret != 0) {
+            goto out;
+        }
         if (self->time + 1 > max_time) {
             ret = MSP_EXIT_MAX_TIME;
             goto out;
@@ -4660,13 +6362,19 @@ msp_run_dtwf(msp_t *self, double max_time, unsigned long max_events)
         self->time++;
 
         /* Following SLiM, we perform migrations prior to selecting
-         * parents for the current generation */
-        node_trees
-            = malloc(self->num_populations * self->num_populations * sizeof(avl_tree_t));
-        if (node_trees == NULL) {
+         * parents for the current generation. The migrants for each pair
+         * of populations are stored contiguously in migrants. */
+        migrants = scratch_buffer_get(
+            &self->scratch, msp_get_num_ancestors(self) * sizeof(*migrants));
+        num_pair_migrants = scratch_buffer_get(&self->scratch,
+            self->num_populations * self->num_populations * sizeof(*num_pair_migrants));
+        if (migrants == NULL || num_pair_migrants == NULL) {
             ret = MSP_ERR_NO_MEMORY;
             goto out;
         }
+        memset(num_pair_migrants, 0,
+            self->num_populations * self->num_populations * sizeof(*num_pair_migrants));
+        num_migrants = 0;
 
         mig_source_pop = 0;
         mig_dest_pop = 0;
@@ -4688,51 +6396,44 @@ msp_run_dtwf(msp_t *self, double max_time, unsigned long max_events)
             }
 
             mig_tmp[j] = 1 - sum;
-            N = avl_count(&self->populations[j].ancestors[label]);
+            N = (uint32_t) self->populations[j].ancestors[label].num_lineages;
             gsl_ran_multinomial(self->rng, self->num_populations, N, mig_tmp, n);
 
             for (k = 0; k < self->num_populations; k++) {
                 if (k == j) {
                     continue;
                 }
-                // Initialize an avl tree for this pair of populations
-                nodes = &node_trees[j * self->num_populations + k];
-                avl_init_tree(nodes, cmp_individual, NULL);
-
                 /* m[j, k] is the rate at which migrants move from
                  * population k to j forwards in time. Backwards
                  * in time, we move the individual from from
                  * population j into population k.
                  */
                 mig_source_pop = (population_id_t) j;
-                mig_dest_pop = (population_id_t) k;
-
+                num_pair_migrants[j * self->num_populations + k] = n[k];
                 for (i = 0; i < n[k]; i++) {
-                    ret = msp_store_simultaneous_migration_events(
-                        self, nodes, mig_source_pop, label);
-                    if (ret != 0) {
-                        goto out;
-                    }
+                    migrants[num_migrants] = msp_store_simultaneous_migration_events(
+                        self, mig_source_pop, label);
+                    num_migrants++;
                 }
             }
         }
+        num_migrants = 0;
         for (j = 0; j < self->num_populations; j++) {
             for (k = 0; k < self->num_populations; k++) {
                 if (k == j) {
                     continue;
                 }
-                nodes = &node_trees[j * self->num_populations + k];
                 mig_source_pop = (population_id_t) j;
                 mig_dest_pop = (population_id_t) k;
-                ret = msp_simultaneous_migration_event(
-                    self, nodes, mig_source_pop, mig_dest_pop);
+                ret = msp_simultaneous_migration_event(self, migrants + num_migrants,
+                    num_pair_migrants[j * self->num_populations + k], mig_source_pop,
+                    mig_dest_pop);
                 if (ret != 0) {
                     goto out;
                 }
+                num_migrants += num_pair_migrants[j * self->num_populations + k];
             }
         }
-        free(node_trees);
-        node_trees = NULL;
 
         /* Demographic events set the simulation time to the time of the event.
          * In the DTWF, this would prevent more than one event occurring per
@@ -4769,7 +6470,6 @@ msp_run_dtwf(msp_t *self, double max_time, unsigned long max_events)
         }
     }
 out:
-    msp_safe_free(node_trees);
     msp_safe_free(n);
     msp_safe_free(mig_tmp);
     return ret;
@@ -4783,8 +6483,8 @@ msp_sweep_initialise(msp_t *self, double switch_proba)
 {
     int ret = 0;
     uint32_t j;
-    avl_node_t *node, *next;
-    avl_tree_t *pop;
+    size_t k;
+    ancestor_set_t *pop;
 
     /* We only support one population and two labels for now */
     if (self->num_populations != 1 || self->num_labels != 2) {
@@ -4792,20 +6492,20 @@ msp_sweep_initialise(msp_t *self, double switch_proba)
         goto out;
     }
 
-    /* Move ancestors to new labels. */
+    /* Move ancestors to new labels. We go backwards through the lineages so
+     * that the lineage moved into the place of a removed one has already
+     * been considered. */
     for (j = 0; j < self->num_populations; j++) {
-        tsk_bug_assert(avl_count(&self->populations[j].ancestors[1]) == 0);
+        tsk_bug_assert(self->populations[j].ancestors[1].num_lineages == 0);
         pop = &self->populations[j].ancestors[0];
-        node = pop->head;
-        while (node != NULL) {
-            next = node->next;
-            if (gsl_rng_uniform(self->rng) < switch_proba) {
-                ret = msp_move_individual(self, node, pop, (population_id_t) j, 1);
+        for (k = pop->num_lineages; k > 0; k--) {
+            if (variate_buffer_uniform(&self->variates) < switch_proba) {
+                ret = msp_move_individual(
+                    self, pop->lineages[k - 1], (population_id_t) j, 1);
                 if (ret != 0) {
                     goto out;
                 }
             }
-            node = next;
         }
     }
 out:
@@ -4819,20 +6519,17 @@ msp_sweep_finalise(msp_t *self)
 {
     int ret = 0;
     uint32_t j;
-    avl_node_t *node, *next;
-    avl_tree_t *pop;
+    ancestor_set_t *pop;
 
     /* Move ancestors to new labels. */
     for (j = 0; j < self->num_populations; j++) {
         pop = &self->populations[j].ancestors[1];
-        node = pop->head;
-        while (node != NULL) {
-            next = node->next;
-            ret = msp_move_individual(self, node, pop, (population_id_t) j, 0);
+        while (pop->num_lineages > 0) {
+            ret = msp_move_individual(
+                self, pop->lineages[pop->num_lineages - 1], (population_id_t) j, 0);
             if (ret != 0) {
                 goto out;
             }
-            node = next;
         }
     }
 out:
@@ -4842,25 +6539,20 @@ out:
 /* Migrate the specified individual to the specified new label.
  */
 static int
-msp_change_label(msp_t *self, segment_t *ind, label_id_t label)
+msp_change_label(msp_t *self, segment_id_t ind, label_id_t label)
 {
-    int ret = 0;
-    avl_tree_t *pop = &self->populations[ind->population].ancestors[ind->label];
-    avl_node_t *node;
+    segment_pool_t *pool = &self->segments;
 
-    /* Find the this individual in the AVL tree. */
-    node = avl_search(pop, ind);
-    tsk_bug_assert(node != NULL);
-    ret = msp_move_individual(self, node, pop, ind->population, label);
-    return ret;
+    return msp_move_individual(self, ind, pool->population[ind], label);
 }
 
 static int
 msp_sweep_recombination_event(
     msp_t *self, label_id_t label, double sweep_locus, double population_frequency)
 {
+    segment_pool_t *pool = &self->segments;
     int ret = 0;
-    segment_t *lhs, *rhs;
+    segment_id_t lhs, rhs;
     label_id_t new_label;
     double r;
 
@@ -4868,9 +6560,9 @@ msp_sweep_recombination_event(
     if (ret != 0) {
         goto out;
     }
-    /* NOTE: we can look at rhs->left when we compare to the sweep site. */
-    r = gsl_rng_uniform(self->rng);
-    if (sweep_locus < rhs->left) {
+    /* NOTE: we can look at the left of rhs when we compare to the sweep site. */
+    r = variate_buffer_uniform(&self->variates);
+    if (sweep_locus < pool->left[rhs]) {
         if (r < 1.0 - population_frequency) {
             /* move rhs to other population */
             new_label = (label + 1) % 2;
@@ -4955,28 +6647,34 @@ msp_run_sweep(msp_t *self)
     curr_step = 1;
     while (msp_get_num_ancestors(self) > 0 && curr_step < num_steps) {
         events++;
+        scratch_buffer_reset(&self->scratch);
+        ret = msp_update_segment_ids(self);
+        if (ret != 0) {
+            goto out;
+        }
         /* Set pop sizes & rec_rates */
         for (j = 0; j < self->num_labels; j++) {
             label = (label_id_t) j;
             recomb_mass = self->recomb_mass_index == NULL
                               ? 0
                               : fenwick_get_total(&self->recomb_mass_index[label]);
-            sweep_pop_sizes[j] = avl_count(&self->populations[0].ancestors[label]);
+            sweep_pop_sizes[j]
+                = (double) self->populations[0].ancestors[label].num_lineages;
             rec_rates[j] = recomb_mass;
         }
 
         event_prob = 1.0;
-        event_rand = gsl_rng_uniform(self->rng);
+        event_rand = variate_buffer_uniform(&self->variates);
         sweep_over = false;
         while (event_prob > event_rand && curr_step < num_steps && !sweep_over) {
             pop_size = get_population_size(&self->populations[0], self->time);
             p_coal_B = 0;
-            if (avl_count(&self->populations[0].ancestors[1]) > 1) {
+            if (self->populations[0].ancestors[1].num_lineages > 1) {
                 p_coal_B = ((sweep_pop_sizes[1] * (sweep_pop_sizes[1] - 1)) * 0.5)
                            / allele_frequency[curr_step] * sweep_dt;
             }
             p_coal_b = 0;
-            if (avl_count(&self->populations[0].ancestors[0]) > 1) {
+            if (self->populations[0].ancestors[0].num_lineages > 1) {
                 p_coal_b = ((sweep_pop_sizes[0] * (sweep_pop_sizes[0] - 1)) * 0.5)
                            / (1.0 - allele_frequency[curr_step]) * sweep_dt;
             }
@@ -5004,7 +6702,7 @@ msp_run_sweep(msp_t *self)
             break;
         }
 
-        tmp_rand = gsl_rng_uniform(self->rng);
+        tmp_rand = variate_buffer_uniform(&self->variates);
 
         e_sum = p_coal_b;
         /* convert time scale */
@@ -5015,12 +6713,12 @@ msp_run_sweep(msp_t *self)
         /* printf("event time: %g\n", self->time); */
         if (tmp_rand < e_sum / sweep_pop_tot_rate) {
             /* coalescent in b background */
-            ret = self->common_ancestor_event(self, 0, 0);
+            ret = msp_common_ancestor_event(self, 0, 0);
         } else {
             e_sum += p_coal_B;
             if (tmp_rand < e_sum / sweep_pop_tot_rate) {
                 /* coalescent in B background */
-                ret = self->common_ancestor_event(self, 0, 1);
+                ret = msp_common_ancestor_event(self, 0, 1);
             } else {
                 e_sum += p_rec_b;
                 if (tmp_rand < e_sum / sweep_pop_tot_rate) {
@@ -5073,13 +6771,16 @@ out:
 
 /* Runs the simulation backwards in time until either the sample has coalesced,
  * or specified maximum simulation time has been reached or the specified maximum
- * number of events has been reached.
+ * number of events has been reached, or the wall-clock limit set by
+ * msp_set_wall_time_limit has been reached, or the memory limit set by
+ * msp_set_memory_limit has been exceeded.
  */
 int MSP_WARN_UNUSED
 msp_run(msp_t *self, double max_time, unsigned long max_events)
 {
     int ret = 0;
     int err;
+    size_t memory_usage[MSP_NUM_MEMORY_CATEGORIES];
 
     if (self->state == MSP_STATE_INITIALISED) {
         self->state = MSP_STATE_SIMULATING;
@@ -5098,6 +6799,10 @@ msp_run(msp_t *self, double max_time, unsigned long max_events)
         ret = MSP_ERR_UNSUPPORTED_OPERATION;
         goto out;
     }
+    if (self->wall_time_limit < DBL_MAX || self->progress_callback != NULL) {
+        self->run_start_wall_time = msp_get_wall_time();
+        self->last_progress_wall_time = self->run_start_wall_time;
+    }
 
     if (msp_is_completed(self)) {
         /* If the simulation is completed, run() is a no-op for
@@ -5110,9 +6815,17 @@ msp_run(msp_t *self, double max_time, unsigned long max_events)
     } else if (self->model.type == MSP_MODEL_SWEEP) {
         /* FIXME making sweep atomic for now as it's non-rentrant */
         ret = msp_run_sweep(self);
+    } else if (self->scheduler == MSP_SCHEDULER_NEXT_REACTION) {
+        ret = msp_run_coalescent_next_reaction(self, max_time, max_events);
     } else {
         ret = msp_run_coalescent(self, max_time, max_events);
     }
+    if (ret < 0 || self->model.type == MSP_MODEL_DTWF
+        || self->model.type == MSP_MODEL_WF_PED || self->model.type == MSP_MODEL_SWEEP) {
+        /* These models don't maintain the population indexes */
+        self->population_indexes_valid = false;
+        self->event_queue_valid = false;
+    }
 
     if (ret < 0) {
         goto out;
@@ -5129,6 +6842,7 @@ msp_run(msp_t *self, double max_time, unsigned long max_events)
         ret = err;
         goto out;
     }
+    msp_update_memory_usage(self, memory_usage);
 out:
     return ret;
 }
@@ -5137,11 +6851,13 @@ out:
 static int MSP_WARN_UNUSED
 msp_insert_uncoalesced_edges(msp_t *self)
 {
+    segment_pool_t *pool = &self->segments;
     int ret = 0;
     population_id_t pop;
     label_id_t label;
-    avl_node_t *a;
-    segment_t *seg;
+    ancestor_set_t *ancestors;
+    size_t a;
+    segment_id_t seg;
     tsk_id_t node;
     int64_t edge_start;
     tsk_node_table_t *nodes = &self->tables->nodes;
@@ -5150,8 +6866,8 @@ msp_insert_uncoalesced_edges(msp_t *self)
 
     for (pop = 0; pop < (population_id_t) self->num_populations; pop++) {
         for (label = 0; label < (label_id_t) self->num_labels; label++) {
-            for (a = self->populations[pop].ancestors[label].head; a != NULL;
-                 a = a->next) {
+            ancestors = &self->populations[pop].ancestors[label];
+            for (a = 0; a < ancestors->num_lineages; a++) {
                 /* If there are any nodes in the segment chain with the current time,
                  * then we don't make any unary edges for them. This is because (a)
                  * we'd end up edges with the same parent and child time (if we didn't
@@ -5159,9 +6875,10 @@ msp_insert_uncoalesced_edges(msp_t *self)
                  * could only have arisen as the result of a coalescence and so this
                  * node really does represent the current ancestor */
                 node = TSK_NULL;
-                for (seg = (segment_t *) a->item; seg != NULL; seg = seg->next) {
-                    if (nodes->time[seg->value] == current_time) {
-                        node = seg->value;
+                for (seg = ancestors->lineages[a]; seg != MSP_NULL_SEGMENT;
+                     seg = pool->next[seg]) {
+                    if (nodes->time[pool->value[seg]] == current_time) {
+                        node = pool->value[seg];
                         break;
                     }
                 }
@@ -5176,11 +6893,14 @@ msp_insert_uncoalesced_edges(msp_t *self)
                 }
 
                 /* For every segment add an edge pointing to this new node */
-                for (seg = (segment_t *) a->item; seg != NULL; seg = seg->next) {
-                    if (seg->value != node) {
-                        tsk_bug_assert(nodes->time[node] > nodes->time[seg->value]);
-                        ret = tsk_edge_table_add_row(&self->tables->edges, seg->left,
-                            seg->right, node, seg->value, NULL, 0);
+                for (seg = ancestors->lineages[a]; seg != MSP_NULL_SEGMENT;
+                     seg = pool->next[seg]) {
+                    if (pool->value[seg] != node) {
+                        tsk_bug_assert(
+                            nodes->time[node] > nodes->time[pool->value[seg]]);
+                        ret = tsk_edge_table_add_row(&self->tables->edges,
+                            pool->left[seg], pool->right[seg], node, pool->value[seg],
+                            NULL, 0);
                         if (ret < 0) {
                             ret = msp_set_tsk_error(ret);
                             goto out;
@@ -5268,6 +6988,7 @@ msp_debug_demography(msp_t *self, double *end_time)
         ret = MSP_ERR_BAD_STATE;
         goto out;
     }
+    scratch_buffer_reset(&self->scratch);
     if (!first_call && self->next_demographic_event != NULL) {
         de = self->next_demographic_event;
 
@@ -5388,7 +7109,7 @@ msp_get_num_population_ancestors(msp_t *self, tsk_id_t population)
     size_t n = 0;
 
     for (label = 0; label < (tsk_id_t) self->num_labels; label++) {
-        n += avl_count(&pop->ancestors[label]);
+        n += pop->ancestors[label].num_lineages;
     }
     return n;
 }
@@ -5408,7 +7129,7 @@ msp_get_num_ancestors(msp_t *self)
 size_t
 msp_get_num_breakpoints(msp_t *self)
 {
-    return avl_count(&self->breakpoints);
+    return breakpoint_set_get_num_items(&self->breakpoints);
 }
 
 size_t
@@ -5430,20 +7151,19 @@ msp_get_num_migrations(msp_t *self)
 }
 
 int MSP_WARN_UNUSED
-msp_get_ancestors(msp_t *self, segment_t **ancestors)
+msp_get_ancestors(msp_t *self, segment_id_t *ancestors)
 {
     int ret = -1;
-    avl_node_t *node;
-    avl_tree_t *population_ancestors;
-    size_t j;
+    ancestor_set_t *population_ancestors;
+    size_t j, l;
     label_id_t label;
     size_t k = 0;
 
     for (j = 0; j < self->num_populations; j++) {
         for (label = 0; label < (label_id_t) self->num_labels; label++) {
             population_ancestors = &self->populations[j].ancestors[label];
-            for (node = population_ancestors->head; node != NULL; node = node->next) {
-                ancestors[k] = (segment_t *) node->item;
+            for (l = 0; l < population_ancestors->num_lineages; l++) {
+                ancestors[k] = population_ancestors->lineages[l];
                 k++;
             }
         }
@@ -5452,20 +7172,49 @@ msp_get_ancestors(msp_t *self, segment_t **ancestors)
     return ret;
 }
 
+/* Copies the fields of the specified segment, which must be in use, into
+ * seg. The next and prev fields can be passed back to this function to
+ * walk along the segment's chain. */
+int MSP_WARN_UNUSED
+msp_get_segment(msp_t *self, segment_id_t id, segment_t *seg)
+{
+    int ret = 0;
+    segment_pool_t *pool = &self->segments;
+
+    if (id == MSP_NULL_SEGMENT || id > segment_pool_get_size(pool)) {
+        ret = MSP_ERR_BAD_PARAM_VALUE;
+        goto out;
+    }
+    seg->left = pool->left[id];
+    seg->right = pool->right[id];
+    seg->prev = pool->prev[id];
+    seg->next = pool->next[id];
+    seg->population = pool->population[id];
+    seg->label = pool->label[id];
+    seg->value = pool->value[id];
+out:
+    return ret;
+}
+
+/* The breakpoints are stored unordered, so they are sorted on each call. */
 int MSP_WARN_UNUSED
 msp_get_breakpoints(msp_t *self, size_t *breakpoints)
 {
-    int ret = -1;
-    avl_node_t *node;
-    node_mapping_t *nm;
-    size_t j = 0;
+    int ret = 0;
+    size_t j;
+    size_t num_breakpoints = msp_get_num_breakpoints(self);
+    double *positions = malloc(GSL_MAX(num_breakpoints, 1) * sizeof(*positions));
 
-    for (node = (&self->breakpoints)->head; node != NULL; node = node->next) {
-        nm = (node_mapping_t *) node->item;
-        breakpoints[j] = (size_t) nm->position;
-        j++;
+    if (positions == NULL) {
+        ret = MSP_ERR_NO_MEMORY;
+        goto out;
     }
-    ret = 0;
+    breakpoint_set_get_sorted(&self->breakpoints, positions);
+    for (j = 0; j < num_breakpoints; j++) {
+        breakpoints[j] = (size_t) positions[j];
+    }
+out:
+    msp_safe_free(positions);
     return ret;
 }
 
@@ -5490,6 +7239,92 @@ msp_get_num_migration_events(msp_t *self, size_t *num_migration_events)
     return 0;
 }
 
+int
+msp_get_timer_calls(msp_t *self, size_t *calls)
+{
+    memcpy(calls, self->timer_calls, MSP_NUM_TIMERS * sizeof(size_t));
+    return 0;
+}
+
+int
+msp_get_timer_elapsed(msp_t *self, double *elapsed)
+{
+    memcpy(elapsed, self->timer_elapsed, MSP_NUM_TIMERS * sizeof(double));
+    return 0;
+}
+
+/* Returns the memory for blocks of AVL nodes and node mappings in which no
+ * objects are in use to the operating system, and shrinks the segment pool
+ * to the smallest number of blocks that hold its segments. The heaps only
+ * grow during a simulation, so after a phase with many lineages (or a large
+ * replicate) most of their blocks may be idle. Blocks that still hold a
+ * live object cannot be released, since objects are never moved. Released
+ * blocks are reallocated when the heaps next need to grow. Segments are
+ * moved by compaction, but in the pedigree model they can be held by
+ * individuals and so the pool is left as it is. */
+int
+msp_trim_memory(msp_t *self)
+{
+    int ret = 0;
+    size_t num_released;
+
+    if (self->state == MSP_STATE_NEW) {
+        ret = MSP_ERR_BAD_STATE;
+        goto out;
+    }
+    /* Make sure the peak usage is recorded before we release anything */
+    msp_record_memory_peak(self);
+    if (self->model.type != MSP_MODEL_WF_PED) {
+        ret = msp_compact_segments(self, 0);
+        if (ret != 0) {
+            goto out;
+        }
+    }
+    ret = object_heap_trim(&self->avl_node_heap, &num_released);
+    if (ret != 0) {
+        goto out;
+    }
+    ret = object_heap_trim(&self->node_mapping_heap, &num_released);
+    if (ret != 0) {
+        goto out;
+    }
+out:
+    return ret;
+}
+
+/* Copies the number of bytes currently allocated for each of the
+ * MSP_NUM_MEMORY_CATEGORIES groups of structures into current, and the
+ * largest number seen since the simulator was allocated into peak. Peaks
+ * are recorded whenever the segment pool, mass indexes, AVL node heap,
+ * lineage arrays or edge buffer grow, before the simulator releases any of
+ * these, at the end of each call to msp_run and when this function is
+ * called. The tables and breakpoint set only grow during a
+ * simulation, and so their peaks are exact at these points too. The
+ * overlap map and scratch buffer can release memory within an event, so
+ * their peaks may miss what they hold only briefly in between. */
+int
+msp_get_memory_usage(msp_t *self, size_t *current, size_t *peak)
+{
+    msp_update_memory_usage(self, current);
+    memcpy(peak, self->memory_peak, MSP_NUM_MEMORY_CATEGORIES * sizeof(size_t));
+    return 0;
+}
+
+/* Copies the records in the event trace into the specified array, which
+ * must have space for msp_get_num_event_trace_records() records. Records
+ * are written in the order that the events occured. */
+int
+msp_get_event_trace(msp_t *self, event_trace_record_t *records)
+{
+    size_t j, num_records = msp_get_num_event_trace_records(self);
+    size_t start = self->num_traced_events - num_records;
+
+    for (j = 0; j < num_records; j++) {
+        records[j] = self->event_trace[(start + j) % self->event_trace_size];
+    }
+    return 0;
+}
+
 int MSP_WARN_UNUSED
 msp_get_population_configuration(msp_t *self, size_t population_id, double *initial_size,
     double *growth_rate, int *state)
@@ -5515,6 +7350,91 @@ msp_get_time(msp_t *self)
     return self->time;
 }
 
+int
+msp_get_scheduler(msp_t *self)
+{
+    return self->scheduler;
+}
+
+bool
+msp_get_instrumentation(msp_t *self)
+{
+    return self->instrumentation;
+}
+
+size_t
+msp_get_event_trace_size(msp_t *self)
+{
+    return self->event_trace_size;
+}
+
+double
+msp_get_wall_time_limit(msp_t *self)
+{
+    return self->wall_time_limit;
+}
+
+size_t
+msp_get_memory_limit(msp_t *self)
+{
+    return self->memory_limit;
+}
+
+size_t
+msp_get_variate_buffer_size(msp_t *self)
+{
+    return self->variates.size;
+}
+
+bool
+msp_get_exact_mass_index(msp_t *self)
+{
+    return self->exact_mass_index;
+}
+
+bool
+msp_get_huge_pages(msp_t *self)
+{
+    return self->huge_pages;
+}
+
+double
+msp_get_segment_compaction_threshold(msp_t *self)
+{
+    return self->segment_compaction_threshold;
+}
+
+size_t
+msp_get_num_event_trace_records(msp_t *self)
+{
+    return GSL_MIN(self->num_traced_events, self->event_trace_size);
+}
+
+/* Returns the name of the specified timer, or NULL if it is out of bounds. */
+const char *
+msp_get_timer_name(int timer)
+{
+    const char *ret = NULL;
+
+    if (timer >= 0 && timer < MSP_NUM_TIMERS) {
+        ret = msp_timer_names[timer];
+    }
+    return ret;
+}
+
+/* Returns the name of the specified memory category, or NULL if it is out
+ * of bounds. */
+const char *
+msp_get_memory_category_name(int category)
+{
+    const char *ret = NULL;
+
+    if (category >= 0 && category < MSP_NUM_MEMORY_CATEGORIES) {
+        ret = msp_memory_category_names[category];
+    }
+    return ret;
+}
+
 /* Demographic events. All times and input parameters are specified in units
  * of generations. When we store these values, we must rescale them into
  * model time, as appropriate. */
@@ -5586,6 +7506,7 @@ msp_change_single_population_parameters(msp_t *self, size_t population_id, doubl
         pop->growth_rate = growth_rate;
     }
     pop->start_time = time;
+    msp_mark_population_parameters_changed(self, (population_id_t) population_id);
 out:
     return ret;
 }
@@ -5684,6 +7605,7 @@ msp_change_migration_matrix_entry(msp_t *self, size_t index, double rate)
         goto out;
     }
     self->migration_matrix[index] = rate;
+    msp_mark_migration_row_changed(self, (population_id_t)(index / N));
 out:
     return ret;
 }
@@ -5776,8 +7698,8 @@ msp_mass_migration(msp_t *self, demographic_event_t *event)
     population_id_t dest = event->params.mass_migration.destination;
     double p = event->params.mass_migration.proportion;
     population_id_t N = (population_id_t) self->num_populations;
-    avl_node_t *node, *next;
-    avl_tree_t *pop;
+    size_t k;
+    ancestor_set_t *pop;
     label_id_t label = 0; /* For now only support label 0 */
 
     /* This should have been caught on adding the event */
@@ -5786,19 +7708,18 @@ msp_mass_migration(msp_t *self, demographic_event_t *event)
         goto out;
     }
     /*
-     * Move lineages from source to dest with probability p.
+     * Move lineages from source to dest with probability p. We go backwards
+     * so that the lineage moved into the place of a migrant has already
+     * been considered.
      */
     pop = &self->populations[source].ancestors[label];
-    node = pop->head;
-    while (node != NULL) {
-        next = node->next;
-        if (gsl_rng_uniform(self->rng) < p) {
-            ret = msp_move_individual(self, node, pop, dest, label);
+    for (k = pop->num_lineages; k > 0; k--) {
+        if (variate_buffer_uniform(&self->variates) < p) {
+            ret = msp_move_individual(self, pop->lineages[k - 1], dest, label);
             if (ret != 0) {
                 goto out;
             }
         }
-        node = next;
     }
 out:
     return ret;
@@ -5871,6 +7792,7 @@ msp_deactivate_population(msp_t *self, int population_id)
     /* Set these to zero for tidyness sake */
     pop->initial_size = 0;
     pop->growth_rate = 0;
+    msp_mark_population_parameters_changed(self, population_id);
 out:
     return ret;
 }
@@ -5890,6 +7812,7 @@ msp_activate_population(msp_t *self, int population_id)
         goto out;
     }
     pop->state = MSP_POP_STATE_ACTIVE;
+    msp_mark_population_parameters_changed(self, population_id);
 out:
     return ret;
 }
@@ -5927,9 +7850,13 @@ msp_population_split(msp_t *self, demographic_event_t *event)
         }
 
         /* Turn off all migration to and from derived[j] */
+        msp_mark_migration_row_changed(self, derived[j]);
         for (k = 0; k < self->num_populations; k++) {
             self->migration_matrix[((size_t) derived[j] * N) + k] = 0;
-            self->migration_matrix[k * N + (size_t) derived[j]] = 0;
+            if (self->migration_matrix[k * N + (size_t) derived[j]] != 0) {
+                self->migration_matrix[k * N + (size_t) derived[j]] = 0;
+                msp_mark_migration_row_changed(self, (population_id_t) k);
+            }
         }
         /* Move all lineages out of derived and into ancestral */
         mass_migration.params.mass_migration.source = derived[j];
@@ -6046,9 +7973,8 @@ msp_admixture(msp_t *self, demographic_event_t *event)
     population_id_t derived = event->params.admixture.derived;
     population_t *pop;
     size_t num_ancestral = event->params.admixture.num_ancestral;
-    size_t index;
-    avl_tree_t *source;
-    avl_node_t *node, *next;
+    size_t index, k;
+    ancestor_set_t *source;
     double u;
     label_id_t label = 0; /* For now only support label 0 */
 
@@ -6072,16 +7998,14 @@ msp_admixture(msp_t *self, demographic_event_t *event)
      * proportion[j].
      */
     source = &self->populations[derived].ancestors[label];
-    node = source->head;
-    while (node != NULL) {
-        next = node->next;
-        u = gsl_rng_uniform(self->rng);
+    for (k = source->num_lineages; k > 0; k--) {
+        u = variate_buffer_uniform(&self->variates);
         index = probability_list_select(u, num_ancestral, proportion);
-        ret = msp_move_individual(self, node, source, ancestral[index], label);
+        ret = msp_move_individual(
+            self, source->lineages[k - 1], ancestral[index], label);
         if (ret != 0) {
             goto out;
         }
-        node = next;
     }
     msp_deactivate_population(self, derived);
 out:
@@ -6158,9 +8082,11 @@ msp_simple_bottleneck(msp_t *self, demographic_event_t *event)
     population_id_t population_id = event->params.simple_bottleneck.population;
     double p = event->params.simple_bottleneck.proportion;
     population_id_t N = (population_id_t) self->num_populations;
-    avl_node_t *node, *next, *q_node;
-    avl_tree_t *pop, Q;
-    segment_t *u;
+    avl_node_t *q_node;
+    avl_tree_t Q;
+    ancestor_set_t *pop;
+    segment_id_t u;
+    size_t k;
     label_id_t label = 0; /* For now only support label 0 */
 
     /* This should have been caught on adding the event */
@@ -6178,23 +8104,19 @@ msp_simple_bottleneck(msp_t *self, demographic_event_t *event)
      * during this simple_bottleneck.
      */
     pop = &self->populations[population_id].ancestors[label];
-    node = pop->head;
-    while (node != NULL) {
-        next = node->next;
-        if (gsl_rng_uniform(self->rng) < p) {
-            u = (segment_t *) node->item;
-            avl_unlink_node(pop, node);
-            msp_free_avl_node(self, node);
+    for (k = pop->num_lineages; k > 0; k--) {
+        if (variate_buffer_uniform(&self->variates) < p) {
+            u = pop->lineages[k - 1];
+            msp_remove_individual(self, u);
             q_node = msp_alloc_avl_node(self);
             if (q_node == NULL) {
                 ret = MSP_ERR_NO_MEMORY;
                 goto out;
             }
-            avl_init_node(q_node, u);
+            msp_init_segment_queue_node(self, q_node, u);
             q_node = avl_insert_node(&Q, q_node);
             tsk_bug_assert(q_node != NULL);
         }
-        node = next;
     }
     ret = msp_merge_ancestors(self, &Q, population_id, label, TSK_NULL, NULL);
 out:
@@ -6252,14 +8174,13 @@ msp_instantaneous_bottleneck(msp_t *self, demographic_event_t *event)
     population_id_t N = (population_id_t) self->num_populations;
     tsk_id_t *lineages = NULL;
     tsk_id_t *pi = NULL;
-    avl_node_t **avl_nodes = NULL;
+    segment_id_t *individuals = NULL;
     avl_tree_t *sets = NULL;
     tsk_id_t u, parent;
     uint32_t j, k, n, num_roots;
     double rate, t;
-    avl_tree_t *pop;
-    avl_node_t *node, *set_node;
-    segment_t *individual;
+    ancestor_set_t *pop;
+    avl_node_t *set_node;
     label_id_t label = 0; /* For now only support label 0 */
 
     if (self->model.type == MSP_MODEL_DTWF) {
@@ -6268,12 +8189,12 @@ msp_instantaneous_bottleneck(msp_t *self, demographic_event_t *event)
     }
     tsk_bug_assert(population_id >= 0 && population_id < N);
     pop = &self->populations[population_id].ancestors[label];
-    n = avl_count(pop);
-    lineages = malloc(n * sizeof(tsk_id_t));
-    avl_nodes = malloc(n * sizeof(avl_node_t *));
-    pi = malloc(2 * n * sizeof(tsk_id_t));
-    sets = malloc(2 * n * sizeof(avl_tree_t));
-    if (lineages == NULL || avl_nodes == NULL || pi == NULL || sets == NULL) {
+    n = (uint32_t) pop->num_lineages;
+    lineages = scratch_buffer_get(&self->scratch, n * sizeof(tsk_id_t));
+    individuals = scratch_buffer_get(&self->scratch, n * sizeof(*individuals));
+    pi = scratch_buffer_get(&self->scratch, 2 * n * sizeof(tsk_id_t));
+    sets = scratch_buffer_get(&self->scratch, 2 * n * sizeof(avl_tree_t));
+    if (lineages == NULL || individuals == NULL || pi == NULL || sets == NULL) {
         ret = MSP_ERR_NO_MEMORY;
         goto out;
     }
@@ -6283,11 +8204,9 @@ msp_instantaneous_bottleneck(msp_t *self, demographic_event_t *event)
     for (u = 0; u < (tsk_id_t)(2 * n); u++) {
         pi[u] = TSK_NULL;
     }
-    j = 0;
-    for (node = pop->head; node != NULL; node = node->next) {
-        avl_nodes[j] = node;
-        j++;
-    }
+    /* Removing lineages from the population reorders it, so we work
+     * from a copy */
+    memcpy(individuals, pop->lineages, n * sizeof(*individuals));
 
     /* Now we implement the Kingman coalescent for these lineages until we have
      * exceeded T2. This is based on the algorithm from Hudson 1990.
@@ -6305,11 +8224,11 @@ msp_instantaneous_bottleneck(msp_t *self, demographic_event_t *event)
         /* Note: there might be issues here if we have very large sample
          * sizes as the uniform_int has a limited range.
          */
-        k = (uint32_t) gsl_rng_uniform_int(self->rng, j);
+        k = (uint32_t) variate_buffer_uniform_int(&self->variates, j);
         pi[lineages[k]] = parent;
         lineages[k] = lineages[j];
         j--;
-        k = j > 0 ? (uint32_t) gsl_rng_uniform_int(self->rng, j) : 0;
+        k = j > 0 ? (uint32_t) variate_buffer_uniform_int(&self->variates, j) : 0;
         pi[lineages[k]] = parent;
         lineages[k] = parent;
         parent++;
@@ -6333,15 +8252,13 @@ msp_instantaneous_bottleneck(msp_t *self, demographic_event_t *event)
         if (u >= (tsk_id_t) n) {
             /* Remove this node from the population, and add it into the
              * set for the root at u */
-            individual = (segment_t *) avl_nodes[j]->item;
-            avl_unlink_node(pop, avl_nodes[j]);
-            msp_free_avl_node(self, avl_nodes[j]);
+            msp_remove_individual(self, individuals[j]);
             set_node = msp_alloc_avl_node(self);
             if (set_node == NULL) {
                 ret = MSP_ERR_NO_MEMORY;
                 goto out;
             }
-            avl_init_node(set_node, individual);
+            msp_init_segment_queue_node(self, set_node, individuals[j]);
             set_node = avl_insert_node(&sets[u], set_node);
             tsk_bug_assert(set_node != NULL);
         }
@@ -6356,18 +8273,6 @@ msp_instantaneous_bottleneck(msp_t *self, demographic_event_t *event)
         }
     }
 out:
-    if (lineages != NULL) {
-        free(lineages);
-    }
-    if (pi != NULL) {
-        free(pi);
-    }
-    if (sets != NULL) {
-        free(sets);
-    }
-    if (avl_nodes != NULL) {
-        free(avl_nodes);
-    }
     return ret;
 }
 
@@ -6415,24 +8320,23 @@ out:
 static int
 msp_census_event(msp_t *self, demographic_event_t *event)
 {
+    segment_pool_t *pool = &self->segments;
     int ret = 0;
-    avl_tree_t *ancestors;
-    avl_node_t *node;
-    segment_t *seg;
+    ancestor_set_t *ancestors;
+    segment_id_t seg;
     tsk_id_t i, j;
     tsk_id_t u;
+    size_t k;
 
     for (i = 0; i < (int) self->num_populations; i++) {
         for (j = 0; j < (int) self->num_labels; j++) {
 
             // Get segment from an ancestor in a population.
             ancestors = &self->populations[i].ancestors[j];
-            node = ancestors->head;
+            for (k = 0; k < ancestors->num_lineages; k++) {
+                seg = ancestors->lineages[k];
 
-            while (node != NULL) {
-                seg = (segment_t *) node->item;
-
-                while (seg != NULL) {
+                while (seg != MSP_NULL_SEGMENT) {
                     // Add an edge to the edge table.
                     ret = msp_flush_edges(self);
                     if (ret != 0) {
@@ -6445,15 +8349,15 @@ msp_census_event(msp_t *self, demographic_event_t *event)
                     }
                     u = (tsk_id_t) ret;
                     // Add an edge joining the segment to the new node.
-                    ret = msp_store_edge(self, seg->left, seg->right, u, seg->value);
+                    ret = msp_store_edge(
+                        self, pool->left[seg], pool->right[seg], u, pool->value[seg]);
                     if (ret != 0) {
                         goto out;
                     }
                     // Modify segment node id.
-                    seg->value = u;
-                    seg = seg->next;
+                    pool->value[seg] = u;
+                    seg = pool->next[seg];
                 }
-                node = node->next;
             }
         }
     }
@@ -6585,7 +8489,7 @@ msp_std_get_common_ancestor_waiting_time(
     msp_t *self, population_id_t pop_id, label_id_t label)
 {
     population_t *pop = &self->populations[pop_id];
-    double n = (double) avl_count(&pop->ancestors[label]);
+    double n = (double) pop->ancestors[label].num_lineages;
     double lambda = n * (n - 1.0) / 2.0;
 
     return msp_get_common_ancestor_waiting_time_from_rate(self, pop, lambda);
@@ -6596,40 +8500,29 @@ msp_std_common_ancestor_event(
     msp_t *self, population_id_t population_id, label_id_t label)
 {
     int ret = 0;
-    uint32_t j, n;
-    avl_tree_t *ancestors;
-    avl_node_t *x_node, *y_node, *node;
-    segment_t *x, *y;
+    size_t j, k, n;
+    ancestor_set_t *ancestors;
+    segment_id_t x, y;
 
     ancestors = &self->populations[population_id].ancestors[label];
-    /* Choose x and y */
-    n = avl_count(ancestors);
-    j = (uint32_t) gsl_rng_uniform_int(self->rng, n);
-    x_node = avl_at(ancestors, j);
-    tsk_bug_assert(x_node != NULL);
-    x = (segment_t *) x_node->item;
-    avl_unlink_node(ancestors, x_node);
-    j = (uint32_t) gsl_rng_uniform_int(self->rng, n - 1);
-    y_node = avl_at(ancestors, j);
-    tsk_bug_assert(y_node != NULL);
-    y = (segment_t *) y_node->item;
-    avl_unlink_node(ancestors, y_node);
+    /* Choose x and then y from the remaining lineages */
+    n = ancestors->num_lineages;
+    j = (size_t) variate_buffer_uniform_int(&self->variates, n);
+    x = ancestors->lineages[j];
+    k = (size_t) variate_buffer_uniform_int(&self->variates, n - 1);
+    if (k >= j) {
+        k++;
+    }
+    y = ancestors->lineages[k];
 
     /* For SMC and SMC' models we reject some events to get the required
      * distribution. */
     if (msp_reject_ca_event(self, x, y)) {
         self->num_rejected_ca_events++;
-        /* insert x and y back into the population */
-        tsk_bug_assert(x_node->item == x);
-        node = avl_insert_node(ancestors, x_node);
-        tsk_bug_assert(node != NULL);
-        tsk_bug_assert(y_node->item == y);
-        node = avl_insert_node(ancestors, y_node);
-        tsk_bug_assert(node != NULL);
     } else {
         self->num_ca_events++;
-        msp_free_avl_node(self, x_node);
-        msp_free_avl_node(self, y_node);
+        msp_remove_individual(self, x);
+        msp_remove_individual(self, y);
         ret = msp_merge_two_ancestors(self, population_id, label, x, y, TSK_NULL, NULL);
     }
     return ret;
@@ -6651,7 +8544,7 @@ msp_dirac_get_common_ancestor_waiting_time_from_rate(
     double u, dt, z;
 
     if (lambda > 0.0) {
-        u = gsl_ran_exponential(self->rng, 1.0 / lambda);
+        u = variate_buffer_exponential(&self->variates, 1.0 / lambda);
         if (alpha == 0.0) {
             if (self->ploidy == 1) {
                 ret = pop->initial_size * pop->initial_size * u;
@@ -6690,7 +8583,7 @@ msp_dirac_get_common_ancestor_waiting_time(
     msp_t *self, population_id_t pop_id, label_id_t label)
 {
     population_t *pop = &self->populations[pop_id];
-    unsigned int n = (unsigned int) avl_count(&pop->ancestors[label]);
+    unsigned int n = (unsigned int) pop->ancestors[label].num_lineages;
     double c = self->model.params.dirac_coalescent.c;
     double lambda = n * (n - 1.0) / 2.0;
     if (self->ploidy == 1) {
@@ -6707,9 +8600,9 @@ msp_dirac_common_ancestor_event(msp_t *self, population_id_t pop_id, label_id_t
 {
     int ret = 0;
     uint32_t j, n, num_participants, num_parental_copies;
-    avl_tree_t *ancestors, Q[4]; /* MSVC won't let us use num_pots here */
-    avl_node_t *x_node, *y_node;
-    segment_t *x, *y;
+    ancestor_set_t *ancestors;
+    avl_tree_t Q[4]; /* MSVC won't let us use num_pots here */
+    segment_id_t x, y;
     double nC2, p;
     double psi = self->model.params.dirac_coalescent.psi;
 
@@ -6722,33 +8615,26 @@ msp_dirac_common_ancestor_event(msp_t *self, population_id_t pop_id, label_id_t
     }
 
     ancestors = &self->populations[pop_id].ancestors[label];
-    n = avl_count(ancestors);
+    n = (uint32_t) ancestors->num_lineages;
     nC2 = gsl_sf_choose(n, 2);
     if (self->ploidy == 1) {
         p = (nC2 / (nC2 + self->model.params.dirac_coalescent.c));
     } else {
         p = (nC2 / (nC2 + self->model.params.dirac_coalescent.c / (2.0 * self->ploidy)));
     }
-    if (gsl_rng_uniform(self->rng) < p) {
+    if (variate_buffer_uniform(&self->variates) < p) {
         /* When 2 * ploidy parental chromosomes are available, Mendelian segregation
          * results in a merger only 1 / (2 * ploidy) of the time. */
         if (self->ploidy == 1
-            || gsl_rng_uniform(self->rng) < 1.0 / (2.0 * self->ploidy)) {
+            || variate_buffer_uniform(&self->variates) < 1.0 / (2.0 * self->ploidy)) {
             /* Choose x and y */
-            n = avl_count(ancestors);
-            j = (uint32_t) gsl_rng_uniform_int(self->rng, n);
-            x_node = avl_at(ancestors, j);
-            tsk_bug_assert(x_node != NULL);
-            x = (segment_t *) x_node->item;
-            avl_unlink_node(ancestors, x_node);
-            j = (uint32_t) gsl_rng_uniform_int(self->rng, n - 1);
-            y_node = avl_at(ancestors, j);
-            tsk_bug_assert(y_node != NULL);
-            y = (segment_t *) y_node->item;
-            avl_unlink_node(ancestors, y_node);
+            j = (uint32_t) variate_buffer_uniform_int(&self->variates, n);
+            x = ancestors->lineages[j];
+            msp_remove_individual(self, x);
+            j = (uint32_t) variate_buffer_uniform_int(&self->variates, n - 1);
+            y = ancestors->lineages[j];
+            msp_remove_individual(self, y);
             self->num_ca_events++;
-            msp_free_avl_node(self, x_node);
-            msp_free_avl_node(self, y_node);
             ret = msp_merge_two_ancestors(self, pop_id, label, x, y, TSK_NULL, NULL);
         }
     } else {
@@ -6839,7 +8725,7 @@ msp_beta_get_common_ancestor_waiting_time_from_rate(
     double u, dt, z;
 
     if (lambda > 0.0) {
-        u = gsl_ran_exponential(self->rng, 1.0 / lambda);
+        u = variate_buffer_exponential(&self->variates, 1.0 / lambda);
         if (gamma == 0.0) {
             ret = beta_compute_timescale(self, pop) * u;
         } else {
@@ -6862,7 +8748,7 @@ msp_beta_get_common_ancestor_waiting_time(
     msp_t *self, population_id_t pop_id, label_id_t label)
 {
     population_t *pop = &self->populations[pop_id];
-    unsigned int n = (unsigned int) avl_count(&pop->ancestors[label]);
+    unsigned int n = (unsigned int) pop->ancestors[label].num_lineages;
     double lambda = n * (n - 1.0) / 2.0;
     double result
         = msp_beta_get_common_ancestor_waiting_time_from_rate(self, pop, lambda);
@@ -6871,12 +8757,12 @@ msp_beta_get_common_ancestor_waiting_time(
 
 int MSP_WARN_UNUSED
 msp_multi_merger_common_ancestor_event(
-    msp_t *self, avl_tree_t *ancestors, avl_tree_t *Q, uint32_t k, uint32_t num_pots)
+    msp_t *self, ancestor_set_t *ancestors, avl_tree_t *Q, uint32_t k, uint32_t num_pots)
 {
     int ret = 0;
     uint32_t j, i, l;
-    avl_node_t *node, *q_node;
-    segment_t *u;
+    avl_node_t *q_node;
+    segment_id_t u;
     uint32_t pot_size;
     uint32_t cumul_pot_size = 0;
 
@@ -6889,20 +8775,17 @@ msp_multi_merger_common_ancestor_event(
         cumul_pot_size += pot_size;
         if (pot_size > 1) {
             for (l = 0; l < pot_size; l++) {
-                j = (uint32_t) gsl_rng_uniform_int(self->rng, avl_count(ancestors));
-                node = avl_at(ancestors, j);
-                tsk_bug_assert(node != NULL);
-
-                u = (segment_t *) node->item;
-                avl_unlink_node(ancestors, node);
-                msp_free_avl_node(self, node);
+                j = (uint32_t) variate_buffer_uniform_int(
+                    &self->variates, ancestors->num_lineages);
+                u = ancestors->lineages[j];
+                msp_remove_individual(self, u);
 
                 q_node = msp_alloc_avl_node(self);
                 if (q_node == NULL) {
                     ret = MSP_ERR_NO_MEMORY;
                     goto out;
                 }
-                avl_init_node(q_node, u);
+                msp_init_segment_queue_node(self, q_node, u);
                 q_node = avl_insert_node(&Q[i], q_node);
                 tsk_bug_assert(q_node != NULL);
             }
@@ -6918,7 +8801,8 @@ msp_beta_common_ancestor_event(msp_t *self, population_id_t pop_id, label_id_t l
 {
     int ret = 0;
     uint32_t j, n, num_participants, num_parental_copies;
-    avl_tree_t *ancestors, Q[4]; /* MSVC won't let us use num_pots here */
+    ancestor_set_t *ancestors;
+    avl_tree_t Q[4]; /* MSVC won't let us use num_pots here */
     double alpha = self->model.params.beta_coalescent.alpha;
     double truncation_point = beta_compute_truncation(self);
     double beta_x, u, increment;
@@ -6935,7 +8819,7 @@ msp_beta_common_ancestor_event(msp_t *self, population_id_t pop_id, label_id_t l
         avl_init_tree(&Q[j], cmp_segment_queue, NULL);
     }
     ancestors = &self->populations[pop_id].ancestors[label];
-    n = avl_count(ancestors);
+    n = (uint32_t) ancestors->num_lineages;
     beta_x = ran_inc_beta(self->rng, 2.0 - alpha, alpha, truncation_point);
 
     /* We calculate the probability of accepting the event */
@@ -6965,11 +8849,12 @@ msp_beta_common_ancestor_event(msp_t *self, population_id_t pop_id, label_id_t l
         u /= gsl_sf_choose(n, 2);
     }
 
-    if (gsl_rng_uniform(self->rng) < u) {
+    if (variate_buffer_uniform(&self->variates) < u) {
         do {
             /* Rejection sampling for the number of participants */
             num_participants = 2 + gsl_ran_binomial(self->rng, beta_x, n - 2);
-        } while (gsl_rng_uniform(self->rng) > 1 / gsl_sf_choose(num_participants, 2));
+        } while (variate_buffer_uniform(&self->variates)
+                 > 1 / gsl_sf_choose(num_participants, 2));
 
         ret = msp_multi_merger_common_ancestor_event(
             self, ancestors, Q, num_participants, num_parental_copies);
@@ -7131,6 +9016,18 @@ msp_set_simulation_model(msp_t *self, int model)
             goto out;
         }
     }
+    if (self->state == MSP_STATE_SIMULATING) {
+        /* The population indexes are not maintained by all models, and
+         * the way that common ancestor events are sampled depends on the
+         * model, so bring them up to date for the new model. */
+        ret = msp_compute_population_indexes(self);
+        if (ret != 0) {
+            goto out;
+        }
+        self->population_indexes_valid = true;
+    }
+    /* The event rates depend on the model, so the queue must be resampled */
+    self->event_queue_valid = false;
 out:
     return ret;
 }
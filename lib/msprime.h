@@ -34,7 +34,11 @@
 #include "avl.h"
 #include "fenwick.h"
 #include "object_heap.h"
+#include "breakpoint_set.h"
+#include "overlap_map.h"
 #include "rate_map.h"
+#include "segment_pool.h"
+#include "rng.h"
 
 #define MSP_MODEL_HUDSON 0
 #define MSP_MODEL_SMC 1
@@ -51,6 +55,42 @@
 #define MSP_EXIT_MAX_EVENTS 1
 #define MSP_EXIT_MAX_TIME 2
 #define MSP_EXIT_MODEL_COMPLETE 3
+#define MSP_EXIT_WALL_TIME 4
+#define MSP_EXIT_MEMORY_LIMIT 5
+
+/* Methods used to choose the next event in the coalescent models */
+#define MSP_SCHEDULER_DIRECT 0
+#define MSP_SCHEDULER_NEXT_REACTION 1
+
+/* Event handlers that are timed when instrumentation is enabled */
+#define MSP_TIMER_RECOMBINATION 0
+#define MSP_TIMER_GENE_CONVERSION 1
+#define MSP_TIMER_COMMON_ANCESTOR 2
+#define MSP_TIMER_MIGRATION 3
+#define MSP_TIMER_FIXED_EVENTS 4
+#define MSP_TIMER_FLUSH_EDGES 5
+#define MSP_TIMER_FENWICK_REBUILD 6
+#define MSP_NUM_TIMERS 7
+
+/* Groups of structures whose memory usage is reported separately */
+#define MSP_MEMORY_SEGMENTS 0
+#define MSP_MEMORY_AVL_NODES 1
+#define MSP_MEMORY_NODE_MAPPINGS 2
+#define MSP_MEMORY_FENWICK 3
+#define MSP_MEMORY_RATE_MAPS 4
+#define MSP_MEMORY_EDGE_BUFFER 5
+#define MSP_MEMORY_POPULATIONS 6
+#define MSP_MEMORY_TABLES 7
+#define MSP_MEMORY_BREAKPOINTS 8
+#define MSP_MEMORY_SCRATCH 9
+#define MSP_NUM_MEMORY_CATEGORIES 10
+
+/* Event types recorded in the event trace */
+#define MSP_TRACE_RECOMBINATION 0
+#define MSP_TRACE_GENE_CONVERSION 1
+#define MSP_TRACE_COMMON_ANCESTOR 2
+#define MSP_TRACE_MIGRATION 3
+#define MSP_TRACE_FIXED_EVENTS 4
 
 #define MSP_NODE_IS_RE_EVENT (1u << 17)
 #define MSP_NODE_IS_CA_EVENT (1u << 18)
@@ -73,15 +113,17 @@
 typedef tsk_id_t population_id_t;
 typedef tsk_id_t label_id_t;
 
-typedef struct segment_t_t {
-    population_id_t population;
-    label_id_t label;
+/* A copy of the fields of a segment, for use outside the simulator. The
+ * simulator stores its segments in a segment_pool_t, and refers to them by
+ * their IDs. */
+typedef struct {
     double left;
     double right;
+    segment_id_t prev;
+    segment_id_t next;
+    population_id_t population;
+    label_id_t label;
     tsk_id_t value;
-    size_t id;
-    struct segment_t_t *prev;
-    struct segment_t_t *next;
 } segment_t;
 
 typedef struct {
@@ -89,6 +131,26 @@ typedef struct {
     uint32_t value;
 } node_mapping_t;
 
+/* A node in an AVL tree used as a priority queue of segments, ordered by
+ * their left coordinates and then their IDs. The node is its own item, and
+ * holds a copy of the key since the segment pool columns move when the pool
+ * grows. All AVL nodes are allocated with this size. */
+typedef struct {
+    avl_node_t avl_node;
+    double left;
+    segment_id_t segment;
+} segment_queue_node_t;
+
+/* The lineages in a population with a given label, in no particular order.
+ * Each lineage is represented by its head segment, and its position in the
+ * lineages array is stored in msp_t.ancestor_index so that it can be removed
+ * in constant time by moving the last lineage into its place. */
+typedef struct {
+    size_t num_lineages;
+    size_t max_lineages;
+    segment_id_t *lineages;
+} ancestor_set_t;
+
 #define MSP_POP_STATE_INACTIVE 0
 #define MSP_POP_STATE_ACTIVE 1
 #define MSP_POP_STATE_PREVIOUSLY_ACTIVE 2
@@ -101,9 +163,29 @@ typedef struct {
     /* The lifecycle state machine. States go strictly from
      * inactive -> active -> previously_active */
     int state;
-    avl_tree_t *ancestors;
+    ancestor_set_t *ancestors;
     tsk_size_t num_potential_destinations;
     tsk_id_t *potential_destinations;
+    /* The total rate of migration out of this population, and an alias
+     * table over the potential_destinations for choosing where a migrant
+     * lineage goes. */
+    double total_migration_rate;
+    double *migration_alias_probability;
+    tsk_id_t *migration_alias;
+    /* True if the number of ancestors has changed since the rates for
+     * this population were last written into the event rate index. */
+    bool event_rates_dirty;
+    /* True if the migration matrix row for this population has been
+     * changed since the destinations and alias table were computed. */
+    bool migration_row_changed;
+    /* Constants for the current epoch, which must be updated whenever the
+     * size, growth rate or state changes. ploidy_size is ploidy * initial_size
+     * and growth_scale is ploidy * growth_rate * initial_size. If the rate of
+     * common ancestor events only depends on the number of lineages it is
+     * stored in the event rate index, and ca_rate_indexed is true. */
+    double ploidy_size;
+    double growth_scale;
+    bool ca_rate_indexed;
 } population_t;
 
 #define MSP_MAX_PED_PLOIDY 2
@@ -189,8 +271,37 @@ typedef struct {
     uint32_t count;
 } overlap_count_t;
 
+/* An indexed binary min-heap of the absolute times at which each
+ * event channel will next fire, used by the next reaction scheduler. */
+typedef struct {
+    size_t size;
+    double *time;
+    size_t *heap;
+    size_t *position;
+} event_queue_t;
+
+/* A record of a single event in the event trace. The number of segments
+ * counts the segments that were modified or freed during the event, and
+ * the number of edges counts the edges that were output. */
+typedef struct {
+    double time;
+    int type;
+    population_id_t population;
+    label_id_t label;
+    uint32_t num_segments;
+    uint32_t num_edges;
+} event_trace_record_t;
+
+/* Called periodically from msp_run to report the simulation time, the
+ * number of ancestors and the numbers of nodes and edges output so far. */
+typedef void (*msp_progress_callback_t)(
+    double time, size_t num_ancestors, size_t num_nodes, size_t num_edges, void *arg);
+
 typedef struct _msp_t {
     gsl_rng *rng;
+    variate_buffer_t variates;
+    /* Temporary arrays used while processing an event */
+    scratch_buffer_t scratch;
     /* input parameters */
     simulation_model_t model;
     bool store_migrations;
@@ -203,10 +314,17 @@ typedef struct _msp_t {
     uint32_t num_populations;
     uint32_t num_labels;
     uint32_t ploidy;
+    int scheduler;
+    /* Use fixed-point Fenwick trees for the recombination and GC mass */
+    bool exact_mass_index;
+    /* Allocate the object heap blocks and mass indexes in huge pages */
+    bool huge_pages;
+    /* Renumber the segments when fewer than this fraction of the IDs are used */
+    double segment_compaction_threshold;
     double start_time;
     pedigree_t pedigree;
     /* Initial state for replication */
-    segment_t **root_segments;
+    segment_id_t *root_segments;
     overlap_count_t *initial_overlaps;
     simulation_model_t initial_model;
     double *initial_migration_matrix;
@@ -227,6 +345,34 @@ typedef struct _msp_t {
     size_t num_multiple_re_events;
     size_t num_noneffective_gc_events;
     size_t num_fenwick_rebuilds;
+    /* Optional instrumentation: the number of calls to and the wall-clock
+     * time spent in each of the timed event handlers. */
+    bool instrumentation;
+    double timer_start[MSP_NUM_TIMERS];
+    double timer_elapsed[MSP_NUM_TIMERS];
+    size_t timer_calls[MSP_NUM_TIMERS];
+    /* Optional ring buffer holding records of the most recent events */
+    event_trace_record_t *event_trace;
+    size_t event_trace_size;
+    size_t num_traced_events;
+    /* Running totals used to fill in the event trace records */
+    size_t num_segment_updates;
+    size_t num_stored_edges;
+    /* Optional limit on the wall-clock time spent in each call to msp_run,
+     * and a callback reporting progress at a fixed wall-clock interval. */
+    double wall_time_limit;
+    double progress_interval;
+    msp_progress_callback_t progress_callback;
+    void *progress_callback_arg;
+    double run_start_wall_time;
+    double last_progress_wall_time;
+    /* Optional limit on the bytes allocated by the simulator; 0 is no limit */
+    size_t memory_limit;
+    /* The caller's node, edge and migration table row increments, which
+     * are replaced while a memory limit is set */
+    tsk_size_t saved_rows_increment[3];
+    /* The largest number of bytes seen in each memory category */
+    size_t memory_peak[MSP_NUM_MEMORY_CATEGORIES];
     /* sampling events */
     sampling_event_t *sampling_events;
     size_t num_sampling_events;
@@ -241,16 +387,46 @@ typedef struct _msp_t {
     double *migration_matrix;
     population_t *populations;
     avl_tree_t non_empty_populations;
-    avl_tree_t breakpoints;
-    avl_tree_t overlap_counts;
+    breakpoint_set_t breakpoints;
+    overlap_map_t overlap_counts;
     /* We keep an independent Fenwick tree for each label */
     fenwick_t *recomb_mass_index;
     fenwick_t *gc_mass_index;
+    /* Direct method event selection. The rates of the common ancestor and
+     * migration events in each population are stored in a Fenwick tree so
+     * that we can draw a single waiting time for all of them and then
+     * choose the event by descending the tree. */
+    fenwick_t event_rate_index;
+    size_t num_nonzero_event_rates;
+    bool ca_rates_indexed;
+    population_id_t *dirty_populations;
+    uint32_t num_dirty_populations;
+    /* Changes reported by demographic events, used to patch the
+     * population indexes rather than recomputing them from scratch. */
+    population_id_t *changed_migration_rows;
+    uint32_t num_changed_migration_rows;
+    bool population_parameters_changed;
+    /* Work space for building the migration alias tables */
+    tsk_id_t *migration_alias_work;
+    /* Next reaction method: the queue of firing times for each event
+     * channel along with the rate used to sample them. */
+    event_queue_t event_queue;
+    double *channel_rate;
+    /* True if the population indexes and the event queue are up to date
+     * with the simulation state, so that msp_run can carry on where the last
+     * call left off. Resampling the queue or recomputing the rates on each
+     * call would make the output depend on how the run is divided. */
+    bool population_indexes_valid;
+    bool event_queue_valid;
     /* memory management */
     object_heap_t avl_node_heap;
     object_heap_t node_mapping_heap;
-    /* We keep an independent segment heap for each label */
-    object_heap_t *segment_heap;
+    /* The segments of all labels. Segment IDs are their indexes in the
+     * pool, and index the mass indexes of their labels. */
+    segment_pool_t segments;
+    /* The positions of lineages in their ancestor sets, indexed by the ID
+     * of the head segment. */
+    uint32_t *ancestor_index;
     /* The tables used to store the simulation state */
     tsk_table_collection_t *tables;
     tsk_bookmark_t input_position;
@@ -405,6 +581,8 @@ typedef struct _mutation_model_t {
 
 typedef struct {
     gsl_rng *rng;
+    variate_buffer_t variates;
+    scratch_buffer_t scratch;
     tsk_table_collection_t *tables;
     double start_time;
     double end_time;
@@ -430,6 +608,17 @@ int msp_set_start_time(msp_t *self, double start_time);
 int msp_set_store_migrations(msp_t *self, bool store_migrations);
 int msp_set_store_full_arg(msp_t *self, bool store_full_arg);
 int msp_set_ploidy(msp_t *self, int ploidy);
+int msp_set_scheduler(msp_t *self, int scheduler);
+int msp_set_instrumentation(msp_t *self, bool instrumentation);
+int msp_set_event_trace_size(msp_t *self, size_t size);
+int msp_set_wall_time_limit(msp_t *self, double wall_time_limit);
+int msp_set_memory_limit(msp_t *self, size_t memory_limit);
+int msp_set_variate_buffer_size(msp_t *self, size_t size);
+int msp_set_exact_mass_index(msp_t *self, bool exact_mass_index);
+int msp_set_huge_pages(msp_t *self, bool huge_pages);
+int msp_set_segment_compaction_threshold(msp_t *self, double threshold);
+int msp_set_progress_callback(
+    msp_t *self, msp_progress_callback_t callback, double interval, void *arg);
 int msp_set_recombination_map(msp_t *self, size_t size, double *position, double *rate);
 int msp_set_recombination_rate(msp_t *self, double rate);
 int msp_set_gene_conversion_map(
@@ -472,10 +661,16 @@ int msp_print_state(msp_t *self, FILE *out);
 int msp_free(msp_t *self);
 void msp_verify(msp_t *self, int options);
 
-int msp_get_ancestors(msp_t *self, segment_t **ancestors);
+int msp_get_ancestors(msp_t *self, segment_id_t *ancestors);
+int msp_get_segment(msp_t *self, segment_id_t id, segment_t *seg);
 int msp_get_breakpoints(msp_t *self, size_t *breakpoints);
 int msp_get_migration_matrix(msp_t *self, double *migration_matrix);
 int msp_get_num_migration_events(msp_t *self, size_t *num_migration_events);
+int msp_get_timer_calls(msp_t *self, size_t *calls);
+int msp_get_timer_elapsed(msp_t *self, double *elapsed);
+int msp_get_memory_usage(msp_t *self, size_t *current, size_t *peak);
+int msp_trim_memory(msp_t *self);
+int msp_get_event_trace(msp_t *self, event_trace_record_t *records);
 int msp_get_population_configuration(msp_t *self, size_t population_id,
     double *initial_size, double *growth_rate, int *state);
 int msp_compute_population_size(
@@ -484,6 +679,18 @@ int msp_is_completed(msp_t *self);
 
 simulation_model_t *msp_get_model(msp_t *self);
 const char *msp_get_model_name(msp_t *self);
+int msp_get_scheduler(msp_t *self);
+bool msp_get_instrumentation(msp_t *self);
+const char *msp_get_timer_name(int timer);
+const char *msp_get_memory_category_name(int category);
+size_t msp_get_event_trace_size(msp_t *self);
+double msp_get_wall_time_limit(msp_t *self);
+size_t msp_get_memory_limit(msp_t *self);
+size_t msp_get_variate_buffer_size(msp_t *self);
+bool msp_get_exact_mass_index(msp_t *self);
+bool msp_get_huge_pages(msp_t *self);
+double msp_get_segment_compaction_threshold(msp_t *self);
+size_t msp_get_num_event_trace_records(msp_t *self);
 bool msp_get_store_migrations(msp_t *self);
 double msp_get_time(msp_t *self);
 size_t msp_get_num_samples(msp_t *self);
@@ -522,13 +729,14 @@ int mutgen_alloc(mutgen_t *self, gsl_rng *rng, tsk_table_collection_t *tables,
     mutation_model_t *model, size_t mutation_block_size);
 int mutgen_set_time_interval(mutgen_t *self, double start_time, double end_time);
 int mutgen_set_rate(mutgen_t *self, double rate);
+int mutgen_set_variate_buffer_size(mutgen_t *self, size_t size);
 int mutgen_set_rate_map(mutgen_t *self, size_t size, double *position, double *rate);
 int mutgen_free(mutgen_t *self);
 int mutgen_generate(mutgen_t *self, int flags);
 void mutgen_print_state(mutgen_t *self, FILE *out);
 
 /* Functions exposed here for unit testing. Not part of public API. */
-int msp_multi_merger_common_ancestor_event(
-    msp_t *self, avl_tree_t *ancestors, avl_tree_t *Q, uint32_t k, uint32_t num_pots);
+int msp_multi_merger_common_ancestor_event(msp_t *self, ancestor_set_t *ancestors,
+    avl_tree_t *Q, uint32_t k, uint32_t num_pots);
 
 #endif /*__MSPRIME_H__*/
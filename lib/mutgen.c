@@ -25,6 +25,9 @@
 
 #include "msprime.h"
 
+/* The initial size in bytes of the scratch buffer, which grows as needed */
+#define MUTGEN_SCRATCH_BUFFER_SIZE 1024
+
 static int
 cmp_site(const void *a, const void *b)
 {
@@ -59,7 +62,7 @@ insert_mutation(site_t *site, mutation_t *new)
 }
 
 static int MSP_WARN_UNUSED
-sort_mutations(site_t *site)
+sort_mutations(scratch_buffer_t *scratch, site_t *site)
 {
     int ret = 0;
     size_t k;
@@ -67,7 +70,7 @@ sort_mutations(site_t *site)
     size_t num_mutations = site->mutations_length;
     mutation_t **p = NULL;
     if (num_mutations > 0) {
-        p = malloc(num_mutations * sizeof(*p));
+        p = scratch_buffer_get(scratch, num_mutations * sizeof(*p));
         if (p == NULL) {
             ret = MSP_ERR_NO_MEMORY;
             goto out;
@@ -90,7 +93,6 @@ sort_mutations(site_t *site)
         }
     }
 out:
-    msp_safe_free(p);
     return ret;
 }
 
@@ -720,6 +722,7 @@ mutgen_print_state(mutgen_t *self, FILE *out)
     rate_map_print_state(&self->rate_map, out);
     fprintf(out, "\tstart_time = %f\n", self->start_time);
     fprintf(out, "\tend_time = %f\n", self->end_time);
+    fprintf(out, "\tvariate_buffer_size = %d\n", (int) self->variates.size);
     fprintf(out, "\tmodel:\n");
     mutation_model_print_state(self->model, out);
     tsk_blkalloc_print_state(&self->allocator, out);
@@ -753,6 +756,14 @@ mutgen_alloc(mutgen_t *self, gsl_rng *rng, tsk_table_collection_t *tables,
     self->rng = rng;
     self->tables = tables;
     self->model = model;
+    ret = variate_buffer_alloc(&self->variates, rng, 0);
+    if (ret != 0) {
+        goto out;
+    }
+    ret = scratch_buffer_alloc(&self->scratch, MUTGEN_SCRATCH_BUFFER_SIZE);
+    if (ret != 0) {
+        goto out;
+    }
     self->start_time = -DBL_MAX;
     self->end_time = DBL_MAX;
     self->block_size = block_size;
@@ -775,9 +786,27 @@ mutgen_free(mutgen_t *self)
 {
     tsk_blkalloc_free(&self->allocator);
     rate_map_free(&self->rate_map);
+    variate_buffer_free(&self->variates);
+    scratch_buffer_free(&self->scratch);
     return 0;
 }
 
+/* Sets the number of uniform variates drawn from the random generator in
+ * each block when placing mutations. See msp_set_variate_buffer_size. */
+int
+mutgen_set_variate_buffer_size(mutgen_t *self, size_t size)
+{
+    int ret = 0;
+
+    variate_buffer_free(&self->variates);
+    ret = variate_buffer_alloc(&self->variates, self->rng, size);
+    if (ret != 0) {
+        variate_buffer_free(&self->variates);
+        variate_buffer_alloc(&self->variates, self->rng, 0);
+    }
+    return ret;
+}
+
 int MSP_WARN_UNUSED
 mutgen_set_time_interval(mutgen_t *self, double start_time, double end_time)
 {
@@ -1125,7 +1154,8 @@ mutgen_place_mutations(mutgen_t *self, bool discrete_sites)
                  * use up all of the doubles before it could happen and so we'd
                  * certainly run out of memory first. */
                 do {
-                    position = gsl_ran_flat(self->rng, site_left, site_right);
+                    position
+                        = variate_buffer_flat(&self->variates, site_left, site_right);
                     if (discrete_sites) {
                         position = floor(position);
                     }
@@ -1133,7 +1163,7 @@ mutgen_place_mutations(mutgen_t *self, bool discrete_sites)
                     avl_node = avl_search(&self->sites, &search);
                 } while (avl_node != NULL && !discrete_sites);
 
-                time = gsl_ran_flat(self->rng, branch_start, branch_end);
+                time = variate_buffer_flat(&self->variates, branch_start, branch_end);
                 tsk_bug_assert(site_left <= position && position < site_right);
                 tsk_bug_assert(branch_start <= time && time < branch_end);
                 if (avl_node != NULL) {
@@ -1167,7 +1197,8 @@ mutgen_choose_alleles(mutgen_t *self, tsk_id_t *parent, mutation_t **bottom_muta
     mutation_t *mut, *parent_mut;
     tsk_id_t u;
 
-    ret = sort_mutations(site);
+    scratch_buffer_reset(&self->scratch);
+    ret = sort_mutations(&self->scratch, site);
     if (ret != 0) {
         goto out;
     }
@@ -1308,6 +1339,8 @@ mutgen_generate(mutgen_t *self, int flags)
     bool discrete_sites = flags & MSP_DISCRETE_SITES;
 
     avl_clear_tree(&self->sites);
+    /* Don't use variates buffered before the generator may have been reseeded */
+    variate_buffer_clear(&self->variates);
 
     ret = mutgen_init_allocator(self);
     if (ret != 0) {
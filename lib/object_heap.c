@@ -19,6 +19,7 @@
 #include <stdio.h>
 #include <string.h>
 #include <stdlib.h>
+#include <stdint.h>
 
 #include "util.h"
 #include "object_heap.h"
@@ -28,7 +29,42 @@
 size_t
 object_heap_get_num_allocated(object_heap_t *self)
 {
-    return self->size - self->top;
+    return object_heap_get_num_blocks(self) * self->block_size - self->top;
+}
+
+/* Returns the number of blocks that currently hold memory */
+size_t
+object_heap_get_num_blocks(object_heap_t *self)
+{
+    return self->num_blocks - self->num_released_blocks;
+}
+
+/* Returns the number of bytes in each arena, or 0 if arenas are not used */
+static size_t
+object_heap_get_arena_size(object_heap_t *self)
+{
+    return self->blocks_per_arena * self->block_size * self->object_size;
+}
+
+/* Returns the number of bytes allocated for the blocks and free list */
+size_t
+object_heap_get_memory_usage(object_heap_t *self)
+{
+    size_t j;
+    size_t ret = self->num_blocks * sizeof(char *) + self->size * sizeof(void *);
+
+    if (self->huge_pages) {
+        ret += self->num_arenas * sizeof(char *);
+        for (j = 0; j < self->num_arenas; j++) {
+            if (self->arenas[j] != NULL) {
+                ret += msp_huge_get_allocated_size(
+                    object_heap_get_arena_size(self), true);
+            }
+        }
+    } else {
+        ret += object_heap_get_num_blocks(self) * self->block_size * self->object_size;
+    }
+    return ret;
 }
 
 void
@@ -39,42 +75,120 @@ object_heap_print_state(object_heap_t *self, FILE *out)
     fprintf(out, "\ttop = %d\n", (int) self->top);
     fprintf(out, "\tblock_size = %d\n", (int) self->block_size);
     fprintf(out, "\tnum_blocks = %d\n", (int) self->num_blocks);
+    fprintf(out, "\tnum_released_blocks = %d\n", (int) self->num_released_blocks);
+    fprintf(out, "\thuge_pages = %d\n", self->huge_pages);
+    if (self->huge_pages) {
+        fprintf(out, "\tblocks_per_arena = %d\n", (int) self->blocks_per_arena);
+        fprintf(out, "\tnum_arenas = %d\n", (int) self->num_arenas);
+    }
     fprintf(out, "\ttotal allocated = %d\n", (int) object_heap_get_num_allocated(self));
 }
 
+/* Allocates the memory for the specified block, whose entry in mem_blocks
+ * must be NULL. In huge page mode the block is placed in its arena, which
+ * is allocated if it does not already exist. */
+static int MSP_WARN_UNUSED
+object_heap_alloc_block(object_heap_t *self, size_t block)
+{
+    int ret = 0;
+    size_t arena, num_arenas;
+    void *p;
+
+    if (!self->huge_pages) {
+        self->mem_blocks[block] = calloc(self->block_size, self->object_size);
+        if (self->mem_blocks[block] == NULL) {
+            ret = MSP_ERR_NO_MEMORY;
+        }
+        goto out;
+    }
+    arena = block / self->blocks_per_arena;
+    if (arena >= self->num_arenas) {
+        num_arenas = arena + 1;
+        p = realloc(self->arenas, num_arenas * sizeof(char *));
+        if (p == NULL) {
+            ret = MSP_ERR_NO_MEMORY;
+            goto out;
+        }
+        self->arenas = p;
+        memset(self->arenas + self->num_arenas, 0,
+            (num_arenas - self->num_arenas) * sizeof(char *));
+        self->num_arenas = num_arenas;
+    }
+    if (self->arenas[arena] == NULL) {
+        self->arenas[arena] = msp_huge_alloc(object_heap_get_arena_size(self), true);
+        if (self->arenas[arena] == NULL) {
+            ret = MSP_ERR_NO_MEMORY;
+            goto out;
+        }
+    }
+    self->mem_blocks[block] = self->arenas[arena]
+                              + (block % self->blocks_per_arena) * self->block_size
+                                    * self->object_size;
+out:
+    return ret;
+}
+
+/* Pushes the objects in the specified block onto the heap, which must be
+ * empty. */
 static void
-object_heap_add_block(object_heap_t *self, char *mem_block)
+object_heap_add_block(object_heap_t *self, size_t block)
 {
     size_t j, index;
+    char *mem_block = self->mem_blocks[block];
 
     for (j = 0; j < self->block_size; j++) {
         self->heap[j] = mem_block + j * self->object_size;
         if (self->init_object != NULL) {
-            index = j + (self->num_blocks - 1) * self->block_size;
+            index = j + block * self->block_size;
             self->init_object(self->heap[j], index);
         }
     }
     self->top = self->block_size;
 }
 
+/* Reallocates the memory for the first block released by object_heap_trim */
+static int MSP_WARN_UNUSED
+object_heap_reuse_block(object_heap_t *self)
+{
+    int ret = 0;
+    size_t block = 0;
+
+    while (self->mem_blocks[block] != NULL) {
+        block++;
+    }
+    tsk_bug_assert(block < self->num_blocks);
+    ret = object_heap_alloc_block(self, block);
+    if (ret != 0) {
+        goto out;
+    }
+    self->num_released_blocks--;
+    object_heap_add_block(self, block);
+out:
+    return ret;
+}
+
 int MSP_WARN_UNUSED
 object_heap_expand(object_heap_t *self)
 {
     int ret = -1;
     void *p;
 
+    if (self->num_released_blocks > 0) {
+        ret = object_heap_reuse_block(self);
+        goto out;
+    }
+
     p = realloc(self->mem_blocks, (self->num_blocks + 1) * sizeof(void *));
     if (p == NULL) {
         ret = MSP_ERR_NO_MEMORY;
         goto out;
     }
     self->mem_blocks = p;
-    p = calloc(self->block_size, self->object_size);
-    if (p == NULL) {
-        ret = MSP_ERR_NO_MEMORY;
+    self->mem_blocks[self->num_blocks] = NULL;
+    ret = object_heap_alloc_block(self, self->num_blocks);
+    if (ret != 0) {
         goto out;
     }
-    self->mem_blocks[self->num_blocks] = p;
     self->num_blocks++;
     /* Now we increase the size of the heap. Since it is currently empty,
      * we avoid the copying cost of realloc and free before making a new
@@ -88,7 +202,7 @@ object_heap_expand(object_heap_t *self)
         ret = MSP_ERR_NO_MEMORY;
         goto out;
     }
-    object_heap_add_block(self, p);
+    object_heap_add_block(self, self->num_blocks - 1);
     ret = 0;
 out:
     return ret;
@@ -105,7 +219,8 @@ object_heap_get_object(object_heap_t *self, size_t index)
 
     block = index / self->block_size;
     obj = index % self->block_size;
-    if (block < self->num_blocks && obj < self->block_size) {
+    if (block < self->num_blocks && obj < self->block_size
+        && self->mem_blocks[block] != NULL) {
         ret = self->mem_blocks[block] + obj * self->object_size;
     }
     return ret;
@@ -137,9 +252,146 @@ object_heap_free_object(object_heap_t *self, void *obj)
     self->top++;
 }
 
+typedef struct {
+    uintptr_t start;
+    size_t block;
+} object_heap_block_start_t;
+
+static int
+cmp_block_start(const void *a, const void *b)
+{
+    const object_heap_block_start_t *ia = (const object_heap_block_start_t *) a;
+    const object_heap_block_start_t *ib = (const object_heap_block_start_t *) b;
+    return (ia->start > ib->start) - (ia->start < ib->start);
+}
+
+/* Frees the arenas in which every block that has memory is entirely free,
+ * as counted in num_free, adding the number of blocks released to
+ * num_released. */
+static void
+object_heap_release_arenas(object_heap_t *self, size_t *num_free, size_t *num_released)
+{
+    size_t j, k, start, stop;
+    bool is_free;
+
+    for (k = 0; k < self->num_arenas; k++) {
+        if (self->arenas[k] == NULL) {
+            continue;
+        }
+        start = k * self->blocks_per_arena;
+        stop = start + self->blocks_per_arena;
+        if (stop > self->num_blocks) {
+            stop = self->num_blocks;
+        }
+        is_free = true;
+        for (j = start; j < stop; j++) {
+            if (self->mem_blocks[j] != NULL && num_free[j] != self->block_size) {
+                is_free = false;
+            }
+        }
+        if (is_free) {
+            for (j = start; j < stop; j++) {
+                if (self->mem_blocks[j] != NULL) {
+                    self->mem_blocks[j] = NULL;
+                    self->num_released_blocks++;
+                    (*num_released)++;
+                }
+            }
+            msp_huge_free(self->arenas[k], object_heap_get_arena_size(self), true);
+            self->arenas[k] = NULL;
+        }
+    }
+}
+
+/* Frees the memory for all blocks in which every object is on the heap,
+ * and stores the number of blocks released in num_released. Objects in
+ * the remaining blocks are not moved, so pointers to allocated objects and
+ * the indexes used by object_heap_get_object stay valid. The cost is
+ * O(top log num_blocks), so this is intended to be called occasionally
+ * rather than after each free. */
+int MSP_WARN_UNUSED
+object_heap_trim(object_heap_t *self, size_t *num_released)
+{
+    int ret = 0;
+    size_t j, k, num_starts, lo, hi, mid, top;
+    uintptr_t obj;
+    object_heap_block_start_t *starts = NULL;
+    size_t *num_free = NULL;
+    size_t *obj_block = NULL;
+
+    *num_released = 0;
+    if (self->top < self->block_size) {
+        /* No block can be entirely free */
+        goto out;
+    }
+    starts = malloc(self->num_blocks * sizeof(*starts));
+    num_free = calloc(self->num_blocks, sizeof(*num_free));
+    obj_block = malloc(self->top * sizeof(*obj_block));
+    if (starts == NULL || num_free == NULL || obj_block == NULL) {
+        ret = MSP_ERR_NO_MEMORY;
+        goto out;
+    }
+    num_starts = 0;
+    for (j = 0; j < self->num_blocks; j++) {
+        if (self->mem_blocks[j] != NULL) {
+            starts[num_starts].start = (uintptr_t) self->mem_blocks[j];
+            starts[num_starts].block = j;
+            num_starts++;
+        }
+    }
+    qsort(starts, num_starts, sizeof(*starts), cmp_block_start);
+
+    /* Find the block containing each free object, which is the block
+     * with the largest start address not greater than the object's. */
+    for (j = 0; j < self->top; j++) {
+        obj = (uintptr_t) self->heap[j];
+        lo = 0;
+        hi = num_starts;
+        while (hi - lo > 1) {
+            mid = (lo + hi) / 2;
+            if (starts[mid].start <= obj) {
+                lo = mid;
+            } else {
+                hi = mid;
+            }
+        }
+        tsk_bug_assert(starts[lo].start <= obj);
+        obj_block[j] = starts[lo].block;
+        num_free[obj_block[j]]++;
+    }
+
+    if (self->huge_pages) {
+        object_heap_release_arenas(self, num_free, num_released);
+    } else {
+        for (j = 0; j < self->num_blocks; j++) {
+            if (num_free[j] == self->block_size) {
+                free(self->mem_blocks[j]);
+                self->mem_blocks[j] = NULL;
+                self->num_released_blocks++;
+                (*num_released)++;
+            }
+        }
+    }
+    if (*num_released > 0) {
+        top = 0;
+        for (k = 0; k < self->top; k++) {
+            if (self->mem_blocks[obj_block[k]] != NULL) {
+                self->heap[top] = self->heap[k];
+                top++;
+            }
+        }
+        self->top = top;
+    }
+out:
+    msp_safe_free(starts);
+    msp_safe_free(num_free);
+    msp_safe_free(obj_block);
+    return ret;
+}
+
 int MSP_WARN_UNUSED
 object_heap_init(object_heap_t *self, size_t object_size, size_t block_size,
-    void (*init_object)(void **, size_t))
+    void (*init_object)(void **, size_t), bool huge_pages)
 {
     int ret = -1;
 
@@ -148,6 +400,13 @@ object_heap_init(object_heap_t *self, size_t object_size, size_t block_size,
     self->size = block_size;
     self->object_size = object_size;
     self->init_object = init_object;
+    self->huge_pages = huge_pages;
+    if (huge_pages) {
+        /* Fill each arena with as many blocks as fit in its huge pages */
+        self->blocks_per_arena
+            = msp_huge_get_allocated_size(block_size * object_size, true)
+              / (block_size * object_size);
+    }
     self->num_blocks = 1;
     self->heap = calloc(self->size, sizeof(void *));
     self->mem_blocks = calloc(1, sizeof(void *));
@@ -155,13 +414,12 @@ object_heap_init(object_heap_t *self, size_t object_size, size_t block_size,
         ret = MSP_ERR_NO_MEMORY;
         goto out;
     }
-    self->mem_blocks[0] = calloc(self->size, self->object_size);
-    if (self->mem_blocks[0] == NULL) {
-        ret = MSP_ERR_NO_MEMORY;
+    ret = object_heap_alloc_block(self, 0);
+    if (ret != 0) {
         goto out;
     }
     self->top = 0;
-    object_heap_add_block(self, self->mem_blocks[0]);
+    object_heap_add_block(self, 0);
     ret = 0;
 out:
     return ret;
@@ -172,12 +430,19 @@ object_heap_free(object_heap_t *self)
 {
     size_t j;
 
-    if (self->mem_blocks != NULL) {
+    if (self->arenas != NULL) {
+        for (j = 0; j < self->num_arenas; j++) {
+            msp_huge_free(self->arenas[j], object_heap_get_arena_size(self), true);
+        }
+        free(self->arenas);
+    } else if (self->mem_blocks != NULL) {
         for (j = 0; j < self->num_blocks; j++) {
             if (self->mem_blocks[j] != NULL) {
                 free(self->mem_blocks[j]);
             }
         }
+    }
+    if (self->mem_blocks != NULL) {
         free(self->mem_blocks);
     }
     if (self->heap != NULL) {
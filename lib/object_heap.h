@@ -21,6 +21,7 @@
 #define OBJECT_HEAP_H
 
 #include <stdio.h>
+#include <stdbool.h>
 #include <string.h>
 #include <assert.h>
 
@@ -30,20 +31,35 @@ typedef struct {
     size_t top;
     size_t size;
     size_t num_blocks;
+    /* Blocks whose memory has been freed by object_heap_trim. Their entries
+     * in mem_blocks are NULL, and they are reallocated before new blocks are
+     * added, so that the indexes of objects never change. */
+    size_t num_released_blocks;
     void **heap;
     char **mem_blocks;
     void (*init_object)(void **obj, size_t index);
+    /* If true, the blocks are carved out of arenas allocated by
+     * msp_huge_alloc, each holding blocks_per_arena consecutive blocks, so
+     * that small blocks share huge pages. The block size, and so the order
+     * in which objects are allocated, is the same in both modes. */
+    bool huge_pages;
+    size_t blocks_per_arena;
+    size_t num_arenas;
+    char **arenas;
 } object_heap_t;
 
 extern size_t object_heap_get_num_allocated(object_heap_t *self);
+extern size_t object_heap_get_memory_usage(object_heap_t *self);
+extern size_t object_heap_get_num_blocks(object_heap_t *self);
 extern void object_heap_print_state(object_heap_t *self, FILE *out);
 extern int object_heap_expand(object_heap_t *self);
 extern void *object_heap_get_object(object_heap_t *self, size_t index);
 extern int object_heap_empty(object_heap_t *self);
 extern void *object_heap_alloc_object(object_heap_t *self);
 extern void object_heap_free_object(object_heap_t *self, void *obj);
+extern int object_heap_trim(object_heap_t *self, size_t *num_released);
 extern int object_heap_init(object_heap_t *self, size_t object_size, size_t block_size,
-    void (*init_object)(void **, size_t));
+    void (*init_object)(void **, size_t), bool huge_pages);
 extern void object_heap_free(object_heap_t *self);
 
 #endif
@@ -0,0 +1,549 @@
+/*
+** Copyright (C) 2024 University of Oxford
+**
+** This file is part of msprime.
+**
+** msprime is free software: you can redistribute it and/or modify
+** it under the terms of the GNU General Public License as published by
+** the Free Software Foundation, either version 3 of the License, or
+** (at your option) any later version.
+**
+** msprime is distributed in the hope that it will be useful,
+** but WITHOUT ANY WARRANTY; without even the implied warranty of
+** MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+** GNU General Public License for more details.
+**
+** You should have received a copy of the GNU General Public License
+** along with msprime.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "util.h"
+#include "overlap_map.h"
+
+/* Adjacent blocks are merged by overlap_map_compress when their items
+ * would fill at most this many slots, so that merging doesn't leave a
+ * block that has to be split again straight away. */
+#define OVERLAP_MAP_MERGE_SIZE (3 * OVERLAP_MAP_BLOCK_SIZE / 4)
+
+int MSP_WARN_UNUSED
+overlap_map_init(overlap_map_t *self)
+{
+    int ret = 0;
+
+    memset(self, 0, sizeof(*self));
+    self->max_blocks = 16;
+    self->block_start = malloc(self->max_blocks * sizeof(*self->block_start));
+    self->blocks = malloc(self->max_blocks * sizeof(*self->blocks));
+    if (self->block_start == NULL || self->blocks == NULL) {
+        ret = MSP_ERR_NO_MEMORY;
+        goto out;
+    }
+out:
+    return ret;
+}
+
+int
+overlap_map_free(overlap_map_t *self)
+{
+    size_t j;
+
+    if (self->blocks != NULL) {
+        for (j = 0; j < self->num_blocks; j++) {
+            free(self->blocks[j]);
+        }
+    }
+    msp_safe_free(self->blocks);
+    msp_safe_free(self->block_start);
+    return 0;
+}
+
+void
+overlap_map_clear(overlap_map_t *self)
+{
+    size_t j;
+
+    for (j = 0; j < self->num_blocks; j++) {
+        free(self->blocks[j]);
+    }
+    self->num_blocks = 0;
+    self->num_items = 0;
+}
+
+/* Inserts a new empty block at the specified index in the list. */
+static int MSP_WARN_UNUSED
+overlap_map_insert_block(overlap_map_t *self, size_t index)
+{
+    int ret = 0;
+    size_t max_blocks;
+    void *p;
+    overlap_map_block_t *block;
+
+    if (self->num_blocks == self->max_blocks) {
+        max_blocks = 2 * self->max_blocks;
+        p = realloc(self->block_start, max_blocks * sizeof(*self->block_start));
+        if (p == NULL) {
+            ret = MSP_ERR_NO_MEMORY;
+            goto out;
+        }
+        self->block_start = p;
+        p = realloc(self->blocks, max_blocks * sizeof(*self->blocks));
+        if (p == NULL) {
+            ret = MSP_ERR_NO_MEMORY;
+            goto out;
+        }
+        self->blocks = p;
+        self->max_blocks = max_blocks;
+    }
+    block = malloc(sizeof(*block));
+    if (block == NULL) {
+        ret = MSP_ERR_NO_MEMORY;
+        goto out;
+    }
+    block->num_items = 0;
+    memmove(self->blocks + index + 1, self->blocks + index,
+        (self->num_blocks - index) * sizeof(*self->blocks));
+    memmove(self->block_start + index + 1, self->block_start + index,
+        (self->num_blocks - index) * sizeof(*self->block_start));
+    self->blocks[index] = block;
+    self->num_blocks++;
+out:
+    return ret;
+}
+
+static void
+overlap_map_remove_block(overlap_map_t *self, size_t index)
+{
+    free(self->blocks[index]);
+    memmove(self->blocks + index, self->blocks + index + 1,
+        (self->num_blocks - index - 1) * sizeof(*self->blocks));
+    memmove(self->block_start + index, self->block_start + index + 1,
+        (self->num_blocks - index - 1) * sizeof(*self->block_start));
+    self->num_blocks--;
+}
+
+/* Moves the items from the specified offset onwards in a block to the
+ * start of another block, which must be empty. */
+static void
+overlap_map_move_items(
+    overlap_map_block_t *source, size_t offset, overlap_map_block_t *dest)
+{
+    size_t n = source->num_items - offset;
+
+    memcpy(dest->position, source->position + offset, n * sizeof(*dest->position));
+    memcpy(dest->count, source->count + offset, n * sizeof(*dest->count));
+    dest->num_items = n;
+    source->num_items = offset;
+}
+
+/* Returns the index of the last block starting at or before the specified
+ * position, or 0 if there is no such block. There must be at least one
+ * block. */
+static size_t
+overlap_map_find_block(overlap_map_t *self, double position)
+{
+    size_t lo = 0;
+    size_t hi = self->num_blocks;
+    size_t mid;
+
+    while (hi - lo > 1) {
+        mid = (lo + hi) / 2;
+        if (self->block_start[mid] <= position) {
+            lo = mid;
+        } else {
+            hi = mid;
+        }
+    }
+    return lo;
+}
+
+/* Returns the offset of the first item in the block whose position is
+ * not less than the specified position. */
+static size_t
+overlap_map_block_lower_bound(overlap_map_block_t *block, double position)
+{
+    size_t lo = 0;
+    size_t hi = block->num_items;
+    size_t mid;
+
+    while (lo < hi) {
+        mid = (lo + hi) / 2;
+        if (block->position[mid] < position) {
+            lo = mid + 1;
+        } else {
+            hi = mid;
+        }
+    }
+    return lo;
+}
+
+/* Returns the offset of the last item in the block, starting from the
+ * specified offset, whose position is less than or equal to the specified
+ * position. The item at the starting offset must satisfy this. */
+static size_t
+overlap_map_block_floor(overlap_map_block_t *block, size_t offset, double position)
+{
+    size_t lo = offset;
+    size_t hi = block->num_items;
+    size_t mid;
+
+    while (hi - lo > 1) {
+        mid = (lo + hi) / 2;
+        if (block->position[mid] <= position) {
+            lo = mid;
+        } else {
+            hi = mid;
+        }
+    }
+    return lo;
+}
+
+/* Inserts an item at offset k in block j, splitting the block if it is
+ * full, and points the cursor at the new item. */
+static int MSP_WARN_UNUSED
+overlap_map_insert_at(overlap_map_t *self, size_t j, size_t k, double position,
+    uint32_t count, overlap_map_cursor_t *cursor)
+{
+    int ret = 0;
+    size_t half;
+    overlap_map_block_t *block = self->blocks[j];
+
+    if (block->num_items == OVERLAP_MAP_BLOCK_SIZE) {
+        ret = overlap_map_insert_block(self, j + 1);
+        if (ret != 0) {
+            goto out;
+        }
+        half = OVERLAP_MAP_BLOCK_SIZE / 2;
+        overlap_map_move_items(block, half, self->blocks[j + 1]);
+        self->block_start[j + 1] = self->blocks[j + 1]->position[0];
+        if (k > half) {
+            j++;
+            k -= half;
+            block = self->blocks[j];
+        }
+    }
+    memmove(block->position + k + 1, block->position + k,
+        (block->num_items - k) * sizeof(*block->position));
+    memmove(block->count + k + 1, block->count + k,
+        (block->num_items - k) * sizeof(*block->count));
+    block->position[k] = position;
+    block->count[k] = count;
+    block->num_items++;
+    self->block_start[j] = block->position[0];
+    self->num_items++;
+    cursor->block = j;
+    cursor->offset = k;
+out:
+    return ret;
+}
+
+/* Inserts an item with the specified position, which must not already be
+ * present in the map. */
+int MSP_WARN_UNUSED
+overlap_map_insert(overlap_map_t *self, double position, uint32_t count)
+{
+    int ret = 0;
+    size_t j, k;
+    overlap_map_block_t *block;
+    overlap_map_cursor_t cursor;
+
+    if (self->num_blocks == 0) {
+        ret = overlap_map_insert_block(self, 0);
+        if (ret != 0) {
+            goto out;
+        }
+    }
+    j = overlap_map_find_block(self, position);
+    block = self->blocks[j];
+    k = overlap_map_block_lower_bound(block, position);
+    tsk_bug_assert(k == block->num_items || block->position[k] != position);
+    ret = overlap_map_insert_at(self, j, k, position, count, &cursor);
+out:
+    return ret;
+}
+
+/* Moves the cursor forward to the last item whose position is less than or
+ * equal to the specified position, returning true if the positions are
+ * equal. The cursor must not be past the position to begin with. Blocks
+ * are skipped by an exponential search from the cursor's block, so the
+ * cost depends on how far the cursor moves and not on the size of the
+ * map. */
+bool
+overlap_map_seek(overlap_map_t *self, double position, overlap_map_cursor_t *cursor)
+{
+    size_t j = cursor->block;
+    size_t k = cursor->offset;
+    size_t step, lo, hi, mid;
+
+    tsk_bug_assert(overlap_map_get_position(self, cursor) <= position);
+    if (j + 1 < self->num_blocks && self->block_start[j + 1] <= position) {
+        lo = j + 1;
+        step = 1;
+        while (
+            lo + step < self->num_blocks && self->block_start[lo + step] <= position) {
+            lo += step;
+            step *= 2;
+        }
+        hi = lo + step;
+        if (hi > self->num_blocks) {
+            hi = self->num_blocks;
+        }
+        while (hi - lo > 1) {
+            mid = (lo + hi) / 2;
+            if (self->block_start[mid] <= position) {
+                lo = mid;
+            } else {
+                hi = mid;
+            }
+        }
+        j = lo;
+        k = 0;
+    }
+    k = overlap_map_block_floor(self->blocks[j], k, position);
+    cursor->block = j;
+    cursor->offset = k;
+    return self->blocks[j]->position[k] == position;
+}
+
+/* Makes sure there is an item at the specified position, inserting one
+ * with the count that applies there if necessary, and points the cursor
+ * at it. The cursor is used as the starting point of the search, as in
+ * overlap_map_seek. */
+int MSP_WARN_UNUSED
+overlap_map_split(overlap_map_t *self, double position, overlap_map_cursor_t *cursor)
+{
+    int ret = 0;
+
+    if (!overlap_map_seek(self, position, cursor)) {
+        ret = overlap_map_insert_at(self, cursor->block, cursor->offset + 1, position,
+            overlap_map_get_count(self, cursor), cursor);
+    }
+    return ret;
+}
+
+/* Makes sure there are items at left and right, as overlap_map_split does,
+ * and points the cursor at the item at left. */
+int MSP_WARN_UNUSED
+overlap_map_split_interval(
+    overlap_map_t *self, double left, double right, overlap_map_cursor_t *cursor)
+{
+    int ret = 0;
+    overlap_map_cursor_t finger;
+    bool found;
+
+    ret = overlap_map_split(self, left, cursor);
+    if (ret != 0) {
+        goto out;
+    }
+    finger = *cursor;
+    ret = overlap_map_split(self, right, &finger);
+    if (ret != 0) {
+        goto out;
+    }
+    /* Inserting at right may have moved the item at left along its block,
+     * or into the next block if the block was split. The start of the
+     * block can't have moved past left, so we search again from there. */
+    cursor->offset = 0;
+    found = overlap_map_seek(self, left, cursor);
+    tsk_bug_assert(found);
+out:
+    return ret;
+}
+
+/* Points the cursor at the item with the specified position and returns
+ * true, or returns false if there is no such item. */
+bool
+overlap_map_find(overlap_map_t *self, double position, overlap_map_cursor_t *cursor)
+{
+    bool ret = false;
+    size_t j, k;
+    overlap_map_block_t *block;
+
+    if (self->num_blocks > 0) {
+        j = overlap_map_find_block(self, position);
+        block = self->blocks[j];
+        k = overlap_map_block_lower_bound(block, position);
+        if (k < block->num_items && block->position[k] == position) {
+            cursor->block = j;
+            cursor->offset = k;
+            ret = true;
+        }
+    }
+    return ret;
+}
+
+/* Points the cursor at the last item whose position is less than or equal
+ * to the specified position. There must be such an item. */
+void
+overlap_map_find_floor(
+    overlap_map_t *self, double position, overlap_map_cursor_t *cursor)
+{
+    size_t j, k;
+    overlap_map_block_t *block;
+
+    tsk_bug_assert(self->num_blocks > 0);
+    j = overlap_map_find_block(self, position);
+    block = self->blocks[j];
+    k = overlap_map_block_lower_bound(block, position);
+    if (k == block->num_items || block->position[k] != position) {
+        tsk_bug_assert(k > 0);
+        k--;
+    }
+    cursor->block = j;
+    cursor->offset = k;
+}
+
+/* Points the cursor at the first item, returning false if the map is
+ * empty. */
+bool
+overlap_map_first(overlap_map_t *self, overlap_map_cursor_t *cursor)
+{
+    cursor->block = 0;
+    cursor->offset = 0;
+    return self->num_items > 0;
+}
+
+static void
+overlap_map_remove(overlap_map_t *self, overlap_map_cursor_t *cursor)
+{
+    overlap_map_block_t *block = self->blocks[cursor->block];
+    size_t k = cursor->offset;
+
+    memmove(block->position + k, block->position + k + 1,
+        (block->num_items - k - 1) * sizeof(*block->position));
+    memmove(block->count + k, block->count + k + 1,
+        (block->num_items - k - 1) * sizeof(*block->count));
+    block->num_items--;
+    self->num_items--;
+    if (block->num_items == 0) {
+        overlap_map_remove_block(self, cursor->block);
+    } else {
+        self->block_start[cursor->block] = block->position[0];
+    }
+}
+
+/* Merges neighbouring blocks between the specified indexes that have few
+ * enough items between them. */
+static void
+overlap_map_merge_blocks(overlap_map_t *self, size_t start, size_t stop)
+{
+    size_t j = start;
+    overlap_map_block_t *x, *y;
+
+    while (j < stop && j + 1 < self->num_blocks) {
+        x = self->blocks[j];
+        y = self->blocks[j + 1];
+        if (x->num_items + y->num_items <= OVERLAP_MAP_MERGE_SIZE) {
+            memcpy(x->position + x->num_items, y->position,
+                y->num_items * sizeof(*y->position));
+            memcpy(x->count + x->num_items, y->count, y->num_items * sizeof(*y->count));
+            x->num_items += y->num_items;
+            overlap_map_remove_block(self, j + 1);
+            stop--;
+        } else {
+            j++;
+        }
+    }
+}
+
+/* Removes the items between left and right that have the same count as
+ * the item before them, starting from the item before the one at left,
+ * which must exist. The first item after right is also checked. */
+void
+overlap_map_compress(overlap_map_t *self, double left, double right)
+{
+    overlap_map_cursor_t x, y;
+    bool found, more;
+    double position;
+    size_t start;
+
+    found = overlap_map_find(self, left, &x);
+    tsk_bug_assert(found);
+    if (x.offset > 0) {
+        x.offset--;
+    } else if (x.block > 0) {
+        x.block--;
+        x.offset = self->blocks[x.block]->num_items - 1;
+    }
+    start = x.block;
+    y = x;
+    more = overlap_map_next(self, &y);
+    while (more) {
+        position = overlap_map_get_position(self, &y);
+        if (overlap_map_get_count(self, &x) == overlap_map_get_count(self, &y)) {
+            overlap_map_remove(self, &y);
+            y = x;
+        } else {
+            x = y;
+        }
+        more = overlap_map_next(self, &y) && position <= right;
+    }
+    overlap_map_merge_blocks(self, start == 0 ? 0 : start - 1, y.block + 1);
+}
+
+size_t
+overlap_map_get_num_items(overlap_map_t *self)
+{
+    return self->num_items;
+}
+
+/* Returns the number of bytes allocated for the blocks and the block list */
+size_t
+overlap_map_get_memory_usage(overlap_map_t *self)
+{
+    return self->num_blocks * sizeof(overlap_map_block_t)
+           + self->max_blocks * (sizeof(*self->block_start) + sizeof(*self->blocks));
+}
+
+void
+overlap_map_print_state(overlap_map_t *self, FILE *out)
+{
+    size_t j, k;
+    overlap_map_block_t *block;
+
+    fprintf(out, "overlap map %p::\n", (void *) self);
+    fprintf(out, "\tnum_items = %d\n", (int) self->num_items);
+    fprintf(out, "\tnum_blocks = %d\n", (int) self->num_blocks);
+    fprintf(out, "\tmax_blocks = %d\n", (int) self->max_blocks);
+    for (j = 0; j < self->num_blocks; j++) {
+        block = self->blocks[j];
+        fprintf(out, "\tblock %d: num_items = %d\n", (int) j, (int) block->num_items);
+        for (k = 0; k < block->num_items; k++) {
+            fprintf(out, "\t\t%.14g -> %d\n", block->position[k], (int) block->count[k]);
+        }
+    }
+}
+
+void
+overlap_map_verify(overlap_map_t *self)
+{
+    size_t j, k;
+    size_t num_items = 0;
+    overlap_map_block_t *block;
+    double last_position = 0;
+
+    tsk_bug_assert(self->num_blocks <= self->max_blocks);
+    for (j = 0; j < self->num_blocks; j++) {
+        block = self->blocks[j];
+        tsk_bug_assert(block->num_items > 0);
+        tsk_bug_assert(block->num_items <= OVERLAP_MAP_BLOCK_SIZE);
+        tsk_bug_assert(self->block_start[j] == block->position[0]);
+        for (k = 0; k < block->num_items; k++) {
+            tsk_bug_assert(num_items == 0 || block->position[k] > last_position);
+            last_position = block->position[k];
+            num_items++;
+        }
+    }
+    tsk_bug_assert(num_items == self->num_items);
+}
+
+extern inline double overlap_map_get_position(
+    overlap_map_t *self, const overlap_map_cursor_t *cursor);
+extern inline uint32_t overlap_map_get_count(
+    overlap_map_t *self, const overlap_map_cursor_t *cursor);
+extern inline void overlap_map_set_count(
+    overlap_map_t *self, const overlap_map_cursor_t *cursor, uint32_t count);
+extern inline bool overlap_map_next(overlap_map_t *self, overlap_map_cursor_t *cursor);
@@ -0,0 +1,122 @@
+/*
+** Copyright (C) 2024 University of Oxford
+**
+** This file is part of msprime.
+**
+** msprime is free software: you can redistribute it and/or modify
+** it under the terms of the GNU General Public License as published by
+** the Free Software Foundation, either version 3 of the License, or
+** (at your option) any later version.
+**
+** msprime is distributed in the hope that it will be useful,
+** but WITHOUT ANY WARRANTY; without even the implied warranty of
+** MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+** GNU General Public License for more details.
+**
+** You should have received a copy of the GNU General Public License
+** along with msprime.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef __OVERLAP_MAP_H__
+#define __OVERLAP_MAP_H__
+
+#include <stdio.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stddef.h>
+
+#define OVERLAP_MAP_BLOCK_SIZE 64
+
+typedef struct {
+    size_t num_items;
+    double position[OVERLAP_MAP_BLOCK_SIZE];
+    uint32_t count[OVERLAP_MAP_BLOCK_SIZE];
+} overlap_map_block_t;
+
+/* A map from genome positions to counts, where each count applies from its
+ * position up to the next one. The items are kept in order in a list of
+ * fixed size blocks, with the first position of each block stored in a
+ * separate array so that a lookup is a binary search over that array and
+ * then over a single block. A block that fills up is split in two, and
+ * blocks that shrink are merged with their neighbours by
+ * overlap_map_compress. */
+typedef struct {
+    size_t num_items;
+    size_t num_blocks;
+    size_t max_blocks;
+    double *block_start;
+    overlap_map_block_t **blocks;
+} overlap_map_t;
+
+/* The location of an item in an overlap_map_t. Cursors are invalidated
+ * by any change to the map other than setting a count. */
+typedef struct {
+    size_t block;
+    size_t offset;
+} overlap_map_cursor_t;
+
+int overlap_map_init(overlap_map_t *self);
+int overlap_map_free(overlap_map_t *self);
+void overlap_map_clear(overlap_map_t *self);
+int overlap_map_insert(overlap_map_t *self, double position, uint32_t count);
+bool overlap_map_seek(
+    overlap_map_t *self, double position, overlap_map_cursor_t *cursor);
+int overlap_map_split(
+    overlap_map_t *self, double position, overlap_map_cursor_t *cursor);
+int overlap_map_split_interval(
+    overlap_map_t *self, double left, double right, overlap_map_cursor_t *cursor);
+bool overlap_map_find(
+    overlap_map_t *self, double position, overlap_map_cursor_t *cursor);
+void overlap_map_find_floor(
+    overlap_map_t *self, double position, overlap_map_cursor_t *cursor);
+bool overlap_map_first(overlap_map_t *self, overlap_map_cursor_t *cursor);
+void overlap_map_compress(overlap_map_t *self, double left, double right);
+size_t overlap_map_get_num_items(overlap_map_t *self);
+size_t overlap_map_get_memory_usage(overlap_map_t *self);
+void overlap_map_print_state(overlap_map_t *self, FILE *out);
+void overlap_map_verify(overlap_map_t *self);
+
+inline double overlap_map_get_position(
+    overlap_map_t *self, const overlap_map_cursor_t *cursor);
+inline uint32_t overlap_map_get_count(
+    overlap_map_t *self, const overlap_map_cursor_t *cursor);
+inline void overlap_map_set_count(
+    overlap_map_t *self, const overlap_map_cursor_t *cursor, uint32_t count);
+inline bool overlap_map_next(overlap_map_t *self, overlap_map_cursor_t *cursor);
+
+inline double
+overlap_map_get_position(overlap_map_t *self, const overlap_map_cursor_t *cursor)
+{
+    return self->blocks[cursor->block]->position[cursor->offset];
+}
+
+inline uint32_t
+overlap_map_get_count(overlap_map_t *self, const overlap_map_cursor_t *cursor)
+{
+    return self->blocks[cursor->block]->count[cursor->offset];
+}
+
+inline void
+overlap_map_set_count(
+    overlap_map_t *self, const overlap_map_cursor_t *cursor, uint32_t count)
+{
+    self->blocks[cursor->block]->count[cursor->offset] = count;
+}
+
+/* Moves the cursor to the next item, returning false if there isn't one. */
+inline bool
+overlap_map_next(overlap_map_t *self, overlap_map_cursor_t *cursor)
+{
+    cursor->offset++;
+    if (cursor->offset == self->blocks[cursor->block]->num_items) {
+        if (cursor->block + 1 == self->num_blocks) {
+            cursor->offset--;
+            return false;
+        }
+        cursor->block++;
+        cursor->offset = 0;
+    }
+    return true;
+}
+
+#endif /*__OVERLAP_MAP_H__*/
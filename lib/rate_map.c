@@ -128,6 +128,25 @@ rate_map_get_size(rate_map_t *self)
     return self->size;
 }
 
+/* Returns the number of bytes allocated for the map's arrays and its
+ * position lookup table. */
+size_t
+rate_map_get_memory_usage(rate_map_t *self)
+{
+    size_t ret = 0;
+
+    if (self->position != NULL) {
+        ret += (self->size + 1)
+               * (sizeof(*self->position) + sizeof(*self->rate)
+                   + sizeof(*self->cumulative_mass));
+    }
+    if (self->position_lookup.lookups != NULL) {
+        ret += self->position_lookup.num_lookups
+               * sizeof(*self->position_lookup.lookups);
+    }
+    return ret;
+}
+
 double
 rate_map_get_total_mass(rate_map_t *self)
 {
@@ -40,6 +40,7 @@ int rate_map_free(rate_map_t *self);
 void rate_map_print_state(rate_map_t *self, FILE *out);
 double rate_map_get_sequence_length(rate_map_t *self);
 size_t rate_map_get_size(rate_map_t *self);
+size_t rate_map_get_memory_usage(rate_map_t *self);
 size_t rate_map_get_num_intervals(rate_map_t *self);
 size_t rate_map_get_index(rate_map_t *self, double x);
 double rate_map_get_total_mass(rate_map_t *self);
@@ -0,0 +1,476 @@
+/*
+** Copyright (C) 2024 University of Oxford
+**
+** This file is part of msprime.
+**
+** msprime is free software: you can redistribute it and/or modify
+** it under the terms of the GNU General Public License as published by
+** the Free Software Foundation, either version 3 of the License, or
+** (at your option) any later version.
+**
+** msprime is distributed in the hope that it will be useful,
+** but WITHOUT ANY WARRANTY; without even the implied warranty of
+** MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+** GNU General Public License for more details.
+**
+** You should have received a copy of the GNU General Public License
+** along with msprime.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+/*
+ * Native random number generator backends. The xoshiro256++ generator is
+ * described at https://prng.di.unimi.it/, PCG64 (the 128 bit LCG with
+ * XSL-RR output) at https://www.pcg-random.org/ and the counter-based
+ * Philox4x32-10 generator in Salmon et al. (2011), "Parallel random numbers:
+ * as easy as 1, 2, 3". All are wrapped as gsl_rng_types; the bulk fill
+ * functions bypass GSL's per draw indirect call when the generator is one
+ * of ours.
+ */
+#ifdef HAVE_CONFIG_H
+#include <config.h>
+#endif
+
+#include <math.h>
+
+#include "util.h"
+#include "rng.h"
+
+/* 2^-53, used to map the top 53 bits of a 64 bit word to [0, 1). */
+#define MSP_RNG_DOUBLE_SCALE (1.0 / 9007199254740992.0)
+
+#define PCG64_MULT_HI 0x2360ed051fc65da4ULL
+#define PCG64_MULT_LO 0x4385df649fccf645ULL
+
+#define PHILOX_M0 0xd2511f53U
+#define PHILOX_M1 0xcd9e8d57U
+#define PHILOX_W0 0x9e3779b9U
+#define PHILOX_W1 0xbb67ae85U
+#define PHILOX_ROUNDS 10
+
+static uint64_t
+splitmix64_next(uint64_t *x)
+{
+    uint64_t z = (*x += 0x9e3779b97f4a7c15ULL);
+
+    z = (z ^ (z >> 30)) * 0xbf58476d1ce4e5b9ULL;
+    z = (z ^ (z >> 27)) * 0x94d049bb133111ebULL;
+    return z ^ (z >> 31);
+}
+
+static inline double
+uint64_to_double(uint64_t x)
+{
+    return (double) (x >> 11) * MSP_RNG_DOUBLE_SCALE;
+}
+
+/*******************************
+ * xoshiro256++
+ *******************************/
+
+static inline uint64_t
+rotl64(uint64_t x, unsigned int k)
+{
+    return (x << k) | (x >> (64 - k));
+}
+
+static inline uint64_t
+xoshiro256pp_next(uint64_t *s)
+{
+    const uint64_t result = rotl64(s[0] + s[3], 23) + s[0];
+    const uint64_t t = s[1] << 17;
+
+    s[2] ^= s[0];
+    s[3] ^= s[1];
+    s[1] ^= s[2];
+    s[0] ^= s[3];
+    s[2] ^= t;
+    s[3] = rotl64(s[3], 45);
+    return result;
+}
+
+static void
+xoshiro256pp_set(void *vstate, unsigned long int seed)
+{
+    msp_xoshiro256pp_state_t *state = (msp_xoshiro256pp_state_t *) vstate;
+    uint64_t x = (uint64_t) seed;
+    size_t j;
+
+    /* Expanding the seed with splitmix64 guarantees a non-zero state. */
+    for (j = 0; j < 4; j++) {
+        state->s[j] = splitmix64_next(&x);
+    }
+}
+
+static unsigned long int
+xoshiro256pp_get(void *vstate)
+{
+    msp_xoshiro256pp_state_t *state = (msp_xoshiro256pp_state_t *) vstate;
+
+    return (unsigned long int) (xoshiro256pp_next(state->s) >> 32);
+}
+
+static double
+xoshiro256pp_get_double(void *vstate)
+{
+    msp_xoshiro256pp_state_t *state = (msp_xoshiro256pp_state_t *) vstate;
+
+    return uint64_to_double(xoshiro256pp_next(state->s));
+}
+
+static const gsl_rng_type xoshiro256pp_type = { "xoshiro256++", 0xffffffffUL, 0,
+    sizeof(msp_xoshiro256pp_state_t), &xoshiro256pp_set, &xoshiro256pp_get,
+    &xoshiro256pp_get_double };
+
+const gsl_rng_type *msp_rng_xoshiro256pp = &xoshiro256pp_type;
+
+/*******************************
+ * PCG64
+ *******************************/
+
+/* The 128 bit arithmetic is done on pairs of 64 bit words to stay within
+ * C99; the compiler recognises the high-word multiply on most platforms. */
+static inline uint64_t
+mulhi64(uint64_t a, uint64_t b)
+{
+    const uint64_t a0 = a & 0xffffffffULL;
+    const uint64_t a1 = a >> 32;
+    const uint64_t b0 = b & 0xffffffffULL;
+    const uint64_t b1 = b >> 32;
+    const uint64_t p00 = a0 * b0;
+    const uint64_t p01 = a0 * b1;
+    const uint64_t p10 = a1 * b0;
+    const uint64_t p11 = a1 * b1;
+    const uint64_t mid = (p00 >> 32) + (p10 & 0xffffffffULL) + (p01 & 0xffffffffULL);
+
+    return p11 + (p10 >> 32) + (p01 >> 32) + (mid >> 32);
+}
+
+static inline void
+pcg64_step(msp_pcg64_state_t *state)
+{
+    const uint64_t lo = state->state_lo * PCG64_MULT_LO;
+    const uint64_t hi = mulhi64(state->state_lo, PCG64_MULT_LO)
+                        + state->state_hi * PCG64_MULT_LO
+                        + state->state_lo * PCG64_MULT_HI;
+
+    state->state_lo = lo + state->inc_lo;
+    state->state_hi = hi + state->inc_hi + (state->state_lo < lo);
+}
+
+static inline uint64_t
+pcg64_next(msp_pcg64_state_t *state)
+{
+    uint64_t value;
+    unsigned int rot;
+
+    pcg64_step(state);
+    value = state->state_hi ^ state->state_lo;
+    rot = (unsigned int) (state->state_hi >> 58);
+    return (value >> rot) | (value << ((64 - rot) & 63));
+}
+
+/* Follows the pcg64_srandom_r procedure for the given 128 bit initial
+ * state and stream selector. */
+static void
+pcg64_seed(msp_pcg64_state_t *state, uint64_t initstate_hi, uint64_t initstate_lo,
+    uint64_t initseq_hi, uint64_t initseq_lo)
+{
+    uint64_t lo;
+
+    state->state_hi = 0;
+    state->state_lo = 0;
+    state->inc_hi = (initseq_hi << 1) | (initseq_lo >> 63);
+    state->inc_lo = (initseq_lo << 1) | 1;
+    pcg64_step(state);
+    lo = state->state_lo + initstate_lo;
+    state->state_hi += initstate_hi + (lo < initstate_lo);
+    state->state_lo = lo;
+    pcg64_step(state);
+}
+
+static void
+pcg64_set(void *vstate, unsigned long int seed)
+{
+    msp_pcg64_state_t *state = (msp_pcg64_state_t *) vstate;
+    uint64_t x = (uint64_t) seed;
+    uint64_t words[4];
+    size_t j;
+
+    for (j = 0; j < 4; j++) {
+        words[j] = splitmix64_next(&x);
+    }
+    pcg64_seed(state, words[0], words[1], words[2], words[3]);
+}
+
+static unsigned long int
+pcg64_get(void *vstate)
+{
+    msp_pcg64_state_t *state = (msp_pcg64_state_t *) vstate;
+
+    return (unsigned long int) (pcg64_next(state) >> 32);
+}
+
+static double
+pcg64_get_double(void *vstate)
+{
+    msp_pcg64_state_t *state = (msp_pcg64_state_t *) vstate;
+
+    return uint64_to_double(pcg64_next(state));
+}
+
+static const gsl_rng_type pcg64_type = { "pcg64", 0xffffffffUL, 0,
+    sizeof(msp_pcg64_state_t), &pcg64_set, &pcg64_get, &pcg64_get_double };
+
+const gsl_rng_type *msp_rng_pcg64 = &pcg64_type;
+
+/*******************************
+ * Philox4x32-10
+ *******************************/
+
+static void
+philox_block(const uint32_t *counter, const uint32_t *key, uint32_t *output)
+{
+    uint32_t x0 = counter[0];
+    uint32_t x1 = counter[1];
+    uint32_t x2 = counter[2];
+    uint32_t x3 = counter[3];
+    uint32_t k0 = key[0];
+    uint32_t k1 = key[1];
+    uint64_t p0, p1;
+    int j;
+
+    for (j = 0; j < PHILOX_ROUNDS; j++) {
+        p0 = (uint64_t) PHILOX_M0 * x0;
+        p1 = (uint64_t) PHILOX_M1 * x2;
+        x0 = (uint32_t) (p1 >> 32) ^ x1 ^ k0;
+        x1 = (uint32_t) p1;
+        x2 = (uint32_t) (p0 >> 32) ^ x3 ^ k1;
+        x3 = (uint32_t) p0;
+        k0 += PHILOX_W0;
+        k1 += PHILOX_W1;
+    }
+    output[0] = x0;
+    output[1] = x1;
+    output[2] = x2;
+    output[3] = x3;
+}
+
+static inline uint64_t
+philox_get_position(const msp_philox_state_t *state)
+{
+    return ((uint64_t) state->counter[1] << 32) | state->counter[0];
+}
+
+static inline void
+philox_set_position(msp_philox_state_t *state, uint64_t block)
+{
+    state->counter[0] = (uint32_t) block;
+    state->counter[1] = (uint32_t) (block >> 32);
+}
+
+static inline uint64_t
+philox_next(msp_philox_state_t *state)
+{
+    const uint32_t *out;
+
+    if (state->index == 2) {
+        philox_block(state->counter, state->key, state->output);
+        philox_set_position(state, philox_get_position(state) + 1);
+        state->index = 0;
+    }
+    out = state->output + 2 * state->index;
+    state->index++;
+    return ((uint64_t) out[0] << 32) | out[1];
+}
+
+static void
+philox_set(void *vstate, unsigned long int seed)
+{
+    msp_philox_state_t *state = (msp_philox_state_t *) vstate;
+    uint64_t s = (uint64_t) seed;
+    size_t j;
+
+    /* Seeds are 32 bit throughout msprime, but fold in any high bits so
+     * that distinct 64 bit seeds give distinct keys where possible. */
+    state->key[0] = (uint32_t) (s ^ (s >> 32));
+    state->key[1] = MSP_RNG_SUBSYSTEM_ANCESTRY;
+    for (j = 0; j < 4; j++) {
+        state->counter[j] = 0;
+        state->output[j] = 0;
+    }
+    state->index = 2;
+}
+
+static unsigned long int
+philox_get(void *vstate)
+{
+    msp_philox_state_t *state = (msp_philox_state_t *) vstate;
+
+    return (unsigned long int) (philox_next(state) >> 32);
+}
+
+static double
+philox_get_double(void *vstate)
+{
+    msp_philox_state_t *state = (msp_philox_state_t *) vstate;
+
+    return uint64_to_double(philox_next(state));
+}
+
+static const gsl_rng_type philox_type = { "philox4x32", 0xffffffffUL, 0,
+    sizeof(msp_philox_state_t), &philox_set, &philox_get, &philox_get_double };
+
+const gsl_rng_type *msp_rng_philox = &philox_type;
+
+/*******************************
+ * Backend selection and bulk fills
+ *******************************/
+
+/* Returns the gsl_rng_type for the specified backend, or NULL if the
+ * backend is not known. */
+const gsl_rng_type *
+msp_rng_get_type(int backend)
+{
+    const gsl_rng_type *ret = NULL;
+
+    switch (backend) {
+        case MSP_RNG_MT19937:
+            ret = gsl_rng_mt19937;
+            break;
+        case MSP_RNG_XOSHIRO256PP:
+            ret = msp_rng_xoshiro256pp;
+            break;
+        case MSP_RNG_PCG64:
+            ret = msp_rng_pcg64;
+            break;
+        case MSP_RNG_PHILOX:
+            ret = msp_rng_philox;
+            break;
+    }
+    return ret;
+}
+
+/* Returns the backend for the specified generator, or -1 if it is some other
+ * GSL generator. */
+int
+msp_rng_get_backend(const gsl_rng *rng)
+{
+    int ret = -1;
+
+    if (rng->type == gsl_rng_mt19937) {
+        ret = MSP_RNG_MT19937;
+    } else if (rng->type == msp_rng_xoshiro256pp) {
+        ret = MSP_RNG_XOSHIRO256PP;
+    } else if (rng->type == msp_rng_pcg64) {
+        ret = MSP_RNG_PCG64;
+    } else if (rng->type == msp_rng_philox) {
+        ret = MSP_RNG_PHILOX;
+    }
+    return ret;
+}
+
+/* Fills x with n uniform variates on [0, 1). The values are exactly those
+ * that n successive calls to gsl_rng_uniform would return. */
+void
+msp_rng_fill_uniform(const gsl_rng *rng, double *x, size_t n)
+{
+    size_t j;
+    uint64_t s[4];
+    msp_pcg64_state_t pcg;
+    msp_philox_state_t philox;
+
+    if (rng->type == msp_rng_xoshiro256pp) {
+        /* Work on a local copy of the state so it can stay in registers */
+        for (j = 0; j < 4; j++) {
+            s[j] = ((msp_xoshiro256pp_state_t *) rng->state)->s[j];
+        }
+        for (j = 0; j < n; j++) {
+            x[j] = uint64_to_double(xoshiro256pp_next(s));
+        }
+        for (j = 0; j < 4; j++) {
+            ((msp_xoshiro256pp_state_t *) rng->state)->s[j] = s[j];
+        }
+    } else if (rng->type == msp_rng_pcg64) {
+        pcg = *((msp_pcg64_state_t *) rng->state);
+        for (j = 0; j < n; j++) {
+            x[j] = uint64_to_double(pcg64_next(&pcg));
+        }
+        *((msp_pcg64_state_t *) rng->state) = pcg;
+    } else if (rng->type == msp_rng_philox) {
+        philox = *((msp_philox_state_t *) rng->state);
+        for (j = 0; j < n; j++) {
+            x[j] = uint64_to_double(philox_next(&philox));
+        }
+        *((msp_philox_state_t *) rng->state) = philox;
+    } else {
+        for (j = 0; j < n; j++) {
+            x[j] = gsl_rng_uniform(rng);
+        }
+    }
+}
+
+/* Fills x with n exponential variates with mean 1 by inversion of a block
+ * of uniforms. The transform is done in a separate loop over the block so
+ * that it can be vectorised by the compiler. */
+void
+msp_rng_fill_exponential(const gsl_rng *rng, double *x, size_t n)
+{
+    size_t j;
+
+    msp_rng_fill_uniform(rng, x, n);
+    for (j = 0; j < n; j++) {
+        x[j] = -log1p(-x[j]);
+    }
+}
+
+/* Selects the stream of a counter-based generator for the specified replicate,
+ * subsystem and stream index (e.g., a genome chunk or mutation partition),
+ * and rewinds to its start. The seed is unchanged. Streams are independent
+ * of each other and of the order in which they are consumed, so work that
+ * is divided between streams gives the same output for any number of
+ * threads. */
+int
+msp_rng_set_stream(gsl_rng *rng, uint32_t replicate, uint32_t subsystem, uint32_t stream)
+{
+    int ret = 0;
+    msp_philox_state_t *state;
+
+    if (rng->type != msp_rng_philox) {
+        ret = MSP_ERR_RNG_NOT_COUNTER_BASED;
+        goto out;
+    }
+    state = (msp_philox_state_t *) rng->state;
+    state->key[1] = subsystem;
+    state->counter[0] = 0;
+    state->counter[1] = 0;
+    state->counter[2] = stream;
+    state->counter[3] = replicate;
+    state->index = 2;
+out:
+    return ret;
+}
+
+/* Advances a counter-based generator by the specified number of draws in
+ * constant time. A draw is one call to gsl_rng_get or gsl_rng_uniform. */
+int
+msp_rng_skip(gsl_rng *rng, uint64_t num_draws)
+{
+    int ret = 0;
+    msp_philox_state_t *state;
+    uint64_t position;
+
+    if (rng->type != msp_rng_philox) {
+        ret = MSP_ERR_RNG_NOT_COUNTER_BASED;
+        goto out;
+    }
+    state = (msp_philox_state_t *) rng->state;
+    /* The position of the next draw, counting two draws per block */
+    position = 2 * philox_get_position(state) - (2 - state->index) + num_draws;
+    philox_set_position(state, position / 2);
+    state->index = 2;
+    if (position % 2 == 1) {
+        philox_next(state);
+    }
+out:
+    return ret;
+}
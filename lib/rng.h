@@ -0,0 +1,77 @@
+/*
+** Copyright (C) 2024 University of Oxford
+**
+** This file is part of msprime.
+**
+** msprime is free software: you can redistribute it and/or modify
+** it under the terms of the GNU General Public License as published by
+** the Free Software Foundation, either version 3 of the License, or
+** (at your option) any later version.
+**
+** msprime is distributed in the hope that it will be useful,
+** but WITHOUT ANY WARRANTY; without even the implied warranty of
+** MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+** GNU General Public License for more details.
+**
+** You should have received a copy of the GNU General Public License
+** along with msprime.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef __RNG_H__
+#define __RNG_H__
+
+#include <stdlib.h>
+#include <stdint.h>
+
+#include <gsl/gsl_rng.h>
+
+/* Random number generator backends. The native backends are exposed as
+ * gsl_rng_types so that a gsl_rng using them can be passed anywhere a GSL
+ * generator is expected, including all of the gsl_ran_* distributions. */
+#define MSP_RNG_MT19937 0
+#define MSP_RNG_XOSHIRO256PP 1
+#define MSP_RNG_PCG64 2
+#define MSP_RNG_PHILOX 3
+
+/* Subsystems of a simulation that draw from separate streams of a
+ * counter-based generator. */
+#define MSP_RNG_SUBSYSTEM_ANCESTRY 0
+#define MSP_RNG_SUBSYSTEM_MUTATIONS 1
+
+typedef struct {
+    uint64_t s[4];
+} msp_xoshiro256pp_state_t;
+
+typedef struct {
+    uint64_t state_hi;
+    uint64_t state_lo;
+    uint64_t inc_hi;
+    uint64_t inc_lo;
+} msp_pcg64_state_t;
+
+/* Philox4x32-10 keyed by (seed, subsystem). The 128 bit counter holds the
+ * block position within the stream in its lower 64 bits, and the stream and
+ * replicate indexes in the upper words, so that every (seed, replicate,
+ * subsystem, stream) tuple has its own independent sequence of 2^65 draws
+ * which can be jumped into at any point. */
+typedef struct {
+    uint32_t key[2];
+    uint32_t counter[4];
+    uint32_t output[4];
+    /* Number of 64 bit words of output consumed; 2 when a new block is needed */
+    uint32_t index;
+} msp_philox_state_t;
+
+extern const gsl_rng_type *msp_rng_xoshiro256pp;
+extern const gsl_rng_type *msp_rng_pcg64;
+extern const gsl_rng_type *msp_rng_philox;
+
+const gsl_rng_type *msp_rng_get_type(int backend);
+int msp_rng_get_backend(const gsl_rng *rng);
+void msp_rng_fill_uniform(const gsl_rng *rng, double *x, size_t n);
+void msp_rng_fill_exponential(const gsl_rng *rng, double *x, size_t n);
+int msp_rng_set_stream(
+    gsl_rng *rng, uint32_t replicate, uint32_t subsystem, uint32_t stream);
+int msp_rng_skip(gsl_rng *rng, uint64_t num_draws);
+
+#endif /*__RNG_H__*/
@@ -0,0 +1,304 @@
+/*
+** Copyright (C) 2024 University of Oxford
+**
+** This file is part of msprime.
+**
+** msprime is free software: you can redistribute it and/or modify
+** it under the terms of the GNU General Public License as published by
+** the Free Software Foundation, either version 3 of the License, or
+** (at your option) any later version.
+**
+** msprime is distributed in the hope that it will be useful,
+** but WITHOUT ANY WARRANTY; without even the implied warranty of
+** MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+** GNU General Public License for more details.
+**
+** You should have received a copy of the GNU General Public License
+** along with msprime.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "util.h"
+#include "segment_pool.h"
+
+static int MSP_WARN_UNUSED
+segment_pool_resize_column(
+    segment_pool_t *self, void **column, size_t item_size, size_t new_size)
+{
+    int ret = 0;
+    void *p;
+
+    p = msp_huge_realloc(*column, (self->size + 1) * item_size,
+        (new_size + 1) * item_size, self->huge_pages);
+    if (p == NULL) {
+        ret = MSP_ERR_NO_MEMORY;
+        goto out;
+    }
+    *column = p;
+out:
+    return ret;
+}
+
+/* Resizes all of the columns to hold new_size segments. If this fails some
+ * columns may have been resized; they are all at least as large as before,
+ * so the pool can still be used at its current size. */
+static int MSP_WARN_UNUSED
+segment_pool_resize(segment_pool_t *self, size_t new_size)
+{
+    int ret = 0;
+
+    if (new_size >= UINT32_MAX) {
+        ret = MSP_ERR_NO_MEMORY;
+        goto out;
+    }
+    ret = segment_pool_resize_column(
+        self, (void **) &self->left, sizeof(*self->left), new_size);
+    if (ret != 0) {
+        goto out;
+    }
+    ret = segment_pool_resize_column(
+        self, (void **) &self->right, sizeof(*self->right), new_size);
+    if (ret != 0) {
+        goto out;
+    }
+    ret = segment_pool_resize_column(
+        self, (void **) &self->value, sizeof(*self->value), new_size);
+    if (ret != 0) {
+        goto out;
+    }
+    ret = segment_pool_resize_column(
+        self, (void **) &self->population, sizeof(*self->population), new_size);
+    if (ret != 0) {
+        goto out;
+    }
+    ret = segment_pool_resize_column(
+        self, (void **) &self->label, sizeof(*self->label), new_size);
+    if (ret != 0) {
+        goto out;
+    }
+    ret = segment_pool_resize_column(
+        self, (void **) &self->prev, sizeof(*self->prev), new_size);
+    if (ret != 0) {
+        goto out;
+    }
+    ret = segment_pool_resize_column(
+        self, (void **) &self->next, sizeof(*self->next), new_size);
+out:
+    return ret;
+}
+
+/* Pushes the segments with indexes start to stop - 1 onto the free list in
+ * increasing order, so that the largest is allocated first. */
+static void
+segment_pool_push_free_segments(segment_pool_t *self, size_t start, size_t stop)
+{
+    size_t j;
+
+    for (j = start; j < stop; j++) {
+        self->prev[j] = MSP_NULL_SEGMENT;
+        self->next[j] = self->free_list;
+        self->free_list = (segment_id_t) j;
+    }
+}
+
+int MSP_WARN_UNUSED
+segment_pool_init(segment_pool_t *self, size_t size, bool huge_pages)
+{
+    int ret = 0;
+
+    memset(self, 0, sizeof(*self));
+    self->huge_pages = huge_pages;
+    ret = segment_pool_resize(self, size);
+    if (ret != 0) {
+        goto out;
+    }
+    self->size = size;
+    self->left[MSP_NULL_SEGMENT] = 0;
+    self->right[MSP_NULL_SEGMENT] = 0;
+    self->value[MSP_NULL_SEGMENT] = TSK_NULL;
+    self->population[MSP_NULL_SEGMENT] = TSK_NULL;
+    self->label[MSP_NULL_SEGMENT] = TSK_NULL;
+    self->prev[MSP_NULL_SEGMENT] = MSP_NULL_SEGMENT;
+    self->next[MSP_NULL_SEGMENT] = MSP_NULL_SEGMENT;
+    self->free_list = MSP_NULL_SEGMENT;
+    segment_pool_push_free_segments(self, 1, size + 1);
+out:
+    return ret;
+}
+
+int
+segment_pool_free(segment_pool_t *self)
+{
+    const size_t n = self->size + 1;
+    const bool huge_pages = self->huge_pages;
+
+    msp_huge_free(self->left, n * sizeof(*self->left), huge_pages);
+    msp_huge_free(self->right, n * sizeof(*self->right), huge_pages);
+    msp_huge_free(self->value, n * sizeof(*self->value), huge_pages);
+    msp_huge_free(self->population, n * sizeof(*self->population), huge_pages);
+    msp_huge_free(self->label, n * sizeof(*self->label), huge_pages);
+    msp_huge_free(self->prev, n * sizeof(*self->prev), huge_pages);
+    msp_huge_free(self->next, n * sizeof(*self->next), huge_pages);
+    memset(self, 0, sizeof(*self));
+    return 0;
+}
+
+/* Adds space for increment more segments, which are allocated largest
+ * index first. If memory can't be allocated the pool is left unchanged. */
+int MSP_WARN_UNUSED
+segment_pool_expand(segment_pool_t *self, size_t increment)
+{
+    int ret = 0;
+    const size_t size = self->size + increment;
+
+    ret = segment_pool_resize(self, size);
+    if (ret != 0) {
+        goto out;
+    }
+    segment_pool_push_free_segments(self, self->size + 1, size + 1);
+    self->size = size;
+out:
+    return ret;
+}
+
+/* Returns a free segment, or the null segment if there are none. The fields
+ * of the segment are not initialised. */
+segment_id_t
+segment_pool_alloc(segment_pool_t *self)
+{
+    segment_id_t u = self->free_list;
+
+    if (u != MSP_NULL_SEGMENT) {
+        self->free_list = self->next[u];
+        self->num_allocated++;
+    }
+    return u;
+}
+
+void
+segment_pool_free_segment(segment_pool_t *self, segment_id_t u)
+{
+    tsk_bug_assert(u != MSP_NULL_SEGMENT && u <= self->size);
+    tsk_bug_assert(self->num_allocated > 0);
+    self->prev[u] = MSP_NULL_SEGMENT;
+    self->next[u] = self->free_list;
+    self->free_list = u;
+    self->num_allocated--;
+}
+
+/* Moves the specified segments of the source pool into this pool, which
+ * must have nothing allocated and space for them. Segment source_id[j]
+ * becomes segment j for 1 <= j <= num_segments, and the links between them
+ * are translated to match, so they must not link to segments that are not
+ * moved. The remaining segments are allocated smallest index first. The
+ * columns of the source are overwritten, and it can only be freed. */
+void
+segment_pool_move_segments(segment_pool_t *self, segment_pool_t *source,
+    size_t num_segments, const segment_id_t *source_id)
+{
+    size_t j;
+    segment_id_t u;
+
+    tsk_bug_assert(self->num_allocated == 0);
+    tsk_bug_assert(num_segments <= self->size);
+    for (j = 1; j <= num_segments; j++) {
+        u = source_id[j];
+        tsk_bug_assert(u != MSP_NULL_SEGMENT && u <= source->size);
+        self->left[j] = source->left[u];
+        self->right[j] = source->right[u];
+        self->value[j] = source->value[u];
+        self->population[j] = source->population[u];
+        self->label[j] = source->label[u];
+        self->prev[j] = source->prev[u];
+        self->next[j] = source->next[u];
+        /* The source's prev column now maps its indexes to ours */
+        source->prev[u] = (segment_id_t) j;
+    }
+    source->prev[MSP_NULL_SEGMENT] = MSP_NULL_SEGMENT;
+    for (j = 1; j <= num_segments; j++) {
+        self->prev[j] = source->prev[self->prev[j]];
+        self->next[j] = source->prev[self->next[j]];
+    }
+    self->free_list = MSP_NULL_SEGMENT;
+    for (j = self->size; j > num_segments; j--) {
+        self->prev[j] = MSP_NULL_SEGMENT;
+        self->next[j] = self->free_list;
+        self->free_list = (segment_id_t) j;
+    }
+    self->num_allocated = num_segments;
+}
+
+size_t
+segment_pool_get_size(segment_pool_t *self)
+{
+    return self->size;
+}
+
+size_t
+segment_pool_get_num_allocated(segment_pool_t *self)
+{
+    return self->num_allocated;
+}
+
+/* Returns the number of bytes allocated for the columns */
+size_t
+segment_pool_get_memory_usage(segment_pool_t *self)
+{
+    const size_t n = self->size + 1;
+    const bool huge_pages = self->huge_pages;
+
+    return msp_huge_get_allocated_size(n * sizeof(*self->left), huge_pages)
+           + msp_huge_get_allocated_size(n * sizeof(*self->right), huge_pages)
+           + msp_huge_get_allocated_size(n * sizeof(*self->value), huge_pages)
+           + msp_huge_get_allocated_size(n * sizeof(*self->population), huge_pages)
+           + msp_huge_get_allocated_size(n * sizeof(*self->label), huge_pages)
+           + msp_huge_get_allocated_size(n * sizeof(*self->prev), huge_pages)
+           + msp_huge_get_allocated_size(n * sizeof(*self->next), huge_pages);
+}
+
+void
+segment_pool_print_state(segment_pool_t *self, FILE *out)
+{
+    fprintf(out, "segment pool %p::\n", (void *) self);
+    fprintf(out, "\tsize = %d\n", (int) self->size);
+    fprintf(out, "\tnum_allocated = %d\n", (int) self->num_allocated);
+    fprintf(out, "\tfree_list = %d\n", (int) self->free_list);
+    fprintf(out, "\thuge_pages = %d\n", self->huge_pages);
+}
+
+/* Checks that the free list and the allocated segments account for all of
+ * the pool, and that the links of the allocated segments are consistent. */
+void
+segment_pool_verify(segment_pool_t *self)
+{
+    size_t j, num_free;
+    segment_id_t u;
+    bool *is_free = calloc(self->size + 1, sizeof(*is_free));
+
+    tsk_bug_assert(is_free != NULL);
+    num_free = 0;
+    for (u = self->free_list; u != MSP_NULL_SEGMENT; u = self->next[u]) {
+        tsk_bug_assert(u <= self->size);
+        tsk_bug_assert(!is_free[u]);
+        is_free[u] = true;
+        num_free++;
+    }
+    tsk_bug_assert(num_free + self->num_allocated == self->size);
+    for (j = 1; j <= self->size; j++) {
+        if (!is_free[j]) {
+            tsk_bug_assert(self->left[j] < self->right[j]);
+            u = self->next[j];
+            tsk_bug_assert(u <= self->size);
+            tsk_bug_assert(
+                u == MSP_NULL_SEGMENT || (!is_free[u] && self->prev[u] == j));
+            u = self->prev[j];
+            tsk_bug_assert(u <= self->size);
+            tsk_bug_assert(
+                u == MSP_NULL_SEGMENT || (!is_free[u] && self->next[u] == j));
+        }
+    }
+    free(is_free);
+}
@@ -0,0 +1,71 @@
+/*
+** Copyright (C) 2024 University of Oxford
+**
+** This file is part of msprime.
+**
+** msprime is free software: you can redistribute it and/or modify
+** it under the terms of the GNU General Public License as published by
+** the Free Software Foundation, either version 3 of the License, or
+** (at your option) any later version.
+**
+** msprime is distributed in the hope that it will be useful,
+** but WITHOUT ANY WARRANTY; without even the implied warranty of
+** MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+** GNU General Public License for more details.
+**
+** You should have received a copy of the GNU General Public License
+** along with msprime.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef __SEGMENT_POOL_H__
+#define __SEGMENT_POOL_H__
+
+#include <stdio.h>
+#include <stdbool.h>
+#include <stdint.h>
+
+#include <tskit.h>
+
+/* Segments are referred to by their index in the pool. Index 0 is the null
+ * segment, so the indexes of the allocated segments start at 1 and can be
+ * used directly as the indexes of a Fenwick tree. */
+typedef uint32_t segment_id_t;
+
+#define MSP_NULL_SEGMENT ((segment_id_t) 0)
+
+/* A store for segments that keeps each field in a separate contiguous
+ * column, and links segments into chains by their 32 bit indexes rather
+ * than by pointers. The columns are reallocated when the pool grows, so
+ * pointers into them are invalidated by segment_pool_expand. Free segments
+ * are kept in a list threaded through the next column. */
+typedef struct {
+    /* The number of segments the columns have space for, excluding the
+     * null segment. */
+    size_t size;
+    size_t num_allocated;
+    segment_id_t free_list;
+    /* Allocate the columns with msp_huge_alloc */
+    bool huge_pages;
+    double *left;
+    double *right;
+    tsk_id_t *value;
+    tsk_id_t *population;
+    tsk_id_t *label;
+    segment_id_t *prev;
+    segment_id_t *next;
+} segment_pool_t;
+
+int segment_pool_init(segment_pool_t *self, size_t size, bool huge_pages);
+int segment_pool_free(segment_pool_t *self);
+int segment_pool_expand(segment_pool_t *self, size_t increment);
+segment_id_t segment_pool_alloc(segment_pool_t *self);
+void segment_pool_free_segment(segment_pool_t *self, segment_id_t u);
+void segment_pool_move_segments(segment_pool_t *self, segment_pool_t *source,
+    size_t num_segments, const segment_id_t *source_id);
+size_t segment_pool_get_size(segment_pool_t *self);
+size_t segment_pool_get_num_allocated(segment_pool_t *self);
+size_t segment_pool_get_memory_usage(segment_pool_t *self);
+void segment_pool_print_state(segment_pool_t *self, FILE *out);
+void segment_pool_verify(segment_pool_t *self);
+
+#endif /*__SEGMENT_POOL_H__*/
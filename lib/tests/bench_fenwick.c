@@ -0,0 +1,123 @@
+/*
+** Copyright (C) 2024 University of Oxford
+**
+** This file is part of msprime.
+**
+** msprime is free software: you can redistribute it and/or modify
+** it under the terms of the GNU General Public License as published by
+** the Free Software Foundation, either version 3 of the License, or
+** (at your option) any later version.
+**
+** msprime is distributed in the hope that it will be useful,
+** but WITHOUT ANY WARRANTY; without even the implied warranty of
+** MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+** GNU General Public License for more details.
+**
+** You should have received a copy of the GNU General Public License
+** along with msprime.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+/*
+ * Microbenchmarks for the Fenwick tree searches used to choose
+ * recombination and gene conversion breakpoints. For each tree size we
+ * time the separate find, get_value and get_cumulative_sum calls against
+ * the single descent of fenwick_find_with_prefix, in the floating point
+ * and fixed-point modes. Usage: bench_fenwick [num_queries]
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+
+#include <gsl/gsl_rng.h>
+
+#include "util.h"
+#include "fenwick.h"
+
+static double
+elapsed_ns(clock_t start, size_t num_queries)
+{
+    return 1e9 * (double) (clock() - start) / CLOCKS_PER_SEC / (double) num_queries;
+}
+
+static void
+run_benchmark(size_t n, bool fixed_point, const double *queries, size_t num_queries)
+{
+    fenwick_t t;
+    size_t j, index;
+    double prefix, value;
+    /* Accumulate the results so that the searches can't be optimised out */
+    double check[2] = { 0, 0 };
+    double time[2];
+    clock_t start;
+    int ret;
+
+    if (fixed_point) {
+        ret = fenwick_alloc_fixed_point(&t, n, 1);
+    } else {
+        ret = fenwick_alloc(&t, n);
+    }
+    if (ret != 0) {
+        fprintf(stderr, "error: %s\n", msp_strerror(ret));
+        exit(EXIT_FAILURE);
+    }
+    for (j = 1; j <= n; j++) {
+        fenwick_set_value(&t, j, 1.0 / (double) (1 + j % 101));
+    }
+
+    start = clock();
+    for (j = 0; j < num_queries; j++) {
+        index = fenwick_find(&t, queries[j] * fenwick_get_total(&t));
+        value = fenwick_get_value(&t, index);
+        prefix = fenwick_get_cumulative_sum(&t, index) - value;
+        check[0] += prefix + value;
+    }
+    time[0] = elapsed_ns(start, num_queries);
+
+    start = clock();
+    for (j = 0; j < num_queries; j++) {
+        fenwick_find_with_prefix(
+            &t, queries[j] * fenwick_get_total(&t), &prefix, &value);
+        check[1] += prefix + value;
+    }
+    time[1] = elapsed_ns(start, num_queries);
+
+    printf("%-6s %10d %14.1f %14.1f %10.2f %g\n", fixed_point ? "fixed" : "float",
+        (int) n, time[0], time[1], time[0] / time[1], check[1] - check[0]);
+    fenwick_free(&t);
+}
+
+int
+main(int argc, char **argv)
+{
+    size_t num_queries = 1000000;
+    size_t sizes[] = { 1 << 10, 1 << 14, 1 << 18, 1 << 22 };
+    double *queries;
+    gsl_rng *rng;
+    size_t j, k;
+
+    if (argc > 1) {
+        num_queries = (size_t) atol(argv[1]);
+    }
+    queries = malloc(num_queries * sizeof(*queries));
+    rng = gsl_rng_alloc(gsl_rng_mt19937);
+    if (queries == NULL || rng == NULL) {
+        fprintf(stderr, "Out of memory\n");
+        exit(EXIT_FAILURE);
+    }
+    gsl_rng_set(rng, 1);
+    for (j = 0; j < num_queries; j++) {
+        queries[j] = gsl_rng_uniform(rng);
+    }
+
+    printf("# ns per query; separate = find + get_value + get_cumulative_sum\n");
+    printf("%-6s %10s %14s %14s %10s %s\n", "mode", "size", "separate",
+        "with_prefix", "speedup", "difference");
+    for (k = 0; k < 2; k++) {
+        for (j = 0; j < sizeof(sizes) / sizeof(*sizes); j++) {
+            run_benchmark(sizes[j], k == 1, queries, num_queries);
+        }
+    }
+    gsl_rng_free(rng);
+    free(queries);
+    return EXIT_SUCCESS;
+}
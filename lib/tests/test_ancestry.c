@@ -182,6 +182,1205 @@ test_single_locus_many_populations(void)
     tsk_table_collection_free(&tables);
 }
 
+static void
+test_stepping_stone_event_rates(void)
+{
+    int ret;
+    msp_t msp;
+    gsl_rng *rng = safe_rng_alloc();
+    uint32_t num_populations = 100;
+    uint32_t n = 2 * num_populations;
+    uint32_t num_events;
+    size_t j, k, num_migrations;
+    sample_t *samples = malloc(n * sizeof(sample_t));
+    double *migration_matrix
+        = calloc(num_populations * num_populations, sizeof(double));
+    size_t *migration_events
+        = malloc(num_populations * num_populations * sizeof(size_t));
+    tsk_table_collection_t tables;
+
+    CU_ASSERT_FATAL(samples != NULL && migration_matrix != NULL);
+    CU_ASSERT_FATAL(migration_events != NULL);
+    for (j = 0; j < n; j++) {
+        samples[j].time = 0;
+        samples[j].population = (population_id_t)(j % num_populations);
+    }
+    for (j = 0; j < num_populations; j++) {
+        k = (j + 1) % num_populations;
+        migration_matrix[j * num_populations + k] = 0.5;
+        migration_matrix[k * num_populations + j] = 0.25;
+    }
+
+    /* With a growing population the common ancestor waiting times must be
+     * sampled for that population rather than from the event rate index,
+     * but the other populations keep using the index. Each case is run with
+     * both schedulers. */
+    for (k = 0; k < 4; k++) {
+        ret = build_sim(&msp, &tables, rng, 10, num_populations, samples, n);
+        CU_ASSERT_EQUAL_FATAL(ret, 0);
+        ret = msp_set_scheduler(
+            &msp, k < 2 ? MSP_SCHEDULER_DIRECT : MSP_SCHEDULER_NEXT_REACTION);
+        CU_ASSERT_EQUAL_FATAL(ret, 0);
+        ret = msp_set_migration_matrix(
+            &msp, num_populations * num_populations, migration_matrix);
+        CU_ASSERT_EQUAL_FATAL(ret, 0);
+        CU_ASSERT_EQUAL_FATAL(msp_set_recombination_rate(&msp, 0.1), 0);
+        if (k % 2 == 1) {
+            ret = msp_set_population_configuration(&msp, 0, 1, 0.01, true);
+            CU_ASSERT_EQUAL_FATAL(ret, 0);
+        }
+        ret = msp_initialise(&msp);
+        CU_ASSERT_EQUAL_FATAL(ret, 0);
+        CU_ASSERT_EQUAL(msp.ca_rates_indexed, false);
+
+        num_events = 0;
+        while ((ret = msp_run(&msp, DBL_MAX, 1)) == MSP_EXIT_MAX_EVENTS) {
+            num_events++;
+            CU_ASSERT_EQUAL(msp.ca_rates_indexed, k % 2 == 0);
+            CU_ASSERT_EQUAL(msp.populations[0].ca_rate_indexed, k % 2 == 0);
+            CU_ASSERT_EQUAL(msp.populations[1].ca_rate_indexed, true);
+            CU_ASSERT_EQUAL(msp.populations[1].ploidy_size, 2 * 1.0);
+            if (num_events % 100 == 0) {
+                msp_verify(&msp, 0);
+            }
+        }
+        CU_ASSERT_EQUAL(ret, 0);
+        msp_verify(&msp, 0);
+        msp_print_state(&msp, _devnull);
+
+        ret = msp_get_num_migration_events(&msp, migration_events);
+        CU_ASSERT_EQUAL(ret, 0);
+        num_migrations = 0;
+        for (j = 0; j < num_populations * num_populations; j++) {
+            CU_ASSERT(migration_matrix[j] > 0 || migration_events[j] == 0);
+            num_migrations += migration_events[j];
+        }
+        CU_ASSERT(num_migrations > 0);
+        CU_ASSERT_EQUAL(1 + num_events, num_migrations
+                                            + msp_get_num_recombination_events(&msp)
+                                            + msp_get_num_common_ancestor_events(&msp));
+
+        ret = msp_free(&msp);
+        CU_ASSERT_EQUAL(ret, 0);
+        tsk_table_collection_free(&tables);
+    }
+    gsl_rng_free(rng);
+    free(samples);
+    free(migration_matrix);
+    free(migration_events);
+}
+
+static void
+test_demographic_events_population_indexes(void)
+{
+    int ret;
+    msp_t msp;
+    gsl_rng *rng = safe_rng_alloc();
+    uint32_t num_populations = 5;
+    uint32_t n = 40;
+    uint32_t num_events;
+    size_t j, k;
+    int32_t derived[] = { 0, 1, 2, 3 };
+    sample_t *samples = malloc(n * sizeof(sample_t));
+    double migration_matrix[25];
+    tsk_table_collection_t tables;
+
+    CU_ASSERT_FATAL(samples != NULL);
+    for (j = 0; j < n; j++) {
+        samples[j].time = 0;
+        samples[j].population = (population_id_t)(j % 4);
+    }
+    samples[n - 1].time = 0.35;
+    for (j = 0; j < num_populations; j++) {
+        for (k = 0; k < num_populations; k++) {
+            migration_matrix[j * num_populations + k]
+                = (j == k || j == 4 || k == 4) ? 0 : 0.1 * (double) (j + 1);
+        }
+    }
+
+    /* The population indexes are patched after each demographic event
+     * rather than recomputed, and msp_verify checks them against the
+     * current state after every event. */
+    for (k = 0; k < 2; k++) {
+        ret = build_sim(&msp, &tables, rng, 10, num_populations, samples, n);
+        CU_ASSERT_EQUAL_FATAL(ret, 0);
+        ret = msp_set_scheduler(
+            &msp, k == 0 ? MSP_SCHEDULER_DIRECT : MSP_SCHEDULER_NEXT_REACTION);
+        CU_ASSERT_EQUAL_FATAL(ret, 0);
+        ret = msp_set_migration_matrix(&msp, 25, migration_matrix);
+        CU_ASSERT_EQUAL_FATAL(ret, 0);
+        ret = msp_set_population_configuration(&msp, 4, 1, 0, false);
+        CU_ASSERT_EQUAL_FATAL(ret, 0);
+        CU_ASSERT_EQUAL_FATAL(msp_set_recombination_rate(&msp, 0.1), 0);
+
+        ret = msp_add_migration_rate_change(&msp, 0.1, 0, 1, 2.0);
+        CU_ASSERT_EQUAL_FATAL(ret, 0);
+        ret = msp_add_population_parameters_change(&msp, 0.2, 1, GSL_NAN, 0.5);
+        CU_ASSERT_EQUAL_FATAL(ret, 0);
+        ret = msp_add_mass_migration(&msp, 0.3, 2, 3, 0.5);
+        CU_ASSERT_EQUAL_FATAL(ret, 0);
+        ret = msp_add_population_parameters_change(&msp, 0.4, -1, GSL_NAN, 0);
+        CU_ASSERT_EQUAL_FATAL(ret, 0);
+        ret = msp_add_migration_rate_change(&msp, 0.5, -1, -1, 0.05);
+        CU_ASSERT_EQUAL_FATAL(ret, 0);
+        ret = msp_add_simple_bottleneck(&msp, 0.6, 3, 0.5);
+        CU_ASSERT_EQUAL_FATAL(ret, 0);
+        ret = msp_add_migration_rate_change(&msp, 0.7, 2, 0, 0);
+        CU_ASSERT_EQUAL_FATAL(ret, 0);
+        ret = msp_add_population_split(&msp, 0.8, 4, derived, 4);
+        CU_ASSERT_EQUAL_FATAL(ret, 0);
+        ret = msp_initialise(&msp);
+        CU_ASSERT_EQUAL_FATAL(ret, 0);
+
+        num_events = 0;
+        while ((ret = msp_run(&msp, DBL_MAX, 1)) == MSP_EXIT_MAX_EVENTS) {
+            num_events++;
+            msp_verify(&msp, 0);
+            if (msp.time > 0.2 && msp.time < 0.4) {
+                CU_ASSERT_FALSE(msp.ca_rates_indexed);
+            } else if (msp.time > 0.4) {
+                CU_ASSERT_TRUE(msp.ca_rates_indexed);
+            }
+        }
+        CU_ASSERT_EQUAL(ret, 0);
+        CU_ASSERT(num_events > 0);
+        CU_ASSERT(msp.time > 0.8);
+        msp_verify(&msp, 0);
+
+        ret = msp_free(&msp);
+        CU_ASSERT_EQUAL(ret, 0);
+        tsk_table_collection_free(&tables);
+    }
+    gsl_rng_free(rng);
+    free(samples);
+}
+
+static void
+test_event_chunk_does_not_change_output(void)
+{
+    int ret;
+    msp_t msp;
+    gsl_rng *rng = safe_rng_alloc();
+    uint32_t n = 20;
+    size_t j, k, l;
+    unsigned long chunks[] = { 1, 7, 10000 };
+    sample_t *samples = malloc(n * sizeof(sample_t));
+    double migration_matrix[] = { 0, 0.1, 0.2, 0 };
+    tsk_table_collection_t tables[3];
+
+    CU_ASSERT_FATAL(samples != NULL);
+    for (j = 0; j < n; j++) {
+        samples[j].time = 0;
+        samples[j].population = (population_id_t)(j % 2);
+    }
+    /* msp_run carries on from where the last call left off, so how the run
+     * is divided doesn't change the output. */
+    for (k = 0; k < 2; k++) {
+        for (l = 0; l < 3; l++) {
+            gsl_rng_set(rng, 5);
+            ret = build_sim(&msp, &tables[l], rng, 100, 2, samples, n);
+            CU_ASSERT_EQUAL_FATAL(ret, 0);
+            ret = msp_set_scheduler(
+                &msp, k == 0 ? MSP_SCHEDULER_DIRECT : MSP_SCHEDULER_NEXT_REACTION);
+            CU_ASSERT_EQUAL_FATAL(ret, 0);
+            ret = msp_set_migration_matrix(&msp, 4, migration_matrix);
+            CU_ASSERT_EQUAL_FATAL(ret, 0);
+            CU_ASSERT_EQUAL_FATAL(msp_set_recombination_rate(&msp, 0.01), 0);
+            CU_ASSERT_EQUAL_FATAL(msp_set_gene_conversion_rate(&msp, 0.01), 0);
+            CU_ASSERT_EQUAL_FATAL(msp_set_gene_conversion_tract_length(&msp, 5), 0);
+            ret = msp_add_population_parameters_change(&msp, 0.5, 1, 0.5, 1);
+            CU_ASSERT_EQUAL_FATAL(ret, 0);
+            ret = msp_add_mass_migration(&msp, 1.0, 1, 0, 1);
+            CU_ASSERT_EQUAL_FATAL(ret, 0);
+            ret = msp_initialise(&msp);
+            CU_ASSERT_EQUAL_FATAL(ret, 0);
+            while ((ret = msp_run(&msp, DBL_MAX, chunks[l])) == MSP_EXIT_MAX_EVENTS) {
+                msp_verify(&msp, 0);
+            }
+            CU_ASSERT_EQUAL(ret, 0);
+            ret = msp_finalise_tables(&msp);
+            CU_ASSERT_EQUAL_FATAL(ret, 0);
+            ret = msp_free(&msp);
+            CU_ASSERT_EQUAL(ret, 0);
+        }
+        CU_ASSERT(tables[0].edges.num_rows > 0);
+        CU_ASSERT_TRUE(tsk_table_collection_equals(&tables[0], &tables[1], 0));
+        CU_ASSERT_TRUE(tsk_table_collection_equals(&tables[0], &tables[2], 0));
+        for (l = 0; l < 3; l++) {
+            tsk_table_collection_free(&tables[l]);
+        }
+    }
+    gsl_rng_free(rng);
+    free(samples);
+}
+
+static void
+test_instrumentation(void)
+{
+    int ret;
+    msp_t msp;
+    gsl_rng *rng = safe_rng_alloc();
+    uint32_t n = 20;
+    size_t j, k;
+    sample_t *samples = malloc(n * sizeof(sample_t));
+    double migration_matrix[] = { 0, 1, 1, 0 };
+    size_t calls[MSP_NUM_TIMERS];
+    double elapsed[MSP_NUM_TIMERS];
+    tsk_table_collection_t tables;
+
+    CU_ASSERT_FATAL(samples != NULL);
+    for (j = 0; j < n; j++) {
+        samples[j].time = 0;
+        samples[j].population = (population_id_t)(j % 2);
+    }
+    for (k = 0; k < 2; k++) {
+        ret = build_sim(&msp, &tables, rng, 10, 2, samples, n);
+        CU_ASSERT_EQUAL_FATAL(ret, 0);
+        ret = msp_set_migration_matrix(&msp, 4, migration_matrix);
+        CU_ASSERT_EQUAL_FATAL(ret, 0);
+        CU_ASSERT_EQUAL_FATAL(msp_set_recombination_rate(&msp, 0.1), 0);
+        CU_ASSERT_EQUAL_FATAL(msp_set_gene_conversion_rate(&msp, 0.1), 0);
+        CU_ASSERT_EQUAL_FATAL(msp_set_gene_conversion_tract_length(&msp, 1), 0);
+        ret = msp_add_mass_migration(&msp, 0.1, 0, 1, 0.5);
+        CU_ASSERT_EQUAL_FATAL(ret, 0);
+        ret = msp_set_instrumentation(&msp, k == 1);
+        CU_ASSERT_EQUAL_FATAL(ret, 0);
+        CU_ASSERT_EQUAL(msp_get_instrumentation(&msp), k == 1);
+        ret = msp_initialise(&msp);
+        CU_ASSERT_EQUAL_FATAL(ret, 0);
+        ret = msp_run(&msp, DBL_MAX, ULONG_MAX);
+        CU_ASSERT_EQUAL(ret, 0);
+        msp_verify(&msp, 0);
+        msp_print_state(&msp, _devnull);
+
+        ret = msp_get_timer_calls(&msp, calls);
+        CU_ASSERT_EQUAL(ret, 0);
+        ret = msp_get_timer_elapsed(&msp, elapsed);
+        CU_ASSERT_EQUAL(ret, 0);
+        for (j = 0; j < MSP_NUM_TIMERS; j++) {
+            CU_ASSERT_FATAL(msp_get_timer_name((int) j) != NULL);
+            CU_ASSERT(elapsed[j] >= 0);
+            if (k == 0) {
+                CU_ASSERT_EQUAL(calls[j], 0);
+                CU_ASSERT_EQUAL(elapsed[j], 0);
+            }
+        }
+        if (k == 1) {
+            CU_ASSERT_EQUAL(calls[MSP_TIMER_RECOMBINATION],
+                msp_get_num_recombination_events(&msp));
+            CU_ASSERT_EQUAL(calls[MSP_TIMER_COMMON_ANCESTOR],
+                msp_get_num_common_ancestor_events(&msp));
+            CU_ASSERT(calls[MSP_TIMER_GENE_CONVERSION] > 0);
+            CU_ASSERT(calls[MSP_TIMER_MIGRATION] > 0);
+            CU_ASSERT_EQUAL(calls[MSP_TIMER_FIXED_EVENTS], 1);
+            CU_ASSERT(calls[MSP_TIMER_FLUSH_EDGES] > 0);
+        }
+        /* Reset clears the timers */
+        ret = msp_reset(&msp);
+        CU_ASSERT_EQUAL(ret, 0);
+        ret = msp_get_timer_calls(&msp, calls);
+        CU_ASSERT_EQUAL(ret, 0);
+        for (j = 0; j < MSP_NUM_TIMERS; j++) {
+            CU_ASSERT_EQUAL(calls[j], 0);
+        }
+
+        ret = msp_free(&msp);
+        CU_ASSERT_EQUAL(ret, 0);
+        tsk_table_collection_free(&tables);
+    }
+    gsl_rng_free(rng);
+    free(samples);
+}
+
+static void
+test_variate_buffer(void)
+{
+    int ret;
+    msp_t msp;
+    gsl_rng *rng = safe_rng_alloc();
+    uint32_t n = 20;
+    size_t j, k, l;
+    size_t sizes[] = { 0, 1, 64, 4096 };
+    sample_t *samples = malloc(n * sizeof(sample_t));
+    double migration_matrix[] = { 0, 1, 1, 0 };
+    tsk_table_collection_t tables[2];
+
+    CU_ASSERT_FATAL(samples != NULL);
+    for (j = 0; j < n; j++) {
+        samples[j].time = 0;
+        samples[j].population = (population_id_t)(j % 2);
+    }
+    for (k = 0; k < sizeof(sizes) / sizeof(*sizes); k++) {
+        /* Run twice with the same seed and buffer size for each scheduler */
+        for (l = 0; l < 4; l++) {
+            gsl_rng_set(rng, 5);
+            ret = build_sim(&msp, &tables[l % 2], rng, 10, 2, samples, n);
+            CU_ASSERT_EQUAL_FATAL(ret, 0);
+            ret = msp_set_scheduler(
+                &msp, l < 2 ? MSP_SCHEDULER_DIRECT : MSP_SCHEDULER_NEXT_REACTION);
+            CU_ASSERT_EQUAL_FATAL(ret, 0);
+            ret = msp_set_migration_matrix(&msp, 4, migration_matrix);
+            CU_ASSERT_EQUAL_FATAL(ret, 0);
+            CU_ASSERT_EQUAL_FATAL(msp_set_recombination_rate(&msp, 0.1), 0);
+            CU_ASSERT_EQUAL_FATAL(msp_set_gene_conversion_rate(&msp, 0.1), 0);
+            CU_ASSERT_EQUAL_FATAL(msp_set_gene_conversion_tract_length(&msp, 1), 0);
+            ret = msp_set_variate_buffer_size(&msp, sizes[k]);
+            CU_ASSERT_EQUAL_FATAL(ret, 0);
+            CU_ASSERT_EQUAL(msp_get_variate_buffer_size(&msp), sizes[k]);
+            ret = msp_initialise(&msp);
+            CU_ASSERT_EQUAL_FATAL(ret, 0);
+            ret = msp_run(&msp, DBL_MAX, ULONG_MAX);
+            CU_ASSERT_EQUAL(ret, 0);
+            msp_verify(&msp, 0);
+            msp_print_state(&msp, _devnull);
+            ret = msp_finalise_tables(&msp);
+            CU_ASSERT_EQUAL(ret, 0);
+            ret = msp_free(&msp);
+            CU_ASSERT_EQUAL(ret, 0);
+            if (l % 2 == 1) {
+                CU_ASSERT_TRUE(tsk_table_collection_equals(&tables[0], &tables[1], 0));
+                tsk_table_collection_free(&tables[0]);
+                tsk_table_collection_free(&tables[1]);
+            }
+        }
+    }
+    gsl_rng_free(rng);
+    free(samples);
+}
+
+static void
+test_rng_backends(void)
+{
+    int ret;
+    msp_t msp;
+    gsl_rng *rng;
+    uint32_t n = 20;
+    size_t j, k, l;
+    int backends[] = { MSP_RNG_MT19937, MSP_RNG_XOSHIRO256PP, MSP_RNG_PCG64 };
+    size_t sizes[] = { 0, 256 };
+    tsk_table_collection_t tables[2];
+
+    for (j = 0; j < sizeof(backends) / sizeof(*backends); j++) {
+        rng = gsl_rng_alloc(msp_rng_get_type(backends[j]));
+        CU_ASSERT_FATAL(rng != NULL);
+        for (k = 0; k < sizeof(sizes) / sizeof(*sizes); k++) {
+            /* Same seed, same backend must give identical output */
+            for (l = 0; l < 2; l++) {
+                gsl_rng_set(rng, 7);
+                ret = build_sim(&msp, &tables[l], rng, 10, 1, NULL, n);
+                CU_ASSERT_EQUAL_FATAL(ret, 0);
+                CU_ASSERT_EQUAL_FATAL(msp_set_recombination_rate(&msp, 0.1), 0);
+                CU_ASSERT_EQUAL_FATAL(msp_set_gene_conversion_rate(&msp, 0.1), 0);
+                CU_ASSERT_EQUAL_FATAL(msp_set_gene_conversion_tract_length(&msp, 1), 0);
+                ret = msp_set_variate_buffer_size(&msp, sizes[k]);
+                CU_ASSERT_EQUAL_FATAL(ret, 0);
+                ret = msp_initialise(&msp);
+                CU_ASSERT_EQUAL_FATAL(ret, 0);
+                ret = msp_run(&msp, DBL_MAX, ULONG_MAX);
+                CU_ASSERT_EQUAL(ret, 0);
+                msp_verify(&msp, 0);
+                ret = msp_finalise_tables(&msp);
+                CU_ASSERT_EQUAL(ret, 0);
+                ret = msp_free(&msp);
+                CU_ASSERT_EQUAL(ret, 0);
+            }
+            CU_ASSERT_TRUE(tsk_table_collection_equals(&tables[0], &tables[1], 0));
+            tsk_table_collection_free(&tables[0]);
+            tsk_table_collection_free(&tables[1]);
+        }
+        gsl_rng_free(rng);
+    }
+}
+
+static void
+test_rng_counter_based_replicates(void)
+{
+    int ret;
+    msp_t msp;
+    gsl_rng *rng = gsl_rng_alloc(msp_rng_philox);
+    uint32_t j, n = 10;
+    uint32_t num_replicates = 4;
+    tsk_table_collection_t tables, single_tables;
+    tsk_table_collection_t replicates[4];
+
+    CU_ASSERT_FATAL(rng != NULL);
+    /* Run the replicates in sequence using one stream per replicate */
+    gsl_rng_set(rng, 3);
+    ret = build_sim(&msp, &tables, rng, 10, 1, NULL, n);
+    CU_ASSERT_EQUAL_FATAL(ret, 0);
+    CU_ASSERT_EQUAL_FATAL(msp_set_recombination_rate(&msp, 0.5), 0);
+    ret = msp_initialise(&msp);
+    CU_ASSERT_EQUAL_FATAL(ret, 0);
+    for (j = 0; j < num_replicates; j++) {
+        ret = msp_rng_set_stream(rng, j, MSP_RNG_SUBSYSTEM_ANCESTRY, 0);
+        CU_ASSERT_EQUAL_FATAL(ret, 0);
+        ret = msp_run(&msp, DBL_MAX, ULONG_MAX);
+        CU_ASSERT_EQUAL_FATAL(ret, 0);
+        ret = msp_finalise_tables(&msp);
+        CU_ASSERT_EQUAL_FATAL(ret, 0);
+        ret = tsk_table_collection_copy(&tables, &replicates[j], 0);
+        CU_ASSERT_EQUAL_FATAL(ret, 0);
+        ret = msp_reset(&msp);
+        CU_ASSERT_EQUAL_FATAL(ret, 0);
+    }
+    msp_free(&msp);
+    tsk_table_collection_free(&tables);
+
+    /* Each replicate can then be reproduced on its own, in any order */
+    for (j = num_replicates; j > 0; j--) {
+        gsl_rng_set(rng, 3);
+        ret = build_sim(&msp, &single_tables, rng, 10, 1, NULL, n);
+        CU_ASSERT_EQUAL_FATAL(ret, 0);
+        CU_ASSERT_EQUAL_FATAL(msp_set_recombination_rate(&msp, 0.5), 0);
+        ret = msp_initialise(&msp);
+        CU_ASSERT_EQUAL_FATAL(ret, 0);
+        ret = msp_rng_set_stream(rng, j - 1, MSP_RNG_SUBSYSTEM_ANCESTRY, 0);
+        CU_ASSERT_EQUAL_FATAL(ret, 0);
+        ret = msp_run(&msp, DBL_MAX, ULONG_MAX);
+        CU_ASSERT_EQUAL_FATAL(ret, 0);
+        ret = msp_finalise_tables(&msp);
+        CU_ASSERT_EQUAL_FATAL(ret, 0);
+        CU_ASSERT_TRUE(
+            tsk_table_collection_equals(&single_tables, &replicates[j - 1], 0));
+        msp_free(&msp);
+        tsk_table_collection_free(&single_tables);
+    }
+    CU_ASSERT_FALSE(tsk_table_collection_equals(&replicates[0], &replicates[1], 0));
+    for (j = 0; j < num_replicates; j++) {
+        tsk_table_collection_free(&replicates[j]);
+    }
+    gsl_rng_free(rng);
+}
+
+static void
+test_exact_mass_index(void)
+{
+    int ret;
+    msp_t msp;
+    gsl_rng *rng = safe_rng_alloc();
+    uint32_t n = 20;
+    size_t k, l;
+    double position[] = { 0, 2, 7, 10 };
+    double rate[] = { 0.2, 0, 0.05 };
+    tsk_table_collection_t tables[2];
+
+    for (k = 0; k < 4; k++) {
+        /* Run twice with the same seed for each scheduler and genome type */
+        for (l = 0; l < 2; l++) {
+            gsl_rng_set(rng, 11);
+            ret = build_sim(&msp, &tables[l], rng, 10, 1, NULL, n);
+            CU_ASSERT_EQUAL_FATAL(ret, 0);
+            CU_ASSERT_FALSE(msp_get_exact_mass_index(&msp));
+            ret = msp_set_scheduler(
+                &msp, k % 2 == 0 ? MSP_SCHEDULER_DIRECT : MSP_SCHEDULER_NEXT_REACTION);
+            CU_ASSERT_EQUAL_FATAL(ret, 0);
+            CU_ASSERT_EQUAL_FATAL(msp_set_discrete_genome(&msp, k < 2), 0);
+            ret = msp_set_recombination_map(&msp, 3, position, rate);
+            CU_ASSERT_EQUAL_FATAL(ret, 0);
+            CU_ASSERT_EQUAL_FATAL(msp_set_gene_conversion_rate(&msp, 0.1), 0);
+            CU_ASSERT_EQUAL_FATAL(msp_set_gene_conversion_tract_length(&msp, 1), 0);
+            CU_ASSERT_EQUAL_FATAL(msp_set_exact_mass_index(&msp, true), 0);
+            CU_ASSERT_TRUE(msp_get_exact_mass_index(&msp));
+            ret = msp_initialise(&msp);
+            CU_ASSERT_EQUAL_FATAL(ret, 0);
+            CU_ASSERT_EQUAL(msp_set_exact_mass_index(&msp, false), MSP_ERR_BAD_STATE);
+            CU_ASSERT_TRUE(fenwick_is_fixed_point(&msp.recomb_mass_index[0]));
+            CU_ASSERT_TRUE(fenwick_is_fixed_point(&msp.gc_mass_index[0]));
+            CU_ASSERT_EQUAL(msp.recomb_mass_index[0].sibling, &msp.gc_mass_index[0]);
+            ret = msp_run(&msp, DBL_MAX, ULONG_MAX);
+            CU_ASSERT_EQUAL(ret, 0);
+            msp_verify(&msp, 0);
+            msp_print_state(&msp, _devnull);
+            CU_ASSERT_EQUAL(msp.num_fenwick_rebuilds, 0);
+            CU_ASSERT(msp_get_num_breakpoints(&msp) > 0);
+            ret = msp_finalise_tables(&msp);
+            CU_ASSERT_EQUAL(ret, 0);
+            ret = msp_free(&msp);
+            CU_ASSERT_EQUAL(ret, 0);
+        }
+        CU_ASSERT_TRUE(tsk_table_collection_equals(&tables[0], &tables[1], 0));
+        tsk_table_collection_free(&tables[0]);
+        tsk_table_collection_free(&tables[1]);
+    }
+    gsl_rng_free(rng);
+}
+
+typedef struct {
+    size_t num_calls;
+    double last_time;
+    bool time_decreased;
+} progress_counter_t;
+
+static void
+count_progress(double time, size_t MSP_UNUSED(num_ancestors),
+    size_t MSP_UNUSED(num_nodes), size_t MSP_UNUSED(num_edges), void *arg)
+{
+    progress_counter_t *counter = (progress_counter_t *) arg;
+
+    counter->num_calls++;
+    if (time < counter->last_time) {
+        counter->time_decreased = true;
+    }
+    counter->last_time = time;
+}
+
+static void
+test_wall_time_limit(void)
+{
+    int ret;
+    msp_t msp;
+    gsl_rng *rng = safe_rng_alloc();
+    uint32_t n = 50;
+    size_t j, k, num_wall_time_exits;
+    sample_t *samples = malloc(n * sizeof(sample_t));
+    double migration_matrix[] = { 0, 1, 1, 0 };
+    progress_counter_t counter;
+    tsk_table_collection_t tables;
+
+    CU_ASSERT_FATAL(samples != NULL);
+    for (j = 0; j < n; j++) {
+        samples[j].time = 0;
+        samples[j].population = (population_id_t)(j % 2);
+    }
+    /* Hudson with both schedulers, and the DTWF */
+    for (k = 0; k < 3; k++) {
+        ret = build_sim(&msp, &tables, rng, 100, 2, samples, n);
+        CU_ASSERT_EQUAL_FATAL(ret, 0);
+        ret = msp_set_migration_matrix(&msp, 4, migration_matrix);
+        CU_ASSERT_EQUAL_FATAL(ret, 0);
+        CU_ASSERT_EQUAL_FATAL(msp_set_recombination_rate(&msp, 0.1), 0);
+        if (k == 1) {
+            ret = msp_set_scheduler(&msp, MSP_SCHEDULER_NEXT_REACTION);
+            CU_ASSERT_EQUAL_FATAL(ret, 0);
+        }
+        if (k == 2) {
+            ret = msp_set_population_configuration(&msp, 0, 100, 0, true);
+            CU_ASSERT_EQUAL_FATAL(ret, 0);
+            ret = msp_set_population_configuration(&msp, 1, 100, 0, true);
+            CU_ASSERT_EQUAL_FATAL(ret, 0);
+            ret = msp_set_simulation_model_dtwf(&msp);
+            CU_ASSERT_EQUAL_FATAL(ret, 0);
+        }
+        CU_ASSERT_EQUAL(msp_get_wall_time_limit(&msp), DBL_MAX);
+        CU_ASSERT_EQUAL(msp_set_wall_time_limit(&msp, 0), MSP_ERR_BAD_PARAM_VALUE);
+        CU_ASSERT_EQUAL(msp_set_wall_time_limit(&msp, -1), MSP_ERR_BAD_PARAM_VALUE);
+        CU_ASSERT_EQUAL(msp_set_wall_time_limit(&msp, NAN), MSP_ERR_BAD_PARAM_VALUE);
+        CU_ASSERT_EQUAL(msp_get_wall_time_limit(&msp), DBL_MAX);
+        ret = msp_set_progress_callback(&msp, count_progress, -1, &counter);
+        CU_ASSERT_EQUAL(ret, MSP_ERR_BAD_PARAM_VALUE);
+
+        /* A tiny limit means we return every time the clock is checked */
+        ret = msp_set_wall_time_limit(&msp, 1e-300);
+        CU_ASSERT_EQUAL_FATAL(ret, 0);
+        CU_ASSERT_EQUAL(msp_get_wall_time_limit(&msp), 1e-300);
+        memset(&counter, 0, sizeof(counter));
+        ret = msp_set_progress_callback(&msp, count_progress, 0, &counter);
+        CU_ASSERT_EQUAL_FATAL(ret, 0);
+        ret = msp_initialise(&msp);
+        CU_ASSERT_EQUAL_FATAL(ret, 0);
+        num_wall_time_exits = 0;
+        while ((ret = msp_run(&msp, DBL_MAX, ULONG_MAX)) == MSP_EXIT_WALL_TIME) {
+            num_wall_time_exits++;
+            msp_verify(&msp, 0);
+        }
+        CU_ASSERT_EQUAL(ret, 0);
+        CU_ASSERT_TRUE(msp_is_completed(&msp));
+        CU_ASSERT(num_wall_time_exits > 0);
+        CU_ASSERT_EQUAL(counter.num_calls, num_wall_time_exits);
+        CU_ASSERT_FALSE(counter.time_decreased);
+        msp_print_state(&msp, _devnull);
+
+        /* A long interval means the callback is never called, and the
+         * simulation runs to completion in one go. */
+        ret = msp_reset(&msp);
+        CU_ASSERT_EQUAL_FATAL(ret, 0);
+        ret = msp_set_wall_time_limit(&msp, DBL_MAX);
+        CU_ASSERT_EQUAL_FATAL(ret, 0);
+        memset(&counter, 0, sizeof(counter));
+        ret = msp_set_progress_callback(&msp, count_progress, 1e6, &counter);
+        CU_ASSERT_EQUAL_FATAL(ret, 0);
+        ret = msp_run(&msp, DBL_MAX, ULONG_MAX);
+        CU_ASSERT_EQUAL(ret, 0);
+        CU_ASSERT_EQUAL(counter.num_calls, 0);
+        ret = msp_set_progress_callback(&msp, NULL, 0, NULL);
+        CU_ASSERT_EQUAL(ret, 0);
+
+        ret = msp_free(&msp);
+        CU_ASSERT_EQUAL(ret, 0);
+        tsk_table_collection_free(&tables);
+    }
+    gsl_rng_free(rng);
+    free(samples);
+}
+
+static void
+test_memory_limit(void)
+{
+    int ret;
+    msp_t msp;
+    gsl_rng *rng = safe_rng_alloc();
+    uint32_t n = 50;
+    size_t j, k;
+    sample_t *samples = malloc(n * sizeof(sample_t));
+    double migration_matrix[] = { 0, 1, 1, 0 };
+    tsk_table_collection_t tables;
+    tsk_treeseq_t ts;
+
+    CU_ASSERT_FATAL(samples != NULL);
+    for (j = 0; j < n; j++) {
+        samples[j].time = 0;
+        samples[j].population = (population_id_t)(j % 2);
+    }
+    /* Hudson with both schedulers, and the DTWF */
+    for (k = 0; k < 3; k++) {
+        ret = build_sim(&msp, &tables, rng, 100, 2, samples, n);
+        CU_ASSERT_EQUAL_FATAL(ret, 0);
+        ret = msp_set_migration_matrix(&msp, 4, migration_matrix);
+        CU_ASSERT_EQUAL_FATAL(ret, 0);
+        CU_ASSERT_EQUAL_FATAL(msp_set_recombination_rate(&msp, 0.1), 0);
+        CU_ASSERT_EQUAL_FATAL(msp_set_gene_conversion_rate(&msp, 0.1), 0);
+        CU_ASSERT_EQUAL_FATAL(msp_set_gene_conversion_tract_length(&msp, 1), 0);
+        if (k == 1) {
+            ret = msp_set_scheduler(&msp, MSP_SCHEDULER_NEXT_REACTION);
+            CU_ASSERT_EQUAL_FATAL(ret, 0);
+        }
+        if (k == 2) {
+            ret = msp_set_population_configuration(&msp, 0, 100, 0, true);
+            CU_ASSERT_EQUAL_FATAL(ret, 0);
+            ret = msp_set_population_configuration(&msp, 1, 100, 0, true);
+            CU_ASSERT_EQUAL_FATAL(ret, 0);
+            ret = msp_set_simulation_model_dtwf(&msp);
+            CU_ASSERT_EQUAL_FATAL(ret, 0);
+        }
+        CU_ASSERT_EQUAL(msp_get_memory_limit(&msp), 0);
+        ret = msp_initialise(&msp);
+        CU_ASSERT_EQUAL_FATAL(ret, 0);
+
+        /* The caller's table increments are left alone without a limit */
+        CU_ASSERT_EQUAL_FATAL(
+            tsk_node_table_set_max_rows_increment(&tables.nodes, 7), 0);
+        CU_ASSERT_EQUAL_FATAL(
+            tsk_edge_table_set_max_rows_increment(&tables.edges, 8), 0);
+        CU_ASSERT_EQUAL_FATAL(
+            tsk_migration_table_set_max_rows_increment(&tables.migrations, 9), 0);
+        ret = msp_set_memory_limit(&msp, 0);
+        CU_ASSERT_EQUAL_FATAL(ret, 0);
+        CU_ASSERT_EQUAL(tables.nodes.max_rows_increment, 7);
+
+        /* Under a limit the tables grow by a bounded number of rows */
+        ret = msp_set_memory_limit(&msp, 1 << 30);
+        CU_ASSERT_EQUAL_FATAL(ret, 0);
+        CU_ASSERT(tables.nodes.max_rows_increment > 1024);
+        CU_ASSERT(tables.edges.max_rows_increment > 1024);
+        CU_ASSERT(tables.migrations.max_rows_increment > 1024);
+
+        /* The initial state already uses more than this */
+        ret = msp_set_memory_limit(&msp, 1);
+        CU_ASSERT_EQUAL_FATAL(ret, 0);
+        CU_ASSERT_EQUAL(msp_get_memory_limit(&msp), 1);
+        CU_ASSERT_EQUAL(tables.nodes.max_rows_increment, 1024);
+        CU_ASSERT_EQUAL(tables.edges.max_rows_increment, 1024);
+        CU_ASSERT_EQUAL(tables.migrations.max_rows_increment, 1024);
+        ret = msp_run(&msp, DBL_MAX, ULONG_MAX);
+        CU_ASSERT_EQUAL(ret, MSP_EXIT_MEMORY_LIMIT);
+        CU_ASSERT_FALSE(msp_is_completed(&msp));
+        msp_verify(&msp, 0);
+        msp_print_state(&msp, _devnull);
+
+        /* Lifting the limit lets the simulation carry on to completion */
+        ret = msp_set_memory_limit(&msp, 0);
+        CU_ASSERT_EQUAL_FATAL(ret, 0);
+        CU_ASSERT_EQUAL(tables.nodes.max_rows_increment, 7);
+        CU_ASSERT_EQUAL(tables.edges.max_rows_increment, 8);
+        CU_ASSERT_EQUAL(tables.migrations.max_rows_increment, 9);
+        ret = msp_run(&msp, DBL_MAX, ULONG_MAX);
+        CU_ASSERT_EQUAL(ret, 0);
+        CU_ASSERT_TRUE(msp_is_completed(&msp));
+
+        /* Stopping at the limit leaves a valid partial result */
+        ret = msp_reset(&msp);
+        CU_ASSERT_EQUAL_FATAL(ret, 0);
+        ret = msp_run(&msp, DBL_MAX, 10);
+        CU_ASSERT_EQUAL(ret, MSP_EXIT_MAX_EVENTS);
+        ret = msp_set_memory_limit(&msp, 1);
+        CU_ASSERT_EQUAL_FATAL(ret, 0);
+        ret = msp_run(&msp, DBL_MAX, ULONG_MAX);
+        CU_ASSERT_EQUAL(ret, MSP_EXIT_MEMORY_LIMIT);
+        msp_verify(&msp, 0);
+        ret = msp_finalise_tables(&msp);
+        CU_ASSERT_EQUAL_FATAL(ret, 0);
+        ret = tsk_treeseq_init(&ts, &tables, TSK_BUILD_INDEXES);
+        CU_ASSERT_EQUAL_FATAL(ret, 0);
+        CU_ASSERT(tsk_treeseq_get_num_trees(&ts) > 0);
+        tsk_treeseq_free(&ts);
+
+        ret = msp_free(&msp);
+        CU_ASSERT_EQUAL(ret, 0);
+        tsk_table_collection_free(&tables);
+    }
+    gsl_rng_free(rng);
+    free(samples);
+}
+
+static size_t
+sum_memory_usage(size_t *usage)
+{
+    size_t j;
+    size_t total = 0;
+
+    for (j = 0; j < MSP_NUM_MEMORY_CATEGORIES; j++) {
+        total += usage[j];
+    }
+    return total;
+}
+
+static void
+test_memory_usage(void)
+{
+    int ret;
+    msp_t msp;
+    gsl_rng *rng = safe_rng_alloc();
+    uint32_t n = 50;
+    size_t j;
+    size_t current[MSP_NUM_MEMORY_CATEGORIES];
+    size_t peak[MSP_NUM_MEMORY_CATEGORIES];
+    size_t initial_total, initial_tables, peak_total;
+    sample_t *samples = malloc(n * sizeof(sample_t));
+    tsk_table_collection_t tables;
+
+    CU_ASSERT_FATAL(samples != NULL);
+    for (j = 0; j < MSP_NUM_MEMORY_CATEGORIES; j++) {
+        CU_ASSERT_FATAL(msp_get_memory_category_name((int) j) != NULL);
+    }
+    CU_ASSERT_EQUAL(msp_get_memory_category_name(-1), NULL);
+    CU_ASSERT_EQUAL(msp_get_memory_category_name(MSP_NUM_MEMORY_CATEGORIES), NULL);
+
+    memset(samples, 0, n * sizeof(sample_t));
+    ret = build_sim(&msp, &tables, rng, 100, 1, samples, n);
+    CU_ASSERT_EQUAL_FATAL(ret, 0);
+    CU_ASSERT_EQUAL_FATAL(msp_set_recombination_rate(&msp, 1), 0);
+    ret = msp_initialise(&msp);
+    CU_ASSERT_EQUAL_FATAL(ret, 0);
+
+    ret = msp_get_memory_usage(&msp, current, peak);
+    CU_ASSERT_EQUAL_FATAL(ret, 0);
+    for (j = 0; j < MSP_NUM_MEMORY_CATEGORIES; j++) {
+        CU_ASSERT(current[j] <= peak[j]);
+    }
+    CU_ASSERT(current[MSP_MEMORY_SEGMENTS] > 0);
+    CU_ASSERT(current[MSP_MEMORY_FENWICK] > 0);
+    CU_ASSERT(current[MSP_MEMORY_RATE_MAPS] > 0);
+    CU_ASSERT(current[MSP_MEMORY_POPULATIONS] > 0);
+    CU_ASSERT(current[MSP_MEMORY_BREAKPOINTS] > 0);
+    CU_ASSERT(current[MSP_MEMORY_SCRATCH] > 0);
+    initial_total = sum_memory_usage(current);
+    initial_tables = current[MSP_MEMORY_TABLES];
+
+    ret = msp_run(&msp, DBL_MAX, ULONG_MAX);
+    CU_ASSERT_EQUAL_FATAL(ret, 0);
+    ret = msp_get_memory_usage(&msp, current, peak);
+    CU_ASSERT_EQUAL_FATAL(ret, 0);
+    for (j = 0; j < MSP_NUM_MEMORY_CATEGORIES; j++) {
+        CU_ASSERT(current[j] <= peak[j]);
+    }
+    CU_ASSERT(current[MSP_MEMORY_TABLES] > initial_tables);
+    CU_ASSERT(sum_memory_usage(current) > initial_total);
+    peak_total = sum_memory_usage(peak);
+    CU_ASSERT(peak_total >= sum_memory_usage(current));
+
+    /* Peaks are kept across resets */
+    ret = msp_reset(&msp);
+    CU_ASSERT_EQUAL_FATAL(ret, 0);
+    ret = msp_get_memory_usage(&msp, current, peak);
+    CU_ASSERT_EQUAL_FATAL(ret, 0);
+    CU_ASSERT(sum_memory_usage(peak) >= peak_total);
+    msp_print_state(&msp, _devnull);
+
+    ret = msp_free(&msp);
+    CU_ASSERT_EQUAL(ret, 0);
+    tsk_table_collection_free(&tables);
+    gsl_rng_free(rng);
+    free(samples);
+}
+
+static void
+test_trim_memory(void)
+{
+    int ret;
+    msp_t msp;
+    gsl_rng *rng = safe_rng_alloc();
+    uint32_t n = 100;
+    size_t j, num_blocks;
+    size_t current[MSP_NUM_MEMORY_CATEGORIES];
+    size_t peak[MSP_NUM_MEMORY_CATEGORIES];
+    size_t before[MSP_NUM_MEMORY_CATEGORIES];
+    sample_t *samples = malloc(n * sizeof(sample_t));
+    tsk_table_collection_t tables;
+
+    CU_ASSERT_FATAL(samples != NULL);
+    memset(samples, 0, n * sizeof(sample_t));
+    ret = build_sim(&msp, &tables, rng, 100, 1, samples, n);
+    CU_ASSERT_EQUAL_FATAL(ret, 0);
+    CU_ASSERT_EQUAL_FATAL(msp_set_recombination_rate(&msp, 1), 0);
+    CU_ASSERT_EQUAL_FATAL(msp_set_segment_block_size(&msp, 16), 0);
+    CU_ASSERT_EQUAL_FATAL(msp_set_avl_node_block_size(&msp, 16), 0);
+    CU_ASSERT_EQUAL_FATAL(msp_set_node_mapping_block_size(&msp, 16), 0);
+    CU_ASSERT_EQUAL(msp_trim_memory(&msp), MSP_ERR_BAD_STATE);
+    ret = msp_initialise(&msp);
+    CU_ASSERT_EQUAL_FATAL(ret, 0);
+
+    for (j = 0; j < 3; j++) {
+        ret = msp_run(&msp, DBL_MAX, ULONG_MAX);
+        CU_ASSERT_EQUAL_FATAL(ret, 0);
+        msp_verify(&msp, 0);
+        num_blocks = msp_get_num_segment_blocks(&msp);
+        CU_ASSERT(num_blocks > 1);
+
+        /* At the end of the simulation there are no segments in use */
+        ret = msp_get_memory_usage(&msp, before, peak);
+        CU_ASSERT_EQUAL_FATAL(ret, 0);
+        ret = msp_trim_memory(&msp);
+        CU_ASSERT_EQUAL_FATAL(ret, 0);
+        msp_verify(&msp, 0);
+        ret = msp_get_memory_usage(&msp, current, peak);
+        CU_ASSERT_EQUAL_FATAL(ret, 0);
+        CU_ASSERT(msp_get_num_segment_blocks(&msp) < num_blocks);
+        CU_ASSERT(current[MSP_MEMORY_SEGMENTS] < before[MSP_MEMORY_SEGMENTS]);
+        CU_ASSERT(peak[MSP_MEMORY_SEGMENTS] >= before[MSP_MEMORY_SEGMENTS]);
+        msp_print_state(&msp, _devnull);
+
+        /* The released blocks are reused by the next replicate */
+        ret = msp_reset(&msp);
+        CU_ASSERT_EQUAL_FATAL(ret, 0);
+        msp_verify(&msp, 0);
+        ret = msp_trim_memory(&msp);
+        CU_ASSERT_EQUAL_FATAL(ret, 0);
+        msp_verify(&msp, 0);
+    }
+
+    ret = msp_free(&msp);
+    CU_ASSERT_EQUAL(ret, 0);
+    tsk_table_collection_free(&tables);
+    gsl_rng_free(rng);
+    free(samples);
+}
+
+static void
+test_memory_peak(void)
+{
+    int ret;
+    msp_t msp;
+    gsl_rng *rng = safe_rng_alloc();
+    uint32_t n = 100;
+    size_t j, l;
+    size_t current[MSP_NUM_MEMORY_CATEGORIES];
+    size_t peak[2][MSP_NUM_MEMORY_CATEGORIES];
+    tsk_table_collection_t tables;
+
+    /* Compaction shrinks the segment ID maps and mass indexes within a call
+     * to msp_run, so the peaks must be recorded as they grow to match those
+     * sampled after every event. */
+    for (l = 0; l < 2; l++) {
+        gsl_rng_set(rng, 5);
+        ret = build_sim(&msp, &tables, rng, 100, 1, NULL, n);
+        CU_ASSERT_EQUAL_FATAL(ret, 0);
+        CU_ASSERT_EQUAL_FATAL(msp_set_recombination_rate(&msp, 1), 0);
+        CU_ASSERT_EQUAL_FATAL(msp_set_segment_block_size(&msp, 16), 0);
+        CU_ASSERT_EQUAL_FATAL(msp_set_segment_compaction_threshold(&msp, 0.5), 0);
+        ret = msp_initialise(&msp);
+        CU_ASSERT_EQUAL_FATAL(ret, 0);
+        if (l == 0) {
+            ret = msp_run(&msp, DBL_MAX, ULONG_MAX);
+            CU_ASSERT_EQUAL(ret, 0);
+        } else {
+            ret = 1;
+            while (ret > 0) {
+                ret = msp_run(&msp, DBL_MAX, 1);
+                CU_ASSERT_FATAL(ret >= 0);
+                CU_ASSERT_EQUAL_FATAL(msp_get_memory_usage(&msp, current, peak[l]), 0);
+            }
+        }
+        ret = msp_get_memory_usage(&msp, current, peak[l]);
+        CU_ASSERT_EQUAL_FATAL(ret, 0);
+        /* Compaction must have happened for the test to be meaningful */
+        CU_ASSERT(current[MSP_MEMORY_FENWICK] < peak[l][MSP_MEMORY_FENWICK]);
+        ret = msp_free(&msp);
+        CU_ASSERT_EQUAL(ret, 0);
+        tsk_table_collection_free(&tables);
+    }
+    for (j = 0; j < MSP_NUM_MEMORY_CATEGORIES; j++) {
+        if (j != MSP_MEMORY_NODE_MAPPINGS && j != MSP_MEMORY_SCRATCH) {
+            CU_ASSERT_EQUAL(peak[0][j], peak[1][j]);
+        }
+    }
+    gsl_rng_free(rng);
+}
+
+static void
+test_segment_compaction(void)
+{
+    int ret;
+    msp_t msp;
+    gsl_rng *rng = safe_rng_alloc();
+    uint32_t n = 100;
+    size_t l, size[2];
+    double threshold[] = { 0, 0.5 };
+    tsk_table_collection_t tables;
+
+    for (l = 0; l < 2; l++) {
+        gsl_rng_set(rng, 5);
+        ret = build_sim(&msp, &tables, rng, 100, 1, NULL, n);
+        CU_ASSERT_EQUAL_FATAL(ret, 0);
+        CU_ASSERT_EQUAL(msp_get_segment_compaction_threshold(&msp), 0.25);
+        CU_ASSERT_EQUAL(
+            msp_set_segment_compaction_threshold(&msp, -1), MSP_ERR_BAD_PARAM_VALUE);
+        CU_ASSERT_EQUAL(
+            msp_set_segment_compaction_threshold(&msp, 0.6), MSP_ERR_BAD_PARAM_VALUE);
+        CU_ASSERT_EQUAL_FATAL(msp_set_recombination_rate(&msp, 1), 0);
+        CU_ASSERT_EQUAL_FATAL(msp_set_gene_conversion_rate(&msp, 0.1), 0);
+        CU_ASSERT_EQUAL_FATAL(msp_set_gene_conversion_tract_length(&msp, 1), 0);
+        CU_ASSERT_EQUAL_FATAL(msp_set_segment_block_size(&msp, 16), 0);
+        CU_ASSERT_EQUAL_FATAL(
+            msp_set_segment_compaction_threshold(&msp, threshold[l]), 0);
+        CU_ASSERT_EQUAL(msp_get_segment_compaction_threshold(&msp), threshold[l]);
+        ret = msp_initialise(&msp);
+        CU_ASSERT_EQUAL_FATAL(ret, 0);
+        /* Check the state regularly as the number of segments grows and
+         * then shrinks again */
+        ret = 1;
+        while (ret > 0) {
+            ret = msp_run(&msp, DBL_MAX, 500);
+            CU_ASSERT_FATAL(ret >= 0);
+            msp_verify(&msp, 0);
+            CU_ASSERT_EQUAL(msp.segments.size, msp.recomb_mass_index[0].size);
+            CU_ASSERT_EQUAL(msp.segments.size, msp.gc_mass_index[0].size);
+        }
+        msp_print_state(&msp, _devnull);
+        size[l] = msp.segments.size;
+        ret = msp_finalise_tables(&msp);
+        CU_ASSERT_EQUAL(ret, 0);
+        ret = msp_free(&msp);
+        CU_ASSERT_EQUAL(ret, 0);
+        tsk_table_collection_free(&tables);
+    }
+    /* Without compaction the segment pool keeps its peak size */
+    CU_ASSERT(size[1] < size[0]);
+    gsl_rng_free(rng);
+}
+
+static void
+test_huge_pages(void)
+{
+    int ret;
+    msp_t msp;
+    gsl_rng *rng = safe_rng_alloc();
+    uint32_t n = 50;
+    size_t l, num_blocks;
+    tsk_table_collection_t tables[2];
+
+    /* Huge pages change where the memory is, but not the output */
+    for (l = 0; l < 2; l++) {
+        gsl_rng_set(rng, 5);
+        ret = build_sim(&msp, &tables[l], rng, 10, 1, NULL, n);
+        CU_ASSERT_EQUAL_FATAL(ret, 0);
+        CU_ASSERT_FALSE(msp_get_huge_pages(&msp));
+        CU_ASSERT_EQUAL_FATAL(msp_set_recombination_rate(&msp, 0.5), 0);
+        CU_ASSERT_EQUAL_FATAL(msp_set_gene_conversion_rate(&msp, 0.1), 0);
+        CU_ASSERT_EQUAL_FATAL(msp_set_gene_conversion_tract_length(&msp, 1), 0);
+        CU_ASSERT_EQUAL_FATAL(msp_set_segment_block_size(&msp, 16), 0);
+        CU_ASSERT_EQUAL_FATAL(msp_set_avl_node_block_size(&msp, 16), 0);
+        CU_ASSERT_EQUAL_FATAL(msp_set_node_mapping_block_size(&msp, 16), 0);
+        CU_ASSERT_EQUAL_FATAL(msp_set_huge_pages(&msp, l == 1), 0);
+        CU_ASSERT_EQUAL(msp_get_huge_pages(&msp), l == 1);
+        ret = msp_initialise(&msp);
+        CU_ASSERT_EQUAL_FATAL(ret, 0);
+        CU_ASSERT_EQUAL(msp_set_huge_pages(&msp, true), MSP_ERR_BAD_STATE);
+        CU_ASSERT_EQUAL(msp.segments.huge_pages, l == 1);
+        CU_ASSERT_EQUAL(msp.avl_node_heap.huge_pages, l == 1);
+        CU_ASSERT_EQUAL(msp.recomb_mass_index[0].huge_pages, l == 1);
+        CU_ASSERT_EQUAL(msp.gc_mass_index[0].huge_pages, l == 1);
+        ret = msp_run(&msp, DBL_MAX, ULONG_MAX);
+        CU_ASSERT_EQUAL(ret, 0);
+        msp_verify(&msp, 0);
+        msp_print_state(&msp, _devnull);
+        num_blocks = msp_get_num_segment_blocks(&msp);
+        CU_ASSERT(num_blocks > 1);
+        ret = msp_trim_memory(&msp);
+        CU_ASSERT_EQUAL_FATAL(ret, 0);
+        CU_ASSERT(msp_get_num_segment_blocks(&msp) < num_blocks);
+        ret = msp_finalise_tables(&msp);
+        CU_ASSERT_EQUAL(ret, 0);
+        ret = msp_free(&msp);
+        CU_ASSERT_EQUAL(ret, 0);
+    }
+    CU_ASSERT_TRUE(tsk_table_collection_equals(&tables[0], &tables[1], 0));
+    tsk_table_collection_free(&tables[0]);
+    tsk_table_collection_free(&tables[1]);
+    gsl_rng_free(rng);
+}
+
+static void
+test_ancestor_sets(void)
+{
+    int ret;
+    msp_t msp;
+    gsl_rng *rng = safe_rng_alloc();
+    uint32_t n = 30;
+    size_t j, k, num_lineages;
+    segment_id_t u;
+    sample_t *samples = malloc(n * sizeof(sample_t));
+    double migration_matrix[] = { 0, 0.5, 0, 0.5, 0, 0.5, 0, 0.5, 0 };
+    ancestor_set_t *ancestors;
+    tsk_table_collection_t tables;
+
+    CU_ASSERT_FATAL(samples != NULL);
+    for (j = 0; j < n; j++) {
+        samples[j].time = 0;
+        samples[j].population = (population_id_t)(j % 3);
+    }
+    ret = build_sim(&msp, &tables, rng, 10, 3, samples, n);
+    CU_ASSERT_EQUAL_FATAL(ret, 0);
+    ret = msp_set_migration_matrix(&msp, 9, migration_matrix);
+    CU_ASSERT_EQUAL_FATAL(ret, 0);
+    CU_ASSERT_EQUAL_FATAL(msp_set_recombination_rate(&msp, 0.5), 0);
+    CU_ASSERT_EQUAL_FATAL(msp_add_mass_migration(&msp, 0.1, 0, 1, 0.5), 0);
+    CU_ASSERT_EQUAL_FATAL(msp_add_simple_bottleneck(&msp, 0.2, 1, 0.5), 0);
+    CU_ASSERT_EQUAL_FATAL(msp_add_instantaneous_bottleneck(&msp, 0.3, 2, 0.5), 0);
+    CU_ASSERT_EQUAL_FATAL(msp_add_mass_migration(&msp, 0.4, 2, 0, 1.0), 0);
+    ret = msp_initialise(&msp);
+    CU_ASSERT_EQUAL_FATAL(ret, 0);
+
+    /* Lineages are swap-removed from the sets, so check that every
+     * lineage is where its back index says it is after each event. */
+    do {
+        ret = msp_run(&msp, DBL_MAX, 1);
+        CU_ASSERT_FATAL(ret >= 0);
+        msp_verify(&msp, 0);
+        num_lineages = 0;
+        for (j = 0; j < msp.num_populations; j++) {
+            ancestors = &msp.populations[j].ancestors[0];
+            CU_ASSERT_FATAL(ancestors->num_lineages <= ancestors->max_lineages);
+            CU_ASSERT_EQUAL(ancestors->num_lineages,
+                msp_get_num_population_ancestors(&msp, (tsk_id_t) j));
+            for (k = 0; k < ancestors->num_lineages; k++) {
+                u = ancestors->lineages[k];
+                CU_ASSERT_EQUAL(msp.segments.population[u], (population_id_t) j);
+                CU_ASSERT_EQUAL(msp.ancestor_index[u], k);
+            }
+            num_lineages += ancestors->num_lineages;
+        }
+        CU_ASSERT_EQUAL(num_lineages, msp_get_num_ancestors(&msp));
+    } while (ret == MSP_EXIT_MAX_EVENTS);
+    CU_ASSERT_EQUAL(ret, 0);
+    CU_ASSERT_EQUAL(msp_get_num_ancestors(&msp), 0);
+
+    ret = msp_free(&msp);
+    CU_ASSERT_EQUAL(ret, 0);
+    tsk_table_collection_free(&tables);
+    gsl_rng_free(rng);
+    free(samples);
+}
+
+static void
+test_event_trace(void)
+{
+    int ret;
+    msp_t msp;
+    gsl_rng *rng = safe_rng_alloc();
+    uint32_t n = 10;
+    size_t j, k, num_records, num_events, num_edges;
+    size_t counts[MSP_TRACE_FIXED_EVENTS + 1];
+    sample_t *samples = malloc(n * sizeof(sample_t));
+    double migration_matrix[] = { 0, 1, 1, 0 };
+    size_t num_migration_events[4];
+    size_t trace_sizes[] = { 0, 1, 7, 100000 };
+    event_trace_record_t *records = malloc(100000 * sizeof(*records));
+    tsk_table_collection_t tables;
+
+    CU_ASSERT_FATAL(samples != NULL && records != NULL);
+    for (j = 0; j < n; j++) {
+        samples[j].time = 0;
+        samples[j].population = (population_id_t)(j % 2);
+    }
+    for (k = 0; k < sizeof(trace_sizes) / sizeof(*trace_sizes); k++) {
+        ret = build_sim(&msp, &tables, rng, 10, 2, samples, n);
+        CU_ASSERT_EQUAL_FATAL(ret, 0);
+        ret = msp_set_migration_matrix(&msp, 4, migration_matrix);
+        CU_ASSERT_EQUAL_FATAL(ret, 0);
+        CU_ASSERT_EQUAL_FATAL(msp_set_recombination_rate(&msp, 0.1), 0);
+        ret = msp_add_mass_migration(&msp, 0.1, 0, 1, 0.5);
+        CU_ASSERT_EQUAL_FATAL(ret, 0);
+        CU_ASSERT_EQUAL(msp_get_event_trace_size(&msp), 0);
+        ret = msp_set_event_trace_size(&msp, trace_sizes[k]);
+        CU_ASSERT_EQUAL_FATAL(ret, 0);
+        CU_ASSERT_EQUAL(msp_get_event_trace_size(&msp), trace_sizes[k]);
+        ret = msp_initialise(&msp);
+        CU_ASSERT_EQUAL_FATAL(ret, 0);
+        CU_ASSERT_EQUAL(msp_get_num_event_trace_records(&msp), 0);
+        ret = msp_run(&msp, DBL_MAX, ULONG_MAX);
+        CU_ASSERT_EQUAL(ret, 0);
+        msp_verify(&msp, 0);
+        msp_print_state(&msp, _devnull);
+
+        ret = msp_get_num_migration_events(&msp, num_migration_events);
+        CU_ASSERT_EQUAL(ret, 0);
+        num_events = 1 + msp_get_num_common_ancestor_events(&msp)
+                     + msp_get_num_recombination_events(&msp)
+                     + num_migration_events[1] + num_migration_events[2];
+        num_records = msp_get_num_event_trace_records(&msp);
+        CU_ASSERT_EQUAL(num_records, GSL_MIN(num_events, trace_sizes[k]));
+        ret = msp_get_event_trace(&msp, records);
+        CU_ASSERT_EQUAL(ret, 0);
+
+        memset(counts, 0, sizeof(counts));
+        num_edges = 0;
+        for (j = 0; j < num_records; j++) {
+            CU_ASSERT_FATAL(records[j].type >= 0);
+            CU_ASSERT_FATAL(records[j].type <= MSP_TRACE_FIXED_EVENTS);
+            counts[records[j].type]++;
+            num_edges += records[j].num_edges;
+            if (j > 0) {
+                CU_ASSERT(records[j - 1].time <= records[j].time);
+            }
+            if (records[j].type == MSP_TRACE_FIXED_EVENTS) {
+                CU_ASSERT_EQUAL(records[j].time, 0.1);
+                CU_ASSERT_EQUAL(records[j].population, TSK_NULL);
+            } else {
+                CU_ASSERT(records[j].population == 0 || records[j].population == 1);
+                CU_ASSERT_EQUAL(records[j].label, 0);
+            }
+            if (records[j].type == MSP_TRACE_COMMON_ANCESTOR) {
+                CU_ASSERT(records[j].num_edges > 0);
+                CU_ASSERT(records[j].num_segments > 0);
+            }
+        }
+        if (num_records > 0) {
+            CU_ASSERT_EQUAL(records[num_records - 1].type, MSP_TRACE_COMMON_ANCESTOR);
+            CU_ASSERT_EQUAL(records[num_records - 1].time, msp_get_time(&msp));
+        }
+        if (num_records == num_events) {
+            CU_ASSERT_EQUAL(counts[MSP_TRACE_FIXED_EVENTS], 1);
+            CU_ASSERT_EQUAL(counts[MSP_TRACE_COMMON_ANCESTOR],
+                msp_get_num_common_ancestor_events(&msp));
+            CU_ASSERT_EQUAL(counts[MSP_TRACE_RECOMBINATION],
+                msp_get_num_recombination_events(&msp));
+            CU_ASSERT_EQUAL(counts[MSP_TRACE_MIGRATION],
+                num_migration_events[1] + num_migration_events[2]);
+            CU_ASSERT_TRUE(num_edges >= msp_get_num_edges(&msp));
+        }
+
+        ret = msp_reset(&msp);
+        CU_ASSERT_EQUAL(ret, 0);
+        CU_ASSERT_EQUAL(msp_get_num_event_trace_records(&msp), 0);
+        ret = msp_free(&msp);
+        CU_ASSERT_EQUAL(ret, 0);
+        tsk_table_collection_free(&tables);
+    }
+    gsl_rng_free(rng);
+    free(samples);
+    free(records);
+}
+
 static void
 test_single_locus_labels(void)
 {
@@ -1628,6 +2827,12 @@ test_simulator_getters_setters(void)
     CU_ASSERT_EQUAL(ret, 0);
     CU_ASSERT_EQUAL(msp_set_ploidy(&msp, -1), MSP_ERR_BAD_PLOIDY);
     CU_ASSERT_EQUAL(msp_set_ploidy(&msp, 0), MSP_ERR_BAD_PLOIDY);
+    CU_ASSERT_EQUAL(msp_get_scheduler(&msp), MSP_SCHEDULER_DIRECT);
+    CU_ASSERT_EQUAL(msp_set_scheduler(&msp, -1), MSP_ERR_BAD_PARAM_VALUE);
+    CU_ASSERT_EQUAL(msp_set_scheduler(&msp, 2), MSP_ERR_BAD_PARAM_VALUE);
+    CU_ASSERT_FALSE(msp_get_instrumentation(&msp));
+    CU_ASSERT_EQUAL(msp_get_timer_name(-1), NULL);
+    CU_ASSERT_EQUAL(msp_get_timer_name(MSP_NUM_TIMERS), NULL);
     CU_ASSERT_EQUAL(msp_set_num_labels(&msp, 0), MSP_ERR_BAD_PARAM_VALUE);
     CU_ASSERT_EQUAL(msp_set_node_mapping_block_size(&msp, 0), MSP_ERR_BAD_PARAM_VALUE);
     CU_ASSERT_EQUAL(msp_set_segment_block_size(&msp, 0), MSP_ERR_BAD_PARAM_VALUE);
@@ -3521,6 +4726,25 @@ main(int argc, char **argv)
         { "test_single_locus_simulation", test_single_locus_simulation },
         { "test_single_locus_two_populations", test_single_locus_two_populations },
         { "test_single_locus_many_populations", test_single_locus_many_populations },
+        { "test_stepping_stone_event_rates", test_stepping_stone_event_rates },
+        { "test_demographic_events_population_indexes",
+            test_demographic_events_population_indexes },
+        { "test_event_chunk_does_not_change_output",
+            test_event_chunk_does_not_change_output },
+        { "test_instrumentation", test_instrumentation },
+        { "test_event_trace", test_event_trace },
+        { "test_wall_time_limit", test_wall_time_limit },
+        { "test_memory_limit", test_memory_limit },
+        { "test_memory_usage", test_memory_usage },
+        { "test_trim_memory", test_trim_memory },
+        { "test_huge_pages", test_huge_pages },
+        { "test_memory_peak", test_memory_peak },
+        { "test_segment_compaction", test_segment_compaction },
+        { "test_ancestor_sets", test_ancestor_sets },
+        { "test_variate_buffer", test_variate_buffer },
+        { "test_rng_backends", test_rng_backends },
+        { "test_rng_counter_based_replicates", test_rng_counter_based_replicates },
+        { "test_exact_mass_index", test_exact_mass_index },
         { "test_single_locus_labels", test_single_locus_labels },
         { "test_single_locus_historical_sample", test_single_locus_historical_sample },
         { "test_single_locus_all_historical", test_single_locus_all_historical },
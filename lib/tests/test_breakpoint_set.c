@@ -0,0 +1,134 @@
+/*
+** Copyright (C) 2024 University of Oxford
+**
+** This file is part of msprime.
+**
+** msprime is free software: you can redistribute it and/or modify
+** it under the terms of the GNU General Public License as published by
+** the Free Software Foundation, either version 3 of the License, or
+** (at your option) any later version.
+**
+** msprime is distributed in the hope that it will be useful,
+** but WITHOUT ANY WARRANTY; without even the implied warranty of
+** MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+** GNU General Public License for more details.
+**
+** You should have received a copy of the GNU General Public License
+** along with msprime.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "testlib.h"
+
+static void
+test_breakpoint_set_simple(void)
+{
+    int ret;
+    breakpoint_set_t set;
+    double items[4];
+
+    ret = breakpoint_set_init(&set, 2);
+    CU_ASSERT_EQUAL_FATAL(ret, 0);
+    CU_ASSERT_EQUAL(set.size, 4);
+    CU_ASSERT_EQUAL(breakpoint_set_get_num_items(&set), 0);
+    CU_ASSERT_EQUAL(breakpoint_set_get_memory_usage(&set), 4 * sizeof(double));
+    CU_ASSERT_FALSE(breakpoint_set_contains(&set, 1.0));
+    breakpoint_set_verify(&set);
+
+    ret = breakpoint_set_insert(&set, 2.5);
+    CU_ASSERT_EQUAL_FATAL(ret, 0);
+    ret = breakpoint_set_insert(&set, 1.0);
+    CU_ASSERT_EQUAL_FATAL(ret, 0);
+    /* Inserting an existing item does nothing */
+    ret = breakpoint_set_insert(&set, 2.5);
+    CU_ASSERT_EQUAL_FATAL(ret, 0);
+    CU_ASSERT_EQUAL(breakpoint_set_get_num_items(&set), 2);
+    CU_ASSERT_EQUAL(set.size, 4);
+    CU_ASSERT_TRUE(breakpoint_set_contains(&set, 1.0));
+    CU_ASSERT_TRUE(breakpoint_set_contains(&set, 2.5));
+    CU_ASSERT_FALSE(breakpoint_set_contains(&set, 2.0));
+    breakpoint_set_verify(&set);
+    breakpoint_set_print_state(&set, _devnull);
+
+    /* The table doubles to stay at most half full */
+    ret = breakpoint_set_insert(&set, 0.5);
+    CU_ASSERT_EQUAL_FATAL(ret, 0);
+    CU_ASSERT_EQUAL(set.size, 8);
+    CU_ASSERT_EQUAL(breakpoint_set_get_num_items(&set), 3);
+    breakpoint_set_verify(&set);
+    breakpoint_set_get_sorted(&set, items);
+    CU_ASSERT_EQUAL(items[0], 0.5);
+    CU_ASSERT_EQUAL(items[1], 1.0);
+    CU_ASSERT_EQUAL(items[2], 2.5);
+
+    /* 0 and -0 are the same position */
+    ret = breakpoint_set_insert(&set, 0.0);
+    CU_ASSERT_EQUAL_FATAL(ret, 0);
+    CU_ASSERT_TRUE(breakpoint_set_contains(&set, -0.0));
+    ret = breakpoint_set_insert(&set, -0.0);
+    CU_ASSERT_EQUAL_FATAL(ret, 0);
+    CU_ASSERT_EQUAL(breakpoint_set_get_num_items(&set), 4);
+
+    breakpoint_set_clear(&set);
+    CU_ASSERT_EQUAL(breakpoint_set_get_num_items(&set), 0);
+    CU_ASSERT_FALSE(breakpoint_set_contains(&set, 1.0));
+    CU_ASSERT_EQUAL(set.size, 8);
+    breakpoint_set_verify(&set);
+    breakpoint_set_free(&set);
+}
+
+static void
+test_breakpoint_set_many(void)
+{
+    int ret;
+    breakpoint_set_t set;
+    size_t j;
+    size_t n = 10000;
+    double *items = malloc(n * sizeof(*items));
+
+    CU_ASSERT_FATAL(items != NULL);
+    ret = breakpoint_set_init(&set, 1);
+    CU_ASSERT_EQUAL_FATAL(ret, 0);
+    /* Insert the integers and halves, which have similar bit patterns,
+     * in decreasing order and each of them twice. */
+    for (j = n; j > 0; j--) {
+        ret = breakpoint_set_insert(&set, (double) (j - 1) / 2);
+        CU_ASSERT_EQUAL_FATAL(ret, 0);
+        ret = breakpoint_set_insert(&set, (double) (j - 1) / 2);
+        CU_ASSERT_EQUAL_FATAL(ret, 0);
+    }
+    CU_ASSERT_EQUAL(breakpoint_set_get_num_items(&set), n);
+    CU_ASSERT_EQUAL(set.size, 32768);
+    breakpoint_set_verify(&set);
+    for (j = 0; j < n; j++) {
+        CU_ASSERT_TRUE(breakpoint_set_contains(&set, (double) j / 2));
+        CU_ASSERT_FALSE(breakpoint_set_contains(&set, (double) j / 2 + 0.25));
+    }
+    breakpoint_set_get_sorted(&set, items);
+    for (j = 0; j < n; j++) {
+        CU_ASSERT_EQUAL_FATAL(items[j], (double) j / 2);
+    }
+    breakpoint_set_free(&set);
+    free(items);
+}
+
+static void
+test_breakpoint_set_errors(void)
+{
+    breakpoint_set_t set;
+
+    CU_ASSERT_EQUAL(breakpoint_set_init(&set, SIZE_MAX), MSP_ERR_BAD_PARAM_VALUE);
+    breakpoint_set_free(&set);
+}
+
+int
+main(int argc, char **argv)
+{
+    CU_TestInfo tests[] = {
+        { "test_breakpoint_set_simple", test_breakpoint_set_simple },
+        { "test_breakpoint_set_many", test_breakpoint_set_many },
+        { "test_breakpoint_set_errors", test_breakpoint_set_errors },
+        CU_TEST_INFO_NULL,
+    };
+
+    return test_main(tests, argc, argv);
+}
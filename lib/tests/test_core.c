@@ -121,6 +121,389 @@ test_probability_list_select(void)
     }
 }
 
+static void
+test_variate_buffer(void)
+{
+    int ret;
+    size_t j, k, size;
+    size_t sizes[] = { 0, 1, 2, 7, 100 };
+    unsigned long n;
+    double x, y;
+    variate_buffer_t buffer;
+    gsl_rng *rng1 = safe_rng_alloc();
+    gsl_rng *rng2 = safe_rng_alloc();
+
+    for (k = 0; k < sizeof(sizes) / sizeof(*sizes); k++) {
+        size = sizes[k];
+        ret = variate_buffer_alloc(&buffer, rng1, size);
+        CU_ASSERT_EQUAL_FATAL(ret, 0);
+        CU_ASSERT_EQUAL(buffer.size, size);
+
+        /* Uniforms are consumed in the order they are generated */
+        gsl_rng_set(rng1, 1);
+        gsl_rng_set(rng2, 1);
+        for (j = 0; j < 1000; j++) {
+            x = variate_buffer_uniform(&buffer);
+            CU_ASSERT_EQUAL(x, gsl_rng_uniform(rng2));
+        }
+        variate_buffer_clear(&buffer);
+        gsl_rng_set(rng1, 2);
+        gsl_rng_set(rng2, 2);
+        for (j = 0; j < 1000; j++) {
+            x = variate_buffer_flat(&buffer, -1, 5);
+            y = gsl_ran_flat(rng2, -1, 5);
+            CU_ASSERT_EQUAL(x, y);
+            CU_ASSERT(x >= -1 && x < 5);
+        }
+
+        /* Exponentials are generated by inversion */
+        variate_buffer_clear(&buffer);
+        gsl_rng_set(rng1, 3);
+        gsl_rng_set(rng2, 3);
+        for (j = 0; j < 1000; j++) {
+            x = variate_buffer_exponential(&buffer, 2.0);
+            if (size == 0) {
+                y = gsl_ran_exponential(rng2, 2.0);
+            } else {
+                y = -2.0 * log1p(-gsl_rng_uniform(rng2));
+            }
+            CU_ASSERT_EQUAL(x, y);
+            CU_ASSERT(x >= 0);
+        }
+
+        /* Mixing the two streams is reproducible for a given seed */
+        variate_buffer_clear(&buffer);
+        gsl_rng_set(rng1, 4);
+        for (j = 0; j < 1000; j++) {
+            x = j % 3 == 0 ? variate_buffer_exponential(&buffer, 1.0)
+                           : variate_buffer_uniform(&buffer);
+            CU_ASSERT(x >= 0);
+        }
+        y = variate_buffer_uniform(&buffer);
+        variate_buffer_clear(&buffer);
+        gsl_rng_set(rng1, 4);
+        for (j = 0; j < 1000; j++) {
+            x = j % 3 == 0 ? variate_buffer_exponential(&buffer, 1.0)
+                           : variate_buffer_uniform(&buffer);
+        }
+        CU_ASSERT_EQUAL(y, variate_buffer_uniform(&buffer));
+
+        /* Integers are the floor of u * n for buffered uniforms */
+        variate_buffer_clear(&buffer);
+        gsl_rng_set(rng1, 5);
+        gsl_rng_set(rng2, 5);
+        for (j = 0; j < 1000; j++) {
+            n = 1 + j % 17;
+            x = (double) variate_buffer_uniform_int(&buffer, n);
+            if (size == 0) {
+                y = (double) gsl_rng_uniform_int(rng2, n);
+            } else {
+                y = floor(gsl_rng_uniform(rng2) * (double) n);
+            }
+            CU_ASSERT_EQUAL(x, y);
+            CU_ASSERT(x < (double) n);
+        }
+        CU_ASSERT_EQUAL(variate_buffer_uniform_int(&buffer, 1), 0);
+
+        variate_buffer_free(&buffer);
+    }
+    gsl_rng_free(rng1);
+    gsl_rng_free(rng2);
+}
+
+static void
+test_scratch_buffer(void)
+{
+    int ret;
+    scratch_buffer_t buffer;
+    size_t j;
+    size_t sizes[] = { 1, 0, 17, 100, 1000, 5 };
+    unsigned char *p[6];
+    unsigned char *q, *mem;
+
+    ret = scratch_buffer_alloc(&buffer, 100);
+    CU_ASSERT_EQUAL_FATAL(ret, 0);
+    CU_ASSERT_EQUAL(buffer.size, 112);
+    CU_ASSERT_EQUAL(scratch_buffer_get_memory_usage(&buffer), 112);
+    /* Requests are aligned and don't overlap, including those that
+     * overflow the main block */
+    for (j = 0; j < 6; j++) {
+        p[j] = scratch_buffer_get(&buffer, sizes[j]);
+        CU_ASSERT_FATAL(p[j] != NULL);
+        CU_ASSERT_EQUAL((uintptr_t) p[j] % 16, 0);
+        memset(p[j], (int) j, sizes[j]);
+    }
+    for (j = 0; j < 6; j++) {
+        if (sizes[j] > 0) {
+            CU_ASSERT_EQUAL(p[j][0], j);
+            CU_ASSERT_EQUAL(p[j][sizes[j] - 1], j);
+        }
+    }
+    mem = (unsigned char *) buffer.mem;
+    CU_ASSERT(p[3] < mem || p[3] >= mem + buffer.size);
+    CU_ASSERT(p[4] < mem || p[4] >= mem + buffer.size);
+    CU_ASSERT_EQUAL(buffer.high_water_mark, 16 + 0 + 32 + 112 + 1008 + 16);
+    CU_ASSERT(scratch_buffer_get_memory_usage(&buffer) >= buffer.high_water_mark);
+
+    /* After a reset the same requests fit in the main block */
+    scratch_buffer_reset(&buffer);
+    mem = (unsigned char *) buffer.mem;
+    CU_ASSERT_EQUAL(buffer.size, buffer.high_water_mark);
+    CU_ASSERT_EQUAL(scratch_buffer_get_memory_usage(&buffer), buffer.size);
+    for (j = 0; j < 6; j++) {
+        q = scratch_buffer_get(&buffer, sizes[j]);
+        CU_ASSERT_FATAL(q != NULL);
+        CU_ASSERT(q >= mem && q + sizes[j] <= mem + buffer.size);
+    }
+    CU_ASSERT_EQUAL(buffer.offset, buffer.size);
+    CU_ASSERT_EQUAL(scratch_buffer_get_memory_usage(&buffer), buffer.size);
+    CU_ASSERT_EQUAL(scratch_buffer_get(&buffer, SIZE_MAX), NULL);
+    scratch_buffer_free(&buffer);
+
+    CU_ASSERT_EQUAL(scratch_buffer_alloc(&buffer, SIZE_MAX), MSP_ERR_BAD_PARAM_VALUE);
+    scratch_buffer_free(&buffer);
+}
+
+static void
+init_index(void **obj, size_t index)
+{
+    *((size_t *) obj) = index;
+}
+
+static void
+test_huge_alloc(void)
+{
+    size_t j, k, size;
+    size_t sizes[] = { 0, 1, 100, MSP_HUGE_PAGE_SIZE, MSP_HUGE_PAGE_SIZE + 1 };
+    unsigned char *p;
+    bool huge_pages;
+
+    for (k = 0; k < 2; k++) {
+        huge_pages = k == 1;
+        for (j = 0; j < sizeof(sizes) / sizeof(*sizes); j++) {
+            size = sizes[j];
+            CU_ASSERT(msp_huge_get_allocated_size(size, huge_pages) >= size);
+            p = msp_huge_alloc(size, huge_pages);
+            CU_ASSERT_FATAL(p != NULL);
+#ifdef __linux__
+            if (huge_pages) {
+                CU_ASSERT_EQUAL((uintptr_t) p % MSP_HUGE_PAGE_SIZE, 0);
+                CU_ASSERT_EQUAL(
+                    msp_huge_get_allocated_size(size, true) % MSP_HUGE_PAGE_SIZE, 0);
+            }
+#endif
+            if (size > 0) {
+                CU_ASSERT_EQUAL(p[0], 0);
+                CU_ASSERT_EQUAL(p[size - 1], 0);
+                memset(p, 7, size);
+            }
+            /* Contents are kept when growing across a huge page boundary */
+            p = msp_huge_realloc(p, size, size + MSP_HUGE_PAGE_SIZE, huge_pages);
+            CU_ASSERT_FATAL(p != NULL);
+            if (size > 0) {
+                CU_ASSERT_EQUAL(p[0], 7);
+                CU_ASSERT_EQUAL(p[size - 1], 7);
+            }
+            p[size + MSP_HUGE_PAGE_SIZE - 1] = 3;
+            msp_huge_free(p, size + MSP_HUGE_PAGE_SIZE, huge_pages);
+        }
+        msp_huge_free(NULL, 0, huge_pages);
+    }
+}
+
+static void
+test_huge_alloc_growth(void)
+{
+#ifdef __linux__
+    size_t j, size, allocated, last_allocated, num_copies;
+
+    /* Growing an array a page at a time only occasionally needs a larger
+     * reservation, and never reserves much more than is needed */
+    last_allocated = 0;
+    num_copies = 0;
+    for (j = 1; j <= 1024; j++) {
+        size = j * MSP_HUGE_PAGE_SIZE;
+        allocated = msp_huge_get_allocated_size(size, true);
+        CU_ASSERT(allocated >= last_allocated);
+        CU_ASSERT_EQUAL(allocated % MSP_HUGE_PAGE_SIZE, 0);
+        if (j > MSP_HUGE_GROWTH_PAGES) {
+            CU_ASSERT(allocated >= size);
+            CU_ASSERT(4 * allocated <= 5 * size);
+        } else {
+            CU_ASSERT_EQUAL(allocated, size);
+        }
+        if (allocated != last_allocated) {
+            num_copies++;
+        }
+        last_allocated = allocated;
+    }
+    CU_ASSERT(num_copies < 64);
+#endif
+}
+
+static void
+test_object_heap_trim(void)
+{
+    int ret;
+    object_heap_t heap;
+    size_t j, num_released, usage;
+    size_t block_size = 4;
+    size_t n = 5 * block_size;
+    size_t **objects = malloc(n * sizeof(*objects));
+    size_t *kept = NULL;
+
+    CU_ASSERT_FATAL(objects != NULL);
+    ret = object_heap_init(&heap, sizeof(size_t), block_size, init_index, false);
+    CU_ASSERT_EQUAL_FATAL(ret, 0);
+    for (j = 0; j < n; j++) {
+        if (object_heap_empty(&heap)) {
+            ret = object_heap_expand(&heap);
+            CU_ASSERT_EQUAL_FATAL(ret, 0);
+        }
+        objects[j] = object_heap_alloc_object(&heap);
+        CU_ASSERT_FATAL(objects[j] != NULL);
+    }
+    CU_ASSERT_EQUAL(object_heap_get_num_blocks(&heap), 5);
+    CU_ASSERT_EQUAL(object_heap_get_num_allocated(&heap), n);
+    usage = object_heap_get_memory_usage(&heap);
+
+    /* Nothing is free, so nothing can be released */
+    ret = object_heap_trim(&heap, &num_released);
+    CU_ASSERT_EQUAL_FATAL(ret, 0);
+    CU_ASSERT_EQUAL(num_released, 0);
+
+    /* Free all of the objects except one in the second block */
+    for (j = 0; j < n; j++) {
+        if (*objects[j] == block_size + 1) {
+            kept = objects[j];
+        } else {
+            object_heap_free_object(&heap, objects[j]);
+        }
+    }
+    CU_ASSERT_EQUAL(object_heap_get_num_allocated(&heap), 1);
+    ret = object_heap_trim(&heap, &num_released);
+    CU_ASSERT_EQUAL_FATAL(ret, 0);
+    CU_ASSERT_EQUAL(num_released, 4);
+    CU_ASSERT_EQUAL(object_heap_get_num_blocks(&heap), 1);
+    CU_ASSERT_EQUAL(object_heap_get_num_allocated(&heap), 1);
+    CU_ASSERT_EQUAL(
+        object_heap_get_memory_usage(&heap), usage - 4 * block_size * sizeof(size_t));
+    CU_ASSERT_EQUAL(object_heap_get_object(&heap, 0), NULL);
+    CU_ASSERT_FATAL(kept != NULL);
+    CU_ASSERT_EQUAL(object_heap_get_object(&heap, block_size + 1), kept);
+    object_heap_print_state(&heap, _devnull);
+    ret = object_heap_trim(&heap, &num_released);
+    CU_ASSERT_EQUAL_FATAL(ret, 0);
+    CU_ASSERT_EQUAL(num_released, 0);
+
+    /* Released blocks are reused, and the objects keep their indexes */
+    for (j = 0; j < n - 1; j++) {
+        if (object_heap_empty(&heap)) {
+            ret = object_heap_expand(&heap);
+            CU_ASSERT_EQUAL_FATAL(ret, 0);
+        }
+        objects[j] = object_heap_alloc_object(&heap);
+        CU_ASSERT_FATAL(objects[j] != NULL);
+        CU_ASSERT_EQUAL(object_heap_get_object(&heap, *objects[j]), objects[j]);
+    }
+    CU_ASSERT_TRUE(object_heap_empty(&heap));
+    CU_ASSERT_EQUAL(object_heap_get_num_blocks(&heap), 5);
+    CU_ASSERT_EQUAL(heap.num_blocks, 5);
+    CU_ASSERT_EQUAL(object_heap_get_num_allocated(&heap), n);
+    CU_ASSERT_EQUAL(object_heap_get_memory_usage(&heap), usage);
+
+    object_heap_free(&heap);
+    free(objects);
+}
+
+static void
+test_object_heap_huge_pages(void)
+{
+    int ret;
+    object_heap_t heap;
+    size_t j, num_released, usage, arena, num_kept_blocks;
+    size_t block_size = 4;
+    size_t num_blocks = 5;
+    size_t n = num_blocks * block_size;
+    size_t **objects = malloc(n * sizeof(*objects));
+    size_t *kept = NULL;
+
+    CU_ASSERT_FATAL(objects != NULL);
+    ret = object_heap_init(&heap, sizeof(size_t), block_size, init_index, true);
+    CU_ASSERT_EQUAL_FATAL(ret, 0);
+    CU_ASSERT_EQUAL(heap.blocks_per_arena,
+        msp_huge_get_allocated_size(block_size * sizeof(size_t), true)
+            / (block_size * sizeof(size_t)));
+    for (j = 0; j < n; j++) {
+        if (object_heap_empty(&heap)) {
+            ret = object_heap_expand(&heap);
+            CU_ASSERT_EQUAL_FATAL(ret, 0);
+        }
+        objects[j] = object_heap_alloc_object(&heap);
+        CU_ASSERT_FATAL(objects[j] != NULL);
+        CU_ASSERT_EQUAL(object_heap_get_object(&heap, *objects[j]), objects[j]);
+    }
+    /* Blocks in the same arena are contiguous */
+    for (j = 1; j < num_blocks; j++) {
+        if (j % heap.blocks_per_arena != 0) {
+            CU_ASSERT_EQUAL(heap.mem_blocks[j],
+                heap.mem_blocks[j - 1] + block_size * sizeof(size_t));
+        }
+    }
+    CU_ASSERT_EQUAL(heap.num_arenas,
+        (num_blocks + heap.blocks_per_arena - 1) / heap.blocks_per_arena);
+    usage = object_heap_get_memory_usage(&heap);
+    object_heap_print_state(&heap, _devnull);
+
+    /* Keep one object in the second block. Only the arenas that do not
+     * contain it can be released. */
+    for (j = 0; j < n; j++) {
+        if (*objects[j] == block_size + 1) {
+            kept = objects[j];
+        } else {
+            object_heap_free_object(&heap, objects[j]);
+        }
+    }
+    CU_ASSERT_FATAL(kept != NULL);
+    arena = 1 / heap.blocks_per_arena;
+    num_kept_blocks = GSL_MIN((arena + 1) * heap.blocks_per_arena, num_blocks)
+                      - arena * heap.blocks_per_arena;
+    ret = object_heap_trim(&heap, &num_released);
+    CU_ASSERT_EQUAL_FATAL(ret, 0);
+    CU_ASSERT_EQUAL(num_released, num_blocks - num_kept_blocks);
+    CU_ASSERT_EQUAL(object_heap_get_num_blocks(&heap), num_kept_blocks);
+    CU_ASSERT_EQUAL(object_heap_get_num_allocated(&heap), 1);
+    CU_ASSERT_EQUAL(object_heap_get_object(&heap, block_size + 1), kept);
+
+    /* Once everything is free all the arenas are released */
+    object_heap_free_object(&heap, kept);
+    ret = object_heap_trim(&heap, &num_released);
+    CU_ASSERT_EQUAL_FATAL(ret, 0);
+    CU_ASSERT_EQUAL(num_released, num_kept_blocks);
+    CU_ASSERT_EQUAL(object_heap_get_num_blocks(&heap), 0);
+    CU_ASSERT_EQUAL(object_heap_get_num_allocated(&heap), 0);
+    CU_ASSERT_EQUAL(object_heap_get_object(&heap, 0), NULL);
+    CU_ASSERT_TRUE(object_heap_get_memory_usage(&heap) < usage);
+
+    /* Released blocks are reused, and the objects keep their indexes */
+    for (j = 0; j < n; j++) {
+        if (object_heap_empty(&heap)) {
+            ret = object_heap_expand(&heap);
+            CU_ASSERT_EQUAL_FATAL(ret, 0);
+        }
+        objects[j] = object_heap_alloc_object(&heap);
+        CU_ASSERT_FATAL(objects[j] != NULL);
+        CU_ASSERT_EQUAL(object_heap_get_object(&heap, *objects[j]), objects[j]);
+    }
+    CU_ASSERT_TRUE(object_heap_empty(&heap));
+    CU_ASSERT_EQUAL(heap.num_blocks, num_blocks);
+    CU_ASSERT_EQUAL(object_heap_get_num_blocks(&heap), num_blocks);
+    CU_ASSERT_EQUAL(object_heap_get_memory_usage(&heap), usage);
+
+    object_heap_free(&heap);
+    free(objects);
+}
+
 static void
 test_tskit_version(void)
 {
@@ -137,6 +520,12 @@ main(int argc, char **argv)
         { "test_strerror", test_strerror },
         { "test_strerror_tskit", test_strerror_tskit },
         { "test_probability_list_select", test_probability_list_select },
+        { "test_variate_buffer", test_variate_buffer },
+        { "test_scratch_buffer", test_scratch_buffer },
+        { "test_huge_alloc", test_huge_alloc },
+        { "test_huge_alloc_growth", test_huge_alloc_growth },
+        { "test_object_heap_trim", test_object_heap_trim },
+        { "test_object_heap_huge_pages", test_object_heap_huge_pages },
         { "test_tskit_version", test_tskit_version },
         CU_TEST_INFO_NULL,
     };
@@ -192,6 +192,447 @@ test_fenwick_rebuild(void)
     CU_ASSERT(fenwick_free(&t) == 0);
 }
 
+static void
+test_fenwick_fixed_point(void)
+{
+    fenwick_t t;
+    uint64_t s, q;
+    size_t j, n;
+
+    CU_ASSERT_EQUAL(fenwick_alloc_fixed_point(&t, 10, 0), MSP_ERR_BAD_PARAM_VALUE);
+    fenwick_free(&t);
+    CU_ASSERT_EQUAL(fenwick_alloc_fixed_point(&t, 10, -1), MSP_ERR_BAD_PARAM_VALUE);
+    fenwick_free(&t);
+    CU_ASSERT_EQUAL(
+        fenwick_alloc_fixed_point(&t, 10, INFINITY), MSP_ERR_BAD_PARAM_VALUE);
+    fenwick_free(&t);
+
+    for (n = 1; n < 100; n++) {
+        s = 0;
+        CU_ASSERT(fenwick_alloc_fixed_point(&t, n, (double) n) == 0);
+        CU_ASSERT_TRUE(fenwick_is_fixed_point(&t));
+        CU_ASSERT_EQUAL(fenwick_find(&t, 1), 0);
+        for (j = 1; j <= n; j++) {
+            fenwick_increment(&t, j, (double) j);
+            s += fenwick_get_fixed_value(&t, j);
+            CU_ASSERT(fenwick_get_value(&t, j) == j);
+            CU_ASSERT_EQUAL(fenwick_get_fixed_cumulative_sum(&t, j), s);
+            CU_ASSERT_EQUAL(fenwick_get_fixed_total(&t), s);
+            CU_ASSERT(fenwick_get_numerical_drift(&t) == 0.0);
+            CU_ASSERT_EQUAL(fenwick_find_fixed(&t, s), j);
+            CU_ASSERT_EQUAL(fenwick_find(&t, fenwick_get_total(&t)), j);
+            q = fenwick_get_fixed_value(&t, j);
+            CU_ASSERT(q > 0);
+            fenwick_set_value(&t, j, 0);
+            CU_ASSERT(fenwick_get_value(&t, j) == 0);
+            CU_ASSERT_EQUAL(fenwick_get_fixed_cumulative_sum(&t, j), s - q);
+            fenwick_set_value(&t, j, (double) j);
+            CU_ASSERT_EQUAL(fenwick_get_fixed_total(&t), s);
+            CU_ASSERT(fenwick_expand(&t, 1) == 0);
+            CU_ASSERT_EQUAL(fenwick_get_fixed_total(&t), s);
+        }
+        fenwick_verify(&t, 0);
+        fenwick_print_state(&t, _devnull);
+        CU_ASSERT(fenwick_free(&t) == 0);
+    }
+}
+
+static void
+test_fenwick_fixed_point_exact_sums(void)
+{
+    fenwick_t t;
+    size_t n = 1000;
+    size_t j, k, index;
+    double value, sum;
+    uint64_t fixed_sum;
+    gsl_rng *rng = gsl_rng_alloc(gsl_rng_default);
+
+    CU_ASSERT(fenwick_alloc_fixed_point(&t, n, 1.0) == 0);
+    /* Repeatedly set and zero random values. In floating point this
+     * accumulates drift; here the total must come back to exactly zero. */
+    for (k = 0; k < 100; k++) {
+        for (j = 0; j < 10 * n; j++) {
+            index = 1 + gsl_rng_uniform_int(rng, n);
+            value = gsl_rng_uniform(rng);
+            fenwick_set_value(&t, index, value);
+        }
+        CU_ASSERT_FALSE(fenwick_rebuild_required(&t));
+        fixed_sum = 0;
+        sum = 0;
+        for (j = 1; j <= n; j++) {
+            fixed_sum += fenwick_get_fixed_value(&t, j);
+            sum += fenwick_get_value(&t, j);
+        }
+        CU_ASSERT_EQUAL(fixed_sum, fenwick_get_fixed_total(&t));
+        CU_ASSERT_DOUBLE_EQUAL(sum, fenwick_get_total(&t), 1e-6);
+        fenwick_verify(&t, 0);
+        /* Every value in [1, total] maps to an index with nonzero value */
+        for (j = 0; j < 100; j++) {
+            fixed_sum = 1 + gsl_rng_uniform_int(rng, n) * (fixed_sum / n);
+            index = fenwick_find_fixed(&t, fixed_sum);
+            CU_ASSERT_FATAL(index > 0 && index <= n);
+            CU_ASSERT(fenwick_get_fixed_value(&t, index) > 0);
+            CU_ASSERT(fenwick_get_fixed_cumulative_sum(&t, index) >= fixed_sum);
+            if (index > 1) {
+                CU_ASSERT(fenwick_get_fixed_cumulative_sum(&t, index - 1) < fixed_sum);
+            }
+        }
+        for (j = 1; j <= n; j++) {
+            fenwick_set_value(&t, j, 0);
+        }
+        CU_ASSERT_EQUAL(fenwick_get_fixed_total(&t), 0);
+        CU_ASSERT_EQUAL(fenwick_get_total(&t), 0);
+    }
+    fenwick_rebuild(&t);
+    CU_ASSERT_EQUAL(fenwick_get_fixed_total(&t), 0);
+
+    fenwick_free(&t);
+    gsl_rng_free(rng);
+}
+
+static void
+test_fenwick_fixed_point_limits(void)
+{
+    fenwick_t t;
+    size_t n = 10;
+    size_t j;
+    /* With a max_value of 1 the scale is 2^39, so this is 2^62 */
+    double big = 0x1p23;
+
+    CU_ASSERT_FATAL(fenwick_alloc_fixed_point(&t, n, 1) == 0);
+    /* Values far below the resolution are still found */
+    fenwick_set_value(&t, 5, 1e-30);
+    CU_ASSERT_EQUAL(fenwick_get_fixed_value(&t, 5), 1);
+    CU_ASSERT_EQUAL(fenwick_get_fixed_total(&t), 1);
+    CU_ASSERT_EQUAL(fenwick_find(&t, 0), 5);
+    CU_ASSERT_EQUAL(fenwick_find(&t, 1), 5);
+    fenwick_set_value(&t, 5, 0);
+    CU_ASSERT_EQUAL(fenwick_get_fixed_total(&t), 0);
+
+    /* The total overflows when it reaches 2^64 */
+    for (j = 1; j <= 3; j++) {
+        fenwick_set_value(&t, j, big);
+        CU_ASSERT_FALSE(fenwick_fixed_point_overflowed(&t));
+    }
+    fenwick_set_value(&t, 4, big);
+    CU_ASSERT_TRUE(fenwick_fixed_point_overflowed(&t));
+    /* The overflow is remembered until the tree is rebuilt */
+    fenwick_set_value(&t, 4, 0);
+    CU_ASSERT_TRUE(fenwick_fixed_point_overflowed(&t));
+    fenwick_rebuild(&t);
+    CU_ASSERT_FALSE(fenwick_fixed_point_overflowed(&t));
+    CU_ASSERT_EQUAL(fenwick_get_fixed_total(&t), 3 * (UINT64_C(1) << 62));
+    fenwick_verify(&t, 0);
+
+    /* Values too large to represent saturate and overflow */
+    fenwick_set_value(&t, 4, 1e30);
+    CU_ASSERT_TRUE(fenwick_fixed_point_overflowed(&t));
+    for (j = 1; j <= n; j++) {
+        fenwick_set_value(&t, j, 0);
+    }
+    fenwick_rebuild(&t);
+    CU_ASSERT_FALSE(fenwick_fixed_point_overflowed(&t));
+    CU_ASSERT_EQUAL(fenwick_get_fixed_total(&t), 0);
+    fenwick_free(&t);
+}
+
+static void
+verify_interleaved_fenwick(fenwick_t *a, fenwick_t *b, fenwick_t *ref)
+{
+    size_t j;
+    fenwick_t *t[] = { a, b };
+
+    for (j = 0; j < 2; j++) {
+        fenwick_verify(t[j], 1e-9);
+        CU_ASSERT_EQUAL_FATAL(fenwick_get_size(t[j]), fenwick_get_size(&ref[j]));
+        CU_ASSERT_DOUBLE_EQUAL(
+            fenwick_get_total(t[j]), fenwick_get_total(&ref[j]), 1e-9);
+        if (fenwick_is_fixed_point(t[j])) {
+            CU_ASSERT_EQUAL(
+                fenwick_get_fixed_total(t[j]), fenwick_get_fixed_total(&ref[j]));
+        }
+    }
+    for (j = 1; j <= fenwick_get_size(a); j++) {
+        CU_ASSERT_EQUAL(fenwick_get_value(a, j), fenwick_get_value(&ref[0], j));
+        CU_ASSERT_EQUAL(fenwick_get_value(b, j), fenwick_get_value(&ref[1], j));
+        CU_ASSERT_DOUBLE_EQUAL(fenwick_get_cumulative_sum(a, j),
+            fenwick_get_cumulative_sum(&ref[0], j), 1e-9);
+        CU_ASSERT_DOUBLE_EQUAL(fenwick_get_cumulative_sum(b, j),
+            fenwick_get_cumulative_sum(&ref[1], j), 1e-9);
+    }
+}
+
+static void
+test_fenwick_interleave(void)
+{
+    fenwick_t a, b, ref[2];
+    size_t n = 50;
+    size_t j, k, mode, index;
+    double x, y;
+    gsl_rng *rng = gsl_rng_alloc(gsl_rng_default);
+
+    /* The trees must have the same size and mode */
+    CU_ASSERT_FATAL(fenwick_alloc(&a, n) == 0);
+    CU_ASSERT_FATAL(fenwick_alloc(&b, n + 1) == 0);
+    CU_ASSERT_EQUAL(fenwick_interleave(&a, &b), MSP_ERR_BAD_PARAM_VALUE);
+    fenwick_free(&b);
+    CU_ASSERT_FATAL(fenwick_alloc_fixed_point(&b, n, 1) == 0);
+    CU_ASSERT_EQUAL(fenwick_interleave(&a, &b), MSP_ERR_BAD_PARAM_VALUE);
+    fenwick_free(&b);
+    CU_ASSERT_FATAL(fenwick_alloc(&b, n) == 0);
+    CU_ASSERT_FATAL(fenwick_use_huge_pages(&b) == 0);
+    CU_ASSERT_EQUAL(fenwick_interleave(&a, &b), MSP_ERR_BAD_PARAM_VALUE);
+    fenwick_free(&a);
+    fenwick_free(&b);
+
+    /* Modes 2 and 3 repeat 0 and 1 with the interleaved arrays in huge pages */
+    for (mode = 0; mode < 4; mode++) {
+        if (mode % 2 == 0) {
+            CU_ASSERT_FATAL(fenwick_alloc(&a, n) == 0);
+            CU_ASSERT_FATAL(fenwick_alloc(&b, n) == 0);
+            CU_ASSERT_FATAL(fenwick_alloc(&ref[0], n) == 0);
+            CU_ASSERT_FATAL(fenwick_alloc(&ref[1], n) == 0);
+        } else {
+            CU_ASSERT_FATAL(fenwick_alloc_fixed_point(&a, n, 1) == 0);
+            CU_ASSERT_FATAL(fenwick_alloc_fixed_point(&b, n, 2) == 0);
+            CU_ASSERT_FATAL(fenwick_alloc_fixed_point(&ref[0], n, 1) == 0);
+            CU_ASSERT_FATAL(fenwick_alloc_fixed_point(&ref[1], n, 2) == 0);
+        }
+        if (mode >= 2) {
+            CU_ASSERT_FATAL(fenwick_use_huge_pages(&a) == 0);
+            CU_ASSERT_FATAL(fenwick_use_huge_pages(&b) == 0);
+        }
+        /* Values set before interleaving are kept */
+        for (j = 1; j <= n; j += 2) {
+            fenwick_set_value(&a, j, 0.5);
+            fenwick_set_value(&ref[0], j, 0.5);
+        }
+        CU_ASSERT_EQUAL_FATAL(fenwick_interleave(&a, &b), 0);
+        CU_ASSERT_EQUAL(fenwick_interleave(&a, &b), MSP_ERR_BAD_PARAM_VALUE);
+        CU_ASSERT_EQUAL(fenwick_use_huge_pages(&a), MSP_ERR_BAD_PARAM_VALUE);
+        fenwick_print_state(&b, _devnull);
+        verify_interleaved_fenwick(&a, &b, ref);
+
+        for (k = 0; k < 3; k++) {
+            for (j = 0; j < 1000; j++) {
+                index = 1 + gsl_rng_uniform_int(rng, fenwick_get_size(&a));
+                x = gsl_rng_uniform(rng);
+                y = 2 * gsl_rng_uniform(rng);
+                if (j % 4 == 0) {
+                    fenwick_set_value(&b, index, y);
+                    fenwick_set_value(&ref[1], index, y);
+                } else if (j % 4 == 1) {
+                    fenwick_set_value_pair(&a, index, 0, 0);
+                    fenwick_set_value(&ref[0], index, 0);
+                    fenwick_set_value(&ref[1], index, 0);
+                } else {
+                    fenwick_set_value_pair(&a, index, x, y);
+                    fenwick_set_value(&ref[0], index, x);
+                    fenwick_set_value(&ref[1], index, y);
+                }
+            }
+            verify_interleaved_fenwick(&a, &b, ref);
+            x = fenwick_get_total(&b) / 3;
+            CU_ASSERT_EQUAL(fenwick_find(&b, x), fenwick_find(&ref[1], x));
+            fenwick_rebuild(&b);
+            fenwick_rebuild(&ref[1]);
+            verify_interleaved_fenwick(&a, &b, ref);
+
+            /* Expanding the first tree expands both */
+            CU_ASSERT_EQUAL_FATAL(fenwick_expand(&a, 7), 0);
+            CU_ASSERT_EQUAL_FATAL(fenwick_expand(&ref[0], 7), 0);
+            CU_ASSERT_EQUAL_FATAL(fenwick_expand(&ref[1], 7), 0);
+            verify_interleaved_fenwick(&a, &b, ref);
+        }
+        fenwick_print_state(&a, _devnull);
+        fenwick_free(&a);
+        fenwick_free(&b);
+        fenwick_free(&ref[0]);
+        fenwick_free(&ref[1]);
+    }
+    gsl_rng_free(rng);
+}
+
+static void
+test_fenwick_shrink(void)
+{
+    fenwick_t a, b;
+    fenwick_t *t[2] = { &a, &b };
+    size_t n = 100;
+    size_t new_size = 20;
+    uint32_t old_index[21];
+    size_t j, k, mode;
+    double value, total;
+
+    /* Modes 2 and 3 repeat 0 and 1 with interleaved trees */
+    for (mode = 0; mode < 4; mode++) {
+        if (mode % 2 == 0) {
+            CU_ASSERT_FATAL(fenwick_alloc(&a, n) == 0);
+            CU_ASSERT_FATAL(fenwick_alloc(&b, n) == 0);
+        } else {
+            CU_ASSERT_FATAL(fenwick_alloc_fixed_point(&a, n, 1) == 0);
+            CU_ASSERT_FATAL(fenwick_alloc_fixed_point(&b, n, 2) == 0);
+        }
+        if (mode >= 2) {
+            CU_ASSERT_EQUAL_FATAL(fenwick_interleave(&a, &b), 0);
+        }
+        for (j = 1; j <= n; j++) {
+            fenwick_set_value(&a, j, (double) j / (double) n);
+            fenwick_set_value(&b, j, 2 - (double) j / (double) n);
+        }
+        /* Move every fifth value in reverse order, leaving the last
+         * indexes empty */
+        old_index[0] = 0;
+        for (j = 1; j <= new_size; j++) {
+            old_index[j] = j <= 15 ? (uint32_t)(n - 5 * (j - 1)) : 0;
+        }
+        CU_ASSERT_EQUAL_FATAL(fenwick_shrink(&a, new_size, old_index), 0);
+        if (mode < 2) {
+            CU_ASSERT_EQUAL_FATAL(fenwick_shrink(&b, new_size, old_index), 0);
+        }
+        for (k = 0; k < 2; k++) {
+            fenwick_verify(t[k], 1e-9);
+            CU_ASSERT_EQUAL(fenwick_get_size(t[k]), new_size);
+            total = 0;
+            for (j = 1; j <= new_size; j++) {
+                value = 0;
+                if (old_index[j] != 0) {
+                    value = (double) old_index[j] / (double) n;
+                    value = k == 0 ? value : 2 - value;
+                }
+                CU_ASSERT_EQUAL(fenwick_get_value(t[k], j), value);
+                total += value;
+            }
+            CU_ASSERT_DOUBLE_EQUAL(fenwick_get_total(t[k]), total, 1e-9);
+            CU_ASSERT_EQUAL(fenwick_find(t[k], total), 15);
+        }
+        /* The shrunk tree can grow again */
+        CU_ASSERT_EQUAL_FATAL(fenwick_expand(&a, 5), 0);
+        if (mode < 2) {
+            CU_ASSERT_EQUAL_FATAL(fenwick_expand(&b, 5), 0);
+        }
+        fenwick_set_value(&b, new_size + 5, 1);
+        for (k = 0; k < 2; k++) {
+            CU_ASSERT_EQUAL(fenwick_get_size(t[k]), new_size + 5);
+            fenwick_verify(t[k], 1e-9);
+        }
+        fenwick_free(&a);
+        fenwick_free(&b);
+    }
+}
+
+static void
+test_fenwick_find_with_prefix(void)
+{
+    fenwick_t a, b;
+    fenwick_t *t;
+    size_t n = 1000;
+    size_t j, mode, index;
+    double x, prefix, value;
+    uint64_t fixed_prefix;
+
+    for (mode = 0; mode < 4; mode++) {
+        if (mode % 2 == 0) {
+            CU_ASSERT_FATAL(fenwick_alloc(&a, n) == 0);
+            CU_ASSERT_FATAL(fenwick_alloc(&b, n) == 0);
+        } else {
+            CU_ASSERT_FATAL(fenwick_alloc_fixed_point(&a, n, 1) == 0);
+            CU_ASSERT_FATAL(fenwick_alloc_fixed_point(&b, n, 1) == 0);
+        }
+        if (mode >= 2) {
+            CU_ASSERT_FATAL(fenwick_interleave(&a, &b) == 0);
+        }
+        t = mode >= 2 ? &b : &a;
+        /* All zeros */
+        CU_ASSERT_EQUAL(fenwick_find_with_prefix(t, 1, &prefix, &value), 0);
+        CU_ASSERT_EQUAL(prefix, 0);
+        CU_ASSERT_EQUAL(value, 0);
+        /* Runs of zeros, including trailing zeros */
+        for (j = 1; j < n - 10; j++) {
+            fenwick_set_value(t, j, j % 7 < 3 ? 0 : 1.0 / (double) j);
+        }
+        for (x = 0; x <= fenwick_get_total(t) + 0.5; x += 0.01) {
+            index = fenwick_find_with_prefix(t, x, &prefix, &value);
+            CU_ASSERT_EQUAL_FATAL(index, fenwick_find(t, x));
+            CU_ASSERT_FATAL(index > 0);
+            CU_ASSERT_EQUAL(value, fenwick_get_value(t, index));
+            CU_ASSERT(value > 0);
+            CU_ASSERT_DOUBLE_EQUAL(
+                prefix, fenwick_get_cumulative_sum(t, index) - value, 1e-9);
+            if (fenwick_is_fixed_point(t)) {
+                CU_ASSERT_EQUAL(prefix * t->fixed_scale,
+                    (double) (fenwick_get_fixed_cumulative_sum(t, index)
+                              - fenwick_get_fixed_value(t, index)));
+            }
+        }
+        /* The first and last nonzero values are at 3 and 986 */
+        CU_ASSERT_EQUAL(fenwick_find_with_prefix(t, 0, &prefix, &value), 3);
+        CU_ASSERT_EQUAL(prefix, 0);
+        CU_ASSERT_EQUAL(
+            fenwick_find_with_prefix(t, 2 * fenwick_get_total(t), &prefix, &value), 986);
+        CU_ASSERT_DOUBLE_EQUAL(prefix + value, fenwick_get_total(t), 1e-9);
+        if (fenwick_is_fixed_point(t)) {
+            CU_ASSERT_EQUAL(fenwick_find_fixed_with_prefix(t, 1, &fixed_prefix), 3);
+            CU_ASSERT_EQUAL(fixed_prefix, 0);
+            index = fenwick_find_fixed_with_prefix(
+                t, fenwick_get_fixed_total(t), &fixed_prefix);
+            CU_ASSERT_EQUAL(index, 986);
+            CU_ASSERT_EQUAL(fixed_prefix + fenwick_get_fixed_value(t, index),
+                fenwick_get_fixed_total(t));
+        }
+        fenwick_free(&a);
+        fenwick_free(&b);
+    }
+}
+
+static void
+test_fenwick_huge_pages(void)
+{
+    fenwick_t t, ref;
+    size_t n = 100;
+    size_t increment = MSP_HUGE_PAGE_SIZE / sizeof(double);
+    size_t j, k, mode;
+
+    for (mode = 0; mode < 2; mode++) {
+        if (mode == 0) {
+            CU_ASSERT_FATAL(fenwick_alloc(&t, n) == 0);
+            CU_ASSERT_FATAL(fenwick_alloc(&ref, n) == 0);
+        } else {
+            CU_ASSERT_FATAL(fenwick_alloc_fixed_point(&t, n, 1) == 0);
+            CU_ASSERT_FATAL(fenwick_alloc_fixed_point(&ref, n, 1) == 0);
+        }
+        CU_ASSERT_FALSE(t.huge_pages);
+        for (j = 1; j <= n; j++) {
+            fenwick_set_value(&t, j, 1.0 / (double) j);
+            fenwick_set_value(&ref, j, 1.0 / (double) j);
+        }
+        CU_ASSERT_EQUAL_FATAL(fenwick_use_huge_pages(&t), 0);
+        CU_ASSERT_TRUE(t.huge_pages);
+        CU_ASSERT_EQUAL_FATAL(fenwick_use_huge_pages(&t), 0);
+        CU_ASSERT_EQUAL(fenwick_get_memory_usage(&t),
+            2 * msp_huge_get_allocated_size((n + 1) * sizeof(double), true));
+
+        /* Expand past the end of the first huge page */
+        for (k = 0; k < 2; k++) {
+            CU_ASSERT_EQUAL_FATAL(fenwick_expand(&t, increment), 0);
+            CU_ASSERT_EQUAL_FATAL(fenwick_expand(&ref, increment), 0);
+            fenwick_set_value(&t, fenwick_get_size(&t), 0.25);
+            fenwick_set_value(&ref, fenwick_get_size(&ref), 0.25);
+        }
+        fenwick_verify(&t, 1e-9);
+        CU_ASSERT_EQUAL_FATAL(fenwick_get_size(&t), fenwick_get_size(&ref));
+        for (j = 1; j <= fenwick_get_size(&t); j += 997) {
+            CU_ASSERT_EQUAL(fenwick_get_value(&t, j), fenwick_get_value(&ref, j));
+            CU_ASSERT_EQUAL(fenwick_get_cumulative_sum(&t, j),
+                fenwick_get_cumulative_sum(&ref, j));
+        }
+        CU_ASSERT_EQUAL(fenwick_get_total(&t), fenwick_get_total(&ref));
+        CU_ASSERT_EQUAL(fenwick_find(&t, 2.0), fenwick_find(&ref, 2.0));
+        fenwick_free(&t);
+        fenwick_free(&ref);
+    }
+}
+
 int
 main(int argc, char **argv)
 {
@@ -201,6 +642,13 @@ main(int argc, char **argv)
         { "test_fenwick_zero_values", test_fenwick_zero_values },
         { "test_fenwick_drift", test_fenwick_drift },
         { "test_fenwick_rebuild", test_fenwick_rebuild },
+        { "test_fenwick_fixed_point", test_fenwick_fixed_point },
+        { "test_fenwick_fixed_point_exact_sums", test_fenwick_fixed_point_exact_sums },
+        { "test_fenwick_fixed_point_limits", test_fenwick_fixed_point_limits },
+        { "test_fenwick_interleave", test_fenwick_interleave },
+        { "test_fenwick_huge_pages", test_fenwick_huge_pages },
+        { "test_fenwick_shrink", test_fenwick_shrink },
+        { "test_fenwick_find_with_prefix", test_fenwick_find_with_prefix },
         CU_TEST_INFO_NULL,
     };
 
@@ -327,6 +327,70 @@ test_single_tree_mutgen(void)
     gsl_rng_free(rng);
 }
 
+static void
+test_single_tree_mutgen_variate_buffer(void)
+{
+    int ret = 0;
+    size_t j, k;
+    size_t sizes[] = { 1, 16, 1000 };
+    gsl_rng *rng = gsl_rng_alloc(gsl_rng_default);
+    tsk_table_collection_t tables1, tables2;
+    mutation_model_t mut_model;
+    mutgen_t mutgen;
+
+    CU_ASSERT_FATAL(rng != NULL);
+    ret = tsk_table_collection_init(&tables1, 0);
+    CU_ASSERT_EQUAL_FATAL(ret, 0);
+    ret = tsk_table_collection_init(&tables2, 0);
+    CU_ASSERT_EQUAL_FATAL(ret, 0);
+    insert_single_tree(&tables1, ALPHABET_BINARY);
+    insert_single_tree(&tables2, ALPHABET_BINARY);
+    ret = matrix_mutation_model_factory(&mut_model, ALPHABET_BINARY);
+    CU_ASSERT_EQUAL_FATAL(ret, 0);
+
+    for (k = 0; k < sizeof(sizes) / sizeof(*sizes); k++) {
+        ret = mutgen_alloc(&mutgen, rng, &tables1, &mut_model, 0);
+        CU_ASSERT_EQUAL_FATAL(ret, 0);
+        ret = mutgen_set_variate_buffer_size(&mutgen, sizes[k]);
+        CU_ASSERT_EQUAL_FATAL(ret, 0);
+        ret = mutgen_set_rate(&mutgen, 10);
+        CU_ASSERT_EQUAL_FATAL(ret, 0);
+        gsl_rng_set(rng, 1);
+        ret = mutgen_generate(&mutgen, 0);
+        CU_ASSERT_EQUAL_FATAL(ret, 0);
+        mutgen_print_state(&mutgen, _devnull);
+        CU_ASSERT_TRUE(tables1.mutations.num_rows > 0);
+        for (j = 0; j < tables1.mutations.num_rows; j++) {
+            CU_ASSERT_TRUE(tables1.mutations.time[j] >= 0.0);
+            CU_ASSERT_TRUE(tables1.sites.position[j] <= 1.0);
+        }
+        ret = mutgen_free(&mutgen);
+        CU_ASSERT_EQUAL_FATAL(ret, 0);
+
+        /* The same seed and buffer size give the same mutations, even
+         * if values were left in the buffer by an earlier call. */
+        ret = mutgen_alloc(&mutgen, rng, &tables2, &mut_model, 0);
+        CU_ASSERT_EQUAL_FATAL(ret, 0);
+        ret = mutgen_set_variate_buffer_size(&mutgen, sizes[k]);
+        CU_ASSERT_EQUAL_FATAL(ret, 0);
+        ret = mutgen_set_rate(&mutgen, 10);
+        CU_ASSERT_EQUAL_FATAL(ret, 0);
+        ret = mutgen_generate(&mutgen, 0);
+        CU_ASSERT_EQUAL_FATAL(ret, 0);
+        gsl_rng_set(rng, 1);
+        ret = mutgen_generate(&mutgen, 0);
+        CU_ASSERT_EQUAL_FATAL(ret, 0);
+        CU_ASSERT_TRUE(tsk_table_collection_equals(&tables1, &tables2, 0));
+        ret = mutgen_free(&mutgen);
+        CU_ASSERT_EQUAL_FATAL(ret, 0);
+    }
+
+    tsk_table_collection_free(&tables1);
+    tsk_table_collection_free(&tables2);
+    mutation_model_free(&mut_model);
+    gsl_rng_free(rng);
+}
+
 static void
 test_single_tree_mutgen_keep_sites(void)
 {
@@ -1314,6 +1378,8 @@ main(int argc, char **argv)
         { "test_mutgen_errors", test_mutgen_errors },
         { "test_mutgen_backwards_mutation_order", test_mutgen_backwards_mutation_order },
         { "test_single_tree_mutgen", test_single_tree_mutgen },
+        { "test_single_tree_mutgen_variate_buffer",
+            test_single_tree_mutgen_variate_buffer },
         { "test_single_tree_mutgen_keep_sites", test_single_tree_mutgen_keep_sites },
         { "test_single_tree_mutgen_discrete_sites",
             test_single_tree_mutgen_discrete_sites },
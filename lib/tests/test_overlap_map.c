@@ -0,0 +1,252 @@
+/*
+** Copyright (C) 2024 University of Oxford
+**
+** This file is part of msprime.
+**
+** msprime is free software: you can redistribute it and/or modify
+** it under the terms of the GNU General Public License as published by
+** the Free Software Foundation, either version 3 of the License, or
+** (at your option) any later version.
+**
+** msprime is distributed in the hope that it will be useful,
+** but WITHOUT ANY WARRANTY; without even the implied warranty of
+** MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+** GNU General Public License for more details.
+**
+** You should have received a copy of the GNU General Public License
+** along with msprime.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "testlib.h"
+
+/* Checks that the items in the map are the specified positions and counts */
+static void
+verify_items(overlap_map_t *map, size_t n, double *position, uint32_t *count)
+{
+    overlap_map_cursor_t cursor;
+    bool more;
+    size_t j;
+
+    overlap_map_verify(map);
+    CU_ASSERT_EQUAL_FATAL(overlap_map_get_num_items(map), n);
+    more = overlap_map_first(map, &cursor);
+    for (j = 0; j < n; j++) {
+        CU_ASSERT_FATAL(more);
+        CU_ASSERT_EQUAL(overlap_map_get_position(map, &cursor), position[j]);
+        CU_ASSERT_EQUAL(overlap_map_get_count(map, &cursor), count[j]);
+        more = overlap_map_next(map, &cursor);
+    }
+    CU_ASSERT_FALSE(more);
+}
+
+static void
+test_overlap_map_simple(void)
+{
+    int ret;
+    overlap_map_t map;
+    overlap_map_cursor_t cursor;
+    double position[] = { 0, 1, 2.5, 4, 10 };
+    uint32_t count[] = { 3, 2, 2, 3, 0 };
+
+    ret = overlap_map_init(&map);
+    CU_ASSERT_EQUAL_FATAL(ret, 0);
+    CU_ASSERT_FALSE(overlap_map_first(&map, &cursor));
+    CU_ASSERT_FALSE(overlap_map_find(&map, 0, &cursor));
+    verify_items(&map, 0, NULL, NULL);
+
+    ret = overlap_map_insert(&map, 0, 3);
+    CU_ASSERT_EQUAL_FATAL(ret, 0);
+    ret = overlap_map_insert(&map, 10, 0);
+    CU_ASSERT_EQUAL_FATAL(ret, 0);
+    ret = overlap_map_insert(&map, 4, 3);
+    CU_ASSERT_EQUAL_FATAL(ret, 0);
+    /* A split takes the count that applies at the position */
+    CU_ASSERT_TRUE(overlap_map_first(&map, &cursor));
+    ret = overlap_map_split(&map, 1, &cursor);
+    CU_ASSERT_EQUAL_FATAL(ret, 0);
+    CU_ASSERT_EQUAL(overlap_map_get_position(&map, &cursor), 1);
+    overlap_map_set_count(&map, &cursor, 2);
+    ret = overlap_map_split(&map, 2.5, &cursor);
+    CU_ASSERT_EQUAL_FATAL(ret, 0);
+    CU_ASSERT_EQUAL(overlap_map_get_count(&map, &cursor), 2);
+    ret = overlap_map_split(&map, 4, &cursor);
+    CU_ASSERT_EQUAL_FATAL(ret, 0);
+    CU_ASSERT_EQUAL(overlap_map_get_count(&map, &cursor), 3);
+    verify_items(&map, 5, position, count);
+    overlap_map_print_state(&map, _devnull);
+    CU_ASSERT(overlap_map_get_memory_usage(&map) >= sizeof(overlap_map_block_t));
+
+    CU_ASSERT_FALSE(overlap_map_find(&map, 3, &cursor));
+    overlap_map_find_floor(&map, 3, &cursor);
+    CU_ASSERT_EQUAL(overlap_map_get_position(&map, &cursor), 2.5);
+    overlap_map_find_floor(&map, 4, &cursor);
+    CU_ASSERT_EQUAL(overlap_map_get_position(&map, &cursor), 4);
+    overlap_map_find_floor(&map, 11, &cursor);
+    CU_ASSERT_EQUAL(overlap_map_get_position(&map, &cursor), 10);
+
+    /* 2.5 has the same count as 1 and is removed */
+    overlap_map_compress(&map, 1, 2.5);
+    position[2] = 4;
+    count[2] = 3;
+    position[3] = 10;
+    count[3] = 0;
+    verify_items(&map, 4, position, count);
+
+    overlap_map_clear(&map);
+    verify_items(&map, 0, NULL, NULL);
+    ret = overlap_map_insert(&map, 0, 3);
+    CU_ASSERT_EQUAL_FATAL(ret, 0);
+    verify_items(&map, 1, position, count);
+    overlap_map_free(&map);
+}
+
+static void
+test_overlap_map_seek(void)
+{
+    int ret;
+    overlap_map_t map;
+    overlap_map_cursor_t cursor, other;
+    size_t j;
+    size_t num_items = 1000;
+    double x;
+
+    ret = overlap_map_init(&map);
+    CU_ASSERT_EQUAL_FATAL(ret, 0);
+    for (j = 0; j < num_items; j++) {
+        ret = overlap_map_insert(&map, (double) (2 * j), (uint32_t) j);
+        CU_ASSERT_EQUAL_FATAL(ret, 0);
+    }
+    /* Seeks must move forward, by small and large steps */
+    CU_ASSERT_TRUE(overlap_map_first(&map, &cursor));
+    for (x = 0; x < 2 * (double) num_items; x += 0.5 + (double) ((int) x % 300)) {
+        CU_ASSERT_EQUAL(overlap_map_seek(&map, x, &cursor), x == 2 * floor(x / 2));
+        overlap_map_find_floor(&map, x, &other);
+        CU_ASSERT_EQUAL(cursor.block, other.block);
+        CU_ASSERT_EQUAL(cursor.offset, other.offset);
+    }
+    CU_ASSERT_FALSE(overlap_map_seek(&map, 1e6, &cursor));
+    CU_ASSERT_EQUAL(
+        overlap_map_get_position(&map, &cursor), 2 * (double) (num_items - 1));
+
+    /* Split many intervals from left to right with one cursor. Each split
+     * adds items in the middle of full blocks, so blocks are split too. */
+    CU_ASSERT_TRUE(overlap_map_first(&map, &cursor));
+    for (j = 0; j < num_items - 1; j++) {
+        ret = overlap_map_split_interval(
+            &map, (double) (2 * j) + 0.5, (double) (2 * j) + 1.5, &cursor);
+        CU_ASSERT_EQUAL_FATAL(ret, 0);
+        CU_ASSERT_EQUAL(overlap_map_get_position(&map, &cursor), (double) (2 * j) + 0.5);
+        CU_ASSERT_EQUAL(overlap_map_get_count(&map, &cursor), j);
+        overlap_map_set_count(&map, &cursor, 0);
+        CU_ASSERT_TRUE(overlap_map_next(&map, &cursor));
+        CU_ASSERT_EQUAL(overlap_map_get_position(&map, &cursor), (double) (2 * j) + 1.5);
+        CU_ASSERT_EQUAL(overlap_map_get_count(&map, &cursor), j);
+    }
+    CU_ASSERT_EQUAL(overlap_map_get_num_items(&map), 3 * num_items - 2);
+    overlap_map_verify(&map);
+    /* Splitting at existing items changes nothing */
+    CU_ASSERT_TRUE(overlap_map_first(&map, &cursor));
+    ret = overlap_map_split_interval(&map, 0, 0.5, &cursor);
+    CU_ASSERT_EQUAL_FATAL(ret, 0);
+    CU_ASSERT_EQUAL(overlap_map_get_num_items(&map), 3 * num_items - 2);
+    CU_ASSERT_TRUE(overlap_map_find(&map, 0.5, &other));
+    CU_ASSERT_EQUAL(overlap_map_get_count(&map, &other), 0);
+    overlap_map_free(&map);
+}
+
+static void
+test_overlap_map_compress(void)
+{
+    int ret;
+    overlap_map_t map;
+    size_t j, k, n, m;
+    size_t num_items = 1000;
+    double *position = malloc(num_items * sizeof(*position));
+    uint32_t *count = malloc(num_items * sizeof(*count));
+    double left, right;
+    uint32_t last_count;
+    bool removed, more;
+    overlap_map_cursor_t cursor;
+
+    CU_ASSERT_FATAL(position != NULL && count != NULL);
+    ret = overlap_map_init(&map);
+    CU_ASSERT_EQUAL_FATAL(ret, 0);
+    /* Insert in an interleaved order so that blocks are split in the
+     * middle as well as at the end. */
+    for (k = 0; k < 4; k++) {
+        for (j = k; j < num_items; j += 4) {
+            ret = overlap_map_insert(&map, (double) j, (uint32_t)((j / 3) % 4));
+            CU_ASSERT_EQUAL_FATAL(ret, 0);
+        }
+    }
+    n = num_items;
+    for (j = 0; j < n; j++) {
+        position[j] = (double) j;
+        count[j] = (uint32_t)((j / 3) % 4);
+    }
+    verify_items(&map, n, position, count);
+    CU_ASSERT(map.num_blocks > num_items / OVERLAP_MAP_BLOCK_SIZE);
+
+    /* Compress over increasingly wide ranges and compare with a simple
+     * implementation on the arrays. */
+    for (k = 1; k < 5; k++) {
+        /* The item at left must exist */
+        j = 37 * k;
+        left = position[j];
+        right = left + (double) (150 * k);
+        if (j > 0) {
+            j--;
+        }
+        last_count = count[j];
+        m = j + 1;
+        for (j = j + 1; j < n; j++) {
+            removed = count[j] == last_count;
+            if (!removed) {
+                position[m] = position[j];
+                count[m] = count[j];
+                last_count = count[j];
+                m++;
+            }
+            if (position[j] > right) {
+                j++;
+                break;
+            }
+        }
+        for (; j < n; j++) {
+            position[m] = position[j];
+            count[m] = count[j];
+            m++;
+        }
+        n = m;
+        overlap_map_compress(&map, left, right);
+        verify_items(&map, n, position, count);
+    }
+    /* With equal counts everywhere, compressing leaves only the first item */
+    more = overlap_map_first(&map, &cursor);
+    while (more) {
+        overlap_map_set_count(&map, &cursor, 1);
+        more = overlap_map_next(&map, &cursor);
+    }
+    overlap_map_compress(&map, 0, (double) num_items);
+    position[0] = 0;
+    count[0] = 1;
+    verify_items(&map, 1, position, count);
+    CU_ASSERT_EQUAL(map.num_blocks, 1);
+
+    overlap_map_free(&map);
+    free(position);
+    free(count);
+}
+
+int
+main(int argc, char **argv)
+{
+    CU_TestInfo tests[] = {
+        { "test_overlap_map_simple", test_overlap_map_simple },
+        { "test_overlap_map_seek", test_overlap_map_seek },
+        { "test_overlap_map_compress", test_overlap_map_compress },
+        CU_TEST_INFO_NULL,
+    };
+
+    return test_main(tests, argc, argv);
+}
@@ -0,0 +1,335 @@
+/*
+** Copyright (C) 2024 University of Oxford
+**
+** This file is part of msprime.
+**
+** msprime is free software: you can redistribute it and/or modify
+** it under the terms of the GNU General Public License as published by
+** the Free Software Foundation, either version 3 of the License, or
+** (at your option) any later version.
+**
+** msprime is distributed in the hope that it will be useful,
+** but WITHOUT ANY WARRANTY; without even the implied warranty of
+** MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+** GNU General Public License for more details.
+**
+** You should have received a copy of the GNU General Public License
+** along with msprime.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "testlib.h"
+
+#include <pthread.h>
+
+static int backends[]
+    = { MSP_RNG_MT19937, MSP_RNG_XOSHIRO256PP, MSP_RNG_PCG64, MSP_RNG_PHILOX };
+
+#define NUM_BACKENDS (sizeof(backends) / sizeof(*backends))
+
+static void
+test_rng_get_type(void)
+{
+    size_t j;
+    gsl_rng *rng;
+
+    for (j = 0; j < NUM_BACKENDS; j++) {
+        CU_ASSERT_FATAL(msp_rng_get_type(backends[j]) != NULL);
+        rng = gsl_rng_alloc(msp_rng_get_type(backends[j]));
+        CU_ASSERT_FATAL(rng != NULL);
+        CU_ASSERT_EQUAL(msp_rng_get_backend(rng), backends[j]);
+        gsl_rng_free(rng);
+    }
+    CU_ASSERT_EQUAL(msp_rng_get_type(MSP_RNG_MT19937), gsl_rng_mt19937);
+    CU_ASSERT_EQUAL(msp_rng_get_type(-1), NULL);
+    CU_ASSERT_EQUAL(msp_rng_get_type(4), NULL);
+
+    rng = gsl_rng_alloc(gsl_rng_taus);
+    CU_ASSERT_FATAL(rng != NULL);
+    CU_ASSERT_EQUAL(msp_rng_get_backend(rng), -1);
+    gsl_rng_free(rng);
+}
+
+static void
+test_rng_reference_values(void)
+{
+    /* Reference outputs of xoshiro256++ from the state {1, 2, 3, 4} */
+    uint64_t xoshiro_ref[] = { 41943041ULL, 58720359ULL, 3588806011781223ULL,
+        3591011842654386ULL, 9228616714210784205ULL };
+    /* Upper 32 bits of the first outputs after seeding with 1 */
+    unsigned long xoshiro_seed_ref[] = { 3485847679UL, 3208790322UL, 430144855UL,
+        3204977055UL, 793188427UL };
+    unsigned long pcg64_seed_ref[] = { 1403500025UL, 1669284670UL, 660981869UL,
+        2015286072UL, 3376780806UL };
+    msp_xoshiro256pp_state_t *state;
+    gsl_rng *rng;
+    double x[5];
+    size_t j;
+
+    rng = gsl_rng_alloc(msp_rng_xoshiro256pp);
+    CU_ASSERT_FATAL(rng != NULL);
+    state = (msp_xoshiro256pp_state_t *) rng->state;
+    for (j = 0; j < 4; j++) {
+        state->s[j] = j + 1;
+    }
+    msp_rng_fill_uniform(rng, x, 5);
+    for (j = 0; j < 5; j++) {
+        CU_ASSERT_EQUAL(x[j], ldexp((double) (xoshiro_ref[j] >> 11), -53));
+    }
+    gsl_rng_set(rng, 1);
+    for (j = 0; j < 5; j++) {
+        CU_ASSERT_EQUAL(gsl_rng_get(rng), xoshiro_seed_ref[j]);
+    }
+    gsl_rng_free(rng);
+
+    rng = gsl_rng_alloc(msp_rng_pcg64);
+    CU_ASSERT_FATAL(rng != NULL);
+    gsl_rng_set(rng, 1);
+    for (j = 0; j < 5; j++) {
+        CU_ASSERT_EQUAL(gsl_rng_get(rng), pcg64_seed_ref[j]);
+    }
+    gsl_rng_free(rng);
+}
+
+static void
+test_rng_fill(void)
+{
+    size_t j, k, l, n;
+    size_t sizes[] = { 0, 1, 7, 1000 };
+    gsl_rng *rng1, *rng2;
+    double *x = malloc(1000 * sizeof(*x));
+
+    CU_ASSERT_FATAL(x != NULL);
+    for (j = 0; j < NUM_BACKENDS; j++) {
+        rng1 = gsl_rng_alloc(msp_rng_get_type(backends[j]));
+        rng2 = gsl_rng_alloc(msp_rng_get_type(backends[j]));
+        CU_ASSERT_FATAL(rng1 != NULL && rng2 != NULL);
+        gsl_rng_set(rng1, 1234);
+        gsl_rng_set(rng2, 1234);
+        for (k = 0; k < sizeof(sizes) / sizeof(*sizes); k++) {
+            n = sizes[k];
+            /* Bulk fills must give exactly the values of successive draws */
+            msp_rng_fill_uniform(rng1, x, n);
+            for (l = 0; l < n; l++) {
+                CU_ASSERT_EQUAL_FATAL(x[l], gsl_rng_uniform(rng2));
+                CU_ASSERT_FATAL(x[l] >= 0 && x[l] < 1);
+            }
+            msp_rng_fill_exponential(rng1, x, n);
+            for (l = 0; l < n; l++) {
+                CU_ASSERT_EQUAL_FATAL(x[l], -log1p(-gsl_rng_uniform(rng2)));
+                CU_ASSERT_FATAL(x[l] >= 0);
+            }
+        }
+        CU_ASSERT_EQUAL(gsl_rng_get(rng1), gsl_rng_get(rng2));
+        gsl_rng_free(rng1);
+        gsl_rng_free(rng2);
+    }
+    free(x);
+}
+
+static void
+test_rng_distributions(void)
+{
+    size_t j, k;
+    size_t n = 10000;
+    unsigned long v;
+    double u, sum;
+    gsl_rng *rng;
+
+    for (j = 0; j < NUM_BACKENDS; j++) {
+        rng = gsl_rng_alloc(msp_rng_get_type(backends[j]));
+        CU_ASSERT_FATAL(rng != NULL);
+        gsl_rng_set(rng, 42);
+        sum = 0;
+        for (k = 0; k < n; k++) {
+            u = gsl_rng_uniform(rng);
+            CU_ASSERT_FATAL(u >= 0 && u < 1);
+            sum += u;
+            v = gsl_rng_uniform_int(rng, 10);
+            CU_ASSERT_FATAL(v < 10);
+            CU_ASSERT_FATAL(gsl_ran_exponential(rng, 1.0) >= 0);
+        }
+        /* Very loose check that the mean is close to 1/2 */
+        CU_ASSERT(fabs(sum / (double) n - 0.5) < 0.05);
+        gsl_rng_free(rng);
+    }
+}
+
+static void
+test_rng_philox_known_answers(void)
+{
+    /* Known answer tests from the Random123 distribution */
+    uint32_t input[][6] = {
+        { 0, 0, 0, 0, 0, 0 },
+        { 0xffffffff, 0xffffffff, 0xffffffff, 0xffffffff, 0xffffffff, 0xffffffff },
+        { 0x243f6a88, 0x85a308d3, 0x13198a2e, 0x03707344, 0xa4093822, 0x299f31d0 },
+    };
+    uint32_t output[][4] = {
+        { 0x6627e8d5, 0xe169c58d, 0xbc57ac4c, 0x9b00dbd8 },
+        { 0x408f276d, 0x41c83b0e, 0xa20bc7c6, 0x6d5451fd },
+        { 0xd16cfe09, 0x94fdcceb, 0x5001e420, 0x24126ea1 },
+    };
+    msp_philox_state_t *state;
+    gsl_rng *rng = gsl_rng_alloc(msp_rng_philox);
+    size_t j, k;
+
+    CU_ASSERT_FATAL(rng != NULL);
+    state = (msp_philox_state_t *) rng->state;
+    for (j = 0; j < 3; j++) {
+        for (k = 0; k < 4; k++) {
+            state->counter[k] = input[j][k];
+        }
+        state->key[0] = input[j][4];
+        state->key[1] = input[j][5];
+        state->index = 2;
+        /* Each block is returned as two 64 bit words, high word first */
+        CU_ASSERT_EQUAL(gsl_rng_get(rng), output[j][0]);
+        CU_ASSERT_EQUAL(gsl_rng_get(rng), output[j][2]);
+    }
+    gsl_rng_free(rng);
+}
+
+static void
+test_rng_philox_streams(void)
+{
+    int ret;
+    size_t j, k;
+    size_t n = 100;
+    gsl_rng *rng = gsl_rng_alloc(msp_rng_philox);
+    double *x = malloc(n * sizeof(*x));
+    double *y = malloc(n * sizeof(*y));
+
+    CU_ASSERT_FATAL(rng != NULL && x != NULL && y != NULL);
+    gsl_rng_set(rng, 1234);
+    ret = msp_rng_set_stream(rng, 5, MSP_RNG_SUBSYSTEM_MUTATIONS, 3);
+    CU_ASSERT_EQUAL_FATAL(ret, 0);
+    msp_rng_fill_uniform(rng, x, n);
+
+    /* Skipping ahead gives the same values as drawing, from any position */
+    for (j = 0; j < n; j++) {
+        gsl_rng_set(rng, 1234);
+        msp_rng_set_stream(rng, 5, MSP_RNG_SUBSYSTEM_MUTATIONS, 3);
+        ret = msp_rng_skip(rng, j / 3);
+        CU_ASSERT_EQUAL_FATAL(ret, 0);
+        ret = msp_rng_skip(rng, j - j / 3);
+        CU_ASSERT_EQUAL_FATAL(ret, 0);
+        CU_ASSERT_EQUAL_FATAL(gsl_rng_uniform(rng), x[j]);
+    }
+    msp_rng_set_stream(rng, 5, MSP_RNG_SUBSYSTEM_MUTATIONS, 3);
+    gsl_rng_uniform(rng);
+    msp_rng_skip(rng, 0);
+    CU_ASSERT_EQUAL(gsl_rng_uniform(rng), x[1]);
+    msp_rng_skip(rng, 3);
+    CU_ASSERT_EQUAL(gsl_rng_uniform(rng), x[5]);
+
+    /* Changing any element of the stream key gives a different stream */
+    for (k = 0; k < 4; k++) {
+        gsl_rng_set(rng, k == 0 ? 1235 : 1234);
+        msp_rng_set_stream(rng, k == 1 ? 6 : 5,
+            k == 2 ? MSP_RNG_SUBSYSTEM_ANCESTRY : MSP_RNG_SUBSYSTEM_MUTATIONS,
+            k == 3 ? 4 : 3);
+        msp_rng_fill_uniform(rng, y, n);
+        CU_ASSERT_NOT_EQUAL(memcmp(x, y, n * sizeof(*x)), 0);
+    }
+    gsl_rng_free(rng);
+
+    for (j = 0; j < NUM_BACKENDS - 1; j++) {
+        rng = gsl_rng_alloc(msp_rng_get_type(backends[j]));
+        CU_ASSERT_FATAL(rng != NULL);
+        ret = msp_rng_set_stream(rng, 0, 0, 0);
+        CU_ASSERT_EQUAL(ret, MSP_ERR_RNG_NOT_COUNTER_BASED);
+        ret = msp_rng_skip(rng, 1);
+        CU_ASSERT_EQUAL(ret, MSP_ERR_RNG_NOT_COUNTER_BASED);
+        gsl_rng_free(rng);
+    }
+    free(x);
+    free(y);
+}
+
+#define NUM_WORK_ITEMS 64
+#define WORK_ITEM_SIZE 1000
+
+typedef struct {
+    size_t thread_id;
+    size_t num_threads;
+    double *output;
+    int ret;
+} rng_worker_t;
+
+/* Work items are divided between threads round-robin, and each draws from its
+ * own stream. */
+static void *
+rng_worker(void *arg)
+{
+    rng_worker_t *worker = (rng_worker_t *) arg;
+    gsl_rng *rng = gsl_rng_alloc(msp_rng_philox);
+    size_t j;
+
+    worker->ret = -1;
+    if (rng == NULL) {
+        goto out;
+    }
+    for (j = worker->thread_id; j < NUM_WORK_ITEMS; j += worker->num_threads) {
+        gsl_rng_set(rng, 42);
+        worker->ret = msp_rng_set_stream(
+            rng, (uint32_t) j / 8, MSP_RNG_SUBSYSTEM_MUTATIONS, (uint32_t) j % 8);
+        if (worker->ret != 0) {
+            goto out;
+        }
+        msp_rng_fill_uniform(rng, worker->output + j * WORK_ITEM_SIZE, WORK_ITEM_SIZE);
+    }
+    worker->ret = 0;
+out:
+    if (rng != NULL) {
+        gsl_rng_free(rng);
+    }
+    return NULL;
+}
+
+static void
+test_rng_philox_threads(void)
+{
+    size_t num_threads[] = { 1, 4, 32 };
+    size_t n = NUM_WORK_ITEMS * WORK_ITEM_SIZE;
+    double *output[3];
+    rng_worker_t workers[32];
+    pthread_t threads[32];
+    size_t j, k;
+
+    for (j = 0; j < 3; j++) {
+        output[j] = malloc(n * sizeof(double));
+        CU_ASSERT_FATAL(output[j] != NULL);
+        for (k = 0; k < num_threads[j]; k++) {
+            workers[k].thread_id = k;
+            workers[k].num_threads = num_threads[j];
+            workers[k].output = output[j];
+            CU_ASSERT_EQUAL_FATAL(
+                pthread_create(&threads[k], NULL, rng_worker, &workers[k]), 0);
+        }
+        for (k = 0; k < num_threads[j]; k++) {
+            CU_ASSERT_EQUAL_FATAL(pthread_join(threads[k], NULL), 0);
+            CU_ASSERT_EQUAL(workers[k].ret, 0);
+        }
+    }
+    CU_ASSERT_EQUAL(memcmp(output[0], output[1], n * sizeof(double)), 0);
+    CU_ASSERT_EQUAL(memcmp(output[0], output[2], n * sizeof(double)), 0);
+    for (j = 0; j < 3; j++) {
+        free(output[j]);
+    }
+}
+
+int
+main(int argc, char **argv)
+{
+    CU_TestInfo tests[] = {
+        { "test_rng_get_type", test_rng_get_type },
+        { "test_rng_reference_values", test_rng_reference_values },
+        { "test_rng_fill", test_rng_fill },
+        { "test_rng_distributions", test_rng_distributions },
+        { "test_rng_philox_known_answers", test_rng_philox_known_answers },
+        { "test_rng_philox_streams", test_rng_philox_streams },
+        { "test_rng_philox_threads", test_rng_philox_threads },
+        CU_TEST_INFO_NULL,
+    };
+
+    return test_main(tests, argc, argv);
+}
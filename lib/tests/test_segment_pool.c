@@ -0,0 +1,156 @@
+/*
+** Copyright (C) 2024 University of Oxford
+**
+** This file is part of msprime.
+**
+** msprime is free software: you can redistribute it and/or modify
+** it under the terms of the GNU General Public License as published by
+** the Free Software Foundation, either version 3 of the License, or
+** (at your option) any later version.
+**
+** msprime is distributed in the hope that it will be useful,
+** but WITHOUT ANY WARRANTY; without even the implied warranty of
+** MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+** GNU General Public License for more details.
+**
+** You should have received a copy of the GNU General Public License
+** along with msprime.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "testlib.h"
+
+static segment_id_t
+alloc_segment(segment_pool_t *pool, double left, double right, segment_id_t prev)
+{
+    segment_id_t u = segment_pool_alloc(pool);
+
+    CU_ASSERT_FATAL(u != MSP_NULL_SEGMENT);
+    pool->left[u] = left;
+    pool->right[u] = right;
+    pool->value[u] = (tsk_id_t) u;
+    pool->population[u] = 0;
+    pool->label[u] = 0;
+    pool->prev[u] = prev;
+    pool->next[u] = MSP_NULL_SEGMENT;
+    if (prev != MSP_NULL_SEGMENT) {
+        pool->next[prev] = u;
+    }
+    return u;
+}
+
+static void
+test_segment_pool_simple(void)
+{
+    int ret;
+    segment_pool_t pool;
+    segment_id_t u, v, w;
+
+    ret = segment_pool_init(&pool, 2, false);
+    CU_ASSERT_EQUAL_FATAL(ret, 0);
+    CU_ASSERT_EQUAL(segment_pool_get_size(&pool), 2);
+    CU_ASSERT_EQUAL(segment_pool_get_num_allocated(&pool), 0);
+    CU_ASSERT_EQUAL(segment_pool_get_memory_usage(&pool),
+        3 * (2 * sizeof(double) + 3 * sizeof(tsk_id_t) + 2 * sizeof(segment_id_t)));
+    segment_pool_verify(&pool);
+
+    /* The largest index is allocated first */
+    u = alloc_segment(&pool, 0, 1, MSP_NULL_SEGMENT);
+    CU_ASSERT_EQUAL(u, 2);
+    v = alloc_segment(&pool, 2, 3, u);
+    CU_ASSERT_EQUAL(v, 1);
+    CU_ASSERT_EQUAL(segment_pool_alloc(&pool), MSP_NULL_SEGMENT);
+    CU_ASSERT_EQUAL(segment_pool_get_num_allocated(&pool), 2);
+    segment_pool_verify(&pool);
+    segment_pool_print_state(&pool, _devnull);
+
+    /* Expanding keeps the existing segments where they are */
+    ret = segment_pool_expand(&pool, 2);
+    CU_ASSERT_EQUAL_FATAL(ret, 0);
+    CU_ASSERT_EQUAL(segment_pool_get_size(&pool), 4);
+    CU_ASSERT_EQUAL(pool.left[u], 0);
+    CU_ASSERT_EQUAL(pool.next[u], v);
+    CU_ASSERT_EQUAL(pool.prev[v], u);
+    w = alloc_segment(&pool, 3, 4, v);
+    CU_ASSERT_EQUAL(w, 4);
+    segment_pool_verify(&pool);
+
+    /* Freed segments are reused last in, first out */
+    pool.next[v] = MSP_NULL_SEGMENT;
+    segment_pool_free_segment(&pool, w);
+    CU_ASSERT_EQUAL(segment_pool_get_num_allocated(&pool), 2);
+    segment_pool_verify(&pool);
+    CU_ASSERT_EQUAL(alloc_segment(&pool, 3, 4, v), w);
+    segment_pool_verify(&pool);
+
+    segment_pool_free(&pool);
+}
+
+static void
+test_segment_pool_move_segments(void)
+{
+    int ret;
+    segment_pool_t source, dest;
+    segment_id_t source_id[4];
+    segment_id_t a, b, c, d;
+
+    ret = segment_pool_init(&source, 8, false);
+    CU_ASSERT_EQUAL_FATAL(ret, 0);
+    ret = segment_pool_init(&dest, 4, false);
+    CU_ASSERT_EQUAL_FATAL(ret, 0);
+
+    /* Two chains, a-b and c, with a freed segment in between */
+    a = alloc_segment(&source, 0, 1, MSP_NULL_SEGMENT);
+    d = alloc_segment(&source, 5, 6, MSP_NULL_SEGMENT);
+    b = alloc_segment(&source, 1, 2, a);
+    c = alloc_segment(&source, 3, 4, MSP_NULL_SEGMENT);
+    segment_pool_free_segment(&source, d);
+    segment_pool_verify(&source);
+
+    source_id[1] = c;
+    source_id[2] = a;
+    source_id[3] = b;
+    segment_pool_move_segments(&dest, &source, 3, source_id);
+    segment_pool_free(&source);
+    segment_pool_verify(&dest);
+    CU_ASSERT_EQUAL(segment_pool_get_num_allocated(&dest), 3);
+
+    CU_ASSERT_EQUAL(dest.left[1], 3);
+    CU_ASSERT_EQUAL(dest.value[1], (tsk_id_t) c);
+    CU_ASSERT_EQUAL(dest.prev[1], MSP_NULL_SEGMENT);
+    CU_ASSERT_EQUAL(dest.next[1], MSP_NULL_SEGMENT);
+    CU_ASSERT_EQUAL(dest.left[2], 0);
+    CU_ASSERT_EQUAL(dest.value[2], (tsk_id_t) a);
+    CU_ASSERT_EQUAL(dest.prev[2], MSP_NULL_SEGMENT);
+    CU_ASSERT_EQUAL(dest.next[2], 3);
+    CU_ASSERT_EQUAL(dest.left[3], 1);
+    CU_ASSERT_EQUAL(dest.value[3], (tsk_id_t) b);
+    CU_ASSERT_EQUAL(dest.prev[3], 2);
+    CU_ASSERT_EQUAL(dest.next[3], MSP_NULL_SEGMENT);
+
+    /* The remaining segments are allocated smallest index first */
+    CU_ASSERT_EQUAL(segment_pool_alloc(&dest), 4);
+    CU_ASSERT_EQUAL(segment_pool_alloc(&dest), MSP_NULL_SEGMENT);
+    segment_pool_free(&dest);
+}
+
+static void
+test_segment_pool_errors(void)
+{
+    segment_pool_t pool;
+
+    CU_ASSERT_EQUAL(segment_pool_init(&pool, UINT32_MAX, false), MSP_ERR_NO_MEMORY);
+    segment_pool_free(&pool);
+}
+
+int
+main(int argc, char **argv)
+{
+    CU_TestInfo tests[] = {
+        { "test_segment_pool_simple", test_segment_pool_simple },
+        { "test_segment_pool_move_segments", test_segment_pool_move_segments },
+        { "test_segment_pool_errors", test_segment_pool_errors },
+        CU_TEST_INFO_NULL,
+    };
+
+    return test_main(tests, argc, argv);
+}
@@ -19,15 +19,28 @@
 
 /* Basic utilities needed in all files */
 
+#ifndef _WIN32
+/* Needed for clock_gettime */
+#define _POSIX_C_SOURCE 199309L
+/* Needed for MAP_ANONYMOUS and madvise */
+#define _DEFAULT_SOURCE
+#endif
+
 #include <stdio.h>
 #include <stdlib.h>
+#include <stdint.h>
 #include <string.h>
 #include <errno.h>
+#include <time.h>
+#ifdef __linux__
+#include <sys/mman.h>
+#endif
 
 #include <gsl/gsl_math.h>
 
 #include <tskit/core.h>
 #include "util.h"
+#include "rng.h"
 
 static const char *
 msp_strerror_internal(int err)
@@ -187,6 +200,15 @@ msp_strerror_internal(int err)
                   "would like to see this feature implemented: "
                   "https://github.com/tskit-dev/msprime/issues/1855 ";
             break;
+        case MSP_ERR_RNG_NOT_COUNTER_BASED:
+            ret = "Streams and skip-ahead are only supported by counter-based "
+                  "random generators";
+            break;
+        case MSP_ERR_MASS_INDEX_OVERFLOW:
+            ret = "The total recombination or gene conversion mass is too large "
+                  "for the exact mass index. Please use the floating point index "
+                  "for simulations with this many lineages.";
+            break;
 
         case MSP_ERR_BAD_PROPORTION:
             ret = "Proportion values must have 0 <= x <= 1";
@@ -373,6 +395,155 @@ __msp_safe_free(void **ptr)
     }
 }
 
+/* Returns the value of a monotonic wall clock in seconds, for measuring
+ * elapsed times. */
+double
+msp_get_wall_time(void)
+{
+#ifdef _WIN32
+    /* On Windows clock() measures wall time rather than processor time */
+    return (double) clock() / CLOCKS_PER_SEC;
+#else
+    struct timespec t;
+
+    clock_gettime(CLOCK_MONOTONIC, &t);
+    return (double) t.tv_sec + 1e-9 * (double) t.tv_nsec;
+#endif
+}
+
+/* Returns the number of bytes that msp_huge_alloc reserves for an
+ * allocation of the specified size. This is a whole number of huge pages,
+ * which beyond MSP_HUGE_GROWTH_PAGES pages is rounded up further to one of
+ * MSP_HUGE_GROWTH_PAGES / 2 evenly spaced steps between successive powers
+ * of two. The reserved size therefore grows geometrically, so that
+ * msp_huge_realloc copies an array that grows in small increments a
+ * bounded number of times per byte, rather than at every huge page
+ * boundary. Beyond the first pages, at most a quarter more than the
+ * requested size is reserved. */
+size_t
+msp_huge_get_allocated_size(size_t size, bool huge_pages)
+{
+#ifdef __linux__
+    size_t num_pages, step;
+
+    if (huge_pages) {
+        size = GSL_MAX(size, 1);
+        num_pages = (size + MSP_HUGE_PAGE_SIZE - 1) / MSP_HUGE_PAGE_SIZE;
+        step = 1;
+        while (num_pages / step >= MSP_HUGE_GROWTH_PAGES) {
+            step *= 2;
+        }
+        num_pages = ((num_pages + step - 1) / step) * step;
+        size = num_pages * MSP_HUGE_PAGE_SIZE;
+    }
+#else
+    (void) huge_pages;
+#endif
+    return size;
+}
+
+/* Allocates size bytes of zeroed memory. If huge_pages is true the memory
+ * is a private anonymous mapping aligned to, and rounded up to a multiple
+ * of, MSP_HUGE_PAGE_SIZE. Explicit huge pages are used if the system has
+ * any reserved, and otherwise the mapping is marked as eligible for
+ * transparent huge pages. Where mappings are not supported, or if
+ * huge_pages is false, this is equivalent to calloc. The memory must be
+ * freed by msp_huge_free with the same size and huge_pages arguments. */
+void *
+msp_huge_alloc(size_t size, bool huge_pages)
+{
+    void *ret = NULL;
+#ifdef __linux__
+    char *p;
+    size_t length, offset;
+
+    if (huge_pages) {
+        length = msp_huge_get_allocated_size(size, true);
+#ifdef MAP_HUGETLB
+        p = mmap(NULL, length, PROT_READ | PROT_WRITE,
+            MAP_PRIVATE | MAP_ANONYMOUS | MAP_HUGETLB, -1, 0);
+        if (p != MAP_FAILED) {
+            ret = p;
+            goto out;
+        }
+#endif
+        /* Map an extra huge page, so that we can trim the region to start
+         * on a huge page boundary. */
+        p = mmap(NULL, length + MSP_HUGE_PAGE_SIZE, PROT_READ | PROT_WRITE,
+            MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+        if (p == MAP_FAILED) {
+            goto out;
+        }
+        offset = (MSP_HUGE_PAGE_SIZE - (uintptr_t) p % MSP_HUGE_PAGE_SIZE)
+                 % MSP_HUGE_PAGE_SIZE;
+        if (offset > 0) {
+            munmap(p, offset);
+        }
+        munmap(p + offset + length, MSP_HUGE_PAGE_SIZE - offset);
+        p += offset;
+#ifdef MADV_HUGEPAGE
+        /* This is only advice, and failure isn't an error */
+        madvise(p, length, MADV_HUGEPAGE);
+#endif
+        ret = p;
+        goto out;
+    }
+#else
+    (void) huge_pages;
+#endif
+    ret = calloc(1, GSL_MAX(size, 1));
+#ifdef __linux__
+out:
+#endif
+    return ret;
+}
+
+/* Changes the size of memory allocated by msp_huge_alloc, as realloc does.
+ * The contents up to the smaller of the two sizes are preserved, and
+ * memory beyond old_size is uninitialised. Returns NULL and leaves the
+ * original memory unchanged if the allocation fails. */
+void *
+msp_huge_realloc(void *ptr, size_t old_size, size_t new_size, bool huge_pages)
+{
+    void *ret = NULL;
+
+    if (ptr == NULL) {
+        ret = msp_huge_alloc(new_size, huge_pages);
+    } else if (huge_pages) {
+        if (msp_huge_get_allocated_size(old_size, true)
+            == msp_huge_get_allocated_size(new_size, true)) {
+            ret = ptr;
+        } else {
+            ret = msp_huge_alloc(new_size, true);
+            if (ret != NULL) {
+                memcpy(ret, ptr, GSL_MIN(old_size, new_size));
+                msp_huge_free(ptr, old_size, true);
+            }
+        }
+    } else {
+        ret = realloc(ptr, GSL_MAX(new_size, 1));
+    }
+    return ret;
+}
+
+void
+msp_huge_free(void *ptr, size_t size, bool huge_pages)
+{
+    if (ptr != NULL) {
+#ifdef __linux__
+        if (huge_pages) {
+            munmap(ptr, msp_huge_get_allocated_size(size, true));
+        } else {
+            free(ptr);
+        }
+#else
+        (void) size;
+        (void) huge_pages;
+        free(ptr);
+#endif
+    }
+}
+
 bool
 doubles_almost_equal(double a, double b, double eps)
 {
@@ -702,6 +873,163 @@ fast_search_free(fast_search_t *self)
     return 0;
 }
 
+int
+variate_buffer_alloc(variate_buffer_t *self, gsl_rng *rng, size_t size)
+{
+    int ret = 0;
+
+    memset(self, 0, sizeof(*self));
+    self->rng = rng;
+    self->size = size;
+    if (size > 0) {
+        self->uniform = malloc(size * sizeof(*self->uniform));
+        self->exponential = malloc(size * sizeof(*self->exponential));
+        if (self->uniform == NULL || self->exponential == NULL) {
+            ret = MSP_ERR_NO_MEMORY;
+            goto out;
+        }
+    }
+    variate_buffer_clear(self);
+out:
+    return ret;
+}
+
+int
+variate_buffer_free(variate_buffer_t *self)
+{
+    msp_safe_free(self->uniform);
+    msp_safe_free(self->exponential);
+    return 0;
+}
+
+/* Discards any buffered values, so that the next variates are drawn from
+ * the current state of the random generator. */
+void
+variate_buffer_clear(variate_buffer_t *self)
+{
+    self->next_uniform = self->size;
+    self->next_exponential = self->size;
+}
+
+void
+variate_buffer_fill_uniform(variate_buffer_t *self)
+{
+    msp_rng_fill_uniform(self->rng, self->uniform, self->size);
+    self->next_uniform = 0;
+}
+
+void
+variate_buffer_fill_exponential(variate_buffer_t *self)
+{
+    msp_rng_fill_exponential(self->rng, self->exponential, self->size);
+    self->next_exponential = 0;
+}
+
+#define SCRATCH_BUFFER_ALIGN 16
+
+/* The blocks given out when a request doesn't fit in the main block start
+ * with a pointer to the previous such block, padded so that the memory
+ * that follows it is aligned. */
+typedef union {
+    void *prev;
+    char pad[SCRATCH_BUFFER_ALIGN];
+} scratch_chunk_t;
+
+static size_t
+scratch_buffer_round_up(size_t size)
+{
+    return (size + SCRATCH_BUFFER_ALIGN - 1) & ~((size_t) SCRATCH_BUFFER_ALIGN - 1);
+}
+
+int
+scratch_buffer_alloc(scratch_buffer_t *self, size_t size)
+{
+    int ret = 0;
+
+    memset(self, 0, sizeof(*self));
+    if (size > SIZE_MAX / 2) {
+        ret = MSP_ERR_BAD_PARAM_VALUE;
+        goto out;
+    }
+    size = GSL_MAX(scratch_buffer_round_up(size), SCRATCH_BUFFER_ALIGN);
+    self->mem = malloc(size);
+    if (self->mem == NULL) {
+        ret = MSP_ERR_NO_MEMORY;
+        goto out;
+    }
+    self->size = size;
+out:
+    return ret;
+}
+
+int
+scratch_buffer_free(scratch_buffer_t *self)
+{
+    scratch_buffer_reset(self);
+    msp_safe_free(self->mem);
+    return 0;
+}
+
+/* Returns size bytes of memory, aligned for any type, that remain valid
+ * until the next reset, or NULL if we are out of memory. */
+void *
+scratch_buffer_get(scratch_buffer_t *self, size_t size)
+{
+    void *ret = NULL;
+    scratch_chunk_t *chunk;
+
+    if (size > SIZE_MAX / 2) {
+        goto out;
+    }
+    size = scratch_buffer_round_up(size);
+    if (self->mem != NULL && size <= self->size - self->offset) {
+        ret = self->mem + self->offset;
+        self->offset += size;
+    } else {
+        chunk = malloc(sizeof(*chunk) + size);
+        if (chunk == NULL) {
+            goto out;
+        }
+        chunk->prev = self->overflow;
+        self->overflow = chunk;
+        ret = chunk + 1;
+    }
+    self->total += size;
+    if (self->total > self->high_water_mark) {
+        self->high_water_mark = self->total;
+    }
+out:
+    return ret;
+}
+
+/* Makes all of the memory returned since the last reset available again. */
+void
+scratch_buffer_reset(scratch_buffer_t *self)
+{
+    scratch_chunk_t *chunk;
+
+    while (self->overflow != NULL) {
+        chunk = (scratch_chunk_t *) self->overflow;
+        self->overflow = chunk->prev;
+        free(chunk);
+    }
+    if (self->high_water_mark > self->size) {
+        /* If this fails, later requests are served by separate blocks
+         * until a reset succeeds in growing the main block. */
+        free(self->mem);
+        self->mem = malloc(self->high_water_mark);
+        self->size = self->mem == NULL ? 0 : self->high_water_mark;
+    }
+    self->offset = 0;
+    self->total = 0;
+}
+
+size_t
+scratch_buffer_get_memory_usage(scratch_buffer_t *self)
+{
+    return self->size + self->total - self->offset;
+}
+
 /*******************************
  *  `extern inline` declarations
  *  Due to compiler/linker limitations of C99, `inline` function declarations
@@ -712,3 +1040,8 @@ fast_search_free(fast_search_t *self)
 extern inline size_t sub_idx_1st_strict_upper_bound(
     const double *base, size_t start, size_t stop, double query);
 extern inline size_t fast_search_idx_strict_upper(fast_search_t *self, double query);
+extern inline double variate_buffer_uniform(variate_buffer_t *self);
+extern inline double variate_buffer_flat(variate_buffer_t *self, double a, double b);
+extern inline double variate_buffer_exponential(variate_buffer_t *self, double mu);
+extern inline unsigned long variate_buffer_uniform_int(
+    variate_buffer_t *self, unsigned long n);
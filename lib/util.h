@@ -24,6 +24,9 @@
 #include <assert.h>
 #include <stdio.h>
 
+#include <gsl/gsl_rng.h>
+#include <gsl/gsl_randist.h>
+
 #include "tskit.h"
 
 #ifdef __GNUC__
@@ -132,6 +135,8 @@
 #define MSP_ERR_PEDIGREE_IND_NOT_DIPLOID                            -89
 #define MSP_ERR_PEDIGREE_IND_NOT_TWO_PARENTS                        -90
 #define MSP_ERR_PEDIGREE_INTERNAL_SAMPLE                            -91
+#define MSP_ERR_RNG_NOT_COUNTER_BASED                               -92
+#define MSP_ERR_MASS_INDEX_OVERFLOW                                 -93
 
 /* clang-format on */
 /* This bit is 0 for any errors originating from tskit */
@@ -141,6 +146,19 @@ int msp_set_tsk_error(int err);
 bool msp_is_tsk_error(int err);
 const char *msp_strerror(int err);
 void __msp_safe_free(void **ptr);
+double msp_get_wall_time(void);
+
+/* Memory that may be backed by huge pages, to reduce TLB misses when large
+ * arrays are accessed at random. */
+#define MSP_HUGE_PAGE_SIZE ((size_t) 2 * 1024 * 1024)
+/* The number of huge pages above which huge page allocations grow
+ * geometrically. See msp_huge_get_allocated_size. */
+#define MSP_HUGE_GROWTH_PAGES ((size_t) 8)
+
+size_t msp_huge_get_allocated_size(size_t size, bool huge_pages);
+void *msp_huge_alloc(size_t size, bool huge_pages);
+void *msp_huge_realloc(void *ptr, size_t old_size, size_t new_size, bool huge_pages);
+void msp_huge_free(void *ptr, size_t size, bool huge_pages);
 
 #define msp_safe_free(pointer) __msp_safe_free((void **) &(pointer))
 
@@ -166,6 +184,53 @@ int fast_search_alloc(fast_search_t *self, const double *values, size_t n_values
 int fast_search_free(fast_search_t *self);
 inline size_t fast_search_idx_strict_upper(fast_search_t *self, double query);
 
+/* Blocks of uniform and standard exponential variates drawn from the
+ * random generator in advance, so that the hot loops read them from memory
+ * rather than calling into GSL for each one. The values are consumed in
+ * order, so the output is reproducible for a given seed and buffer size.
+ * If the size is zero the variates are drawn directly from the generator,
+ * giving exactly the same values as the corresponding GSL functions. */
+typedef struct {
+    gsl_rng *rng;
+    size_t size;
+    size_t next_uniform;
+    size_t next_exponential;
+    double *uniform;
+    double *exponential;
+} variate_buffer_t;
+
+int variate_buffer_alloc(variate_buffer_t *self, gsl_rng *rng, size_t size);
+int variate_buffer_free(variate_buffer_t *self);
+void variate_buffer_clear(variate_buffer_t *self);
+void variate_buffer_fill_uniform(variate_buffer_t *self);
+void variate_buffer_fill_exponential(variate_buffer_t *self);
+inline double variate_buffer_uniform(variate_buffer_t *self);
+inline double variate_buffer_flat(variate_buffer_t *self, double a, double b);
+inline double variate_buffer_exponential(variate_buffer_t *self, double mu);
+inline unsigned long variate_buffer_uniform_int(variate_buffer_t *self, unsigned long n);
+
+/* Memory for arrays that are only needed while a single event is being
+ * processed. Requests are served by moving an offset along one block of
+ * memory, and anything that doesn't fit is given a block of its own. When
+ * the buffer is reset the extra blocks are freed and the main block is
+ * grown to the largest total requested since the previous reset, so that
+ * once the buffer has reached its high-water mark no further calls to
+ * malloc are needed. */
+typedef struct {
+    size_t size;
+    size_t offset;
+    size_t total;
+    size_t high_water_mark;
+    char *mem;
+    void *overflow;
+} scratch_buffer_t;
+
+int scratch_buffer_alloc(scratch_buffer_t *self, size_t size);
+int scratch_buffer_free(scratch_buffer_t *self);
+void *scratch_buffer_get(scratch_buffer_t *self, size_t size);
+void scratch_buffer_reset(scratch_buffer_t *self);
+size_t scratch_buffer_get_memory_usage(scratch_buffer_t *self);
+
 /***********************************
  * INLINE FUNCTION IMPLEMENTATIONS *
  ***********************************/
@@ -220,4 +285,55 @@ fast_search_idx_strict_upper(fast_search_t *self, double query)
     return ret;
 }
 
+/* Equivalent to gsl_rng_uniform */
+inline double
+variate_buffer_uniform(variate_buffer_t *self)
+{
+    if (self->size == 0) {
+        return gsl_rng_uniform(self->rng);
+    }
+    if (self->next_uniform == self->size) {
+        variate_buffer_fill_uniform(self);
+    }
+    return self->uniform[self->next_uniform++];
+}
+
+/* Equivalent to gsl_ran_flat */
+inline double
+variate_buffer_flat(variate_buffer_t *self, double a, double b)
+{
+    double u = variate_buffer_uniform(self);
+    return a * (1 - u) + b * u;
+}
+
+/* Equivalent to gsl_ran_exponential */
+inline double
+variate_buffer_exponential(variate_buffer_t *self, double mu)
+{
+    if (self->size == 0) {
+        return gsl_ran_exponential(self->rng, mu);
+    }
+    if (self->next_exponential == self->size) {
+        variate_buffer_fill_exponential(self);
+    }
+    return mu * self->exponential[self->next_exponential++];
+}
+
+/* Equivalent to gsl_rng_uniform_int, returning an integer from 0 to n - 1,
+ * where n must be at least 1. When buffered this is the floor of u * n for
+ * a buffered uniform u, rather than GSL's rejection method, and so the
+ * values differ from the unbuffered ones. */
+inline unsigned long
+variate_buffer_uniform_int(variate_buffer_t *self, unsigned long n)
+{
+    unsigned long k;
+
+    if (self->size == 0) {
+        return gsl_rng_uniform_int(self->rng, n);
+    }
+    k = (unsigned long) (variate_buffer_uniform(self) * (double) n);
+    /* u * n can round up to n when n is large */
+    return k < n ? k : n - 1;
+}
+
 #endif /*__UTIL_H__*/
@@ -46,6 +46,7 @@ from msprime.ancestry import (
     SweepGenicSelection,
     FixedPedigree,
     TimeUnitsMismatchWarning,
+    MemoryLimitWarning,
 )
 
 from msprime.core import __version__
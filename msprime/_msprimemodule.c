@@ -45,6 +45,11 @@ static PyObject *MsprimeLibraryError;
 typedef struct {
     PyObject_HEAD
     unsigned long seed;
+    int backend;
+    /* The stream selected for counter-based generators */
+    uint32_t replicate_index;
+    uint32_t subsystem;
+    uint32_t stream;
     gsl_rng* rng;
 } RandomGenerator;
 
@@ -233,6 +238,7 @@ RandomGenerator_parse_seed(RandomGenerator *self, PyObject *py_seed)
 {
 
     int ret = -1;
+    int err;
     unsigned long long seed = PyLong_AsUnsignedLongLong(py_seed);
 
     if (PyErr_Occurred()) {
@@ -245,6 +251,15 @@ RandomGenerator_parse_seed(RandomGenerator *self, PyObject *py_seed)
     }
     self->seed = seed;
     gsl_rng_set(self->rng, self->seed);
+    if (self->backend == MSP_RNG_PHILOX) {
+        /* Reseeding keeps the currently selected stream */
+        err = msp_rng_set_stream(
+            self->rng, self->replicate_index, self->subsystem, self->stream);
+        if (err != 0) {
+            handle_library_error(err);
+            goto out;
+        }
+    }
     ret = 0;
 out:
     return ret;
@@ -254,14 +269,30 @@ static int
 RandomGenerator_init(RandomGenerator *self, PyObject *args, PyObject *kwds)
 {
     int ret = -1;
-    static char *kwlist[] = {"seed", NULL};
+    static char *kwlist[] = {"seed", "backend", NULL};
     PyObject *py_seed = NULL;
+    int backend = MSP_RNG_MT19937;
+    const gsl_rng_type *rng_type;
 
     self->rng = NULL;
-    if (!PyArg_ParseTupleAndKeywords(args, kwds, "|O", kwlist, &py_seed)) {
+    if (!PyArg_ParseTupleAndKeywords(args, kwds, "|Oi", kwlist,
+                &py_seed, &backend)) {
+        goto out;
+    }
+    rng_type = msp_rng_get_type(backend);
+    if (rng_type == NULL) {
+        PyErr_SetString(PyExc_ValueError, "Unknown random generator backend");
+        goto out;
+    }
+    self->backend = backend;
+    self->replicate_index = 0;
+    self->subsystem = MSP_RNG_SUBSYSTEM_ANCESTRY;
+    self->stream = 0;
+    self->rng = gsl_rng_alloc(rng_type);
+    if (self->rng == NULL) {
+        PyErr_NoMemory();
         goto out;
     }
-    self->rng = gsl_rng_alloc(gsl_rng_default);
     if (py_seed != NULL) {
         if (RandomGenerator_parse_seed(self, py_seed) != 0) {
             goto out;
@@ -285,6 +316,19 @@ out:
     return ret;
 }
 
+static PyObject *
+RandomGenerator_get_backend(RandomGenerator *self, void *closure)
+{
+    PyObject *ret = NULL;
+
+    if (RandomGenerator_check_state(self) != 0) {
+        goto out;
+    }
+    ret = Py_BuildValue("i", self->backend);
+out:
+    return ret;
+}
+
 static int
 RandomGenerator_set_seed(RandomGenerator *self, PyObject *args, void *closure)
 {
@@ -405,6 +449,70 @@ out:
     return ret;
 }
 
+static PyObject *
+RandomGenerator_set_stream(RandomGenerator *self, PyObject *args, PyObject *kwds)
+{
+    PyObject *ret = NULL;
+    int err;
+    static char *kwlist[] = {"replicate_index", "subsystem", "stream", NULL};
+    Py_ssize_t replicate_index, subsystem;
+    Py_ssize_t stream = 0;
+
+    if (RandomGenerator_check_state(self) != 0) {
+        goto out;
+    }
+    if (!PyArg_ParseTupleAndKeywords(args, kwds, "nn|n", kwlist,
+                &replicate_index, &subsystem, &stream)) {
+        goto out;
+    }
+    if (replicate_index < 0 || replicate_index > UINT32_MAX
+            || subsystem < 0 || subsystem > UINT32_MAX
+            || stream < 0 || stream > UINT32_MAX) {
+        PyErr_SetString(PyExc_ValueError,
+            "Stream identifiers must be between 0 and 2^32 - 1");
+        goto out;
+    }
+    err = msp_rng_set_stream(self->rng, (uint32_t) replicate_index,
+            (uint32_t) subsystem, (uint32_t) stream);
+    if (err != 0) {
+        handle_library_error(err);
+        goto out;
+    }
+    self->replicate_index = (uint32_t) replicate_index;
+    self->subsystem = (uint32_t) subsystem;
+    self->stream = (uint32_t) stream;
+    ret = Py_BuildValue("");
+out:
+    return ret;
+}
+
+static PyObject *
+RandomGenerator_skip(RandomGenerator *self, PyObject *args)
+{
+    PyObject *ret = NULL;
+    int err;
+    long long num_draws;
+
+    if (RandomGenerator_check_state(self) != 0) {
+        goto out;
+    }
+    if (!PyArg_ParseTuple(args, "L", &num_draws)) {
+        goto out;
+    }
+    if (num_draws < 0) {
+        PyErr_SetString(PyExc_ValueError, "Cannot skip a negative number of draws");
+        goto out;
+    }
+    err = msp_rng_skip(self->rng, (uint64_t) num_draws);
+    if (err != 0) {
+        handle_library_error(err);
+        goto out;
+    }
+    ret = Py_BuildValue("");
+out:
+    return ret;
+}
+
 static PyMethodDef RandomGenerator_methods[] = {
     {"flat", (PyCFunction) RandomGenerator_flat,
         METH_VARARGS, "Interface for gsl_ran_flat"},
@@ -412,6 +520,11 @@ static PyMethodDef RandomGenerator_methods[] = {
         METH_VARARGS, "Interface for gsl_ran_poisson"},
     {"uniform_int", (PyCFunction) RandomGenerator_uniform_int,
         METH_VARARGS, "Interface for gsl_rng_uniform_int"},
+    {"set_stream", (PyCFunction) RandomGenerator_set_stream,
+        METH_VARARGS|METH_KEYWORDS,
+        "Selects the stream of a counter-based generator"},
+    {"skip", (PyCFunction) RandomGenerator_skip,
+        METH_VARARGS, "Skips ahead the specified number of draws"},
     {NULL}  /* Sentinel */
 };
 
@@ -419,6 +532,8 @@ static PyGetSetDef RandomGenerator_getsetters[] = {
     {"seed", (getter) RandomGenerator_get_seed,
         (setter) RandomGenerator_set_seed,
             "The initial seed for this random generator" },
+    {"backend", (getter) RandomGenerator_get_backend, NULL,
+            "The backend used by this random generator" },
     {NULL}  /* Sentinel */
 };
 
@@ -1768,7 +1883,9 @@ Simulator_init(Simulator *self, PyObject *args, PyObject *kwds)
         "node_mapping_block_size", "store_migrations", "start_time",
         "store_full_arg", "num_labels", "gene_conversion_rate",
         "gene_conversion_tract_length", "discrete_genome",
-        "ploidy", NULL};
+        "ploidy", "scheduler", "instrumentation", "event_trace_size",
+        "variate_buffer_size", "exact_mass_index", "memory_limit", "huge_pages",
+        "segment_compaction_threshold", NULL};
     PyObject *migration_matrix = NULL;
     PyObject *population_configuration = NULL;
     PyObject *demographic_events = NULL;
@@ -1789,11 +1906,19 @@ Simulator_init(Simulator *self, PyObject *args, PyObject *kwds)
     double gene_conversion_rate = 0;
     double gene_conversion_tract_length = 1.0;
     int ploidy = 2;
+    int scheduler = MSP_SCHEDULER_DIRECT;
+    int instrumentation = false;
+    Py_ssize_t event_trace_size = 0;
+    Py_ssize_t variate_buffer_size = 0;
+    int exact_mass_index = false;
+    Py_ssize_t memory_limit = 0;
+    int huge_pages = false;
+    double segment_compaction_threshold = 0.25;
 
     self->sim = NULL;
     self->random_generator = NULL;
     if (!PyArg_ParseTupleAndKeywords(args, kwds,
-            "O!O!|O!O!OO!O!nnnidinddii", kwlist,
+            "O!O!|O!O!OO!O!nnnidinddiiiinninid", kwlist,
             &LightweightTableCollectionType, &tables,
             &RandomGeneratorType, &random_generator,
             /* optional */
@@ -1806,7 +1931,9 @@ Simulator_init(Simulator *self, PyObject *args, PyObject *kwds)
             &node_mapping_block_size, &store_migrations, &start_time,
             &store_full_arg, &num_labels,
             &gene_conversion_rate, &gene_conversion_tract_length,
-            &discrete_genome, &ploidy)) {
+            &discrete_genome, &ploidy, &scheduler, &instrumentation,
+            &event_trace_size, &variate_buffer_size, &exact_mass_index,
+            &memory_limit, &huge_pages, &segment_compaction_threshold)) {
         goto out;
     }
     self->random_generator = random_generator;
@@ -1895,6 +2022,59 @@ Simulator_init(Simulator *self, PyObject *args, PyObject *kwds)
         handle_input_error("set_ploidy", sim_ret);
         goto out;
     }
+    sim_ret = msp_set_scheduler(self->sim, scheduler);
+    if (sim_ret != 0) {
+        handle_input_error("set_scheduler", sim_ret);
+        goto out;
+    }
+    sim_ret = msp_set_instrumentation(self->sim, (bool) instrumentation);
+    if (sim_ret != 0) {
+        handle_input_error("set_instrumentation", sim_ret);
+        goto out;
+    }
+    if (event_trace_size < 0) {
+        PyErr_SetString(PyExc_ValueError, "event_trace_size must be >= 0");
+        goto out;
+    }
+    sim_ret = msp_set_event_trace_size(self->sim, (size_t) event_trace_size);
+    if (sim_ret != 0) {
+        handle_input_error("set_event_trace_size", sim_ret);
+        goto out;
+    }
+    if (variate_buffer_size < 0) {
+        PyErr_SetString(PyExc_ValueError, "variate_buffer_size must be >= 0");
+        goto out;
+    }
+    sim_ret = msp_set_variate_buffer_size(self->sim, (size_t) variate_buffer_size);
+    if (sim_ret != 0) {
+        handle_input_error("set_variate_buffer_size", sim_ret);
+        goto out;
+    }
+    sim_ret = msp_set_exact_mass_index(self->sim, (bool) exact_mass_index);
+    if (sim_ret != 0) {
+        handle_input_error("set_exact_mass_index", sim_ret);
+        goto out;
+    }
+    if (memory_limit < 0) {
+        PyErr_SetString(PyExc_ValueError, "memory_limit must be >= 0");
+        goto out;
+    }
+    sim_ret = msp_set_memory_limit(self->sim, (size_t) memory_limit);
+    if (sim_ret != 0) {
+        handle_input_error("set_memory_limit", sim_ret);
+        goto out;
+    }
+    sim_ret = msp_set_huge_pages(self->sim, (bool) huge_pages);
+    if (sim_ret != 0) {
+        handle_input_error("set_huge_pages", sim_ret);
+        goto out;
+    }
+    sim_ret = msp_set_segment_compaction_threshold(
+        self->sim, segment_compaction_threshold);
+    if (sim_ret != 0) {
+        handle_input_error("set_segment_compaction_threshold", sim_ret);
+        goto out;
+    }
 
     sim_ret = msp_set_num_labels(self->sim, (size_t) num_labels);
     if (sim_ret != 0) {
@@ -2054,6 +2234,30 @@ out:
     return ret;
 }
 
+static PyObject *
+Simulator_get_scheduler(Simulator *self, void *closure)
+{
+    PyObject *ret = NULL;
+    if (Simulator_check_sim(self) != 0) {
+        goto out;
+    }
+    ret = Py_BuildValue("i", msp_get_scheduler(self->sim));
+out:
+    return ret;
+}
+
+static PyObject *
+Simulator_get_instrumentation(Simulator *self, void *closure)
+{
+    PyObject *ret = NULL;
+    if (Simulator_check_sim(self) != 0) {
+        goto out;
+    }
+    ret = Py_BuildValue("i", msp_get_instrumentation(self->sim));
+out:
+    return ret;
+}
+
 static PyObject *
 Simulator_get_record_migrations(Simulator *self, void *closure)
 {
@@ -2319,6 +2523,225 @@ out:
     return ret;
 }
 
+static PyObject *
+Simulator_get_handler_timings(Simulator  *self, void *closure)
+{
+    PyObject *ret = NULL;
+    PyObject *dict = NULL;
+    PyObject *value = NULL;
+    size_t calls[MSP_NUM_TIMERS];
+    double elapsed[MSP_NUM_TIMERS];
+    int j, err;
+
+    if (Simulator_check_sim(self) != 0) {
+        goto out;
+    }
+    err = msp_get_timer_calls(self->sim, calls);
+    if (err != 0) {
+        handle_library_error(err);
+        goto out;
+    }
+    err = msp_get_timer_elapsed(self->sim, elapsed);
+    if (err != 0) {
+        handle_library_error(err);
+        goto out;
+    }
+    dict = PyDict_New();
+    if (dict == NULL) {
+        goto out;
+    }
+    for (j = 0; j < MSP_NUM_TIMERS; j++) {
+        value = Py_BuildValue("nd", (Py_ssize_t) calls[j], elapsed[j]);
+        if (value == NULL) {
+            goto out;
+        }
+        if (PyDict_SetItemString(dict, msp_get_timer_name(j), value) != 0) {
+            goto out;
+        }
+        Py_DECREF(value);
+        value = NULL;
+    }
+    ret = dict;
+    dict = NULL;
+out:
+    Py_XDECREF(dict);
+    Py_XDECREF(value);
+    return ret;
+}
+
+static PyObject *
+Simulator_get_memory_usage(Simulator  *self, void *closure)
+{
+    PyObject *ret = NULL;
+    PyObject *dict = NULL;
+    PyObject *value = NULL;
+    size_t current[MSP_NUM_MEMORY_CATEGORIES];
+    size_t peak[MSP_NUM_MEMORY_CATEGORIES];
+    int j, err;
+
+    if (Simulator_check_sim(self) != 0) {
+        goto out;
+    }
+    err = msp_get_memory_usage(self->sim, current, peak);
+    if (err != 0) {
+        handle_library_error(err);
+        goto out;
+    }
+    dict = PyDict_New();
+    if (dict == NULL) {
+        goto out;
+    }
+    for (j = 0; j < MSP_NUM_MEMORY_CATEGORIES; j++) {
+        value = Py_BuildValue("nn", (Py_ssize_t) current[j], (Py_ssize_t) peak[j]);
+        if (value == NULL) {
+            goto out;
+        }
+        if (PyDict_SetItemString(dict, msp_get_memory_category_name(j), value) != 0) {
+            goto out;
+        }
+        Py_DECREF(value);
+        value = NULL;
+    }
+    ret = dict;
+    dict = NULL;
+out:
+    Py_XDECREF(dict);
+    Py_XDECREF(value);
+    return ret;
+}
+
+static PyObject *
+Simulator_get_event_trace_size(Simulator  *self, void *closure)
+{
+    PyObject *ret = NULL;
+    if (Simulator_check_sim(self) != 0) {
+        goto out;
+    }
+    ret = Py_BuildValue("n", (Py_ssize_t) msp_get_event_trace_size(self->sim));
+out:
+    return ret;
+}
+
+static PyObject *
+Simulator_get_variate_buffer_size(Simulator  *self, void *closure)
+{
+    PyObject *ret = NULL;
+    if (Simulator_check_sim(self) != 0) {
+        goto out;
+    }
+    ret = Py_BuildValue("n", (Py_ssize_t) msp_get_variate_buffer_size(self->sim));
+out:
+    return ret;
+}
+
+static PyObject *
+Simulator_get_memory_limit(Simulator  *self, void *closure)
+{
+    PyObject *ret = NULL;
+    if (Simulator_check_sim(self) != 0) {
+        goto out;
+    }
+    ret = Py_BuildValue("n", (Py_ssize_t) msp_get_memory_limit(self->sim));
+out:
+    return ret;
+}
+
+static PyObject *
+Simulator_get_exact_mass_index(Simulator  *self, void *closure)
+{
+    PyObject *ret = NULL;
+    if (Simulator_check_sim(self) != 0) {
+        goto out;
+    }
+    ret = Py_BuildValue("i", msp_get_exact_mass_index(self->sim));
+out:
+    return ret;
+}
+
+static PyObject *
+Simulator_get_huge_pages(Simulator  *self, void *closure)
+{
+    PyObject *ret = NULL;
+    if (Simulator_check_sim(self) != 0) {
+        goto out;
+    }
+    ret = Py_BuildValue("i", msp_get_huge_pages(self->sim));
+out:
+    return ret;
+}
+
+static PyObject *
+Simulator_get_segment_compaction_threshold(Simulator  *self, void *closure)
+{
+    PyObject *ret = NULL;
+    if (Simulator_check_sim(self) != 0) {
+        goto out;
+    }
+    ret = Py_BuildValue("d", msp_get_segment_compaction_threshold(self->sim));
+out:
+    return ret;
+}
+
+static PyObject *
+Simulator_get_event_trace(Simulator  *self, void *closure)
+{
+    PyObject *ret = NULL;
+    PyArrayObject *time = NULL;
+    PyArrayObject *type = NULL;
+    PyArrayObject *population = NULL;
+    PyArrayObject *label = NULL;
+    PyArrayObject *num_segments = NULL;
+    PyArrayObject *num_edges = NULL;
+    event_trace_record_t *records = NULL;
+    npy_intp j, num_records;
+    int err;
+
+    if (Simulator_check_sim(self) != 0) {
+        goto out;
+    }
+    num_records = (npy_intp) msp_get_num_event_trace_records(self->sim);
+    records = PyMem_Malloc((1 + num_records) * sizeof(*records));
+    if (records == NULL) {
+        PyErr_NoMemory();
+        goto out;
+    }
+    err = msp_get_event_trace(self->sim, records);
+    if (err != 0) {
+        handle_library_error(err);
+        goto out;
+    }
+    time = (PyArrayObject *) PyArray_SimpleNew(1, &num_records, NPY_FLOAT64);
+    type = (PyArrayObject *) PyArray_SimpleNew(1, &num_records, NPY_INT32);
+    population = (PyArrayObject *) PyArray_SimpleNew(1, &num_records, NPY_INT32);
+    label = (PyArrayObject *) PyArray_SimpleNew(1, &num_records, NPY_INT32);
+    num_segments = (PyArrayObject *) PyArray_SimpleNew(1, &num_records, NPY_UINT32);
+    num_edges = (PyArrayObject *) PyArray_SimpleNew(1, &num_records, NPY_UINT32);
+    if (time == NULL || type == NULL || population == NULL || label == NULL
+            || num_segments == NULL || num_edges == NULL) {
+        goto out;
+    }
+    for (j = 0; j < num_records; j++) {
+        ((double *) PyArray_DATA(time))[j] = records[j].time;
+        ((int32_t *) PyArray_DATA(type))[j] = (int32_t) records[j].type;
+        ((int32_t *) PyArray_DATA(population))[j] = (int32_t) records[j].population;
+        ((int32_t *) PyArray_DATA(label))[j] = (int32_t) records[j].label;
+        ((uint32_t *) PyArray_DATA(num_segments))[j] = records[j].num_segments;
+        ((uint32_t *) PyArray_DATA(num_edges))[j] = records[j].num_edges;
+    }
+    ret = Py_BuildValue("{s:O,s:O,s:O,s:O,s:O,s:O}",
+            "time", time, "type", type, "population", population,
+            "label", label, "num_segments", num_segments, "num_edges", num_edges);
+out:
+    PyMem_Free(records);
+    Py_XDECREF(time);
+    Py_XDECREF(type);
+    Py_XDECREF(population);
+    Py_XDECREF(label);
+    Py_XDECREF(num_segments);
+    Py_XDECREF(num_edges);
+    return ret;
+}
+
 static PyObject *
 Simulator_get_num_multiple_recombination_events(Simulator  *self, void *closure)
 {
@@ -2429,36 +2852,45 @@ out:
 }
 
 static PyObject *
-Simulator_individual_to_python(Simulator *self, segment_t *ind)
+Simulator_individual_to_python(Simulator *self, segment_id_t ind)
 {
     PyObject *ret = NULL;
     PyObject *l = NULL;
     PyObject *t = NULL;
     size_t num_segments, j;
-    segment_t *u;
+    segment_id_t u;
+    segment_t seg;
+    int err;
 
     num_segments = 0;
-    u = ind;
-    while (u != NULL) {
+    for (u = ind; u != MSP_NULL_SEGMENT; u = seg.next) {
+        err = msp_get_segment(self->sim, u, &seg);
+        if (err != 0) {
+            handle_library_error(err);
+            goto out;
+        }
         num_segments++;
-        u = u->next;
     }
     l = PyList_New(num_segments);
     if (l == NULL) {
         goto out;
     }
-    u = ind;
     j = 0;
-    while (u != NULL) {
-        t = Py_BuildValue("(d,d,I,I)", u->left, u->right, u->value,
-                u->population);
+    for (u = ind; u != MSP_NULL_SEGMENT; u = seg.next) {
+        err = msp_get_segment(self->sim, u, &seg);
+        if (err != 0) {
+            Py_DECREF(l);
+            handle_library_error(err);
+            goto out;
+        }
+        t = Py_BuildValue("(d,d,I,I)", seg.left, seg.right, seg.value,
+                seg.population);
         if (t == NULL) {
             Py_DECREF(l);
             goto out;
         }
         PyList_SET_ITEM(l, j, t);
         j++;
-        u = u->next;
     }
     ret = l;
 out:
@@ -2471,7 +2903,7 @@ Simulator_get_ancestors(Simulator *self, void *closure)
     PyObject *ret = NULL;
     PyObject *l = NULL;
     PyObject *py_ind = NULL;
-    segment_t **ancestors = NULL;
+    segment_id_t *ancestors = NULL;
     size_t num_ancestors, j;
     int err;
 
@@ -2479,7 +2911,7 @@ Simulator_get_ancestors(Simulator *self, void *closure)
         goto out;
     }
     num_ancestors = msp_get_num_ancestors(self->sim);
-    ancestors = PyMem_Malloc(num_ancestors * sizeof(segment_t *));
+    ancestors = PyMem_Malloc(num_ancestors * sizeof(*ancestors));
     if (ancestors == NULL) {
         PyErr_NoMemory();
         goto out;
@@ -2653,16 +3085,17 @@ static PyObject *
 Simulator_run(Simulator *self, PyObject *args, PyObject *kwds)
 {
     PyObject *ret = NULL;
-    static char *kwlist[] = {"end_time", "max_events", NULL};
+    static char *kwlist[] = {"end_time", "max_events", "wall_time_limit", NULL};
     int status;
     unsigned long max_events = UINT32_MAX;
     double end_time = DBL_MAX;
+    double wall_time_limit = DBL_MAX;
 
     if (Simulator_check_sim(self) != 0) {
         goto out;
     }
-    if (!PyArg_ParseTupleAndKeywords(args, kwds, "|dk", kwlist,
-                &end_time, &max_events)) {
+    if (!PyArg_ParseTupleAndKeywords(args, kwds, "|dkd", kwlist,
+                &end_time, &max_events, &wall_time_limit)) {
         goto out;
     }
     if (end_time < 0) {
@@ -2673,6 +3106,15 @@ Simulator_run(Simulator *self, PyObject *args, PyObject *kwds)
         PyErr_SetString(PyExc_ValueError, "max_events must be > 0");
         goto out;
     }
+    if (!(wall_time_limit > 0)) {
+        PyErr_SetString(PyExc_ValueError, "wall_time_limit must be > 0");
+        goto out;
+    }
+    status = msp_set_wall_time_limit(self->sim, wall_time_limit);
+    if (status != 0) {
+        handle_library_error(status);
+        goto out;
+    }
 
     Py_BEGIN_ALLOW_THREADS
     status = msp_run(self->sim, end_time, max_events);
@@ -2725,6 +3167,25 @@ out:
     return ret;
 }
 
+static PyObject *
+Simulator_trim_memory(Simulator *self)
+{
+    PyObject *ret = NULL;
+    int status;
+
+    if (Simulator_check_sim(self) != 0) {
+        goto out;
+    }
+    status = msp_trim_memory(self->sim);
+    if (status < 0) {
+        handle_library_error(status);
+        goto out;
+    }
+    ret = Py_BuildValue("");
+out:
+    return ret;
+}
+
 static PyObject *
 Simulator_debug_demography(Simulator *self)
 {
@@ -2878,6 +3339,9 @@ static PyMethodDef Simulator_methods[] = {
             "if sample has coalesced and False otherwise." },
     {"reset", (PyCFunction) Simulator_reset, METH_NOARGS,
             "Resets the simulation so it's ready for another replicate."},
+    {"trim_memory", (PyCFunction) Simulator_trim_memory, METH_NOARGS,
+            "Returns the memory for unused blocks of segments, AVL nodes "
+            "and node mappings to the operating system."},
     {"finalise_tables", (PyCFunction) Simulator_finalise_tables, METH_NOARGS,
             "Finalises the tables so they're ready for export."},
     {"debug_demography", (PyCFunction) Simulator_debug_demography, METH_NOARGS,
@@ -2987,6 +3451,44 @@ static PyGetSetDef Simulator_getsetters[] = {
     {"num_fenwick_rebuilds",
             (getter) Simulator_get_num_fenwick_rebuilds, NULL,
             "The number of times fenwick_rebuild was called."},
+    {"handler_timings",
+            (getter) Simulator_get_handler_timings, NULL,
+            "A dictionary mapping each instrumented event handler to the "
+            "number of calls and the wall-clock time spent in it."},
+    {"memory_usage",
+            (getter) Simulator_get_memory_usage, NULL,
+            "A dictionary mapping each group of structures to the current "
+            "and peak number of bytes allocated for it. Peaks are recorded "
+            "as the structures grow, except for the short-lived overlap map "
+            "and scratch buffer allocations made within an event."},
+    {"event_trace_size",
+            (getter) Simulator_get_event_trace_size, NULL,
+            "The maximum number of events held in the event trace."},
+    {"event_trace",
+            (getter) Simulator_get_event_trace, NULL,
+            "A dictionary of arrays describing the most recent events, "
+            "oldest first."},
+    {"variate_buffer_size",
+            (getter) Simulator_get_variate_buffer_size, NULL,
+            "The number of random variates generated in each block."},
+    {"memory_limit",
+            (getter) Simulator_get_memory_limit, NULL,
+            "The maximum number of bytes used by the simulation, or 0 if "
+            "there is no limit."},
+    {"exact_mass_index",
+            (getter) Simulator_get_exact_mass_index, NULL,
+            "True if the recombination and gene conversion mass indexes use "
+            "exact fixed-point sums. These support at most about 16.7 million "
+            "lineages spanning the whole genome, and round each segment's mass "
+            "to 2^-40 of the total mass of the rate map."},
+    {"huge_pages",
+            (getter) Simulator_get_huge_pages, NULL,
+            "True if the simulation heaps and mass indexes are allocated in "
+            "huge pages."},
+    {"segment_compaction_threshold",
+            (getter) Simulator_get_segment_compaction_threshold, NULL,
+            "The fraction of segment IDs in use below which the IDs are "
+            "compacted and the mass indexes shrunk."},
     {"population_configuration",
             (getter) Simulator_get_population_configuration, NULL,
             "The population configurations"},
@@ -3017,6 +3519,12 @@ static PyGetSetDef Simulator_getsetters[] = {
     {"ploidy",
             (getter) Simulator_get_ploidy, NULL,
             "Returns the simulation ploidy." },
+    {"scheduler",
+            (getter) Simulator_get_scheduler, NULL,
+            "The method used to choose the next event." },
+    {"instrumentation",
+            (getter) Simulator_get_instrumentation, NULL,
+            "True if the event handlers are being timed." },
     {"tables",
             (getter) Simulator_get_tables, NULL,
             "The tables"},
@@ -3099,20 +3607,25 @@ msprime_sim_mutations(PyObject *self, PyObject *args, PyObject *kwds)
     size_t size;
     mutation_model_t *model = NULL;
     int discrete_genome = false;
+    Py_ssize_t variate_buffer_size = 0;
     static char *kwlist[] = {
         "tables", "random_generator", "rate_map", "model",
         "discrete_genome", "keep",
-        "start_time", "end_time", NULL};
+        "start_time", "end_time", "variate_buffer_size", NULL};
     mutgen_t mutgen;
     int err;
 
     memset(&mutgen, 0, sizeof(mutgen));
-    if (!PyArg_ParseTupleAndKeywords(args, kwds, "O!O!O!O|iidd", kwlist,
+    if (!PyArg_ParseTupleAndKeywords(args, kwds, "O!O!O!O|iiddn", kwlist,
             &LightweightTableCollectionType, &tables,
             &RandomGeneratorType, &random_generator,
             &PyDict_Type, &rate_map,
             &py_model, &discrete_genome, &keep,
-            &start_time, &end_time)) {
+            &start_time, &end_time, &variate_buffer_size)) {
+        goto out;
+    }
+    if (variate_buffer_size < 0) {
+        PyErr_SetString(PyExc_ValueError, "variate_buffer_size must be >= 0");
         goto out;
     }
     if (LightweightTableCollection_check_state(tables) != 0
@@ -3147,6 +3660,11 @@ msprime_sim_mutations(PyObject *self, PyObject *args, PyObject *kwds)
         handle_library_error(err);
         goto out;
     }
+    err = mutgen_set_variate_buffer_size(&mutgen, (size_t) variate_buffer_size);
+    if (err != 0) {
+        handle_library_error(err);
+        goto out;
+    }
     if (discrete_genome) {
         flags |= MSP_DISCRETE_SITES;
     }
@@ -3340,6 +3858,28 @@ PyInit__msprime(void)
     PyModule_AddIntConstant(module, "EXIT_MAX_EVENTS", MSP_EXIT_MAX_EVENTS);
     PyModule_AddIntConstant(module, "EXIT_MAX_TIME", MSP_EXIT_MAX_TIME);
     PyModule_AddIntConstant(module, "EXIT_MODEL_COMPLETE", MSP_EXIT_MODEL_COMPLETE);
+    PyModule_AddIntConstant(module, "EXIT_WALL_TIME", MSP_EXIT_WALL_TIME);
+    PyModule_AddIntConstant(module, "EXIT_MEMORY_LIMIT", MSP_EXIT_MEMORY_LIMIT);
+
+    PyModule_AddIntConstant(module, "RNG_MT19937", MSP_RNG_MT19937);
+    PyModule_AddIntConstant(module, "RNG_XOSHIRO256PP", MSP_RNG_XOSHIRO256PP);
+    PyModule_AddIntConstant(module, "RNG_PCG64", MSP_RNG_PCG64);
+    PyModule_AddIntConstant(module, "RNG_PHILOX", MSP_RNG_PHILOX);
+    PyModule_AddIntConstant(module, "RNG_SUBSYSTEM_ANCESTRY", MSP_RNG_SUBSYSTEM_ANCESTRY);
+    PyModule_AddIntConstant(module, "RNG_SUBSYSTEM_MUTATIONS",
+            MSP_RNG_SUBSYSTEM_MUTATIONS);
+
+    PyModule_AddIntConstant(module, "SCHEDULER_DIRECT", MSP_SCHEDULER_DIRECT);
+    PyModule_AddIntConstant(
+        module, "SCHEDULER_NEXT_REACTION", MSP_SCHEDULER_NEXT_REACTION);
+
+    PyModule_AddIntConstant(module, "TRACE_RECOMBINATION", MSP_TRACE_RECOMBINATION);
+    PyModule_AddIntConstant(
+        module, "TRACE_GENE_CONVERSION", MSP_TRACE_GENE_CONVERSION);
+    PyModule_AddIntConstant(
+        module, "TRACE_COMMON_ANCESTOR", MSP_TRACE_COMMON_ANCESTOR);
+    PyModule_AddIntConstant(module, "TRACE_MIGRATION", MSP_TRACE_MIGRATION);
+    PyModule_AddIntConstant(module, "TRACE_FIXED_EVENTS", MSP_TRACE_FIXED_EVENTS);
 
     /* The function unset_gsl_error_handler should be called at import time,
      * ensuring we capture the value of the handler. However, just in case
@@ -56,6 +56,13 @@ class TimeUnitsMismatchWarning(UserWarning):
     """
 
 
+class MemoryLimitWarning(UserWarning):
+    """
+    Warning raised when a simulation stops early because it has exceeded
+    its memory limit. The returned tree sequence holds the partial result.
+    """
+
+
 def _model_factory(model: None | str | AncestryModel) -> AncestryModel:
     """
     Returns an AncestryModel corresponding to the specified model
@@ -649,12 +656,17 @@ def _wrap_replicates(
     if num_replicates is None and replicate_index is None:
         # Default single-replicate case.
         replicate_index = 0
+    start_index = 0
     if replicate_index is not None:
         num_replicates = replicate_index + 1
+        if simulator.counter_based_rng:
+            # Each replicate has its own stream, so we can go straight to it.
+            start_index = replicate_index
     iterator = simulator.run_replicates(
         num_replicates,
         mutation_rate=mutation_rate,
         provenance_dict=provenance_dict,
+        start_index=start_index,
     )
     if replicate_index is not None:
         deque = collections.deque(iterator, maxlen=1)
@@ -793,6 +805,15 @@ def _parse_sim_ancestry(
     num_labels=None,
     random_seed=None,
     init_for_debugger=False,
+    scheduler=None,
+    instrumentation=False,
+    event_trace_size=0,
+    variate_buffer_size=0,
+    exact_mass_index=False,
+    memory_limit=0,
+    huge_pages=False,
+    segment_compaction_threshold=0.25,
+    rng_backend=None,
 ):
     """
     Argument parser for the sim_ancestry frontend. Interprets all the parameters
@@ -1005,7 +1026,9 @@ def _parse_sim_ancestry(
     # It's useful to call _parse_sim_ancestry outside the context of the main
     # entry point - so we want to get good seeds in this case too.
     random_seed = _parse_random_seed(random_seed)
-    random_generator = _msprime.RandomGenerator(random_seed)
+    random_generator = _msprime.RandomGenerator(
+        random_seed, backend=core._parse_rng_backend(rng_backend)
+    )
 
     return Simulator(
         tables=initial_state,
@@ -1022,6 +1045,14 @@ def _parse_sim_ancestry(
         end_time=end_time,
         num_labels=num_labels,
         random_generator=random_generator,
+        scheduler=scheduler,
+        instrumentation=instrumentation,
+        event_trace_size=event_trace_size,
+        variate_buffer_size=variate_buffer_size,
+        exact_mass_index=exact_mass_index,
+        memory_limit=memory_limit,
+        huge_pages=huge_pages,
+        segment_compaction_threshold=segment_compaction_threshold,
     )
 
 
@@ -1047,6 +1078,7 @@ def sim_ancestry(
     num_replicates=None,
     replicate_index=None,
     record_provenance=None,
+    rng_backend=None,
 ):
     """
     Simulates an ancestral process described by the specified model, demography and
@@ -1152,6 +1184,14 @@ def sim_ancestry(
         the genome. See the :ref:`sec_ancestry_end_time` section for examples.
     :param bool record_provenance: If True (the default), record all input
         parameters in the tree sequence :ref:`tskit:sec_provenance`.
+    :param str rng_backend: The pseudorandom number generator to use; one
+        of ``"mt19937"`` (the Mersenne Twister, the default),
+        ``"xoshiro256++"``, ``"pcg64"`` or ``"philox"``. The faster generators
+        give statistically equivalent but not identical results to the default
+        for a given ``random_seed``. The counter-based ``"philox"`` generator
+        gives each replicate its own stream, so that a given
+        ``replicate_index`` is simulated directly and the output does not
+        depend on how replicates are distributed between processes or threads.
     :param model: The ancestry model to use. This can be either a
         single instance of :class:`.AncestryModel` (or a string that can be
         interpreted as an ancestry model), or a list of :class:`.AncestryModel`
@@ -1200,6 +1240,7 @@ def sim_ancestry(
             record_full_arg=record_full_arg,
             num_labels=num_labels,
             random_seed=random_seed,
+            rng_backend=rng_backend,
             # num_replicates is excluded as provenance is per replicate
             # replicate index is excluded as it is inserted for each replicate
         )
@@ -1222,6 +1263,7 @@ def sim_ancestry(
         record_full_arg=record_full_arg,
         num_labels=num_labels,
         random_seed=random_seed,
+        rng_backend=rng_backend,
     )
     return _wrap_replicates(
         sim,
@@ -1259,6 +1301,18 @@ class ExitReason(enum.IntEnum):
     resulting in coalescence.
     """
 
+    WALL_TIME = _msprime.EXIT_WALL_TIME
+    """
+    We ran for the specified maximum wall-clock time. Like MAX_EVENTS,
+    this is used to return to Python at regular intervals.
+    """
+
+    MEMORY_LIMIT = _msprime.EXIT_MEMORY_LIMIT
+    """
+    The simulation used more than the specified maximum amount of memory
+    and was stopped early.
+    """
+
 
 class Simulator(_msprime.Simulator):
     """
@@ -1269,6 +1323,13 @@ class Simulator(_msprime.Simulator):
     arbitrarily between versions.
     """
 
+    # The number of seconds of wall-clock time after which the low-level
+    # simulator returns control to Python when no event chunk is given. The
+    # number of events run in each slice depends on the speed of the machine,
+    # but the output does not: the low-level simulator carries on from where
+    # it left off on each call.
+    wall_time_slice = 1.0
+
     def __init__(
         self,
         *,
@@ -1286,6 +1347,14 @@ class Simulator(_msprime.Simulator):
         start_time=None,
         end_time=None,
         num_labels=None,
+        scheduler=None,
+        instrumentation=False,
+        event_trace_size=0,
+        variate_buffer_size=0,
+        exact_mass_index=False,
+        memory_limit=0,
+        huge_pages=False,
+        segment_compaction_threshold=0.25,
     ):
         # We always need at least n segments, so no point in making
         # allocation any smaller than this.
@@ -1315,6 +1384,10 @@ class Simulator(_msprime.Simulator):
         gene_conversion_rate = gene_conversion_map.rate[0]
 
         start_time = -1 if start_time is None else start_time
+        # The next reaction scheduler is an alternative to the default
+        # direct method, mainly of interest for benchmarking large
+        # structured models.
+        scheduler = _msprime.SCHEDULER_DIRECT if scheduler is None else scheduler
         super().__init__(
             tables=ll_tables,
             recombination_map=ll_recomb_map,
@@ -1333,6 +1406,14 @@ class Simulator(_msprime.Simulator):
             gene_conversion_tract_length=gene_conversion_tract_length,
             discrete_genome=discrete_genome,
             ploidy=ploidy,
+            scheduler=scheduler,
+            instrumentation=instrumentation,
+            event_trace_size=event_trace_size,
+            variate_buffer_size=variate_buffer_size,
+            exact_mass_index=exact_mass_index,
+            memory_limit=memory_limit,
+            huge_pages=huge_pages,
+            segment_compaction_threshold=segment_compaction_threshold,
         )
         # Highlevel attributes used externally that have no lowlevel equivalent
         self.end_time = np.inf if end_time is None else end_time
@@ -1342,6 +1423,10 @@ class Simulator(_msprime.Simulator):
         # when we'll take the same approach as the recombination map.
         self.gene_conversion_map = gene_conversion_map
 
+    @property
+    def counter_based_rng(self):
+        return self.random_generator.backend == _msprime.RNG_PHILOX
+
     def copy_tables(self):
         """
         Returns a copy of the underlying table collection. This is useful
@@ -1366,6 +1451,27 @@ class Simulator(_msprime.Simulator):
     def recombination_map(self):
         return intervals.RateMap(**super().recombination_map)
 
+    @property
+    def event_trace(self):
+        """
+        Returns the events held in the event trace as a numpy structured
+        array, oldest first. The ``type`` field is one of the
+        ``_msprime.TRACE_*`` constants.
+        """
+        columns = super().event_trace
+        dtype = [
+            ("time", np.float64),
+            ("type", np.int32),
+            ("population", np.int32),
+            ("label", np.int32),
+            ("num_segments", np.uint32),
+            ("num_edges", np.uint32),
+        ]
+        trace = np.zeros(len(columns["time"]), dtype=dtype)
+        for name, _ in dtype:
+            trace[name] = columns[name]
+        return trace
+
     def _choose_num_labels(self, models):
         """
         Choose the number of labels appropriately, given the ancestry
@@ -1412,19 +1518,22 @@ class Simulator(_msprime.Simulator):
         return ll_recomb_map
 
     def _run_until(self, end_time, event_chunk=None, debug_func=None):
-        # This is a pretty big default event chunk so that we don't spend
-        # too much time going back and forth into Python. We could imagine
-        # doing something a bit more sophisticated where we try to tune the
-        # number of events so that we end up with roughly 10 second slices
-        # (say).
+        # Unless a number of events per chunk is specified, we return to
+        # Python after a fixed slice of wall-clock time. This way fast models
+        # don't spend time going back and forth into Python, and slow models
+        # still return regularly to update logs and check if CTRL-C has been
+        # hit.
+        run_kwargs = {"end_time": end_time}
         if event_chunk is None:
-            event_chunk = 10 ** 4
-        if event_chunk <= 0:
-            raise ValueError("Must have at least 1 event per chunk")
+            run_kwargs["wall_time_limit"] = self.wall_time_slice
+        else:
+            if event_chunk <= 0:
+                raise ValueError("Must have at least 1 event per chunk")
+            run_kwargs["max_events"] = event_chunk
         logger.info("Running model %s until max time: %f", self.model, end_time)
         ret = ExitReason.MAX_EVENTS
-        while ret == ExitReason.MAX_EVENTS:
-            ret = ExitReason(super().run(end_time, event_chunk))
+        while ret in (ExitReason.MAX_EVENTS, ExitReason.WALL_TIME):
+            ret = ExitReason(super().run(**run_kwargs))
             if self.time > end_time:
                 # Currently the Pedigree and Sweeps models are "non-reentrant"
                 # We can change this to an assertion once these have been fixed.
@@ -1460,6 +1569,13 @@ class Simulator(_msprime.Simulator):
                 raise ValueError("Model durations must be >= 0")
             end_time = min(self.time + model_duration, self.end_time)
             exit_reason = self._run_until(end_time, event_chunk, debug_func)
+            if exit_reason == ExitReason.MEMORY_LIMIT:
+                warnings.warn(
+                    f"Memory limit of {self.memory_limit} bytes exceeded at "
+                    f"time={self.time:g}; returning the partial result",
+                    MemoryLimitWarning,
+                )
+                break
             if exit_reason == ExitReason.COALESCENCE or self.time == self.end_time:
                 logger.debug("Skipping remaining %d models", len(self.models) - j - 1)
                 break
@@ -1477,10 +1593,15 @@ class Simulator(_msprime.Simulator):
         *,
         mutation_rate=None,
         provenance_dict=None,
+        start_index=0,
     ):
         """
         Sequentially yield the specified number of simulation replicates.
+        If the random generator is counter-based each replicate draws from
+        its own stream, and the replicates before start_index are skipped.
         """
+        if start_index != 0 and not self.counter_based_rng:
+            raise ValueError("Can only skip replicates with a counter-based rng")
         encoded_provenance = None
         # The JSON is modified for each replicate to insert the replicate number.
         # To avoid repeatedly encoding the same JSON (which can take milliseconds)
@@ -1492,10 +1613,18 @@ class Simulator(_msprime.Simulator):
                 provenance_dict, num_replicates
             )
 
-        for replicate_index in range(num_replicates):
+        for replicate_index in range(start_index, num_replicates):
             logger.info("Starting replicate %d", replicate_index)
+            if self.counter_based_rng:
+                self.random_generator.set_stream(
+                    replicate_index, _msprime.RNG_SUBSYSTEM_ANCESTRY
+                )
             self.run()
             if mutation_rate is not None:
+                if self.counter_based_rng:
+                    self.random_generator.set_stream(
+                        replicate_index, _msprime.RNG_SUBSYSTEM_MUTATIONS
+                    )
                 # This is only called from simulate() or the ms interface,
                 # so does not need any further parameters.
                 mutations._simple_mutate(
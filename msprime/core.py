@@ -122,6 +122,33 @@ def _parse_flag(value: Any, *, default: bool) -> bool:
     return value
 
 
+# The available random number generator backends, keyed by the names
+# accepted by the ``rng_backend`` arguments of sim_ancestry and sim_mutations.
+RNG_BACKENDS = {
+    "mt19937": _msprime.RNG_MT19937,
+    "xoshiro256++": _msprime.RNG_XOSHIRO256PP,
+    "pcg64": _msprime.RNG_PCG64,
+    "philox": _msprime.RNG_PHILOX,
+}
+
+
+def _parse_rng_backend(value: Any) -> int:
+    """
+    Parses a random number generator backend name, returning the low-level
+    constant. If the value is None, the default Mersenne Twister is used.
+    """
+    if value is None:
+        value = "mt19937"
+    if not isinstance(value, str):
+        raise TypeError("rng_backend must be a string")
+    try:
+        return RNG_BACKENDS[value.lower()]
+    except KeyError:
+        raise ValueError(
+            f"Unknown rng_backend '{value}'; must be one of {list(RNG_BACKENDS)}"
+        )
+
+
 @dataclasses.dataclass
 class TableEntry:
     data: str
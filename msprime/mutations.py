@@ -1248,6 +1248,7 @@ def sim_mutations(
     end_time=None,
     discrete_genome=None,
     keep=None,
+    rng_backend=None,
 ):
     """
     Simulates mutations on the specified ancestry and returns the resulting
@@ -1317,6 +1318,9 @@ def sim_mutations(
     :param bool discrete_genome: Whether to generate mutations at only integer positions
         along the genome (Default=True).
     :param bool keep: Whether to keep existing mutations. (default: True)
+    :param str rng_backend: The pseudorandom number generator to use; one
+        of ``"mt19937"`` (the default), ``"xoshiro256++"``, ``"pcg64"`` or
+        ``"philox"``. See :func:`.sim_ancestry` for details.
     :return: The :class:`tskit.TreeSequence` object resulting from overlaying
         mutations on the input tree sequence.
     :rtype: :class:`tskit.TreeSequence`
@@ -1341,6 +1345,7 @@ def sim_mutations(
         discrete_genome=discrete_genome,
         keep=keep,
         random_seed=seed,
+        rng_backend=rng_backend,
     )
     encoded_provenance = provenance.json_encode_provenance(
         provenance.get_provenance_dict(parameters)
@@ -1369,7 +1374,10 @@ def sim_mutations(
     keep = core._parse_flag(keep, default=True)
 
     model = mutation_model_factory(model)
-    rng = _msprime.RandomGenerator(seed)
+    rng = _msprime.RandomGenerator(seed, backend=core._parse_rng_backend(rng_backend))
+    if rng.backend == _msprime.RNG_PHILOX:
+        # Keep mutations independent of an ancestry simulation with the same seed
+        rng.set_stream(0, _msprime.RNG_SUBSYSTEM_MUTATIONS)
     lwt = _msprime.LightweightTableCollection()
     lwt.fromdict(tables.asdict())
     _msprime.sim_mutations(
@@ -75,7 +75,11 @@ msp_source_files = [
     "avl.c",
     "util.c",
     "object_heap.c",
+    "breakpoint_set.c",
+    "overlap_map.c",
+    "segment_pool.c",
     "rate_map.c",
+    "rng.c",
     "mutgen.c",
     "likelihood.c",
 ]
@@ -19,6 +19,7 @@
 """
 Test cases for basic ancestry simulation operations.
 """
+import concurrent.futures
 import datetime
 import json
 import logging
@@ -33,6 +34,7 @@ import tskit
 import msprime
 from msprime import _msprime
 from msprime import ancestry
+from msprime import core
 
 
 def tree_sequences_equal(ts1, ts2):
@@ -268,6 +270,205 @@ class TestSimulator:
             r = random.random()
             self.verify_simulation(n, m, r)
 
+    @pytest.mark.parametrize("growth_rate", [0, 0.1])
+    def test_next_reaction_scheduler(self, growth_rate):
+        demography = msprime.Demography.island_model([1] * 3, migration_rate=0.5)
+        demography.populations[0].growth_rate = growth_rate
+        for scheduler in [_msprime.SCHEDULER_DIRECT, _msprime.SCHEDULER_NEXT_REACTION]:
+            sim = ancestry._parse_sim_ancestry(
+                {0: 5, 1: 5, 2: 5},
+                demography=demography,
+                sequence_length=10,
+                recombination_rate=0.1,
+                gene_conversion_rate=0.1,
+                gene_conversion_tract_length=2,
+                random_seed=2,
+                scheduler=scheduler,
+            )
+            assert sim.scheduler == scheduler
+            ts = next(sim.run_replicates(1))
+            assert all(tree.num_roots == 1 for tree in ts.trees())
+            assert sim.num_common_ancestor_events > 0
+            assert sim.num_recombination_events > 0
+            assert np.sum(sim.num_migration_events) > 0
+
+    @pytest.mark.parametrize("variate_buffer_size", [0, 1, 1000])
+    def test_variate_buffer_size(self, variate_buffer_size):
+        replicates = []
+        for _ in range(2):
+            sim = ancestry._parse_sim_ancestry(
+                10,
+                sequence_length=10,
+                recombination_rate=0.1,
+                gene_conversion_rate=0.1,
+                gene_conversion_tract_length=1,
+                random_seed=2,
+                variate_buffer_size=variate_buffer_size,
+            )
+            assert sim.variate_buffer_size == variate_buffer_size
+            replicates.append(list(sim.run_replicates(3)))
+        for ts1, ts2 in zip(*replicates):
+            assert ts1.tables == ts2.tables
+
+    @pytest.mark.parametrize("discrete_genome", [True, False])
+    def test_exact_mass_index(self, discrete_genome):
+        replicates = []
+        for _ in range(2):
+            sim = ancestry._parse_sim_ancestry(
+                10,
+                sequence_length=10,
+                recombination_rate=0.1,
+                gene_conversion_rate=0.1,
+                gene_conversion_tract_length=1,
+                discrete_genome=discrete_genome,
+                random_seed=2,
+                exact_mass_index=True,
+            )
+            assert sim.exact_mass_index
+            replicates.append(list(sim.run_replicates(3)))
+            assert sim.num_fenwick_rebuilds == 0
+        for ts1, ts2 in zip(*replicates):
+            assert ts1.tables == ts2.tables
+            assert ts1.num_trees > 1
+
+    def test_huge_pages(self):
+        replicates = []
+        for huge_pages in [False, True]:
+            sim = ancestry._parse_sim_ancestry(
+                10,
+                sequence_length=10,
+                recombination_rate=0.1,
+                gene_conversion_rate=0.1,
+                gene_conversion_tract_length=1,
+                random_seed=2,
+                huge_pages=huge_pages,
+            )
+            assert sim.huge_pages == huge_pages
+            replicates.append(list(sim.run_replicates(3)))
+        for ts1, ts2 in zip(*replicates):
+            assert ts1.tables == ts2.tables
+
+    def test_segment_compaction_threshold(self):
+        for threshold in [0, 0.5]:
+            sim = ancestry._parse_sim_ancestry(
+                10,
+                sequence_length=10,
+                recombination_rate=0.1,
+                gene_conversion_rate=0.1,
+                gene_conversion_tract_length=1,
+                random_seed=2,
+                segment_compaction_threshold=threshold,
+            )
+            assert sim.segment_compaction_threshold == threshold
+            for ts in sim.run_replicates(3):
+                assert ts.num_trees > 1
+                assert all(tree.num_roots == 1 for tree in ts.trees())
+
+    @pytest.mark.parametrize(
+        "rng_backend", ["mt19937", "xoshiro256++", "pcg64", "philox"]
+    )
+    def test_rng_backend(self, rng_backend):
+        replicates = []
+        for _ in range(2):
+            sim = ancestry._parse_sim_ancestry(
+                10,
+                sequence_length=10,
+                recombination_rate=0.1,
+                random_seed=2,
+                rng_backend=rng_backend,
+            )
+            assert sim.random_generator.backend == core.RNG_BACKENDS[rng_backend]
+            replicates.append(list(sim.run_replicates(3)))
+        for ts1, ts2 in zip(*replicates):
+            assert ts1.tables == ts2.tables
+
+    def test_rng_backend_provenance(self):
+        ts = msprime.sim_ancestry(5, random_seed=2, rng_backend="pcg64")
+        params = json.loads(ts.provenance(0).record)["parameters"]
+        assert params["rng_backend"] == "pcg64"
+        ts2 = msprime.sim_ancestry(5, random_seed=2, rng_backend="PCG64")
+        assert ts.tables.edges == ts2.tables.edges
+
+    @pytest.mark.parametrize("bad_backend", ["", "mt", "xoshiro256"])
+    def test_bad_rng_backend(self, bad_backend):
+        with pytest.raises(ValueError):
+            msprime.sim_ancestry(5, random_seed=2, rng_backend=bad_backend)
+
+    def test_bad_rng_backend_type(self):
+        with pytest.raises(TypeError):
+            msprime.sim_ancestry(5, random_seed=2, rng_backend=1)
+
+    @pytest.mark.parametrize("num_threads", [1, 4, 32])
+    def test_counter_based_replicates_threads(self, num_threads):
+        kwargs = dict(
+            samples=5,
+            sequence_length=10,
+            recombination_rate=0.1,
+            random_seed=42,
+            rng_backend="philox",
+        )
+        sequential = list(msprime.sim_ancestry(num_replicates=32, **kwargs))
+        with concurrent.futures.ThreadPoolExecutor(num_threads) as executor:
+            futures = [
+                executor.submit(msprime.sim_ancestry, replicate_index=j, **kwargs)
+                for j in range(32)
+            ]
+            parallel = [future.result() for future in futures]
+        for ts1, ts2 in zip(sequential, parallel):
+            ts1.tables.assert_equals(ts2.tables, ignore_provenance=True)
+        assert sequential[0].tables.edges != sequential[1].tables.edges
+
+    def test_counter_based_replicate_index_skips(self):
+        sim = ancestry._parse_sim_ancestry(5, random_seed=2, rng_backend="philox")
+        assert sim.counter_based_rng
+        replicates = list(sim.run_replicates(4))
+        sim = ancestry._parse_sim_ancestry(5, random_seed=2, rng_backend="philox")
+        skipped = list(sim.run_replicates(4, start_index=2))
+        assert len(skipped) == 2
+        for ts1, ts2 in zip(replicates[2:], skipped):
+            assert ts1.tables.edges == ts2.tables.edges
+        sim = ancestry._parse_sim_ancestry(5, random_seed=2)
+        assert not sim.counter_based_rng
+        with pytest.raises(ValueError):
+            list(sim.run_replicates(4, start_index=2))
+
+    @pytest.mark.parametrize("event_trace_size", [1, 10, 10 ** 6])
+    def test_event_trace(self, event_trace_size):
+        demography = msprime.Demography.island_model([1] * 2, migration_rate=0.5)
+        sim = ancestry._parse_sim_ancestry(
+            {0: 5, 1: 5},
+            demography=demography,
+            sequence_length=10,
+            recombination_rate=0.1,
+            random_seed=2,
+            event_trace_size=event_trace_size,
+        )
+        assert sim.event_trace_size == event_trace_size
+        assert len(sim.event_trace) == 0
+        next(sim.run_replicates(1))
+        trace = sim.event_trace
+        num_events = (
+            sim.num_common_ancestor_events
+            + sim.num_recombination_events
+            + np.sum(sim.num_migration_events)
+        )
+        assert len(trace) == min(num_events, event_trace_size)
+        assert np.all(np.diff(trace["time"]) >= 0)
+        assert trace["time"][-1] == sim.time
+        assert trace["type"][-1] == _msprime.TRACE_COMMON_ANCESTOR
+        if event_trace_size >= num_events:
+            types = trace["type"]
+            assert np.sum(types == _msprime.TRACE_COMMON_ANCESTOR) == (
+                sim.num_common_ancestor_events
+            )
+            assert np.sum(types == _msprime.TRACE_RECOMBINATION) == (
+                sim.num_recombination_events
+            )
+            assert np.sum(types == _msprime.TRACE_MIGRATION) == np.sum(
+                sim.num_migration_events
+            )
+            assert np.sum(trace["num_edges"]) >= sim.num_edges
+
     def test_perf_parameters(self):
         sim = ancestry._parse_simulate(10)
         sim.run()
@@ -296,6 +497,63 @@ class TestSimulator:
         sim.run(event_chunk=1, debug_func=f)
         assert count > 0
 
+    def test_wall_time_slice(self):
+        sim = ancestry._parse_simulate(100, length=10, recombination_rate=1)
+        assert sim.wall_time_slice > 0
+        # The clock is only read after a fixed number of events, so we
+        # return after every check with a tiny slice.
+        sim.wall_time_slice = 1e-300
+        count = 0
+
+        def f(sim):
+            nonlocal count
+            count += 1
+
+        sim.run(debug_func=f)
+        assert count > 1
+        assert sim.num_ancestors == 0
+
+    @pytest.mark.parametrize(
+        "scheduler", [_msprime.SCHEDULER_DIRECT, _msprime.SCHEDULER_NEXT_REACTION]
+    )
+    def test_event_chunk_does_not_change_output(self, scheduler):
+        # The low-level simulator carries on where it left off on each call,
+        # so how the run is divided into chunks doesn't change the result.
+        demography = msprime.Demography.island_model([100, 100], 0.1)
+        tables = []
+        for event_chunk in [None, 1, 7, 10 ** 4]:
+            sim = ancestry._parse_sim_ancestry(
+                samples={0: 10, 1: 10},
+                demography=demography,
+                sequence_length=100,
+                recombination_rate=0.01,
+                gene_conversion_rate=0.01,
+                gene_conversion_tract_length=5,
+                random_seed=42,
+                scheduler=scheduler,
+            )
+            sim.run(event_chunk=event_chunk)
+            sim.finalise_tables()
+            tables.append(sim.copy_tables())
+        assert tables[0].edges.num_rows > 0
+        for other in tables[1:]:
+            assert tables[0] == other
+
+    def test_memory_limit(self):
+        sim = ancestry._parse_sim_ancestry(
+            10, sequence_length=10, recombination_rate=0.1, memory_limit=1
+        )
+        assert sim.memory_limit == 1
+        with pytest.warns(msprime.MemoryLimitWarning, match="Memory limit"):
+            ts = next(sim.run_replicates(1))
+        assert ts.num_samples == 20
+        assert ts.first().num_roots == 20
+        sim = ancestry._parse_sim_ancestry(
+            10, sequence_length=10, recombination_rate=0.1, memory_limit=2 ** 40
+        )
+        ts = next(sim.run_replicates(1))
+        assert all(tree.num_roots == 1 for tree in ts.trees())
+
     def test_info_logging(self, caplog):
         sim = ancestry._parse_simulate(10)
         sim.random_generator.seed = 42
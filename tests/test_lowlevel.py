@@ -1076,6 +1076,108 @@ class TestSimulator(LowLevelTestCase):
         sim.run(max_events=1)
         assert sim.time > 0
 
+    def test_run_wall_time_limit(self):
+        sim = make_sim(
+            100, sequence_length=10, recombination_map=uniform_rate_map(L=10, rate=1)
+        )
+        for bad_type in ["sdf", [], {}]:
+            with pytest.raises(TypeError):
+                sim.run(wall_time_limit=bad_type)
+        for bad_value in [0, -1, np.nan]:
+            with pytest.raises(ValueError):
+                sim.run(wall_time_limit=bad_value)
+        assert sim.time == 0
+        # The clock is checked after a fixed number of events, so a tiny
+        # limit means we return after each check.
+        num_exits = 0
+        while sim.run(wall_time_limit=1e-300) == _msprime.EXIT_WALL_TIME:
+            num_exits += 1
+        assert num_exits > 0
+        assert sim.num_ancestors == 0
+        sim.reset()
+        assert sim.run(wall_time_limit=1e6) == _msprime.EXIT_COALESCENCE
+
+    def test_memory_limit(self):
+        sim = make_sim(10)
+        assert sim.memory_limit == 0
+        for bad_type in ["sdf", [], 0.5]:
+            with pytest.raises(TypeError):
+                make_sim(10, memory_limit=bad_type)
+        with pytest.raises(ValueError):
+            make_sim(10, memory_limit=-1)
+        sim = make_sim(
+            100,
+            sequence_length=10,
+            recombination_map=uniform_rate_map(L=10, rate=1),
+            memory_limit=1,
+        )
+        assert sim.memory_limit == 1
+        assert sim.run(max_events=10) == _msprime.EXIT_MEMORY_LIMIT
+        assert sim.num_ancestors == 100
+        # The partial result is still valid
+        sim.finalise_tables()
+        tables = tskit.TableCollection.fromdict(sim.tables.asdict())
+        ts = tables.tree_sequence()
+        assert ts.first().num_roots == 100
+        sim = make_sim(
+            100,
+            sequence_length=10,
+            recombination_map=uniform_rate_map(L=10, rate=1),
+            memory_limit=2 ** 40,
+        )
+        assert sim.run() == _msprime.EXIT_COALESCENCE
+
+    def test_memory_usage(self):
+        sim = make_sim(
+            100,
+            sequence_length=10,
+            recombination_map=uniform_rate_map(L=10, rate=1),
+        )
+        usage = sim.memory_usage
+        assert set(usage.keys()) == {
+            "segments",
+            "avl_nodes",
+            "node_mappings",
+            "fenwick",
+            "rate_maps",
+            "edge_buffer",
+            "populations",
+            "tables",
+            "breakpoints",
+            "scratch",
+        }
+        for current, peak in usage.values():
+            assert 0 <= current <= peak
+        assert usage["segments"][0] > 0
+        assert usage["rate_maps"][0] > 0
+        sim.run()
+        after = sim.memory_usage
+        for current, peak in after.values():
+            assert 0 <= current <= peak
+        assert after["tables"][0] > usage["tables"][0]
+        sim.reset()
+        for name, (_, peak) in sim.memory_usage.items():
+            assert peak >= after[name][1]
+
+    def test_trim_memory(self):
+        sim = make_sim(
+            100,
+            sequence_length=10,
+            recombination_map=uniform_rate_map(L=10, rate=1),
+            segment_block_size=16,
+        )
+        for _ in range(2):
+            sim.run()
+            num_blocks = sim.num_segment_blocks
+            before = sim.memory_usage
+            sim.trim_memory()
+            after = sim.memory_usage
+            assert sim.num_segment_blocks < num_blocks
+            assert after["segments"][0] < before["segments"][0]
+            assert after["segments"][1] == before["segments"][1]
+            sim.reset()
+        assert sim.run() == _msprime.EXIT_COALESCENCE
+
     def test_set_bad_model(self):
         sim = make_sim(10)
         with pytest.raises(ValueError):
@@ -1154,6 +1256,180 @@ class TestSimulator(LowLevelTestCase):
             with pytest.raises(_msprime.InputError):
                 f(bad_ploidy)
 
+    def test_scheduler(self):
+        sim = make_sim(10)
+        assert sim.scheduler == _msprime.SCHEDULER_DIRECT
+        for scheduler in [_msprime.SCHEDULER_DIRECT, _msprime.SCHEDULER_NEXT_REACTION]:
+            sim = make_sim(10, scheduler=scheduler)
+            assert sim.scheduler == scheduler
+            sim.run()
+            assert sim.num_ancestors == 0
+        for bad_type in ["sdf", [], 0.0]:
+            with pytest.raises(TypeError):
+                make_sim(10, scheduler=bad_type)
+        for bad_scheduler in [-1, 2, 100]:
+            with pytest.raises(_msprime.InputError):
+                make_sim(10, scheduler=bad_scheduler)
+
+    def test_instrumentation(self):
+        sim = make_sim(10)
+        assert not sim.instrumentation
+        sim.run()
+        timings = sim.handler_timings
+        assert set(timings.keys()) == {
+            "recombination",
+            "gene_conversion",
+            "common_ancestor",
+            "migration",
+            "fixed_events",
+            "flush_edges",
+            "fenwick_rebuild",
+        }
+        assert all(value == (0, 0) for value in timings.values())
+
+        sim = make_sim(
+            10,
+            sequence_length=10,
+            recombination_map=uniform_rate_map(10, 0.1),
+            instrumentation=True,
+        )
+        assert sim.instrumentation
+        sim.run()
+        timings = sim.handler_timings
+        assert timings["common_ancestor"][0] == sim.num_common_ancestor_events
+        assert timings["recombination"][0] == sim.num_recombination_events
+        for calls, elapsed in timings.values():
+            assert calls >= 0
+            assert elapsed >= 0
+        sim.reset()
+        assert all(value == (0, 0) for value in sim.handler_timings.values())
+        for bad_type in ["sdf", [], 0.0]:
+            with pytest.raises(TypeError):
+                make_sim(10, instrumentation=bad_type)
+
+    def test_event_trace(self):
+        sim = make_sim(10)
+        assert sim.event_trace_size == 0
+        sim.run()
+        trace = sim.event_trace
+        assert set(trace.keys()) == {
+            "time",
+            "type",
+            "population",
+            "label",
+            "num_segments",
+            "num_edges",
+        }
+        assert all(len(column) == 0 for column in trace.values())
+
+        sim = make_sim(10, event_trace_size=5)
+        assert sim.event_trace_size == 5
+        sim.run()
+        trace = sim.event_trace
+        assert all(len(column) == 5 for column in trace.values())
+        assert np.all(trace["type"] == _msprime.TRACE_COMMON_ANCESTOR)
+        assert np.all(trace["population"] == 0)
+        assert np.all(np.diff(trace["time"]) > 0)
+        assert trace["time"][-1] == sim.time
+        assert np.all(trace["num_edges"] > 0)
+        sim.reset()
+        assert all(len(column) == 0 for column in sim.event_trace.values())
+        with pytest.raises(ValueError):
+            make_sim(10, event_trace_size=-1)
+        for bad_type in ["sdf", [], 0.0]:
+            with pytest.raises(TypeError):
+                make_sim(10, event_trace_size=bad_type)
+
+    def test_variate_buffer_size(self):
+        sim = make_sim(10)
+        assert sim.variate_buffer_size == 0
+        with pytest.raises(ValueError):
+            make_sim(10, variate_buffer_size=-1)
+        for bad_type in ["sdf", [], 0.0]:
+            with pytest.raises(TypeError):
+                make_sim(10, variate_buffer_size=bad_type)
+        tables = []
+        for size in [1, 100, 100]:
+            sim = make_sim(
+                10,
+                sequence_length=10,
+                recombination_map=uniform_rate_map(L=10, rate=1),
+                variate_buffer_size=size,
+            )
+            assert sim.variate_buffer_size == size
+            assert sim.run() == _msprime.EXIT_COALESCENCE
+            sim.finalise_tables()
+            tables.append(tskit.TableCollection.fromdict(sim.tables.asdict()))
+        # The same seed and buffer size give the same result
+        assert tables[1] == tables[2]
+
+    def test_exact_mass_index(self):
+        sim = make_sim(10)
+        assert not sim.exact_mass_index
+        for bad_type in ["sdf", [], None]:
+            with pytest.raises(TypeError):
+                make_sim(10, exact_mass_index=bad_type)
+        tables = []
+        for _ in range(2):
+            sim = make_sim(
+                10,
+                sequence_length=10,
+                recombination_map=uniform_rate_map(L=10, rate=1),
+                gene_conversion_rate=0.5,
+                exact_mass_index=True,
+            )
+            assert sim.exact_mass_index
+            assert sim.run() == _msprime.EXIT_COALESCENCE
+            assert sim.num_fenwick_rebuilds == 0
+            sim.finalise_tables()
+            tables.append(tskit.TableCollection.fromdict(sim.tables.asdict()))
+        assert tables[0] == tables[1]
+
+    def test_huge_pages(self):
+        sim = make_sim(10)
+        assert not sim.huge_pages
+        for bad_type in ["sdf", [], None]:
+            with pytest.raises(TypeError):
+                make_sim(10, huge_pages=bad_type)
+        tables = []
+        for huge_pages in [False, True]:
+            sim = make_sim(
+                10,
+                sequence_length=10,
+                recombination_map=uniform_rate_map(L=10, rate=1),
+                gene_conversion_rate=0.5,
+                huge_pages=huge_pages,
+            )
+            assert sim.huge_pages == huge_pages
+            assert sim.run() == _msprime.EXIT_COALESCENCE
+            sim.finalise_tables()
+            tables.append(tskit.TableCollection.fromdict(sim.tables.asdict()))
+        # Huge pages do not change the output
+        assert tables[0] == tables[1]
+
+    def test_segment_compaction_threshold(self):
+        sim = make_sim(10)
+        assert sim.segment_compaction_threshold == 0.25
+        for bad_type in ["sdf", [], None]:
+            with pytest.raises(TypeError):
+                make_sim(10, segment_compaction_threshold=bad_type)
+        for bad_value in [-1, 0.51, 1, np.inf, np.nan]:
+            with pytest.raises(_msprime.InputError):
+                make_sim(10, segment_compaction_threshold=bad_value)
+        for threshold in [0, 0.1, 0.5]:
+            sim = make_sim(
+                100,
+                sequence_length=100,
+                recombination_map=uniform_rate_map(L=100, rate=1),
+                gene_conversion_rate=0.5,
+                segment_compaction_threshold=threshold,
+            )
+            assert sim.segment_compaction_threshold == threshold
+            assert sim.run() == _msprime.EXIT_COALESCENCE
+            sim.finalise_tables()
+            tables = tskit.TableCollection.fromdict(sim.tables.asdict())
+            assert tables.tree_sequence().first().num_roots == 1
+
     @pytest.mark.skipif(IS_WINDOWS, reason="windows IO is weird")
     def test_print_state_errors(self):
         sim = make_sim(10)
@@ -2467,10 +2743,87 @@ class TestRandomGenerator:
         with pytest.raises(AttributeError):
             del rng.seed
 
+    def test_backend(self):
+        backends = [
+            _msprime.RNG_MT19937,
+            _msprime.RNG_XOSHIRO256PP,
+            _msprime.RNG_PCG64,
+            _msprime.RNG_PHILOX,
+        ]
+        assert _msprime.RandomGenerator().backend == _msprime.RNG_MT19937
+        for backend in backends:
+            rng = _msprime.RandomGenerator(1, backend=backend)
+            assert rng.backend == backend
+            values = rng.flat(0, 1, 100)
+            assert np.all(values >= 0) and np.all(values < 1)
+            rng.seed = 1
+            assert np.array_equal(values, rng.flat(0, 1, 100))
+            assert 0 <= rng.uniform_int(10) < 10
+        # Different backends give different streams for the same seed
+        values = [
+            _msprime.RandomGenerator(1, backend=backend).flat(0, 1, 10)
+            for backend in backends
+        ]
+        assert not np.array_equal(values[0], values[1])
+        assert not np.array_equal(values[1], values[2])
+        for bad_backend in [-1, 4, 100]:
+            with pytest.raises(ValueError):
+                _msprime.RandomGenerator(1, backend=bad_backend)
+        for bad_type in ["x", 1.0, None]:
+            with pytest.raises(TypeError):
+                _msprime.RandomGenerator(1, backend=bad_type)
+
+    def test_set_stream(self):
+        rng = _msprime.RandomGenerator(1, backend=_msprime.RNG_PHILOX)
+        x = rng.flat(0, 1, 20)
+        rng.set_stream(0, _msprime.RNG_SUBSYSTEM_ANCESTRY, 0)
+        assert np.array_equal(x, rng.flat(0, 1, 20))
+        rng.set_stream(1, _msprime.RNG_SUBSYSTEM_ANCESTRY)
+        y = rng.flat(0, 1, 20)
+        assert not np.array_equal(x, y)
+        # Reseeding keeps the current stream
+        rng.seed = 1
+        assert np.array_equal(y, rng.flat(0, 1, 20))
+        rng.set_stream(replicate_index=1, subsystem=_msprime.RNG_SUBSYSTEM_MUTATIONS)
+        assert not np.array_equal(y, rng.flat(0, 1, 20))
+        for bad_value in [-1, 2 ** 32]:
+            with pytest.raises(ValueError):
+                rng.set_stream(bad_value, 0)
+            with pytest.raises(ValueError):
+                rng.set_stream(0, bad_value)
+            with pytest.raises(ValueError):
+                rng.set_stream(0, 0, bad_value)
+        with pytest.raises(TypeError):
+            rng.set_stream(0)
+        for backend in [_msprime.RNG_MT19937, _msprime.RNG_PCG64]:
+            rng = _msprime.RandomGenerator(1, backend=backend)
+            with pytest.raises(_msprime.LibraryError):
+                rng.set_stream(0, 0)
+            with pytest.raises(_msprime.LibraryError):
+                rng.skip(1)
+
+    def test_skip(self):
+        rng = _msprime.RandomGenerator(5, backend=_msprime.RNG_PHILOX)
+        x = rng.flat(0, 1, 100)
+        for j in [0, 1, 2, 51, 99]:
+            rng.seed = 5
+            rng.skip(j)
+            assert rng.flat(0, 1) == x[j]
+        with pytest.raises(ValueError):
+            rng.skip(-1)
+        with pytest.raises(TypeError):
+            rng.skip("1")
+
     def test_uninitialised(self):
         uninitialised_rng = _msprime.RandomGenerator.__new__(_msprime.RandomGenerator)
         with pytest.raises(SystemError):
             uninitialised_rng.seed
+        with pytest.raises(SystemError):
+            uninitialised_rng.backend
+        with pytest.raises(SystemError):
+            uninitialised_rng.set_stream(0, 0)
+        with pytest.raises(SystemError):
+            uninitialised_rng.skip(0)
         with pytest.raises(SystemError):
             uninitialised_rng.flat()
         with pytest.raises(SystemError):
@@ -2997,6 +3350,40 @@ class TestSimMutations:
             with pytest.raises(_msprime.LibraryError):
                 mutgen(start_time=start_time, end_time=end_time)
 
+    def test_variate_buffer_size(self):
+        sim = make_sim(10, sequence_length=10)
+        sim.run()
+        sim.finalise_tables()
+        rate_map = uniform_rate_map(10, 1)
+        model = get_mutation_model()
+        mutgen = functools.partial(
+            _msprime.sim_mutations,
+            sim.tables,
+            _msprime.RandomGenerator(1),
+            rate_map,
+            model,
+        )
+        for bad_type in ["x", {}, 0.1]:
+            with pytest.raises(TypeError):
+                mutgen(variate_buffer_size=bad_type)
+        with pytest.raises(ValueError):
+            mutgen(variate_buffer_size=-1)
+        results = []
+        for size in [0, 1, 100, 100]:
+            ll_tables = _msprime.LightweightTableCollection()
+            ll_tables.fromdict(sim.tables.asdict())
+            _msprime.sim_mutations(
+                ll_tables,
+                _msprime.RandomGenerator(5),
+                rate_map,
+                model,
+                variate_buffer_size=size,
+            )
+            tables = tskit.TableCollection.fromdict(ll_tables.asdict())
+            assert tables.mutations.num_rows > 0
+            results.append(tables)
+        assert results[2] == results[3]
+
     def verify_block_size(self, tables):
         rng = _msprime.RandomGenerator(1)
         ll_tables = _msprime.LightweightTableCollection()
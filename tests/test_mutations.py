@@ -589,6 +589,28 @@ class TestSimMutations(MutateMixin):
             with pytest.raises(ValueError):
                 msprime.sim_mutations(ts, bad_rate)
 
+    @pytest.mark.parametrize(
+        "rng_backend", ["mt19937", "xoshiro256++", "pcg64", "philox"]
+    )
+    def test_rng_backend(self, rng_backend):
+        ts = msprime.sim_ancestry(8, sequence_length=100, random_seed=2)
+        mts1 = msprime.sim_mutations(
+            ts, rate=0.1, random_seed=3, rng_backend=rng_backend
+        )
+        mts2 = msprime.sim_mutations(
+            ts, rate=0.1, random_seed=3, rng_backend=rng_backend
+        )
+        assert mts1.num_mutations > 0
+        assert mts1.tables.sites == mts2.tables.sites
+        assert mts1.tables.mutations == mts2.tables.mutations
+
+    def test_bad_rng_backend(self):
+        ts = msprime.sim_ancestry(2, random_seed=2)
+        with pytest.raises(TypeError):
+            msprime.sim_mutations(ts, rate=0, rng_backend=1)
+        with pytest.raises(ValueError):
+            msprime.sim_mutations(ts, rate=0, rng_backend="xyz")
+
     def test_bad_models(self):
         ts = msprime.sim_ancestry(2, random_seed=2)
         for bad_type in [{}, True, 123]: